@@ -8,6 +8,7 @@ set(INC_PATHFFT $ENV{FFTW_INCLUDE})
 unset(FFTW_PATH CACHE)
 unset(FFTW_INCLUDES CACHE)
 unset(FFTW_LIBRARIES CACHE)
+unset(FFTW_THREADS CACHE)
 	   
 
 if(DEFINED ENV{FFTW_INCLUDE})
@@ -20,6 +21,8 @@ endif()
 
 find_library(_FFTW_SINGLE  NAMES fftw3f  PATHS ${LIB_PATHFFT} $ENV{FFTW_LIB} $ENV{FFTW_HOME} )
 find_library(_FFTW_DOUBLE  NAMES fftw3   PATHS ${LIB_PATHFFT} $ENV{FFTW_LIB} $ENV{FFTW_HOME} )
+find_library(_FFTW_SINGLE_THREADS  NAMES fftw3f_threads  PATHS ${LIB_PATHFFT} $ENV{FFTW_LIB} $ENV{FFTW_HOME} )
+find_library(_FFTW_DOUBLE_THREADS  NAMES fftw3_threads   PATHS ${LIB_PATHFFT} $ENV{FFTW_LIB} $ENV{FFTW_HOME} )
 
 if (FFTW_PATH AND FFTW_INCLUDES AND 
    (_FFTW_SINGLE OR NOT FFTW_FIND_REQUIRED_SINGLE) AND 
@@ -32,6 +35,21 @@ if (FFTW_PATH AND FFTW_INCLUDES AND
 	if (_FFTW_DOUBLE)
 		set(FFTW_LIBRARIES ${FFTW_LIBRARIES} ${_FFTW_DOUBLE})
 	endif()
+
+	# Multithreaded plans, if there are threads libraries for every precision found
+	# (they go before the FFTW libraries themselves, for static linking)
+	if ((_FFTW_SINGLE_THREADS OR NOT _FFTW_SINGLE) AND (_FFTW_DOUBLE_THREADS OR NOT _FFTW_DOUBLE))
+		set(FFTW_THREADS TRUE)
+		if (_FFTW_DOUBLE_THREADS)
+			set(FFTW_LIBRARIES ${_FFTW_DOUBLE_THREADS} ${FFTW_LIBRARIES})
+		endif()
+		if (_FFTW_SINGLE_THREADS)
+			set(FFTW_LIBRARIES ${_FFTW_SINGLE_THREADS} ${FFTW_LIBRARIES})
+		endif()
+	else()
+		set(FFTW_THREADS FALSE)
+		message(STATUS "No FFTW threads libraries were found: FFTs will be single-threaded")
+	endif()
 	
 	message(STATUS "Found FFTW")
 	message(STATUS "FFTW_PATH: ${FFTW_PATH}")
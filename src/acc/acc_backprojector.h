@@ -13,6 +13,7 @@
 
 #ifndef CUDA
 #include <tbb/spin_mutex.h>
+#include "src/acc/cpu/cpu_backprojection_buffers.h"
 #endif
 
 class AccBackprojector {
@@ -26,6 +27,7 @@ public:
 
 	#ifndef CUDA
 	tbb::spin_mutex *mutexes;
+	BackprojectionBuffers *buffers;  // Per-thread buffers, or NULL to lock rows of the model
 	#endif
 
 	size_t allocaton_size;
@@ -46,7 +48,7 @@ public:
 				d_mdlReal(NULL), d_mdlImag(NULL), d_mdlWeight(NULL),
 				stream(0)
 				#ifndef CUDA
-				, mutexes(0)
+				, mutexes(0), buffers(0)
 				#endif
 	{}
 
@@ -57,6 +59,13 @@ public:
 
 	void initMdl();
 
+	#ifndef CUDA
+	// Let every thread backproject into buffers of up to bytes_per_thread (0: none),
+	// which mergeBuffers() adds into the model
+	void setThreadBuffers(size_t bytes_per_thread);
+	void mergeBuffers();
+	#endif
+
 	void backproject(
 			XFLOAT *d_imgs_nomask_real,
 			XFLOAT *d_imgs_nomask_imag,
@@ -85,6 +85,22 @@ void AccBackprojector::initMdl()
 }
 
 
+#ifndef CUDA
+void AccBackprojector::setThreadBuffers(size_t bytes_per_thread)
+{
+	delete buffers;
+	buffers = NULL;
+	if (bytes_per_thread > 0)
+		buffers = new BackprojectionBuffers(d_mdlReal, d_mdlImag, d_mdlWeight, mdlX, mdlY, mdlZ, bytes_per_thread);
+}
+
+void AccBackprojector::mergeBuffers()
+{
+	if (buffers != NULL)
+		buffers->merge();
+}
+#endif
+
 void AccBackprojector::getMdlData(XFLOAT *r, XFLOAT *i, XFLOAT * w)
 {
 #ifdef CUDA
@@ -96,6 +112,7 @@ void AccBackprojector::getMdlData(XFLOAT *r, XFLOAT *i, XFLOAT * w)
 
 	DEBUG_HANDLE_ERROR(cudaStreamSynchronize(stream)); //Wait for copy
 #else
+	mergeBuffers();
 	memcpy(r, d_mdlReal,   mdlXYZ * sizeof(XFLOAT));
 	memcpy(i, d_mdlImag,   mdlXYZ * sizeof(XFLOAT));
 	memcpy(w, d_mdlWeight, mdlXYZ * sizeof(XFLOAT));
@@ -105,6 +122,7 @@ void AccBackprojector::getMdlData(XFLOAT *r, XFLOAT *i, XFLOAT * w)
 void AccBackprojector::getMdlDataPtrs(XFLOAT *& r, XFLOAT *& i, XFLOAT *& w)
 {
 #ifndef CUDA
+	mergeBuffers();
 	r = d_mdlReal;
 	i = d_mdlImag;
 	w = d_mdlWeight;
@@ -135,6 +153,8 @@ void AccBackprojector::clear()
 		free(d_mdlImag);
 		free(d_mdlWeight);
 		delete [] mutexes;
+		delete buffers;
+		buffers = NULL;
 #endif
 
 		d_mdlReal = d_mdlImag = d_mdlWeight = NULL;
@@ -382,7 +382,7 @@ void runBackProjectKernel(
                 BP.d_mdlReal, BP.d_mdlImag, BP.d_mdlWeight,
                 BP.maxR, BP.maxR2, (XFLOAT) BP.padding_factor,
                 (unsigned) imgX, (unsigned) imgY, (unsigned) imgX * imgY,
-                (unsigned) BP.mdlX, BP.mdlInitY, BP.mutexes
+                (unsigned) BP.mdlX, BP.mdlInitY, BP.mutexes, BP.buffers
             );
         } else {
             CpuKernels::backproject2D<false>(
@@ -394,7 +394,7 @@ void runBackProjectKernel(
                 BP.d_mdlReal, BP.d_mdlImag, BP.d_mdlWeight,
                 BP.maxR, BP.maxR2, (XFLOAT) BP.padding_factor,
                 (unsigned) imgX, (unsigned) imgY, (unsigned) imgX * imgY,
-                (unsigned) BP.mdlX, BP.mdlInitY, BP.mutexes
+                (unsigned) BP.mdlX, BP.mdlInitY, BP.mutexes, BP.buffers
             );
         }
         #endif
@@ -441,7 +441,7 @@ void runBackProjectKernel(
                         BP.d_mdlReal, BP.d_mdlImag, BP.d_mdlWeight,
                         BP.maxR, BP.maxR2, BP.padding_factor,
                         imgX, imgY, imgZ, (size_t) imgX * (size_t) imgY * (size_t) imgZ,
-                        BP.mdlX, BP.mdlY, BP.mdlInitY, BP.mdlInitZ, BP.mutexes
+                        BP.mdlX, BP.mdlY, BP.mdlInitY, BP.mdlInitZ, BP.mutexes, BP.buffers
                     );
                 } else {
                     CpuKernels::backprojectSGD<true, false>
@@ -454,7 +454,7 @@ void runBackProjectKernel(
                         BP.d_mdlReal, BP.d_mdlImag, BP.d_mdlWeight,
                         BP.maxR, BP.maxR2, BP.padding_factor,
                         imgX, imgY, imgZ, (size_t) imgX * (size_t) imgY * (size_t) imgZ,
-                        BP.mdlX, BP.mdlY, BP.mdlInitY, BP.mdlInitZ, BP.mutexes
+                        BP.mdlX, BP.mdlY, BP.mdlInitY, BP.mdlInitZ, BP.mutexes, BP.buffers
                     );
                 }
                 #endif
@@ -499,7 +499,7 @@ void runBackProjectKernel(
                         (unsigned) imgX, (unsigned) imgY, (unsigned) imgZ, 
                         (size_t) imgX * (size_t) imgY * (size_t) imgZ,
                         (unsigned) BP.mdlX, (unsigned) BP.mdlY, 
-                        BP.mdlInitY, BP.mdlInitZ, BP.mutexes
+                        BP.mdlInitY, BP.mdlInitZ, BP.mutexes, BP.buffers
                     );
                 } else {
                     CpuKernels::backprojectSGD<false, false>
@@ -514,7 +514,7 @@ void runBackProjectKernel(
                         (unsigned) imgX, (unsigned) imgY, (unsigned) imgZ, 
                         (size_t) imgX * (size_t) imgY * (size_t) imgZ,
                         (unsigned) BP.mdlX, (unsigned) BP.mdlY, 
-                        BP.mdlInitY, BP.mdlInitZ, BP.mutexes
+                        BP.mdlInitY, BP.mdlInitZ, BP.mutexes, BP.buffers
                     );
                 }
                 #endif
@@ -563,7 +563,7 @@ void runBackProjectKernel(
                         (unsigned) imgX, (unsigned) imgY, (unsigned) imgZ, 
                         (size_t) imgX * (size_t) imgY * (size_t) imgZ,
                         (unsigned) BP.mdlX, (unsigned) BP.mdlY, 
-                        BP.mdlInitY, BP.mdlInitZ, BP.mutexes
+                        BP.mdlInitY, BP.mdlInitZ, BP.mutexes, BP.buffers
                     );
                 } else {
                     CpuKernels::backproject3D<true, false>
@@ -578,7 +578,7 @@ void runBackProjectKernel(
                         (unsigned) imgX, (unsigned) imgY, (unsigned) imgZ, 
                         (size_t) imgX * (size_t) imgY * (size_t) imgZ,
                         (unsigned) BP.mdlX, (unsigned) BP.mdlY, 
-                        BP.mdlInitY, BP.mdlInitZ, BP.mutexes
+                        BP.mdlInitY, BP.mdlInitZ, BP.mutexes, BP.buffers
                     );
                 }
                 #endif
@@ -626,7 +626,7 @@ void runBackProjectKernel(
                         (unsigned) imgX, (unsigned) imgY, (unsigned) imgZ, 
                         (size_t) imgX * (size_t) imgY * (size_t) imgZ,
                         (unsigned) BP.mdlX, (unsigned) BP.mdlY, 
-                        BP.mdlInitY, BP.mdlInitZ, BP.mutexes
+                        BP.mdlInitY, BP.mdlInitZ, BP.mutexes, BP.buffers
                     );
                 } else {
                     CpuKernels::backprojectRef3D<false>
@@ -641,7 +641,7 @@ void runBackProjectKernel(
                         (unsigned) imgX, (unsigned) imgY, (unsigned) imgZ, 
                         (size_t) imgX * (size_t) imgY * (size_t) imgZ,
                         (unsigned) BP.mdlX, (unsigned) BP.mdlY, 
-                        BP.mdlInitY, BP.mdlInitZ, BP.mutexes
+                        BP.mdlInitY, BP.mdlInitZ, BP.mutexes, BP.buffers
                     );
                 }
                 #else
@@ -658,7 +658,7 @@ void runBackProjectKernel(
                         (unsigned) imgX, (unsigned) imgY, (unsigned) imgZ, 
                         (size_t) imgX * (size_t) imgY * (size_t) imgZ,
                         (unsigned) BP.mdlX, (unsigned) BP.mdlY, 
-                        BP.mdlInitY, BP.mdlInitZ, BP.mutexes
+                        BP.mdlInitY, BP.mdlInitZ, BP.mutexes, BP.buffers
                     );
                 } else {
                     CpuKernels::backproject3D<false, false>
@@ -673,7 +673,7 @@ void runBackProjectKernel(
                         (unsigned) imgX, (unsigned) imgY, (unsigned) imgZ, 
                         (size_t) imgX * (size_t) imgY * (size_t) imgZ,
                         (unsigned) BP.mdlX, (unsigned) BP.mdlY, 
-                        BP.mdlInitY, BP.mdlInitZ, BP.mutexes
+                        BP.mdlInitY, BP.mdlInitZ, BP.mutexes, BP.buffers
                     );
                 }
                 #endif
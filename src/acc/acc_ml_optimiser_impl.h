@@ -224,13 +224,8 @@ void getFourierTransformsAndCtfs(
             // If all followers had preread images into RAM: get those now
             if (baseMLO->do_preread_images) {
 
-                img.data.reshape(baseMLO->mydata.particles[part_id].images[img_id].img);
                 CTICTOC(accMLO->timer, "ParaReadPrereadImages", ({
-                    std::copy_n(
-                        baseMLO->mydata.particles[part_id].images[img_id].img.begin(),
-                        baseMLO->mydata.particles[part_id].images[img_id].img.size(),
-                        img.data.begin()
-                    );
+                    baseMLO->mydata.getPrereadImage(part_id, img_id, img.data);
                 }));
             } else {
                 if (accMLO->dataIs3D) {
@@ -953,7 +948,8 @@ void getAllSquaredDifferencesCoarse(
                     !IS_NOT_INV,
                     baseMLO->do_skip_align, baseMLO->do_skip_rotate,
                     baseMLO->mymodel.orientational_prior_mode,
-                    MBL, MBR
+                    MBL, MBR,
+                    &accMLO->bundle->projectionPlanCache
                 );
             }
         }
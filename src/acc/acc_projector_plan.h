@@ -2,11 +2,68 @@
 #define ACC_PROJECTOR_PLAN_H_
 
 #include <vector>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 #include "src/acc/acc_ptr.h"
 #include "src/healpix_sampling.h"
 #include <iostream>
 #include <fstream>
 
+/*
+ * Orientations and rotation matrices of projector plans, shared by the particles
+ * (and threads) of one iteration. Particles whose priors and significant
+ * orientations select the same set of orientations of the same class get a copy
+ * of the plan, rather than recomputing the oversampled orientations and matrices.
+ * Entries are keyed by a hash of everything the plan depends on, and compared in
+ * full. Once the cache holds max_bytes, further plans are computed but not stored.
+ */
+class AccProjectorPlanCache
+{
+public:
+
+	struct Entry
+	{
+		std::vector<long int> signature;
+		std::vector<long unsigned> iorientclasses;
+		std::vector<XFLOAT> eulers;
+	};
+
+	AccProjectorPlanCache(size_t max_bytes = (size_t) 256 * 1024 * 1024):
+		max_bytes(max_bytes), bytes(0),
+		hits(0), misses(0), hit_seconds(0.), miss_seconds(0.)
+	{}
+
+	// The entry with this signature, or NULL
+	std::shared_ptr<const Entry> find(size_t hash, const std::vector<long int> &signature);
+
+	void insert(size_t hash, std::shared_ptr<const Entry> entry);
+
+	// Would an entry of this size be stored? (Ask before copying a plan back from the device.)
+	bool accepts(size_t entry_bytes);
+
+	static size_t entryBytes(size_t signature_size, size_t orientation_num)
+	{
+		return signature_size * sizeof(long int) + orientation_num * (sizeof(long unsigned) + 9 * sizeof(XFLOAT));
+	}
+
+	// Time taken by a plan set up from the cache (hit) or from scratch (miss)
+	void count(bool hit, double seconds);
+
+	// Hit rate, and the setup time the hits saved
+	void printStatistics(std::ostream &os);
+
+	void clear();
+
+private:
+
+	std::mutex mutex;
+	std::unordered_map<size_t, std::vector<std::shared_ptr<const Entry> > > entries;
+	size_t max_bytes, bytes;
+	long int hits, misses;
+	double hit_seconds, miss_seconds;
+};
+
 class AccProjectorPlan
 {
 public:
@@ -57,7 +114,8 @@ public:
 			bool do_skip_rotate,
 			int orientational_prior_mode,
 			Matrix<RFLOAT> &L_,
-			Matrix<RFLOAT> &R_);
+			Matrix<RFLOAT> &R_,
+			AccProjectorPlanCache *cache = NULL);
 
 	void setup(
 			HealpixSampling &sampling,
@@ -1,3 +1,6 @@
+#include <chrono>
+#include <iomanip>
+#include <cstring>
 #include "src/acc/acc_projector_plan.h"
 #include "src/acc/utilities.h"
 #include "src/time.h"
@@ -91,32 +94,12 @@ void AccProjectorPlan::setup(
     unsigned iclass,
     bool coarse, bool inverseMatrix, bool do_skip_align, bool do_skip_rotate,
     int orientational_prior_mode,
-    Matrix<RFLOAT> &L_, Matrix<RFLOAT> &R_
+    Matrix<RFLOAT> &L_, Matrix<RFLOAT> &R_,
+    AccProjectorPlanCache *cache
 ) {
     TICTOC(TIMING_TOP, ({
 
-    std::vector<RFLOAT> oversampled_rot, oversampled_tilt, oversampled_psi;
-
-    AccPtr<XFLOAT> alphas =  eulers.make<XFLOAT>(nr_dir * nr_psi * nr_oversampled_rot * 9);
-    AccPtr<XFLOAT> betas =   eulers.make<XFLOAT>(nr_dir * nr_psi * nr_oversampled_rot * 9);
-    AccPtr<XFLOAT> gammas =  eulers.make<XFLOAT>(nr_dir * nr_psi * nr_oversampled_rot * 9);
-    AccPtr<XFLOAT> perturb = eulers.make<XFLOAT>((size_t) 9);
-    AccPtr<XFLOAT> adjustL = eulers.make<XFLOAT>((size_t) 9);
-    AccPtr<XFLOAT> adjustR = eulers.make<XFLOAT>((size_t) 9);
-
-    alphas.hostAlloc();
-    betas .hostAlloc();
-    gammas.hostAlloc();
-
-    eulers.free();
-    eulers.setSize(nr_dir * nr_psi * nr_oversampled_rot * 9);
-    eulers.hostAlloc();
-
-    iorientclasses.free();
-    iorientclasses.setSize(nr_dir * nr_psi * nr_oversampled_rot);
-    iorientclasses.hostAlloc();
-
-    orientation_num = 0;
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
 
     auto L = Matrix<RFLOAT>::identity(3);
     auto R = Matrix<RFLOAT>::identity(3);
@@ -142,10 +125,13 @@ void AccProjectorPlan::setup(
         R = R.matmul(R_);
     }
 
+    // (idir, ipsi, iorientclass) of the orientations to project
+    std::vector<long int> selected;
+
     TICTOC(TIMING_SAMPLING, ({
 
     for (long int idir = idir_min, iorient = 0; idir <= idir_max; idir++) {
-        for (long int ipsi = ipsi_min, ipart = 0; ipsi <= ipsi_max; ipsi++, iorient++) {
+        for (long int ipsi = ipsi_min; ipsi <= ipsi_max; ipsi++, iorient++) {
             long int iorientclass = iclass * nr_dir * nr_psi + iorient;
 
             RFLOAT pdf_orientation;
@@ -183,84 +169,241 @@ void AccProjectorPlan::setup(
             }
             }));
 
-            TICTOC(TIMING_PROC, ({
             if (do_proceed) {
-                // Now get the oversampled (rot, tilt, psi) triplets
-                // This will be only the original (rot, tilt, psi) triplet in the first pass (sp.current_oversampling == 0)
-                TICTOC(TIMING_GEN, ({
-                getOrientations(
-                    sampling, idir, ipsi, current_oversampling, oversampled_rot, oversampled_tilt, oversampled_psi,
-                    pointer_dir_nonzeroprior, directions_prior, pointer_psi_nonzeroprior, psi_prior
-                );
-                }));
-
-                // Loop over all oversampled orientations (only a single one in the first pass)
-                for (long int iover_rot = 0; iover_rot < nr_oversampled_rot; iover_rot++, ipart++) {
-                    if (sampling.is_3D) {
-                        alphas.getHostPtr()[orientation_num] = oversampled_rot [iover_rot];
-                        betas .getHostPtr()[orientation_num] = oversampled_tilt[iover_rot];
-                        gammas.getHostPtr()[orientation_num] = oversampled_psi [iover_rot];
-                    } else {
-                        alphas.getHostPtr()[orientation_num] = oversampled_psi [iover_rot] + myperturb;
-                    }
+                selected.push_back(idir);
+                selected.push_back(ipsi);
+                selected.push_back(iorientclass);
+            }
+        }
+    }
+    }));
+
+    // The plan only depends on the selected orientations (through the priors, if any) and on these
+    std::vector<long int> signature;
+    size_t hash = 0;
+    std::shared_ptr<const AccProjectorPlanCache::Entry> cached;
+    if (cache) {
+        // Exact bit patterns of the real-valued parameters
+        const auto bits = [] (RFLOAT x) {
+            double d = x;
+            long int b = 0;
+            memcpy(&b, &d, std::min(sizeof(b), sizeof(d)));
+            return b;
+        };
+        signature.reserve(26 + selected.size());
+        signature.push_back(iclass);
+        signature.push_back(current_oversampling);
+        signature.push_back(nr_oversampled_rot);
+        signature.push_back(sampling.healpix_order);
+        signature.push_back(sampling.is_3D);
+        signature.push_back(inverseMatrix);
+        signature.push_back(doL);
+        signature.push_back(doR);
+        signature.push_back(bits(myperturb));
+        for (int i = 0; i < 9; i++) {
+            signature.push_back(doL ? bits(L.data()[i]) : 0);
+            signature.push_back(doR ? bits(R.data()[i]) : 0);
+        }
+        for (size_t i = 0; i < selected.size(); i += 3) {
+            const long int idir = selected[i], ipsi = selected[i + 1];
+            const bool use_pointers = pointer_dir_nonzeroprior.size() > idir && pointer_psi_nonzeroprior.size() > ipsi;
+            signature.push_back(use_pointers ? pointer_dir_nonzeroprior[idir] : idir);
+            signature.push_back(use_pointers ? pointer_psi_nonzeroprior[ipsi] : ipsi);
+            signature.push_back(selected[i + 2]);
+        }
+        for (long int x : signature)
+            hash ^= std::hash<long int>()(x) + 0x9e3779b97f4a7c15 + (hash << 6) + (hash >> 2);
+
+        cached = cache->find(hash, signature);
+    }
+
+    if (cached) {
+        orientation_num = cached->iorientclasses.size();
+
+        iorientclasses.free();
+        iorientclasses.setSize(orientation_num);
+        eulers.free();
+        eulers.setSize(orientation_num * 9);
+        if (orientation_num > 0) {
+            iorientclasses.hostAlloc();
+            std::copy(cached->iorientclasses.begin(), cached->iorientclasses.end(), iorientclasses.getHostPtr());
+            iorientclasses.putOnDevice();
+
+            eulers.hostAlloc();
+            std::copy(cached->eulers.begin(), cached->eulers.end(), eulers.getHostPtr());
+            eulers.putOnDevice();
+        }
+    } else {
+        std::vector<RFLOAT> oversampled_rot, oversampled_tilt, oversampled_psi;
+
+        AccPtr<XFLOAT> alphas =  eulers.make<XFLOAT>(nr_dir * nr_psi * nr_oversampled_rot * 9);
+        AccPtr<XFLOAT> betas =   eulers.make<XFLOAT>(nr_dir * nr_psi * nr_oversampled_rot * 9);
+        AccPtr<XFLOAT> gammas =  eulers.make<XFLOAT>(nr_dir * nr_psi * nr_oversampled_rot * 9);
+        AccPtr<XFLOAT> perturb = eulers.make<XFLOAT>((size_t) 9);
+        AccPtr<XFLOAT> adjustL = eulers.make<XFLOAT>((size_t) 9);
+        AccPtr<XFLOAT> adjustR = eulers.make<XFLOAT>((size_t) 9);
+
+        alphas.hostAlloc();
+        betas .hostAlloc();
+        gammas.hostAlloc();
+
+        eulers.free();
+        eulers.setSize(nr_dir * nr_psi * nr_oversampled_rot * 9);
+        eulers.hostAlloc();
+
+        iorientclasses.free();
+        iorientclasses.setSize(nr_dir * nr_psi * nr_oversampled_rot);
+        iorientclasses.hostAlloc();
+
+        orientation_num = 0;
+
+        for (size_t i = 0; i < selected.size(); i += 3) {
+            TICTOC(TIMING_PROC, ({
+            // Now get the oversampled (rot, tilt, psi) triplets
+            // This will be only the original (rot, tilt, psi) triplet in the first pass (sp.current_oversampling == 0)
+            TICTOC(TIMING_GEN, ({
+            getOrientations(
+                sampling, selected[i], selected[i + 1], current_oversampling, oversampled_rot, oversampled_tilt, oversampled_psi,
+                pointer_dir_nonzeroprior, directions_prior, pointer_psi_nonzeroprior, psi_prior
+            );
+            }));
 
-                    iorientclasses.getHostPtr()[orientation_num] = iorientclass;
-                    orientation_num++;
+            // Loop over all oversampled orientations (only a single one in the first pass)
+            for (long int iover_rot = 0; iover_rot < nr_oversampled_rot; iover_rot++) {
+                if (sampling.is_3D) {
+                    alphas.getHostPtr()[orientation_num] = oversampled_rot [iover_rot];
+                    betas .getHostPtr()[orientation_num] = oversampled_tilt[iover_rot];
+                    gammas.getHostPtr()[orientation_num] = oversampled_psi [iover_rot];
+                } else {
+                    alphas.getHostPtr()[orientation_num] = oversampled_psi [iover_rot] + myperturb;
                 }
+
+                iorientclasses.getHostPtr()[orientation_num] = selected[i + 2];
+                orientation_num++;
             }
             }));
         }
-    }
-    }));
 
-    iorientclasses.resizeHost(orientation_num);
-    iorientclasses.putOnDevice();
+        iorientclasses.resizeHost(orientation_num);
+        iorientclasses.putOnDevice();
 
-    eulers.resizeHost(orientation_num * 9);
-    eulers.deviceAlloc();
+        eulers.resizeHost(orientation_num * 9);
+        eulers.deviceAlloc();
 
-    alphas.resizeHost(orientation_num);
-    alphas.putOnDevice();
+        alphas.resizeHost(orientation_num);
+        alphas.putOnDevice();
 
-    if (sampling.is_3D) {
-        betas.resizeHost(orientation_num);
-        betas.putOnDevice();
-        gammas.resizeHost(orientation_num);
-        gammas.putOnDevice();
-    }
+        if (sampling.is_3D) {
+            betas.resizeHost(orientation_num);
+            betas.putOnDevice();
+            gammas.resizeHost(orientation_num);
+            gammas.putOnDevice();
+        }
 
-    if (doL) {
-        adjustL.hostAlloc();
-        std::copy_n(L.data(), 9, adjustL.getHostPtr());
-        adjustL.putOnDevice();
-    }
+        if (doL) {
+            adjustL.hostAlloc();
+            std::copy_n(L.data(), 9, adjustL.getHostPtr());
+            adjustL.putOnDevice();
+        }
+
+        if (doR) {
+            adjustR.hostAlloc();
+            std::copy_n(R.data(), 9, adjustR.getHostPtr());
+            adjustR.putOnDevice();
+        }
+
+        const int grid_size = ceil((float) orientation_num / (float) BLOCK_SIZE);
+
+        if (sampling.is_3D) {
+            AccUtilities::acc_make_eulers_3D<acc::type>(
+                grid_size, BLOCK_SIZE, eulers.getStream(),
+                alphas.getAccPtr(), betas.getAccPtr(), gammas.getAccPtr(), eulers.getAccPtr(),
+                orientation_num,
+                doL ? adjustL.getAccPtr() : nullptr,
+                doR ? adjustR.getAccPtr() : nullptr,
+                doL, doR, inverseMatrix
+            );
+        } else {
+            AccUtilities::acc_make_eulers_2D<acc::type>(
+                grid_size, BLOCK_SIZE, eulers.getStream(),
+                alphas.getAccPtr(), eulers.getAccPtr(),
+                orientation_num, inverseMatrix
+            );
+        }
 
-    if (doR) {
-        adjustR.hostAlloc();
-        std::copy_n(R.data(), 9, adjustR.getHostPtr());
-        adjustR.putOnDevice();
+        if (cache && cache->accepts(AccProjectorPlanCache::entryBytes(signature.size(), orientation_num))) {
+            std::shared_ptr<AccProjectorPlanCache::Entry> entry (new AccProjectorPlanCache::Entry());
+            entry->signature.swap(signature);
+            entry->iorientclasses.assign(iorientclasses.getHostPtr(), iorientclasses.getHostPtr() + orientation_num);
+            eulers.cpToHost();
+            eulers.streamSync();
+            entry->eulers.assign(eulers.getHostPtr(), eulers.getHostPtr() + orientation_num * 9);
+            cache->insert(hash, entry);
+        }
     }
 
-    const int grid_size = ceil((float) orientation_num / (float) BLOCK_SIZE);
-
-    if (sampling.is_3D) {
-        AccUtilities::acc_make_eulers_3D<acc::type>(
-            grid_size, BLOCK_SIZE, eulers.getStream(),
-            alphas.getAccPtr(), betas.getAccPtr(), gammas.getAccPtr(), eulers.getAccPtr(),
-            orientation_num,
-            doL ? adjustL.getAccPtr() : nullptr,
-            doR ? adjustR.getAccPtr() : nullptr,
-            doL, doR, inverseMatrix
-        );
+    if (cache)
+        cache->count((bool) cached, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+
+    }));
+}
+
+std::shared_ptr<const AccProjectorPlanCache::Entry> AccProjectorPlanCache::find(size_t hash, const std::vector<long int> &signature) {
+    std::lock_guard<std::mutex> lock(mutex);
+    const auto bucket = entries.find(hash);
+    if (bucket != entries.end())
+        for (const auto &entry : bucket->second)
+            if (entry->signature == signature)
+                return entry;
+    return std::shared_ptr<const Entry>();
+}
+
+void AccProjectorPlanCache::insert(size_t hash, std::shared_ptr<const Entry> entry) {
+    const size_t size = entryBytes(entry->signature.size(), entry->iorientclasses.size());
+    std::lock_guard<std::mutex> lock(mutex);
+    if (bytes + size > max_bytes) return;
+    // Another thread may have set up the same plan meanwhile
+    std::vector<std::shared_ptr<const Entry> > &bucket = entries[hash];
+    for (const auto &other : bucket)
+        if (other->signature == entry->signature)
+            return;
+    bucket.push_back(entry);
+    bytes += size;
+}
+
+bool AccProjectorPlanCache::accepts(size_t entry_bytes) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return bytes + entry_bytes <= max_bytes;
+}
+
+void AccProjectorPlanCache::count(bool hit, double seconds) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (hit) {
+        hits++;
+        hit_seconds += seconds;
     } else {
-        AccUtilities::acc_make_eulers_2D<acc::type>(
-            grid_size, BLOCK_SIZE, eulers.getStream(),
-            alphas.getAccPtr(), eulers.getAccPtr(),
-            orientation_num, inverseMatrix
-        );
+        misses++;
+        miss_seconds += seconds;
     }
+}
 
-    }));
+void AccProjectorPlanCache::printStatistics(std::ostream &os) {
+    std::lock_guard<std::mutex> lock(mutex);
+    const long int total = hits + misses;
+    if (total == 0) return;
+    // A hit saves the time a miss takes, less the copy
+    const double saved = misses > 0 ? hits * (miss_seconds / misses) - hit_seconds : 0.;
+    os << " Projector plans: " << hits << " of " << total << " (" << std::fixed << std::setprecision(1)
+       << 100. * hits / total << "%) from the cache, saving " << std::setprecision(2) << saved << " s of "
+       << miss_seconds + saved + hit_seconds << " s of setup" << std::defaultfloat << std::endl;
+}
+
+void AccProjectorPlanCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.clear();
+    bytes = 0;
+    hits = misses = 0;
+    hit_seconds = miss_seconds = 0.;
 }
 
 void AccProjectorPlan::printTo(std::ostream &os) {
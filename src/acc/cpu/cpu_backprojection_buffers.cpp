@@ -0,0 +1,140 @@
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <tbb/parallel_for_each.h>
+
+#include "src/macros.h"
+#include "src/acc/acc_ptr.h"
+#include "src/acc/cpu/cpu_backprojection_buffers.h"
+
+BackprojectionBuffers::Buffer::Buffer(BackprojectionBuffers *owner):
+	owner(owner),
+	tiles((size_t)owner->tiles_x * owner->tiles_y * owner->tiles_z, (XFLOAT*) NULL)
+{}
+
+// Copies start empty
+BackprojectionBuffers::Buffer::Buffer(const Buffer &other):
+	owner(other.owner),
+	tiles(other.tiles.size(), (XFLOAT*) NULL)
+{}
+
+BackprojectionBuffers::Buffer::~Buffer()
+{
+	for (size_t i = 0; i < used.size(); i++)
+		free(tiles[used[i]]);
+	for (size_t i = 0; i < spare.size(); i++)
+		free(spare[i]);
+}
+
+XFLOAT* BackprojectionBuffers::Buffer::newTile(size_t t)
+{
+	if (used.size() >= owner->max_tiles_per_thread)
+		flush();
+
+	XFLOAT *tile;
+	if (!spare.empty())
+	{
+		tile = spare.back();
+		spare.pop_back();
+	}
+	else
+	{
+		const size_t bytes = 3 * owner->tile_voxels * sizeof(XFLOAT);
+		if (posix_memalign((void **)&tile, MEM_ALIGN, bytes)) CRITICAL(RAMERR);
+		memset(tile, 0, bytes);
+	}
+
+	tiles[t] = tile;
+	used.push_back(t);
+	return tile;
+}
+
+void BackprojectionBuffers::Buffer::flush()
+{
+	// In the order of the model, to make it likelier that other threads are flushing elsewhere
+	std::sort(used.begin(), used.end());
+	for (size_t i = 0; i < used.size(); i++)
+	{
+		XFLOAT *tile = tiles[used[i]];
+		owner->addTile(used[i], tile);
+		memset(tile, 0, 3 * owner->tile_voxels * sizeof(XFLOAT));
+		spare.push_back(tile);
+		tiles[used[i]] = NULL;
+	}
+	used.clear();
+}
+
+void BackprojectionBuffers::Buffer::release()
+{
+	flush();
+	for (size_t i = 0; i < spare.size(); i++)
+		free(spare[i]);
+	spare.clear();
+}
+
+BackprojectionBuffers::BackprojectionBuffers(
+		XFLOAT *mdl_real, XFLOAT *mdl_imag, XFLOAT *mdl_weight,
+		int mdl_x, int mdl_y, int mdl_z,
+		size_t bytes_per_thread):
+	mdl_real(mdl_real), mdl_imag(mdl_imag), mdl_weight(mdl_weight),
+	mdl_x(mdl_x), mdl_y(mdl_y), mdl_z(std::max(mdl_z, 1)),
+	buffers([this]() { return Buffer(this); })
+{
+	const int dim = 1 << BP_TILE_DIM_LOG2;
+	tiles_x = (mdl_x + dim - 1) / dim;
+	tiles_y = (mdl_y + dim - 1) / dim;
+	// 2D models have tiles of a single slice
+	if (this->mdl_z == 1)
+	{
+		tiles_z = 1;
+		tile_z_mask = 0;
+		tile_voxels = dim * dim;
+	}
+	else
+	{
+		tiles_z = (this->mdl_z + dim - 1) / dim;
+		tile_z_mask = dim - 1;
+		tile_voxels = dim * dim * dim;
+	}
+	max_tiles_per_thread = std::max(bytes_per_thread / (3 * tile_voxels * sizeof(XFLOAT)), (size_t) 1);
+
+	mutexes = new tbb::spin_mutex[(size_t)tiles_x * tiles_y * tiles_z];
+}
+
+BackprojectionBuffers::~BackprojectionBuffers()
+{
+	buffers.clear();
+	delete [] mutexes;
+}
+
+void BackprojectionBuffers::addTile(size_t t, const XFLOAT *tile)
+{
+	const int shift = BP_TILE_DIM_LOG2, dim = 1 << shift;
+	const int tile_dim_z = tile_z_mask + 1;
+	const int x0 = (t % tiles_x) * dim;
+	const int y0 = (t / tiles_x % tiles_y) * dim;
+	const int z0 = (t / tiles_x / tiles_y) * tile_dim_z;
+	const int nx = std::min(dim, mdl_x - x0), ny = std::min(dim, mdl_y - y0), nz = std::min(tile_dim_z, mdl_z - z0);
+
+	const XFLOAT *tile_imag = tile + tile_voxels, *tile_weight = tile + 2 * tile_voxels;
+
+	tbb::spin_mutex::scoped_lock lock(mutexes[t]);
+	for (int z = 0; z < nz; z++)
+	for (int y = 0; y < ny; y++)
+	{
+		const size_t idx = ((size_t)(z0 + z) * mdl_y + y0 + y) * mdl_x + x0;
+		const int v = (z << shift | y) << shift;
+		#pragma omp simd
+		for (int x = 0; x < nx; x++)
+		{
+			mdl_real  [idx + x] += tile       [v + x];
+			mdl_imag  [idx + x] += tile_imag  [v + x];
+			mdl_weight[idx + x] += tile_weight[v + x];
+		}
+	}
+}
+
+void BackprojectionBuffers::merge()
+{
+	tbb::parallel_for_each(buffers.begin(), buffers.end(), [](Buffer &buffer) { buffer.release(); });
+}
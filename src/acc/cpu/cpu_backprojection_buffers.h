@@ -0,0 +1,121 @@
+#ifndef CPU_BACKPROJECTION_BUFFERS_H_
+#define CPU_BACKPROJECTION_BUFFERS_H_
+
+#include <cstddef>
+#include <vector>
+#include <tbb/enumerable_thread_specific.h>
+#include <tbb/spin_mutex.h>
+
+#include "src/acc/settings.h"
+#include "src/acc/cpu/cpu_settings.h"
+
+/*
+ * Per-thread accumulation buffers for the CPU backprojection kernels.
+ *
+ * Rather than locking rows of the shared model for every voxel, each thread adds
+ * its voxels into private tiles of 2^BP_TILE_DIM_LOG2 voxels along each axis, which
+ * are allocated when first touched. merge() adds all tiles into the model, at the end
+ * of a batch of particles. A thread whose tiles would take more than bytes_per_thread
+ * adds them into the model early, locking one tile of the model at a time.
+ */
+class BackprojectionBuffers
+{
+public:
+
+	class Buffer
+	{
+		friend class BackprojectionBuffers;
+
+		BackprojectionBuffers *owner;
+		std::vector<XFLOAT*> tiles;  // Real, imaginary and weight parts of each tile, or NULL
+		std::vector<size_t> used;    // Indices of the non-NULL tiles
+		std::vector<XFLOAT*> spare;  // Zeroed tiles, for reuse
+
+		XFLOAT* newTile(size_t t);
+
+	public:
+
+		Buffer(BackprojectionBuffers *owner);
+		Buffer(const Buffer &other);
+		~Buffer();
+
+		// Add the buffered voxels into the model, and zero the buffer
+		void flush();
+
+		// Flush, and free all tiles
+		void release();
+
+		inline void add(int x, int y, int z, XFLOAT real, XFLOAT imag, XFLOAT weight)
+		{
+			const int shift = BP_TILE_DIM_LOG2, mask = (1 << shift) - 1;
+			const size_t t = ((size_t)(z >> shift) * owner->tiles_y + (y >> shift)) * owner->tiles_x + (x >> shift);
+			XFLOAT *tile = tiles[t];
+			if (tile == NULL)
+				tile = newTile(t);
+			const int v = (((z & owner->tile_z_mask) << shift | (y & mask)) << shift) | (x & mask);
+			tile[v]                          += real;
+			tile[v + owner->tile_voxels]     += imag;
+			tile[v + 2 * owner->tile_voxels] += weight;
+		}
+
+		// Split real, imag and weight over the 4 (2D) or 8 voxels from (x0, y0, z0) to
+		// (x0 + 1, y0 + 1, z0 + 1), with the interpolation weights dd[z][y][x]
+		inline void addTrilinear(int x0, int y0, int z0, const XFLOAT dd[8], XFLOAT real, XFLOAT imag, XFLOAT weight)
+		{
+			const int mask = (1 << BP_TILE_DIM_LOG2) - 1;
+			const int nz = owner->tile_z_mask == 0 ? 1 : 2;
+			if ((x0 & mask) != mask && (y0 & mask) != mask && (nz == 1 || (z0 & owner->tile_z_mask) != owner->tile_z_mask))
+			{
+				// All voxels in one tile
+				const int shift = BP_TILE_DIM_LOG2;
+				const size_t t = ((size_t)(z0 >> shift) * owner->tiles_y + (y0 >> shift)) * owner->tiles_x + (x0 >> shift);
+				XFLOAT *tile = tiles[t];
+				if (tile == NULL)
+					tile = newTile(t);
+				XFLOAT *tile_imag = tile + owner->tile_voxels, *tile_weight = tile + 2 * owner->tile_voxels;
+				const int v0 = (((z0 & owner->tile_z_mask) << shift | (y0 & mask)) << shift) | (x0 & mask);
+				for (int k = 0; k < 4 * nz; k++)
+				{
+					const int v = v0 + ((k >> 2) << (2 * shift)) + (((k >> 1) & 1) << shift) + (k & 1);
+					tile[v]        += dd[k] * real;
+					tile_imag[v]   += dd[k] * imag;
+					tile_weight[v] += dd[k] * weight;
+				}
+			}
+			else
+				for (int k = 0; k < 4 * nz; k++)
+					add(x0 + (k & 1), y0 + ((k >> 1) & 1), z0 + (k >> 2), dd[k] * real, dd[k] * imag, dd[k] * weight);
+		}
+	};
+
+	BackprojectionBuffers(
+			XFLOAT *mdl_real, XFLOAT *mdl_imag, XFLOAT *mdl_weight,
+			int mdl_x, int mdl_y, int mdl_z,
+			size_t bytes_per_thread);
+
+	~BackprojectionBuffers();
+
+	// Buffer of the calling thread
+	Buffer& local() { return buffers.local(); }
+
+	// Add all buffers into the model and free them (no thread may be adding to them)
+	void merge();
+
+private:
+
+	XFLOAT *mdl_real, *mdl_imag, *mdl_weight;
+	int mdl_x, mdl_y, mdl_z;
+	int tiles_x, tiles_y, tiles_z, tile_z_mask;
+	int tile_voxels;
+	size_t max_tiles_per_thread;
+
+	tbb::spin_mutex *mutexes;  // One per tile of the model
+	tbb::enumerable_thread_specific<Buffer> buffers;
+
+	void addTile(size_t t, const XFLOAT *tile);
+
+	BackprojectionBuffers(const BackprojectionBuffers&);
+	BackprojectionBuffers& operator=(const BackprojectionBuffers&);
+};
+
+#endif
@@ -4,6 +4,7 @@
 #include <cassert>
 
 #include "src/acc/acc_backprojector.h"
+#include "src/acc/cpu/cpu_backprojection_buffers.h"
 #include "src/acc/cpu/cpu_kernels/helper.h"
 
 namespace CpuKernels
@@ -38,8 +39,12 @@ void backproject2D(
 		unsigned img_xy,
 		unsigned mdl_x,
 		int mdl_inity,
-		tbb::spin_mutex *mutexes)
+		tbb::spin_mutex *mutexes,
+		BackprojectionBuffers *buffers)
 {
+	// Without locks if there are per-thread buffers
+	BackprojectionBuffers::Buffer *buffer = buffers ? &buffers->local() : NULL;
+
 	int img_y_half = img_y / 2;
 
 	int max_r2_out = max_r2 * padding_factor * padding_factor;
@@ -182,6 +187,12 @@ void backproject2D(
 				XFLOAT dd10 =  fy * mfx;
 				XFLOAT dd11 =  fy *  fx;
 
+				if (buffer) {
+					const XFLOAT dd[8] = {dd00, dd01, dd10, dd11};
+					buffer->addTrilinear(x0, y0, 0, dd, real[x], imag[x], Fweight[x]);
+					continue;
+				}
+
 				size_t idx_tmp;
 
 				// Locking necessary since all threads share the same back projector
@@ -254,8 +265,12 @@ void backproject3D(
 		unsigned mdl_y,
 		int mdl_inity,
 		int mdl_initz,
-		tbb::spin_mutex *mutexes)
+		tbb::spin_mutex *mutexes,
+		BackprojectionBuffers *buffers)
 {
+	// Without locks if there are per-thread buffers
+	BackprojectionBuffers::Buffer *buffer = buffers ? &buffers->local() : NULL;
+
 	int img_y_half = img_y / 2;
 	int img_z_half = img_z / 2;
 
@@ -428,6 +443,13 @@ void backproject3D(
 					XFLOAT mfy = (XFLOAT)1.0 - fy;
 					XFLOAT mfz = (XFLOAT)1.0 - fz;
 
+					if (buffer) {
+						const XFLOAT dd[8] = {mfz * mfy * mfx, mfz * mfy * fx, mfz * fy * mfx, mfz * fy * fx,
+						                       fz * mfy * mfx,  fz * mfy * fx,  fz * fy * mfx,  fz * fy * fx};
+						buffer->addTrilinear(x0, y0, z0, dd, real[tid], imag[tid], Fweight[tid]);
+						continue;
+					}
+
 					// Locking necessary since all threads share the same back projector
 					XFLOAT dd000 = mfz * mfy * mfx;
 					XFLOAT dd001 = mfz * mfy *  fx;
@@ -536,8 +558,12 @@ void backprojectRef3D(
 		unsigned mdl_y,
 		int      mdl_inity,
 		int      mdl_initz,
-		tbb::spin_mutex *mutexes)
+		tbb::spin_mutex *mutexes,
+		BackprojectionBuffers *buffers)
 {
+	// Without locks if there are per-thread buffers
+	BackprojectionBuffers::Buffer *buffer = buffers ? &buffers->local() : NULL;
+
 	int img_y_half = img_y / 2;
 	int img_y_half_2 = img_y_half * img_y_half;
 	int img_z_half = img_z / 2;
@@ -681,6 +707,13 @@ void backprojectRef3D(
 				XFLOAT mfy = (XFLOAT)1.0 - fy;
 				XFLOAT mfz = (XFLOAT)1.0 - fz;
 
+				if (buffer) {
+					const XFLOAT dd[8] = {mfz * mfy * mfx, mfz * mfy * fx, mfz * fy * mfx, mfz * fy * fx,
+					                       fz * mfy * mfx,  fz * mfy * fx,  fz * fy * mfx,  fz * fy * fx};
+					buffer->addTrilinear(x0, y0, z0, dd, real[x], imag[x], Fweight[x]);
+					continue;
+				}
+
 				XFLOAT mfz_mfy = mfz * mfy;
 				size_t z0_mdl_x_mdl_y = (size_t)z0 * mdl_x_mdl_y;
 				size_t y0_mdl_x = (size_t)y0 * (size_t)mdl_x;
@@ -796,8 +829,12 @@ void backprojectSGD(
 		unsigned mdl_y,
 		int mdl_inity,
 		int mdl_initz,
-		tbb::spin_mutex *mutexes)
+		tbb::spin_mutex *mutexes,
+		BackprojectionBuffers *buffers)
 {
+	// Without locks if there are per-thread buffers
+	BackprojectionBuffers::Buffer *buffer = buffers ? &buffers->local() : NULL;
+
 	int img_y_half = img_y / 2;
 	int img_z_half = img_z / 2;
 
@@ -989,6 +1026,13 @@ void backprojectSGD(
 					XFLOAT mfy = (XFLOAT)1.0 - fy;
 					XFLOAT mfz = (XFLOAT)1.0 - fz;
 
+					if (buffer) {
+						const XFLOAT dd[8] = {mfz * mfy * mfx, mfz * mfy * fx, mfz * fy * mfx, mfz * fy * fx,
+						                       fz * mfy * mfx,  fz * mfy * fx,  fz * fy * mfx,  fz * fy * fx};
+						buffer->addTrilinear(x0, y0, z0, dd, real[tid], imag[tid], Fweight[tid]);
+						continue;
+					}
+
 					XFLOAT dd000 = mfz * mfy * mfx;
 					XFLOAT dd001 = mfz * mfy *  fx;
 
@@ -10,6 +10,7 @@
 #include "src/acc/acc_projector.h"
 #include "src/acc/cpu/cpu_kernels/cpu_utils.h"
 #include "src/acc/cpu/cpu_kernels/helper.h"
+#include "src/acc/cpu/cpu_kernels/diff2_simd.h"
 
 namespace CpuKernels
 {
@@ -380,9 +381,7 @@ inline void diff2_coarse(
 								&sin_y[0][0], &cos_y[0][0]);	
 	}
 	
-	XFLOAT trans_cos_x[block_sz], trans_sin_x[block_sz];
-	XFLOAT trans_cos_y[block_sz], trans_sin_y[block_sz];
-	XFLOAT trans_cos_z[block_sz], trans_sin_z[block_sz];
+	XFLOAT trans_cc[block_sz], trans_ss[block_sz];
 #endif  // not Intel Compiler
 	
 	int x[pass_num][block_sz], y[pass_num][block_sz], z[pass_num][block_sz];
@@ -498,49 +497,69 @@ inline void diff2_coarse(
 			}
 
 			for(unsigned long i=0; i<translation_num; i++) {
-				XFLOAT tx = trans_x[i];
-				XFLOAT ty = trans_y[i];
-				XFLOAT tz = trans_z[i];                 
-
 #ifndef __INTEL_COMPILER
+				// Phase shift of every pixel for this translation, from the lookup tables
 				for (int tid=0; tid<elements; tid++) {
 
 					int xidx = x[pass][tid];
 					int yidx = y[pass][tid];
 					int zidx;
 
+					XFLOAT trans_cos_x, trans_sin_x;
+					XFLOAT trans_cos_y, trans_sin_y;
+					XFLOAT trans_cos_z, trans_sin_z;
+
 					if(DATA3D) {
 						zidx = z[pass][tid];
 						if ( zidx < 0) {
-							trans_cos_z[tid] =  cos_z[i][-zidx];
-							trans_sin_z[tid] = -sin_z[i][-zidx];            
+							trans_cos_z =  cos_z[i][-zidx];
+							trans_sin_z = -sin_z[i][-zidx];            
 						}
 						else {
-							trans_cos_z[tid] = cos_z[i][zidx];
-							trans_sin_z[tid] = sin_z[i][zidx];
+							trans_cos_z = cos_z[i][zidx];
+							trans_sin_z = sin_z[i][zidx];
 						}
 					}
 
 					if ( yidx < 0) {
-						trans_cos_y[tid] =  cos_y[i][-yidx];
-						trans_sin_y[tid] = -sin_y[i][-yidx];            
+						trans_cos_y =  cos_y[i][-yidx];
+						trans_sin_y = -sin_y[i][-yidx];            
 					}
 					else {
-						trans_cos_y[tid] = cos_y[i][yidx];
-						trans_sin_y[tid] = sin_y[i][yidx];
+						trans_cos_y = cos_y[i][yidx];
+						trans_sin_y = sin_y[i][yidx];
 					}
 
 					if ( xidx < 0) {
-						trans_cos_x[tid] =  cos_x[i][-xidx];
-						trans_sin_x[tid] = -sin_x[i][-xidx];            
+						trans_cos_x =  cos_x[i][-xidx];
+						trans_sin_x = -sin_x[i][-xidx];            
 					}
 					else {
-						trans_cos_x[tid] = cos_x[i][xidx];
-						trans_sin_x[tid] = sin_x[i][xidx];
-					}					
-				}  // tid  						
-#endif  // not Intel Compiler
-				
+						trans_cos_x = cos_x[i][xidx];
+						trans_sin_x = sin_x[i][xidx];
+					}
+
+					XFLOAT s = trans_sin_x * trans_cos_y + trans_cos_x * trans_sin_y;
+					XFLOAT c = trans_cos_x * trans_cos_y - trans_sin_x * trans_sin_y;
+					if(DATA3D) {
+						trans_ss[tid] = s * trans_cos_z + c * trans_sin_z;
+						trans_cc[tid] = c * trans_cos_z - s * trans_sin_z;
+					}
+					else {
+						trans_ss[tid] = s;
+						trans_cc[tid] = c;
+					}
+				}  // tid
+
+				diff2_block(elements, trans_cc, trans_ss,
+						s_real[pass], s_imag[pass], s_corr[pass],
+						&s_ref_real[0][0], &s_ref_imag[0][0], block_sz, eulers_per_block,
+						diff2s[i]);
+#else  // Intel Compiler - accept the (hopefully vectorized) sincos call every iteration rather than caching
+				XFLOAT tx = trans_x[i];
+				XFLOAT ty = trans_y[i];
+				XFLOAT tz = trans_z[i];                 
+
 				#pragma omp simd
 				for (int tid=0; tid<block_sz; tid++) {
 // This will generate masked SVML routines for Intel compiler
@@ -549,38 +568,14 @@ inline void diff2_coarse(
 						continue;                
 
 					XFLOAT real, imag;
-#ifndef __INTEL_COMPILER
-					if(DATA3D) {
-//						translatePixel(x[tid], y[tid], z[tid], tx, ty, tz, s_real[tid], s_imag[tid], real, imag);
-						XFLOAT s  = trans_sin_x[tid] * trans_cos_y[tid] + trans_cos_x[tid] * trans_sin_y[tid];
-						XFLOAT c  = trans_cos_x[tid] * trans_cos_y[tid] - trans_sin_x[tid] * trans_sin_y[tid];
-
-						XFLOAT ss = s * trans_cos_z[tid] + c * trans_sin_z[tid];
-						XFLOAT cc = c * trans_cos_z[tid] - s * trans_sin_z[tid];				
-
-						real = cc * s_real[pass][tid] - ss * s_imag[pass][tid];
-						imag = cc * s_imag[pass][tid] + ss * s_real[pass][tid];
-					}
-					else  { // 2D data
-//						translatePixel(x[tid], y[tid],         tx, ty,     s_real[tid], s_imag[tid], real, imag);
-						XFLOAT ss = trans_sin_x[tid] * trans_cos_y[tid] + trans_cos_x[tid] * trans_sin_y[tid];
-						XFLOAT cc = trans_cos_x[tid] * trans_cos_y[tid] - trans_sin_x[tid] * trans_sin_y[tid];
-			
-						real = cc * s_real[pass][tid] - ss * s_imag[pass][tid];
-						imag = cc * s_imag[pass][tid] + ss * s_real[pass][tid];
-					}
-#else  // Intel Compiler - accept the (hopefully vectorized) sincos call every iteration rather than caching
 					if(DATA3D)
 						translatePixel(x[pass][tid], y[pass][tid], z[pass][tid], tx, ty, tz,
 										s_real[pass][tid], s_imag[pass][tid], real, imag);
 					else
 						translatePixel(x[pass][tid], y[pass][tid], tx, ty,
 										s_real[pass][tid], s_imag[pass][tid], real, imag);
-#endif  // not Intel Compiler
 
-#ifdef __INTEL_COMPILER
 					#pragma unroll(eulers_per_block)
-#endif
 					for (int j = 0; j < eulers_per_block; j ++) {
 						XFLOAT diff_real =  s_ref_real[j][tid] - real;
 						XFLOAT diff_imag =  s_ref_imag[j][tid] - imag;
@@ -588,6 +583,7 @@ inline void diff2_coarse(
 						diff2s[i][j] += (diff_real * diff_real + diff_imag * diff_imag) * s_corr[pass][tid];
 					}
 				} // for tid
+#endif  // not Intel Compiler
 			}  // for each translation
 		}  // for each pass
 
@@ -717,24 +713,9 @@ inline void diff2_fine_2D(
 					trans_sin_y = sin_y[itrans][y];
 				}
 
-				XFLOAT *trans_cos_x = &cos_x[itrans][0];
-				XFLOAT *trans_sin_x = &sin_x[itrans][0];     
-
-				XFLOAT sum = (XFLOAT) 0.0;                   
-				#pragma omp simd  reduction(+:sum) 
-				for(int x = xstart; x < xend; x++) {
-					XFLOAT ss = trans_sin_x[x] * trans_cos_y + trans_cos_x[x] * trans_sin_y;
-					XFLOAT cc = trans_cos_x[x] * trans_cos_y - trans_sin_x[x] * trans_sin_y;
-
-					XFLOAT shifted_real = cc * imgs_real[x] - ss * imgs_imag[x];
-					XFLOAT shifted_imag = cc * imgs_imag[x] + ss * imgs_real[x];
-
-					XFLOAT diff_real =  ref_real[x] - shifted_real;
-					XFLOAT diff_imag =  ref_imag[x] - shifted_imag;
-
-					sum += (diff_real * diff_real + diff_imag * diff_imag);
-				}
-				s[itrans] += sum;
+				s[itrans] += diff2_row(xend - xstart,
+						&cos_x[itrans][xstart], &sin_x[itrans][xstart], trans_cos_y, trans_sin_y,
+						ref_real + xstart, ref_imag + xstart, imgs_real + xstart, imgs_imag + xstart);
 			}
 
 			pixel += (unsigned long)xSize;
@@ -892,27 +873,13 @@ inline void diff2_fine_3D(
 						trans_sin_y = sin_y[itrans][y];
 					}
 
-					XFLOAT *trans_cos_x = &cos_x[itrans][0];
-					XFLOAT *trans_sin_x = &sin_x[itrans][0];     
-
-					XFLOAT sum = (XFLOAT) 0.0;                   
-					#pragma omp simd  reduction(+:sum) 
-					for(int x = xstart_y; x < xend_y; x++) {
-						XFLOAT s1  = trans_sin_x[x] * trans_cos_y + trans_cos_x[x] * trans_sin_y;
-						XFLOAT c1  = trans_cos_x[x] * trans_cos_y - trans_sin_x[x] * trans_sin_y;
-
-						XFLOAT ss = s1 * trans_cos_z + c1 * trans_sin_z;
-						XFLOAT cc = c1 * trans_cos_z - s1 * trans_sin_z;				
+					// The z phase is constant along the row: fold it into the y phase
+					XFLOAT trans_cos_yz = trans_cos_y * trans_cos_z - trans_sin_y * trans_sin_z;
+					XFLOAT trans_sin_yz = trans_sin_y * trans_cos_z + trans_cos_y * trans_sin_z;
 
-						XFLOAT shifted_real = cc * imgs_real[x] - ss * imgs_imag[x];
-						XFLOAT shifted_imag = cc * imgs_imag[x] + ss * imgs_real[x];
-
-						XFLOAT diff_real =  ref_real[x] - shifted_real;
-						XFLOAT diff_imag =  ref_imag[x] - shifted_imag;
-
-						sum += (diff_real * diff_real + diff_imag * diff_imag);
-					}
-					s[itrans] += sum;
+					s[itrans] += diff2_row(xend_y - xstart_y,
+							&cos_x[itrans][xstart_y], &sin_x[itrans][xstart_y], trans_cos_yz, trans_sin_yz,
+							ref_real + xstart_y, ref_imag + xstart_y, imgs_real + xstart_y, imgs_imag + xstart_y);
 				}
 
 				pixel += (unsigned long)xSize;
@@ -970,8 +937,8 @@ inline void diff2_CC_coarse_2D(
 			&sin_y[0][0], &cos_y[0][0]);
 	
 	// Set up other arrays
-	XFLOAT s_weight[trans_num][xSize];	
-	XFLOAT s_norm[trans_num][xSize];
+	XFLOAT s_weight[trans_num];
+	XFLOAT s_norm;
 
 	XFLOAT ref_real[xSize], ref_imag[xSize];
 	XFLOAT img_real[xSize], img_imag[xSize], corr_imag[xSize];
@@ -986,8 +953,8 @@ inline void diff2_CC_coarse_2D(
 		e6 = g_eulers[iorient*9+6];
 		e7 = g_eulers[iorient*9+7];
 
-		memset(s_weight, 0, sizeof(XFLOAT) * xSize * trans_num);
-		memset(s_norm, 0, sizeof(XFLOAT) *   xSize * trans_num);
+		memset(s_weight, 0, sizeof(XFLOAT) * trans_num);
+		s_norm = (XFLOAT)0.0;
 
 		unsigned long pixel = 0;
 		for(int iy = 0; iy < ySize; iy++) {
@@ -1021,6 +988,13 @@ inline void diff2_CC_coarse_2D(
 				corr_imag[x] = g_corr_img[pixel + x];            
 			}
 
+			// The norm of the reference does not depend on the translation
+			XFLOAT norm = (XFLOAT)0.0;
+			#pragma omp simd reduction(+:norm)
+			for(int x = xstart; x < xend; x++)
+				norm += (ref_real[x] * ref_real[x] + ref_imag[x] * ref_imag[x]) * corr_imag[x];
+			s_norm += norm;
+
 			for(unsigned long itrans=0; itrans<trans_num; itrans++) {
 				XFLOAT trans_cos_y, trans_sin_y;
 				if ( y < 0) {
@@ -1032,40 +1006,21 @@ inline void diff2_CC_coarse_2D(
 					trans_sin_y = sin_y[itrans][y];
 				}
 
-				XFLOAT *trans_cos_x = &cos_x[itrans][0];
-				XFLOAT *trans_sin_x = &sin_x[itrans][0];     
-
-				for(int x = xstart; x < xend; x++) {
-
-					XFLOAT ss = trans_sin_x[x] * trans_cos_y + trans_cos_x[x] * trans_sin_y;
-					XFLOAT cc = trans_cos_x[x] * trans_cos_y - trans_sin_x[x] * trans_sin_y;
-
-					XFLOAT real = cc * img_real[x] - ss * img_imag[x];
-					XFLOAT imag = cc * img_imag[x] + ss * img_real[x];
-
-					s_weight[itrans][x] += (ref_real[x] * real        + ref_imag[x] * imag       ) * corr_imag[x];
-					s_norm  [itrans][x] += (ref_real[x] * ref_real[x] + ref_imag[x] * ref_imag[x]) * corr_imag[x];
-				}
+				s_weight[itrans] += cc_row(xend - xstart,
+						&cos_x[itrans][xstart], &sin_x[itrans][xstart], trans_cos_y, trans_sin_y,
+						ref_real + xstart, ref_imag + xstart, img_real + xstart, img_imag + xstart, corr_imag + xstart);
 			}
 
 			pixel += (unsigned long)xSize;
 		}
 
 		for(unsigned long itrans=0; itrans<trans_num; itrans++) {
-			XFLOAT sum_weight = (XFLOAT)0.0;
-			XFLOAT sum_norm   = (XFLOAT)0.0;		
-
-			for(int i=0; i<xSize; i++){
-				sum_weight += s_weight[itrans][i];
-				sum_norm   += s_norm  [itrans][i];
-			}
-
 	#ifdef RELION_SINGLE_PRECISION                  
 			g_diff2[(unsigned long)iorient*(unsigned long)trans_num + itrans] = 
-					- ( sum_weight / sqrtf(sum_norm));
+					- ( s_weight[itrans] / sqrtf(s_norm));
 	#else                   
 			g_diff2[(unsigned long)iorient*(unsigned long)trans_num + itrans] = 
-					- ( sum_weight / sqrt(sum_norm));
+					- ( s_weight[itrans] / sqrt(s_norm));
 	#endif
 		}
 	} // for iorient
@@ -1114,8 +1069,8 @@ inline void diff2_CC_coarse_3D(
 							  &sin_z[0][0], &cos_z[0][0]);
 		
 	// Set up some arrays
-	XFLOAT s_weight[trans_num][xSize];
-	XFLOAT s_norm[trans_num][xSize];
+	XFLOAT s_weight[trans_num];
+	XFLOAT s_norm;
 
 	XFLOAT ref_real[xSize], ref_imag[xSize];
 	XFLOAT img_real[xSize], img_imag[xSize], corr_imag[xSize];
@@ -1132,8 +1087,8 @@ inline void diff2_CC_coarse_3D(
 		e7 = g_eulers[iorient*9+7];
 		e8 = g_eulers[iorient*9+8];
 
-		memset(s_weight, 0, sizeof(XFLOAT) * xSize * trans_num);
-		memset(s_norm,   0, sizeof(XFLOAT) *   xSize * trans_num);
+		memset(s_weight, 0, sizeof(XFLOAT) * trans_num);
+		s_norm = (XFLOAT)0.0;
 
 		unsigned long pixel = 0;
 		for(int iz = 0; iz < zSize; iz ++) {
@@ -1173,6 +1128,13 @@ inline void diff2_CC_coarse_3D(
 					corr_imag[x] = g_corr_img[pixel + x];    	        
 				}
 
+				// The norm of the reference does not depend on the translation
+				XFLOAT norm = (XFLOAT)0.0;
+				#pragma omp simd reduction(+:norm)
+				for(int x = xstart_y; x < xend_y; x++)
+					norm += (ref_real[x] * ref_real[x] + ref_imag[x] * ref_imag[x]) * corr_imag[x];
+				s_norm += norm;
+
 				for(int itrans=0; itrans<trans_num; itrans++) {
 					XFLOAT trans_cos_z, trans_sin_z;
 					if ( z < 0) {
@@ -1194,23 +1156,13 @@ inline void diff2_CC_coarse_3D(
 						trans_sin_y = sin_y[itrans][y];
 					}
 
-					XFLOAT *trans_cos_x = &cos_x[itrans][0];
-					XFLOAT *trans_sin_x = &sin_x[itrans][0];     
-
-					for(int x = xstart_y; x < xend_y; x++) {
-
-						XFLOAT s  = trans_sin_x[x] * trans_cos_y + trans_cos_x[x] * trans_sin_y;
-						XFLOAT c  = trans_cos_x[x] * trans_cos_y - trans_sin_x[x] * trans_sin_y;
-
-						XFLOAT ss = s * trans_cos_z + c * trans_sin_z;
-						XFLOAT cc = c * trans_cos_z - s * trans_sin_z;				
-
-						XFLOAT real = cc * img_real[x] - ss * img_imag[x];
-						XFLOAT imag = cc * img_imag[x] + ss * img_real[x];
+					// The z phase is constant along the row: fold it into the y phase
+					XFLOAT trans_cos_yz = trans_cos_y * trans_cos_z - trans_sin_y * trans_sin_z;
+					XFLOAT trans_sin_yz = trans_sin_y * trans_cos_z + trans_cos_y * trans_sin_z;
 
-						s_weight[itrans][x] += (ref_real[x] * real        + ref_imag[x] * imag       ) * corr_imag[x];
-						s_norm  [itrans][x] += (ref_real[x] * ref_real[x] + ref_imag[x] * ref_imag[x]) * corr_imag[x];
-					}
+					s_weight[itrans] += cc_row(xend_y - xstart_y,
+							&cos_x[itrans][xstart_y], &sin_x[itrans][xstart_y], trans_cos_yz, trans_sin_yz,
+							ref_real + xstart_y, ref_imag + xstart_y, img_real + xstart_y, img_imag + xstart_y, corr_imag + xstart_y);
 				}
 				
 				pixel += (unsigned long)xSize;
@@ -1218,20 +1170,12 @@ inline void diff2_CC_coarse_3D(
 		}
 
 		for(unsigned long itrans=0; itrans<trans_num; itrans++) {
-			XFLOAT sum_weight = (XFLOAT)0.0;
-			XFLOAT sum_norm   = (XFLOAT)0.0;		
-
-			for(int i=0; i<xSize; i++){
-				sum_weight += s_weight[itrans][i];
-				sum_norm   += s_norm  [itrans][i];
-			}
-
 	#ifdef RELION_SINGLE_PRECISION                  
 			g_diff2[(unsigned long)iorient*(unsigned long)trans_num + itrans] = 
-					- ( sum_weight / sqrtf(sum_norm));
+					- ( s_weight[itrans] / sqrtf(s_norm));
 	#else                   
 			g_diff2[(unsigned long)iorient*(unsigned long)trans_num + itrans] = 
-					- ( sum_weight / sqrt(sum_norm));
+					- ( s_weight[itrans] / sqrt(s_norm));
 	#endif
 		}
 	} // for iorient
@@ -1280,8 +1224,8 @@ inline void diff2_CC_fine_2D(
 
 	XFLOAT trans_x[translation_num], trans_y[translation_num];
 
-	XFLOAT  s   [translation_num][xSize]; 
-	XFLOAT  s_cc[translation_num][xSize];
+	XFLOAT s[translation_num];
+	XFLOAT s_cc;
 	
 	XFLOAT ref_real[xSize], ref_imag[xSize];
 	XFLOAT img_real[xSize], img_imag[xSize], corr_imag[xSize];
@@ -1310,8 +1254,8 @@ inline void diff2_CC_fine_2D(
 		e6 = g_eulers[iorient*9+6];
 		e7 = g_eulers[iorient*9+7];
 
-		memset(&s[0][0],    0, sizeof(XFLOAT) * xSize * trans_num);
-		memset(&s_cc[0][0], 0, sizeof(XFLOAT) * xSize * trans_num);
+		memset(s, 0, sizeof(XFLOAT) * trans_num);
+		s_cc = (XFLOAT)0.0;
 
 		unsigned long pixel = 0;
 		for(int iy = 0; iy < ySize; iy++) {
@@ -1345,6 +1289,13 @@ inline void diff2_CC_fine_2D(
 				corr_imag[x] = g_corr_img [pixel + x];
 			}
 
+			// The norm of the reference does not depend on the translation
+			XFLOAT norm = (XFLOAT)0.0;
+			#pragma omp simd reduction(+:norm)
+			for(int x = xstart; x < xend; x++)
+				norm += (ref_real[x] * ref_real[x] + ref_imag[x] * ref_imag[x]) * corr_imag[x];
+			s_cc += norm;
+
 			for (unsigned long itrans=0; itrans<trans_num; itrans++) // finish all translations in each partial pass
 			{			
 				XFLOAT trans_cos_y, trans_sin_y;
@@ -1357,37 +1308,20 @@ inline void diff2_CC_fine_2D(
 					trans_sin_y = sin_y[itrans][y];
 				}
 
-				XFLOAT *trans_cos_x = &cos_x[itrans][0];
-				XFLOAT *trans_sin_x = &sin_x[itrans][0];     
-
-				for(int x = xstart; x < xend; x++) {			
-					XFLOAT ss = trans_sin_x[x] * trans_cos_y + trans_cos_x[x] * trans_sin_y;
-					XFLOAT cc = trans_cos_x[x] * trans_cos_y - trans_sin_x[x] * trans_sin_y;
-
-					XFLOAT shifted_real = cc * img_real[x] - ss * img_imag[x];
-					XFLOAT shifted_imag = cc * img_imag[x] + ss * img_real[x];					    
-
-					s[itrans][x]    += (ref_real[x] * shifted_real + ref_imag[x] * shifted_imag) * corr_imag[x];
-					s_cc[itrans][x] += (ref_real[x] * ref_real[x] + ref_imag[x] * ref_imag[x])   * corr_imag[x];
-				}
+				s[itrans] += cc_row(xend - xstart,
+						&cos_x[itrans][xstart], &sin_x[itrans][xstart], trans_cos_y, trans_sin_y,
+						ref_real + xstart, ref_imag + xstart, img_real + xstart, img_imag + xstart, corr_imag + xstart);
 			}
 
 			pixel += (unsigned long)xSize;
 		} // loop y direction
 
 		for(unsigned long itrans=0; itrans<trans_num; itrans++) {
-			XFLOAT sum1 = (XFLOAT)0.0;
-			XFLOAT sum2 = (XFLOAT)0.0;
-			for(int x=0; x<xSize; x++){
-				sum1 += s   [itrans][x];
-				sum2 += s_cc[itrans][x]; 
-			} 
-
 			unsigned long int iy = d_job_idx[bid] + itrans;
 	#ifdef RELION_SINGLE_PRECISION         
-			g_diff2s[iy] = - sum1 / sqrtf(sum2);
+			g_diff2s[iy] = - s[itrans] / sqrtf(s_cc);
 	#else
-			g_diff2s[iy] = - sum1 / sqrt(sum2);
+			g_diff2s[iy] = - s[itrans] / sqrt(s_cc);
 	#endif
 		}
 	} // for bid
@@ -1437,8 +1371,8 @@ inline void diff2_CC_fine_3D(
 
 	XFLOAT trans_x[translation_num], trans_y[translation_num], trans_z[translation_num];
 
-	XFLOAT  s   [translation_num][xSize]; 
-	XFLOAT  s_cc[translation_num][xSize];
+	XFLOAT s[translation_num];
+	XFLOAT s_cc;
 
 	XFLOAT ref_real[xSize], ref_imag[xSize];
 	XFLOAT img_real[xSize], img_imag[xSize], corr_imag[xSize];
@@ -1461,8 +1395,8 @@ inline void diff2_CC_fine_3D(
 								  &sin_y[0][0], &cos_y[0][0],
 								  &sin_z[0][0], &cos_z[0][0]);
 
-		memset(&s[0][0],    0, sizeof(XFLOAT) * xSize * trans_num);
-		memset(&s_cc[0][0], 0, sizeof(XFLOAT) * xSize * trans_num);
+		memset(s, 0, sizeof(XFLOAT) * trans_num);
+		s_cc = (XFLOAT)0.0;
 
 		// index of comparison
 		unsigned long int iorient = d_rot_idx[d_job_idx[bid]];	
@@ -1514,6 +1448,13 @@ inline void diff2_CC_fine_3D(
 					corr_imag[x] = g_corr_img [pixel + x];	            
 				}
 
+				// The norm of the reference does not depend on the translation
+				XFLOAT norm = (XFLOAT)0.0;
+				#pragma omp simd reduction(+:norm)
+				for(int x = xstart_y; x < xend_y; x++)
+					norm += (ref_real[x] * ref_real[x] + ref_imag[x] * ref_imag[x]) * corr_imag[x];
+				s_cc += norm;
+
 				for (unsigned long itrans=0; itrans<trans_num; itrans++) // finish all translations in each partial pass
 				{			
 					XFLOAT trans_cos_z, trans_sin_z;
@@ -1536,22 +1477,13 @@ inline void diff2_CC_fine_3D(
 						trans_sin_y = sin_y[itrans][y];
 					}
 
-					XFLOAT *trans_cos_x = &cos_x[itrans][0];
-					XFLOAT *trans_sin_x = &sin_x[itrans][0];     
-
-					for(int x = xstart_y; x < xend_y; x++) {			
-						XFLOAT s1  = trans_sin_x[x] * trans_cos_y + trans_cos_x[x] * trans_sin_y;
-						XFLOAT c1  = trans_cos_x[x] * trans_cos_y - trans_sin_x[x] * trans_sin_y;
-
-						XFLOAT ss = s1 * trans_cos_z + c1 * trans_sin_z;
-						XFLOAT cc = c1 * trans_cos_z - s1 * trans_sin_z;		
+					// The z phase is constant along the row: fold it into the y phase
+					XFLOAT trans_cos_yz = trans_cos_y * trans_cos_z - trans_sin_y * trans_sin_z;
+					XFLOAT trans_sin_yz = trans_sin_y * trans_cos_z + trans_cos_y * trans_sin_z;
 
-						XFLOAT shifted_real = cc * img_real[x] - ss * img_imag[x];
-						XFLOAT shifted_imag = cc * img_imag[x] + ss * img_real[x];			
-
-						s[itrans][x]    += (ref_real[x] * shifted_real + ref_imag[x] * shifted_imag) * corr_imag[x];
-						s_cc[itrans][x] += (ref_real[x]*ref_real[x] + ref_imag[x]*ref_imag[x])       * corr_imag[x];
-					}
+					s[itrans] += cc_row(xend_y - xstart_y,
+							&cos_x[itrans][xstart_y], &sin_x[itrans][xstart_y], trans_cos_yz, trans_sin_yz,
+							ref_real + xstart_y, ref_imag + xstart_y, img_real + xstart_y, img_imag + xstart_y, corr_imag + xstart_y);
 				}
 			}
 
@@ -1559,18 +1491,11 @@ inline void diff2_CC_fine_3D(
 		} // loop y direction
 
 		for(unsigned long itrans=0; itrans<trans_num; itrans++) {
-			XFLOAT sum1 = (XFLOAT)0.0;
-			XFLOAT sum2 = (XFLOAT)0.0;
-			for(int x=0; x<xSize; x++){
-				sum1 += s   [itrans][x];
-				sum2 += s_cc[itrans][x]; 
-			} 
-
 			unsigned long int iy = d_job_idx[bid] + itrans;
 	#ifdef RELION_SINGLE_PRECISION         
-			g_diff2s[iy] = - sum1 / sqrtf(sum2);
+			g_diff2s[iy] = - s[itrans] / sqrtf(s_cc);
 	#else
-			g_diff2s[iy] = - sum1 / sqrt(sum2);
+			g_diff2s[iy] = - s[itrans] / sqrt(s_cc);
 	#endif
 
 		}		
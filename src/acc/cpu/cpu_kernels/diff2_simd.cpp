@@ -0,0 +1,380 @@
+#include "src/acc/cpu/cpu_kernels/diff2_simd.h"
+#include "src/acc/cpu/cpu_kernels/cpu_utils.h"
+#include "src/error.h"
+#include <algorithm>
+#include <climits>
+#include <cstddef>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define DIFF2_SIMD_X86
+#include <immintrin.h>
+#endif
+
+namespace CpuKernels {
+
+namespace Scalar {
+
+XFLOAT diff2_row(
+    int n,
+    const XFLOAT *cos_x, const XFLOAT *sin_x, XFLOAT cos_y, XFLOAT sin_y,
+    const XFLOAT *ref_real, const XFLOAT *ref_imag,
+    const XFLOAT *img_real, const XFLOAT *img_imag
+) {
+    XFLOAT sum = 0.0;
+    #pragma omp simd reduction(+:sum)
+    for (int x = 0; x < n; x++) {
+        XFLOAT ss = sin_x[x] * cos_y + cos_x[x] * sin_y;
+        XFLOAT cc = cos_x[x] * cos_y - sin_x[x] * sin_y;
+
+        XFLOAT shifted_real = cc * img_real[x] - ss * img_imag[x];
+        XFLOAT shifted_imag = cc * img_imag[x] + ss * img_real[x];
+
+        XFLOAT diff_real = ref_real[x] - shifted_real;
+        XFLOAT diff_imag = ref_imag[x] - shifted_imag;
+
+        sum += diff_real * diff_real + diff_imag * diff_imag;
+    }
+    return sum;
+}
+
+XFLOAT cc_row(
+    int n,
+    const XFLOAT *cos_x, const XFLOAT *sin_x, XFLOAT cos_y, XFLOAT sin_y,
+    const XFLOAT *ref_real, const XFLOAT *ref_imag,
+    const XFLOAT *img_real, const XFLOAT *img_imag,
+    const XFLOAT *corr
+) {
+    XFLOAT sum = 0.0;
+    #pragma omp simd reduction(+:sum)
+    for (int x = 0; x < n; x++) {
+        XFLOAT ss = sin_x[x] * cos_y + cos_x[x] * sin_y;
+        XFLOAT cc = cos_x[x] * cos_y - sin_x[x] * sin_y;
+
+        XFLOAT real = cc * img_real[x] - ss * img_imag[x];
+        XFLOAT imag = cc * img_imag[x] + ss * img_real[x];
+
+        sum += (ref_real[x] * real + ref_imag[x] * imag) * corr[x];
+    }
+    return sum;
+}
+
+void diff2_block(
+    int n,
+    const XFLOAT *cc, const XFLOAT *ss,
+    const XFLOAT *img_real, const XFLOAT *img_imag, const XFLOAT *corr,
+    const XFLOAT *ref_real, const XFLOAT *ref_imag, int ref_stride, int nr_refs,
+    XFLOAT *diff2s
+) {
+    for (int p = 0; p < n; p++) {
+        XFLOAT real = cc[p] * img_real[p] - ss[p] * img_imag[p];
+        XFLOAT imag = cc[p] * img_imag[p] + ss[p] * img_real[p];
+
+        for (int j = 0; j < nr_refs; j++) {
+            XFLOAT diff_real = ref_real[(size_t) j * ref_stride + p] - real;
+            XFLOAT diff_imag = ref_imag[(size_t) j * ref_stride + p] - imag;
+
+            diff2s[j] += (diff_real * diff_real + diff_imag * diff_imag) * corr[p];
+        }
+    }
+}
+
+void project3D_row(
+    int n,
+    XFLOAT ax, XFLOAT ay, XFLOAT az, XFLOAT bx, XFLOAT by, XFLOAT bz,
+    XFLOAT padding_factor, int max_r2,
+    const std::complex<XFLOAT> *mdl, int mdlX, int mdlXY, int mdlInitY, int mdlInitZ,
+    XFLOAT *real, XFLOAT *imag
+) {
+    for (int i = 0; i < n; i++) {
+        XFLOAT xp = (ax + i * bx) * padding_factor;
+        XFLOAT yp = (ay + i * by) * padding_factor;
+        XFLOAT zp = (az + i * bz) * padding_factor;
+
+        int r2 = xp * xp + yp * yp + zp * zp;
+        if (r2 > max_r2) {
+            real[i] = imag[i] = (XFLOAT) 0.0;
+            continue;
+        }
+
+        bool invers = xp < 0;
+        if (invers) {
+            xp = -xp;
+            yp = -yp;
+            zp = -zp;
+        }
+        complex3D(const_cast<std::complex<XFLOAT>*>(mdl), real[i], imag[i], xp, yp, zp, mdlX, mdlXY, mdlInitY, mdlInitZ);
+        if (invers)
+            imag[i] = -imag[i];
+    }
+}
+
+}
+
+#ifdef DIFF2_SIMD_X86
+
+namespace Avx2 {
+
+#define SIMD_TARGET __attribute__((target("avx2,fma")))
+
+#ifdef ACC_DOUBLE_PRECISION
+typedef __m256d vec;
+const int W = 4;
+SIMD_TARGET inline vec set1(XFLOAT a) { return _mm256_set1_pd(a); }
+SIMD_TARGET inline vec zero() { return _mm256_setzero_pd(); }
+SIMD_TARGET inline vec load(const XFLOAT *p, int m) {
+    if (m >= W) return _mm256_loadu_pd(p);
+    return _mm256_maskload_pd(p, _mm256_cmpgt_epi64(_mm256_set1_epi64x(m), _mm256_setr_epi64x(0, 1, 2, 3)));
+}
+SIMD_TARGET inline void store(XFLOAT *p, vec a) { _mm256_storeu_pd(p, a); }
+SIMD_TARGET inline vec add(vec a, vec b) { return _mm256_add_pd(a, b); }
+SIMD_TARGET inline vec sub(vec a, vec b) { return _mm256_sub_pd(a, b); }
+SIMD_TARGET inline vec mul(vec a, vec b) { return _mm256_mul_pd(a, b); }
+SIMD_TARGET inline vec fmadd (vec a, vec b, vec c) { return _mm256_fmadd_pd (a, b, c); }
+SIMD_TARGET inline vec fnmadd(vec a, vec b, vec c) { return _mm256_fnmadd_pd(a, b, c); }
+SIMD_TARGET inline XFLOAT hsum(vec a) {
+    __m128d s = _mm_add_pd(_mm256_castpd256_pd128(a), _mm256_extractf128_pd(a, 1));
+    return _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+}
+typedef __m256d mask;
+typedef __m128i ivec;
+SIMD_TARGET inline vec iota() { return _mm256_setr_pd(0, 1, 2, 3); }
+SIMD_TARGET inline mask first(int m) {
+    return _mm256_castsi256_pd(_mm256_cmpgt_epi64(_mm256_set1_epi64x(m), _mm256_setr_epi64x(0, 1, 2, 3)));
+}
+SIMD_TARGET inline mask lt(vec a, vec b) { return _mm256_cmp_pd(a, b, _CMP_LT_OQ); }
+SIMD_TARGET inline mask land(mask a, mask b) { return _mm256_and_pd(a, b); }
+SIMD_TARGET inline vec floorv(vec a) { return _mm256_floor_pd(a); }
+SIMD_TARGET inline ivec toint(vec a) { return _mm256_cvttpd_epi32(a); }
+SIMD_TARGET inline ivec iset1(int a) { return _mm_set1_epi32(a); }
+SIMD_TARGET inline ivec iadd(ivec a, ivec b) { return _mm_add_epi32(a, b); }
+SIMD_TARGET inline ivec isub(ivec a, ivec b) { return _mm_sub_epi32(a, b); }
+SIMD_TARGET inline ivec imul(ivec a, ivec b) { return _mm_mullo_epi32(a, b); }
+SIMD_TARGET inline vec gather(const XFLOAT *mdl, ivec i, mask k) {
+    return _mm256_mask_i32gather_pd(_mm256_setzero_pd(), mdl, _mm_add_epi32(i, i), k, 8);
+}
+SIMD_TARGET inline vec negate_if(mask k, vec a) { return _mm256_xor_pd(a, _mm256_and_pd(k, _mm256_set1_pd(-0.0))); }
+SIMD_TARGET inline void store_n(XFLOAT *p, vec a, int m) { _mm256_maskstore_pd(p, _mm256_castpd_si256(first(m)), a); }
+#else
+typedef __m256 vec;
+const int W = 8;
+SIMD_TARGET inline vec set1(XFLOAT a) { return _mm256_set1_ps(a); }
+SIMD_TARGET inline vec zero() { return _mm256_setzero_ps(); }
+SIMD_TARGET inline vec load(const XFLOAT *p, int m) {
+    if (m >= W) return _mm256_loadu_ps(p);
+    return _mm256_maskload_ps(p, _mm256_cmpgt_epi32(_mm256_set1_epi32(m), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)));
+}
+SIMD_TARGET inline void store(XFLOAT *p, vec a) { _mm256_storeu_ps(p, a); }
+SIMD_TARGET inline vec add(vec a, vec b) { return _mm256_add_ps(a, b); }
+SIMD_TARGET inline vec sub(vec a, vec b) { return _mm256_sub_ps(a, b); }
+SIMD_TARGET inline vec mul(vec a, vec b) { return _mm256_mul_ps(a, b); }
+SIMD_TARGET inline vec fmadd (vec a, vec b, vec c) { return _mm256_fmadd_ps (a, b, c); }
+SIMD_TARGET inline vec fnmadd(vec a, vec b, vec c) { return _mm256_fnmadd_ps(a, b, c); }
+SIMD_TARGET inline XFLOAT hsum(vec a) {
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    return _mm_cvtss_f32(_mm_add_ss(s, _mm_shuffle_ps(s, s, 1)));
+}
+typedef __m256 mask;
+typedef __m256i ivec;
+SIMD_TARGET inline vec iota() { return _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7); }
+SIMD_TARGET inline mask first(int m) {
+    return _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(m), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)));
+}
+SIMD_TARGET inline mask lt(vec a, vec b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+SIMD_TARGET inline mask land(mask a, mask b) { return _mm256_and_ps(a, b); }
+SIMD_TARGET inline vec floorv(vec a) { return _mm256_floor_ps(a); }
+SIMD_TARGET inline ivec toint(vec a) { return _mm256_cvttps_epi32(a); }
+SIMD_TARGET inline ivec iset1(int a) { return _mm256_set1_epi32(a); }
+SIMD_TARGET inline ivec iadd(ivec a, ivec b) { return _mm256_add_epi32(a, b); }
+SIMD_TARGET inline ivec isub(ivec a, ivec b) { return _mm256_sub_epi32(a, b); }
+SIMD_TARGET inline ivec imul(ivec a, ivec b) { return _mm256_mullo_epi32(a, b); }
+SIMD_TARGET inline vec gather(const XFLOAT *mdl, ivec i, mask k) {
+    return _mm256_mask_i32gather_ps(_mm256_setzero_ps(), mdl, i, k, 8);
+}
+SIMD_TARGET inline vec negate_if(mask k, vec a) { return _mm256_xor_ps(a, _mm256_and_ps(k, _mm256_set1_ps(-0.0f))); }
+SIMD_TARGET inline void store_n(XFLOAT *p, vec a, int m) { _mm256_maskstore_ps(p, _mm256_castps_si256(first(m)), a); }
+#endif
+
+#include "src/acc/cpu/cpu_kernels/diff2_simd_impl.h"
+
+#undef SIMD_TARGET
+
+}
+
+namespace Avx512 {
+
+#define SIMD_TARGET __attribute__((target("avx512f")))
+
+#ifdef ACC_DOUBLE_PRECISION
+typedef __m512d vec;
+const int W = 8;
+SIMD_TARGET inline vec set1(XFLOAT a) { return _mm512_set1_pd(a); }
+SIMD_TARGET inline vec zero() { return _mm512_setzero_pd(); }
+SIMD_TARGET inline vec load(const XFLOAT *p, int m) {
+    if (m >= W) return _mm512_loadu_pd(p);
+    return _mm512_maskz_loadu_pd((__mmask8) ((1u << m) - 1), p);
+}
+SIMD_TARGET inline void store(XFLOAT *p, vec a) { _mm512_storeu_pd(p, a); }
+SIMD_TARGET inline vec add(vec a, vec b) { return _mm512_add_pd(a, b); }
+SIMD_TARGET inline vec sub(vec a, vec b) { return _mm512_sub_pd(a, b); }
+SIMD_TARGET inline vec mul(vec a, vec b) { return _mm512_mul_pd(a, b); }
+SIMD_TARGET inline vec fmadd (vec a, vec b, vec c) { return _mm512_fmadd_pd (a, b, c); }
+SIMD_TARGET inline vec fnmadd(vec a, vec b, vec c) { return _mm512_fnmadd_pd(a, b, c); }
+SIMD_TARGET inline XFLOAT hsum(vec a) { return _mm512_reduce_add_pd(a); }
+typedef __mmask8 mask;
+typedef __m256i ivec;
+SIMD_TARGET inline vec iota() { return _mm512_setr_pd(0, 1, 2, 3, 4, 5, 6, 7); }
+SIMD_TARGET inline mask first(int m) { return m >= W ? (mask) 0xFF : (mask) ((1u << m) - 1); }
+SIMD_TARGET inline mask lt(vec a, vec b) { return _mm512_cmp_pd_mask(a, b, _CMP_LT_OQ); }
+SIMD_TARGET inline mask land(mask a, mask b) { return a & b; }
+SIMD_TARGET inline vec floorv(vec a) { return _mm512_roundscale_pd(a, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC); }
+SIMD_TARGET inline ivec toint(vec a) { return _mm512_cvttpd_epi32(a); }
+SIMD_TARGET inline ivec iset1(int a) { return _mm256_set1_epi32(a); }
+SIMD_TARGET inline ivec iadd(ivec a, ivec b) { return _mm256_add_epi32(a, b); }
+SIMD_TARGET inline ivec isub(ivec a, ivec b) { return _mm256_sub_epi32(a, b); }
+SIMD_TARGET inline ivec imul(ivec a, ivec b) { return _mm256_mullo_epi32(a, b); }
+SIMD_TARGET inline vec gather(const XFLOAT *mdl, ivec i, mask k) {
+    return _mm512_mask_i32gather_pd(_mm512_setzero_pd(), k, _mm256_add_epi32(i, i), mdl, 8);
+}
+SIMD_TARGET inline vec negate_if(mask k, vec a) { return _mm512_mask_sub_pd(a, k, _mm512_setzero_pd(), a); }
+SIMD_TARGET inline void store_n(XFLOAT *p, vec a, int m) { _mm512_mask_storeu_pd(p, first(m), a); }
+#else
+typedef __m512 vec;
+const int W = 16;
+SIMD_TARGET inline vec set1(XFLOAT a) { return _mm512_set1_ps(a); }
+SIMD_TARGET inline vec zero() { return _mm512_setzero_ps(); }
+SIMD_TARGET inline vec load(const XFLOAT *p, int m) {
+    if (m >= W) return _mm512_loadu_ps(p);
+    return _mm512_maskz_loadu_ps((__mmask16) ((1u << m) - 1), p);
+}
+SIMD_TARGET inline void store(XFLOAT *p, vec a) { _mm512_storeu_ps(p, a); }
+SIMD_TARGET inline vec add(vec a, vec b) { return _mm512_add_ps(a, b); }
+SIMD_TARGET inline vec sub(vec a, vec b) { return _mm512_sub_ps(a, b); }
+SIMD_TARGET inline vec mul(vec a, vec b) { return _mm512_mul_ps(a, b); }
+SIMD_TARGET inline vec fmadd (vec a, vec b, vec c) { return _mm512_fmadd_ps (a, b, c); }
+SIMD_TARGET inline vec fnmadd(vec a, vec b, vec c) { return _mm512_fnmadd_ps(a, b, c); }
+SIMD_TARGET inline XFLOAT hsum(vec a) { return _mm512_reduce_add_ps(a); }
+typedef __mmask16 mask;
+typedef __m512i ivec;
+SIMD_TARGET inline vec iota() { return _mm512_setr_ps(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15); }
+SIMD_TARGET inline mask first(int m) { return m >= W ? (mask) 0xFFFF : (mask) ((1u << m) - 1); }
+SIMD_TARGET inline mask lt(vec a, vec b) { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+SIMD_TARGET inline mask land(mask a, mask b) { return a & b; }
+SIMD_TARGET inline vec floorv(vec a) { return _mm512_roundscale_ps(a, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC); }
+SIMD_TARGET inline ivec toint(vec a) { return _mm512_cvttps_epi32(a); }
+SIMD_TARGET inline ivec iset1(int a) { return _mm512_set1_epi32(a); }
+SIMD_TARGET inline ivec iadd(ivec a, ivec b) { return _mm512_add_epi32(a, b); }
+SIMD_TARGET inline ivec isub(ivec a, ivec b) { return _mm512_sub_epi32(a, b); }
+SIMD_TARGET inline ivec imul(ivec a, ivec b) { return _mm512_mullo_epi32(a, b); }
+SIMD_TARGET inline vec gather(const XFLOAT *mdl, ivec i, mask k) {
+    return _mm512_mask_i32gather_ps(_mm512_setzero_ps(), k, i, mdl, 8);
+}
+SIMD_TARGET inline vec negate_if(mask k, vec a) { return _mm512_mask_sub_ps(a, k, _mm512_setzero_ps(), a); }
+SIMD_TARGET inline void store_n(XFLOAT *p, vec a, int m) { _mm512_mask_storeu_ps(p, first(m), a); }
+#endif
+
+#include "src/acc/cpu/cpu_kernels/diff2_simd_impl.h"
+
+#undef SIMD_TARGET
+
+}
+
+#endif  // DIFF2_SIMD_X86
+
+Diff2Isa diff2BestIsa() {
+#ifdef DIFF2_SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return DIFF2_AVX512;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return DIFF2_AVX2;
+#endif
+    return DIFF2_SCALAR;
+}
+
+static Diff2Isa diff2_isa = diff2BestIsa();
+
+Diff2Isa diff2Isa() {
+    return diff2_isa;
+}
+
+void setDiff2Isa(Diff2Isa isa) {
+    if (isa > diff2BestIsa())
+        REPORT_ERROR(std::string("setDiff2Isa: this CPU does not support ") + diff2IsaName(isa));
+    diff2_isa = isa;
+}
+
+const char* diff2IsaName(Diff2Isa isa) {
+    switch (isa) {
+        case DIFF2_AVX2:   return "AVX2";
+        case DIFF2_AVX512: return "AVX-512";
+        default:           return "scalar";
+    }
+}
+
+XFLOAT diff2_row(
+    int n,
+    const XFLOAT *cos_x, const XFLOAT *sin_x, XFLOAT cos_y, XFLOAT sin_y,
+    const XFLOAT *ref_real, const XFLOAT *ref_imag,
+    const XFLOAT *img_real, const XFLOAT *img_imag
+) {
+    switch (diff2_isa) {
+#ifdef DIFF2_SIMD_X86
+        case DIFF2_AVX512: return Avx512::diff2_row(n, cos_x, sin_x, cos_y, sin_y, ref_real, ref_imag, img_real, img_imag);
+        case DIFF2_AVX2:   return Avx2  ::diff2_row(n, cos_x, sin_x, cos_y, sin_y, ref_real, ref_imag, img_real, img_imag);
+#endif
+        default:           return Scalar::diff2_row(n, cos_x, sin_x, cos_y, sin_y, ref_real, ref_imag, img_real, img_imag);
+    }
+}
+
+XFLOAT cc_row(
+    int n,
+    const XFLOAT *cos_x, const XFLOAT *sin_x, XFLOAT cos_y, XFLOAT sin_y,
+    const XFLOAT *ref_real, const XFLOAT *ref_imag,
+    const XFLOAT *img_real, const XFLOAT *img_imag,
+    const XFLOAT *corr
+) {
+    switch (diff2_isa) {
+#ifdef DIFF2_SIMD_X86
+        case DIFF2_AVX512: return Avx512::cc_row(n, cos_x, sin_x, cos_y, sin_y, ref_real, ref_imag, img_real, img_imag, corr);
+        case DIFF2_AVX2:   return Avx2  ::cc_row(n, cos_x, sin_x, cos_y, sin_y, ref_real, ref_imag, img_real, img_imag, corr);
+#endif
+        default:           return Scalar::cc_row(n, cos_x, sin_x, cos_y, sin_y, ref_real, ref_imag, img_real, img_imag, corr);
+    }
+}
+
+void diff2_block(
+    int n,
+    const XFLOAT *cc, const XFLOAT *ss,
+    const XFLOAT *img_real, const XFLOAT *img_imag, const XFLOAT *corr,
+    const XFLOAT *ref_real, const XFLOAT *ref_imag, int ref_stride, int nr_refs,
+    XFLOAT *diff2s
+) {
+    switch (diff2_isa) {
+#ifdef DIFF2_SIMD_X86
+        case DIFF2_AVX512: Avx512::diff2_block(n, cc, ss, img_real, img_imag, corr, ref_real, ref_imag, ref_stride, nr_refs, diff2s); break;
+        case DIFF2_AVX2:   Avx2  ::diff2_block(n, cc, ss, img_real, img_imag, corr, ref_real, ref_imag, ref_stride, nr_refs, diff2s); break;
+#endif
+        default:           Scalar::diff2_block(n, cc, ss, img_real, img_imag, corr, ref_real, ref_imag, ref_stride, nr_refs, diff2s);
+    }
+}
+
+void project3D_row(
+    int n,
+    XFLOAT ax, XFLOAT ay, XFLOAT az, XFLOAT bx, XFLOAT by, XFLOAT bz,
+    XFLOAT padding_factor, int max_r2,
+    const std::complex<XFLOAT> *mdl, int mdlX, int mdlXY, int mdlZ, int mdlInitY, int mdlInitZ,
+    XFLOAT *real, XFLOAT *imag
+) {
+#ifdef DIFF2_SIMD_X86
+    // The gathers take 32-bit offsets (in XFLOATs, scaled by 8 bytes)
+    const bool offsets_fit = (size_t) mdlXY * (size_t) std::max(mdlZ, 1) <= INT_MAX / (sizeof(XFLOAT) / sizeof(float));
+    const XFLOAT *m = reinterpret_cast<const XFLOAT*>(mdl);
+    if (offsets_fit) switch (diff2_isa) {
+        case DIFF2_AVX512: Avx512::project3D_row(n, ax, ay, az, bx, by, bz, padding_factor, max_r2, m, mdlX, mdlXY, mdlInitY, mdlInitZ, real, imag); return;
+        case DIFF2_AVX2:   Avx2  ::project3D_row(n, ax, ay, az, bx, by, bz, padding_factor, max_r2, m, mdlX, mdlXY, mdlInitY, mdlInitZ, real, imag); return;
+        default: break;
+    }
+#endif
+    Scalar::project3D_row(n, ax, ay, az, bx, by, bz, padding_factor, max_r2, mdl, mdlX, mdlXY, mdlInitY, mdlInitZ, real, imag);
+}
+
+}
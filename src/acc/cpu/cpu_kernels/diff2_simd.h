@@ -0,0 +1,73 @@
+#ifndef DIFF2_SIMD_H_
+#define DIFF2_SIMD_H_
+
+#include <complex>
+#include "src/acc/settings.h"
+
+namespace CpuKernels {
+
+/*
+ * Inner loops of the diff2 and wavg kernels, written out for AVX2 and AVX-512.
+ *
+ * All complex arrays are split into real and imaginary parts (structure of arrays),
+ * as they already are in the kernels. The instruction set is picked once, from what
+ * the CPU supports, so that one binary runs everywhere; setDiff2Isa() overrides it
+ * (e.g. to compare with the scalar loops).
+ */
+
+enum Diff2Isa { DIFF2_SCALAR, DIFF2_AVX2, DIFF2_AVX512 };
+
+// Widest instruction set supported by this CPU (and compiler)
+Diff2Isa diff2BestIsa();
+
+// Instruction set used by the kernels
+Diff2Isa diff2Isa();
+
+// Use isa from now on (an error if the CPU does not support it)
+void setDiff2Isa(Diff2Isa isa);
+
+const char* diff2IsaName(Diff2Isa isa);
+
+// sum_x |ref - img * exp(i (phi_x + phi_y))|^2 over one row of n pixels,
+// where cos/sin_x hold the phase of every pixel and cos/sin_y that of the row
+XFLOAT diff2_row(
+    int n,
+    const XFLOAT *cos_x, const XFLOAT *sin_x, XFLOAT cos_y, XFLOAT sin_y,
+    const XFLOAT *ref_real, const XFLOAT *ref_imag,
+    const XFLOAT *img_real, const XFLOAT *img_imag
+);
+
+// sum_x Re(conj(ref) * img * exp(i (phi_x + phi_y))) * corr over one row of n pixels
+XFLOAT cc_row(
+    int n,
+    const XFLOAT *cos_x, const XFLOAT *sin_x, XFLOAT cos_y, XFLOAT sin_y,
+    const XFLOAT *ref_real, const XFLOAT *ref_imag,
+    const XFLOAT *img_real, const XFLOAT *img_imag,
+    const XFLOAT *corr
+);
+
+// diff2s[j] += sum_p |ref_j - img * (cc + i ss)|^2 * corr over n pixels, for nr_refs references
+// (reference j starts at ref_real/imag + j * ref_stride)
+void diff2_block(
+    int n,
+    const XFLOAT *cc, const XFLOAT *ss,
+    const XFLOAT *img_real, const XFLOAT *img_imag, const XFLOAT *corr,
+    const XFLOAT *ref_real, const XFLOAT *ref_imag, int ref_stride, int nr_refs,
+    XFLOAT *diff2s
+);
+
+// One row of n pixels of a projection of the 3D model (interleaved complex, as in
+// AccProjectorKernel): pixel i is interpolated at padding_factor * (a + i * b), like
+// project3Dmodel() does, and is zero where that lies beyond sqrt(max_r2) (padded).
+// The AVX2 and AVX-512 versions gather the 8 neighbours of W pixels at a time.
+void project3D_row(
+    int n,
+    XFLOAT ax, XFLOAT ay, XFLOAT az, XFLOAT bx, XFLOAT by, XFLOAT bz,
+    XFLOAT padding_factor, int max_r2,
+    const std::complex<XFLOAT> *mdl, int mdlX, int mdlXY, int mdlZ, int mdlInitY, int mdlInitZ,
+    XFLOAT *real, XFLOAT *imag
+);
+
+}
+
+#endif /* DIFF2_SIMD_H_ */
@@ -0,0 +1,145 @@
+// Vectorised bodies of the diff2_simd.h loops.
+//
+// Included once per instruction set by diff2_simd.cpp, after it has defined SIMD_TARGET,
+// the vector type `vec` of W XFLOATs, and set1/zero/load/add/sub/mul/fmadd/fnmadd/store/hsum for it.
+// load(p, m) loads min(m, W) values and zeroes the other lanes.
+//
+// project3D_row also needs a lane mask type `mask` and a vector `ivec` of W ints, with
+// iota (0, 1, ..., W-1), first(m) (the first min(m, W) lanes), lt, land, floorv, toint,
+// iset1/iadd/isub/imul, gather(mdl, i, k) (the XFLOATs at complex offsets i of mdl, zero
+// outside k), negate_if and store_n(p, a, m) (stores min(m, W) values).
+
+SIMD_TARGET XFLOAT diff2_row(
+    int n,
+    const XFLOAT *cos_x, const XFLOAT *sin_x, XFLOAT cos_y, XFLOAT sin_y,
+    const XFLOAT *ref_real, const XFLOAT *ref_imag,
+    const XFLOAT *img_real, const XFLOAT *img_imag
+) {
+    const vec cy = set1(cos_y), sy = set1(sin_y);
+    vec sum = zero();
+    for (int x = 0; x < n; x += W) {
+        const int m = n - x;
+        const vec cx = load(cos_x + x, m), sx = load(sin_x + x, m);
+        const vec ss = fmadd(sx, cy, mul(cx, sy));
+        const vec cc = fnmadd(sx, sy, mul(cx, cy));
+
+        const vec ir = load(img_real + x, m), ii = load(img_imag + x, m);
+        const vec dr = sub(load(ref_real + x, m), fnmadd(ss, ii, mul(cc, ir)));
+        const vec di = sub(load(ref_imag + x, m), fmadd (ss, ir, mul(cc, ii)));
+        sum = fmadd(dr, dr, fmadd(di, di, sum));
+    }
+    return hsum(sum);
+}
+
+SIMD_TARGET XFLOAT cc_row(
+    int n,
+    const XFLOAT *cos_x, const XFLOAT *sin_x, XFLOAT cos_y, XFLOAT sin_y,
+    const XFLOAT *ref_real, const XFLOAT *ref_imag,
+    const XFLOAT *img_real, const XFLOAT *img_imag,
+    const XFLOAT *corr
+) {
+    const vec cy = set1(cos_y), sy = set1(sin_y);
+    vec sum = zero();
+    for (int x = 0; x < n; x += W) {
+        const int m = n - x;
+        const vec cx = load(cos_x + x, m), sx = load(sin_x + x, m);
+        const vec ss = fmadd(sx, cy, mul(cx, sy));
+        const vec cc = fnmadd(sx, sy, mul(cx, cy));
+
+        const vec ir = load(img_real + x, m), ii = load(img_imag + x, m);
+        const vec real = fnmadd(ss, ii, mul(cc, ir));
+        const vec imag = fmadd (ss, ir, mul(cc, ii));
+        const vec dot = fmadd(load(ref_real + x, m), real, mul(load(ref_imag + x, m), imag));
+        sum = fmadd(dot, load(corr + x, m), sum);
+    }
+    return hsum(sum);
+}
+
+SIMD_TARGET void diff2_block(
+    int n,
+    const XFLOAT *cc, const XFLOAT *ss,
+    const XFLOAT *img_real, const XFLOAT *img_imag, const XFLOAT *corr,
+    const XFLOAT *ref_real, const XFLOAT *ref_imag, int ref_stride, int nr_refs,
+    XFLOAT *diff2s
+) {
+    // Shift the image once, padded with zeros to whole vectors
+    const int n_padded = (n + W - 1) / W * W;
+    XFLOAT shifted_real[n_padded], shifted_imag[n_padded], weight[n_padded];
+    for (int p = 0; p < n; p += W) {
+        const int m = n - p;
+        const vec c = load(cc + p, m), s = load(ss + p, m);
+        const vec ir = load(img_real + p, m), ii = load(img_imag + p, m);
+        store(shifted_real + p, fnmadd(s, ii, mul(c, ir)));
+        store(shifted_imag + p, fmadd (s, ir, mul(c, ii)));
+        store(weight + p, load(corr + p, m));
+    }
+
+    // The padding has zero weight; the (masked) reference loads keep it finite
+    for (int j = 0; j < nr_refs; j++) {
+        const XFLOAT *rr = ref_real + (size_t) j * ref_stride;
+        const XFLOAT *ri = ref_imag + (size_t) j * ref_stride;
+        vec sum = zero();
+        for (int p = 0; p < n; p += W) {
+            const int m = n - p;
+            const vec dr = sub(load(rr + p, m), load(shifted_real + p, W));
+            const vec di = sub(load(ri + p, m), load(shifted_imag + p, W));
+            sum = fmadd(fmadd(dr, dr, mul(di, di)), load(weight + p, W), sum);
+        }
+        diff2s[j] += hsum(sum);
+    }
+}
+
+SIMD_TARGET inline vec lerp(vec a, vec b, vec f) {
+    return fmadd(sub(b, a), f, a);
+}
+
+SIMD_TARGET void project3D_row(
+    int n,
+    XFLOAT ax, XFLOAT ay, XFLOAT az, XFLOAT bx, XFLOAT by, XFLOAT bz,
+    XFLOAT padding_factor, int max_r2,
+    const XFLOAT *mdl, int mdlX, int mdlXY, int mdlInitY, int mdlInitZ,
+    XFLOAT *real, XFLOAT *imag
+) {
+    const vec pad = set1(padding_factor);
+    // (int) r2 <= max_r2, as in project3Dmodel
+    const vec r2_limit = set1((XFLOAT) max_r2 + (XFLOAT) 1.0);
+    const ivec dx = iset1(1), dy = iset1(mdlX), dz = iset1(mdlXY);
+    const ivec init_y = iset1(mdlInitY), init_z = iset1(mdlInitZ);
+
+    for (int i = 0; i < n; i += W) {
+        const int m = n - i;
+        const vec t = add(set1((XFLOAT) i), iota());
+        vec xp = mul(fmadd(t, set1(bx), set1(ax)), pad);
+        vec yp = mul(fmadd(t, set1(by), set1(ay)), pad);
+        vec zp = mul(fmadd(t, set1(bz), set1(az)), pad);
+
+        const vec r2 = fmadd(xp, xp, fmadd(yp, yp, mul(zp, zp)));
+        const mask inside = land(first(m), lt(r2, r2_limit));
+
+        // Only the asymmetric half is stored: use the complex conjugate of the hermitian pair
+        const mask invers = lt(xp, zero());
+        xp = negate_if(invers, xp);
+        yp = negate_if(invers, yp);
+        zp = negate_if(invers, zp);
+
+        const vec x0 = floorv(xp), y0 = floorv(yp), z0 = floorv(zp);
+        const vec fx = sub(xp, x0), fy = sub(yp, y0), fz = sub(zp, z0);
+
+        const ivec o000 = iadd(iadd(imul(isub(toint(z0), init_z), dz), imul(isub(toint(y0), init_y), dy)), toint(x0));
+        const ivec o001 = iadd(o000, dx), o010 = iadd(o000, dy), o011 = iadd(o010, dx);
+        const ivec o100 = iadd(o000, dz), o101 = iadd(o001, dz), o110 = iadd(o010, dz), o111 = iadd(o011, dz);
+
+        for (int c = 0; c < 2; c++) {
+            const XFLOAT *base = mdl + c;  // real, then imaginary parts
+            const vec dx00 = lerp(gather(base, o000, inside), gather(base, o001, inside), fx);
+            const vec dx01 = lerp(gather(base, o100, inside), gather(base, o101, inside), fx);
+            const vec dx10 = lerp(gather(base, o010, inside), gather(base, o011, inside), fx);
+            const vec dx11 = lerp(gather(base, o110, inside), gather(base, o111, inside), fx);
+            const vec v = lerp(lerp(dx00, dx10, fy), lerp(dx01, dx11, fy), fz);
+            if (c == 0)
+                store_n(real + i, v, m);
+            else
+                store_n(imag + i, negate_if(invers, v), m);
+        }
+    }
+}
@@ -9,6 +9,7 @@
 #include "src/acc/acc_projector.h"
 #include "src/acc/cpu/cpu_kernels/cpu_utils.h"
 #include "src/acc/cpu/cpu_kernels/helper.h"
+#include "src/acc/cpu/cpu_kernels/diff2_simd.h"
 
 #ifndef CUDA
 
@@ -119,12 +120,17 @@ void wavg_ref3D(
                 wdiff2s_AA[x] = g_wdiff2s_AA[pixel + x];
             }
             
+            if(REF3D)
+                project3D_row(xend - xstart,
+                              e0 * xstart + e1 * y, e3 * xstart + e4 * y, e6 * xstart + e7 * y,
+                              e0, e3, e6, projector.padding_factor, projector.maxR2_padded,
+                              projector.mdlComplex, projector.mdlX, projector.mdlXY, projector.mdlZ,
+                              projector.mdlInitY, projector.mdlInitZ,
+                              ref_real + xstart, ref_imag + xstart);
+
             #pragma omp simd
             for(int x = xstart; x < xend; x++) {
-                if(REF3D)
-                    projector.project3Dmodel(x, y, e0, e1, e3, e4, e6, e7,
-                                            ref_real[x], ref_imag[x]);
-                else
+                if(!REF3D)
                     projector.project2Dmodel(x, y, e0, e1, e3, e4,
                                             ref_real[x], ref_imag[x]);
                 if (REFCTF)
@@ -300,10 +306,17 @@ void wavg_3D(
                     }
                 }
 
+                project3D_row(xend_y - xstart_y,
+                              e0 * xstart_y + e1 * y + e2 * z,
+                              e3 * xstart_y + e4 * y + e5 * z,
+                              e6 * xstart_y + e7 * y + e8 * z,
+                              e0, e3, e6, projector.padding_factor, projector.maxR2_padded,
+                              projector.mdlComplex, projector.mdlX, projector.mdlXY, projector.mdlZ,
+                              projector.mdlInitY, projector.mdlInitZ,
+                              ref_real + xstart_y, ref_imag + xstart_y);
+
                 #pragma omp simd
                 for(int x = xstart_y; x < xend_y; x++) {
-                    projector.project3Dmodel(x, y, z, e0, e1, e2, e3, e4, e5, e6, e7, e8,
-                                             ref_real[x], ref_imag[x]);
                     if (REFCTF)
                     {
                         if(CTFPREMULTIPLIED)
@@ -66,10 +66,6 @@
 #include "src/acc/acc_ml_optimiser_impl.h"
 
 
-#include <tbb/spin_mutex.h>
-tbb::spin_mutex      mkl_mutex;
-
-
 void MlDataBundle::setup(MlOptimiser *baseMLO)
 {
 	/*======================================================
@@ -110,6 +106,8 @@ void MlDataBundle::setup(MlOptimiser *baseMLO)
 				baseMLO->wsum_model.BPref[imodel].padding_factor);
 
 		backprojectors[imodel].initMdl();
+		// Split the buffer of each thread over the classes
+		backprojectors[imodel].setThreadBuffers((size_t) baseMLO->cpu_bp_buffer_mb * 1024 * 1024 / nr_bproj);
 	}
 
 	/*======================================================
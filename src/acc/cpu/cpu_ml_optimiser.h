@@ -28,6 +28,7 @@ public:
 	std::vector< AccProjector > projectors;
 	std::vector< AccBackprojector > backprojectors;
 	std::vector< AccProjectorPlan > coarseProjectionPlans;
+	AccProjectorPlanCache projectionPlanCache;  // For plans generated on the fly
 
 	void setup(MlOptimiser *baseMLO);
 
@@ -63,6 +63,8 @@
 #define BP_2D_BLOCK_SIZE 128
 #define BP_REF3D_BLOCK_SIZE 128
 #define BP_DATA3D_BLOCK_SIZE 640
+#define BP_TILE_DIM_LOG2 3			// -- Per-thread backprojection buffers are kept in --
+									// tiles of 2^BP_TILE_DIM_LOG2 voxels along each axis
 
 #define REF_GROUP_SIZE 3			// -- Number of references to be treated per block --
 									// This applies to wavg and reduces global memory
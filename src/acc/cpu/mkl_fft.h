@@ -164,9 +164,7 @@ public:
 
 #include <fftw3.h>
 #include <tbb/spin_mutex.h>
-
-
-extern tbb::spin_mutex      mkl_mutex;
+#include "src/fftw_plans.h"
 
 class MklFFT
 {
@@ -253,7 +251,8 @@ public:
 		#define ACC_FFTW_COMPLEX      fftwf_complex
 		#endif
 
-		tbb::spin_mutex::scoped_lock lock (mkl_mutex);
+		// The FFTW planner is shared with FftwPlans
+		std::lock_guard<std::mutex> lock (FftwPlans::plannerMutex());
 		fPlanForward = ACC_FFTW_PLAN_DFT_R2C(
 			dimension, N,  reals.getAccPtr(), (ACC_FFTW_COMPLEX*) fouriers.getAccPtr(), FFTW_ESTIMATE);
 		fPlanBackward = ACC_FFTW_PLAN_DFT_C2R(
@@ -298,7 +297,7 @@ public:
 
 		if (planSet)
 		{
-			tbb::spin_mutex::scoped_lock lock(mkl_mutex);
+			std::lock_guard<std::mutex> lock (FftwPlans::plannerMutex());
 #ifdef ACC_DOUBLE_PRECISION
 			fftw_destroy_plan(fPlanForward);
 			fftw_destroy_plan(fPlanBackward);
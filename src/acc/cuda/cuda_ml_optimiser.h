@@ -49,6 +49,7 @@ class MlDeviceBundle {
     //Used for precalculations of projection setup
     bool generateProjectionPlanOnTheFly;
     std::vector<AccProjectorPlan> coarseProjectionPlans;
+    AccProjectorPlanCache projectionPlanCache;  // For plans generated on the fly
 
     MlOptimiser *baseMLO;
 
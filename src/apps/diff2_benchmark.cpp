@@ -0,0 +1,186 @@
+/***************************************************************************
+ *
+ * Author: "agent"
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This complete copyright notice must be included in any revised version of the
+ * source code. Additional authorship citations may be added, but existing
+ * author citations must be preserved.
+ ***************************************************************************/
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include <src/args.h>
+#include <src/strings.h>
+#include <src/acc/cpu/cpu_kernels/diff2_simd.h>
+
+using namespace CpuKernels;
+
+// Compare the scalar inner loops of the ALTCPU diff2 kernels with their AVX2 and
+// AVX-512 versions, on random 2D images of several sizes and numbers of translations.
+
+struct Problem {
+	int xdim, ydim, nr_trans;
+	std::vector<XFLOAT> cos_x, sin_x, cos_y, sin_y;  // [nr_trans][xdim] and [nr_trans][ydim]
+	std::vector<XFLOAT> ref_real, ref_imag, img_real, img_imag, corr;  // [ydim][xdim]
+	std::vector<XFLOAT> cc, ss;  // Phase of every pixel, [ydim][xdim]
+	std::vector<XFLOAT> block_refs_real, block_refs_imag;  // [nr_block_refs][xdim * ydim]
+};
+
+static const int block_size = 256, nr_block_refs = 16;
+
+static Problem makeProblem(int size, int nr_trans, std::mt19937 &rng) {
+	std::uniform_real_distribution<XFLOAT> uniform(-1.0, 1.0);
+	Problem p;
+	p.xdim = size / 2 + 1;
+	p.ydim = size;
+	p.nr_trans = nr_trans;
+	const int n = p.xdim * p.ydim;
+
+	for (int t = 0; t < nr_trans; t++) {
+		const double tx = uniform(rng) * 0.1, ty = uniform(rng) * 0.1;
+		for (int x = 0; x < p.xdim; x++) {
+			p.cos_x.push_back(cos(x * tx));
+			p.sin_x.push_back(sin(x * tx));
+		}
+		for (int y = 0; y < p.ydim; y++) {
+			p.cos_y.push_back(cos(y * ty));
+			p.sin_y.push_back(sin(y * ty));
+		}
+	}
+	for (int i = 0; i < n; i++) {
+		p.ref_real.push_back(uniform(rng));
+		p.ref_imag.push_back(uniform(rng));
+		p.img_real.push_back(uniform(rng));
+		p.img_imag.push_back(uniform(rng));
+		p.corr.push_back(uniform(rng) + 1.0);
+		const XFLOAT phase = uniform(rng) * PI;
+		p.cc.push_back(cos(phase));
+		p.ss.push_back(sin(phase));
+	}
+	for (int i = 0; i < nr_block_refs * n; i++) {
+		p.block_refs_real.push_back(uniform(rng));
+		p.block_refs_imag.push_back(uniform(rng));
+	}
+	return p;
+}
+
+// As in diff2_fine_2D: one diff2_row per row and translation
+static XFLOAT runFine(const Problem &p) {
+	XFLOAT total = 0.0;
+	for (int t = 0; t < p.nr_trans; t++)
+	for (int y = 0; y < p.ydim; y++) {
+		const size_t row = (size_t) y * p.xdim;
+		total += diff2_row(p.xdim, &p.cos_x[t * p.xdim], &p.sin_x[t * p.xdim], p.cos_y[t * p.ydim + y], p.sin_y[t * p.ydim + y],
+			&p.ref_real[row], &p.ref_imag[row], &p.img_real[row], &p.img_imag[row]);
+	}
+	return total;
+}
+
+// As in diff2_CC_coarse_2D and diff2_CC_fine_2D
+static XFLOAT runCC(const Problem &p) {
+	XFLOAT total = 0.0;
+	for (int t = 0; t < p.nr_trans; t++)
+	for (int y = 0; y < p.ydim; y++) {
+		const size_t row = (size_t) y * p.xdim;
+		total += cc_row(p.xdim, &p.cos_x[t * p.xdim], &p.sin_x[t * p.xdim], p.cos_y[t * p.ydim + y], p.sin_y[t * p.ydim + y],
+			&p.ref_real[row], &p.ref_imag[row], &p.img_real[row], &p.img_imag[row], &p.corr[row]);
+	}
+	return total;
+}
+
+// As in diff2_coarse: blocks of pixels compared with several references at once
+// (with the same pixel phases for every translation, to keep their look-up out of the timing)
+static XFLOAT runCoarse(const Problem &p) {
+	const int n = p.xdim * p.ydim;
+	std::vector<XFLOAT> diff2s (nr_block_refs, 0.0);
+	for (int t = 0; t < p.nr_trans; t++)
+	for (int start = 0; start < n; start += block_size) {
+		diff2_block(std::min(block_size, n - start), &p.cc[start], &p.ss[start],
+			&p.img_real[start], &p.img_imag[start], &p.corr[start],
+			&p.block_refs_real[start], &p.block_refs_imag[start], n, nr_block_refs, &diff2s[0]);
+	}
+	XFLOAT total = 0.0;
+	for (XFLOAT d : diff2s) total += d;
+	return total;
+}
+
+int main(int argc, char *argv[]) {
+	IOParser parser;
+
+	parser.setCommandLine(argc, argv);
+	parser.addSection("General options");
+	const std::string sizes_text = parser.getOption("--sizes", "Comma-separated image sizes (pixels)", "64,128,256,400");
+	const std::string trans_text = parser.getOption("--trans", "Comma-separated numbers of translations", "9,25,81");
+	const double min_time = textToFloat(parser.getOption("--min_time", "Run every case for at least this long (seconds)", "0.2"));
+
+	if (parser.checkForErrors()) return RELION_EXIT_FAILURE;
+
+	std::vector<std::string> sizes, trans;
+	tokenize(sizes_text, sizes, ",");
+	tokenize(trans_text, trans, ",");
+
+	typedef std::chrono::steady_clock clock;
+	typedef XFLOAT (*Kernel) (const Problem &);
+	const char *kernel_names[] = {"fine", "CC", "coarse"};
+	const Kernel kernels[] = {runFine, runCC, runCoarse};
+
+	const Diff2Isa best = diff2BestIsa();
+	std::cout << "Best instruction set on this CPU: " << diff2IsaName(best) << std::endl;
+	std::cout << "  size  trans  kernel     isa       time/pass (ms)  speed-up" << std::endl;
+
+	std::mt19937 rng (12345);
+	for (const std::string &size : sizes)
+	for (const std::string &nr_trans : trans) {
+		const Problem p = makeProblem(textToInteger(size), textToInteger(nr_trans), rng);
+
+		for (int k = 0; k < 3; k++) {
+			double scalar_time = 0.0;
+			XFLOAT scalar_result = 0.0;
+			for (int isa = DIFF2_SCALAR; isa <= best; isa++) {
+				setDiff2Isa((Diff2Isa) isa);
+
+				XFLOAT result = kernels[k](p);
+				long int passes = 0;
+				const auto t0 = clock::now();
+				double elapsed;
+				do {
+					result = kernels[k](p);
+					passes++;
+					elapsed = std::chrono::duration<double>(clock::now() - t0).count();
+				} while (elapsed < min_time);
+				const double time = elapsed / passes;
+
+				if (isa == DIFF2_SCALAR) {
+					scalar_time = time;
+					scalar_result = result;
+				}
+				printf("%6s %6s  %-9s  %-8s  %14.3f  %8.2f\n",
+					size.c_str(), nr_trans.c_str(), kernel_names[k], diff2IsaName((Diff2Isa) isa),
+					time * 1000.0, scalar_time / time);
+
+				if (std::abs(result - scalar_result) > 1e-3 * std::abs(scalar_result)) {
+					std::cerr << "ERROR: " << diff2IsaName((Diff2Isa) isa) << " and scalar results differ: "
+						<< result << " vs " << scalar_result << std::endl;
+					return RELION_EXIT_FAILURE;
+				}
+			}
+		}
+	}
+
+	setDiff2Isa(best);
+	return RELION_EXIT_SUCCESS;
+}
@@ -573,7 +573,7 @@ class reconstruct_parameters {
                 Image<RFLOAT> *weights = writeWeights ? new Image<RFLOAT> : nullptr;
                 vol() = backprojector[j]->reconstruct(
                     grid_iters, do_map, tau2,
-                    1.0, 1.0, -1, false, weights
+                    1.0, 1.0, -1, false, weights, nr_omp_threads
                 );
 
                 if (writeWeights) {
@@ -0,0 +1,114 @@
+/***************************************************************************
+ *
+ * Author: "agent"
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This complete copyright notice must be included in any revised version of the
+ * source code. Additional authorship citations may be added, but existing
+ * author citations must be preserved.
+ ***************************************************************************/
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include <src/args.h>
+#include <src/strings.h>
+#include <src/fftw.h>
+
+// Compare the Fourier transforms of a stack of random 2D images, one image at a time
+// (FourierTransformer) and in batches (BatchFourierTransformer), for several image sizes.
+
+typedef std::chrono::steady_clock Clock;
+
+// Seconds per image of run(), repeated for at least min_time
+template <typename F>
+static double timePerImage(F run, long int nr_images, double min_time) {
+    run();
+    long int passes = 0;
+    const auto t0 = Clock::now();
+    double elapsed;
+    do {
+        run();
+        passes++;
+        elapsed = std::chrono::duration<double>(Clock::now() - t0).count();
+    } while (elapsed < min_time);
+    return elapsed / (passes * nr_images);
+}
+
+int main(int argc, char *argv[]) {
+    IOParser parser;
+
+    parser.setCommandLine(argc, argv);
+    parser.addSection("General options");
+    const std::string sizes_text = parser.getOption("--sizes", "Comma-separated image sizes (pixels)", "64,128,256,400");
+    const int nr_images = textToInteger(parser.getOption("--images", "Number of images in the stack", "256"));
+    const int batch_size = textToInteger(parser.getOption("--batch", "Number of images per batch", "64"));
+    const double min_time = textToFloat(parser.getOption("--min_time", "Run every case for at least this long (seconds)", "0.5"));
+
+    if (parser.checkForErrors()) return RELION_EXIT_FAILURE;
+
+    std::vector<std::string> sizes;
+    tokenize(sizes_text, sizes, ",");
+
+    std::cout << "  size  batch  per-image (us/img)  batched (us/img)  speed-up" << std::endl;
+
+    std::mt19937 rng (12345);
+    std::normal_distribution<RFLOAT> normal (0.0, 1.0);
+    for (const std::string &size_text : sizes) {
+        const int size = textToInteger(size_text);
+
+        std::vector<MultidimArray<RFLOAT> > images (nr_images, MultidimArray<RFLOAT>(size, size));
+        for (auto &img : images)
+            for (RFLOAT &x : img) x = normal(rng);
+
+        std::vector<MultidimArray<Complex> > single (nr_images), batched (nr_images);
+
+        FourierTransformer transformer;
+        const double single_time = timePerImage([&] () {
+            for (int i = 0; i < nr_images; i++)
+                single[i] = transformer.FourierTransform(images[i]);
+        }, nr_images, min_time);
+
+        BatchFourierTransformer batch;
+        const double batch_time = timePerImage([&] () {
+            for (int first = 0; first < nr_images; first += batch_size) {
+                const int n = std::min(batch_size, nr_images - first);
+                batch.resize(n, size, size);
+                for (int j = 0; j < n; j++)
+                    batch.setReal(j, images[first + j]);
+                batch.FourierTransform();
+                for (int j = 0; j < n; j++)
+                    batch.getFourier(j, batched[first + j]);
+            }
+        }, nr_images, min_time);
+
+        printf("%6d %6d  %18.2f  %16.2f  %8.2f\n",
+            size, batch_size, single_time * 1e6, batch_time * 1e6, single_time / batch_time);
+
+        RFLOAT max_diff = 0.0, max_abs = 0.0;
+        for (int i = 0; i < nr_images; i++)
+        for (long int n = 0; n < single[i].size(); n++) {
+            max_diff = std::max(max_diff, (RFLOAT) abs(single[i][n] - batched[i][n]));
+            max_abs  = std::max(max_abs,  (RFLOAT) abs(single[i][n]));
+        }
+        if (max_diff > 1e-4 * max_abs) {
+            std::cerr << "ERROR: per-image and batched transforms differ by " << max_diff
+                << " (largest coefficient " << max_abs << ")" << std::endl;
+            return RELION_EXIT_FAILURE;
+        }
+    }
+
+    return RELION_EXIT_SUCCESS;
+}
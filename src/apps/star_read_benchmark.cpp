@@ -0,0 +1,119 @@
+/***************************************************************************
+ *
+ * Author: "agent"
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This complete copyright notice must be included in any revised version of the
+ * source code. Additional authorship citations may be added, but existing
+ * author citations must be preserved.
+ ***************************************************************************/
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <omp.h>
+
+#include <src/args.h>
+#include <src/metadata_table.h>
+
+// Compare the stream STAR reader (MetaDataTable::readStar) with the parallel
+// in-place reader (MetaDataTable::read) on synthetic particle files.
+
+static void writeParticles(const FileName &fn, long rows) {
+	FILE *f = fopen(fn.c_str(), "w");
+	if (!f) REPORT_ERROR("Cannot write " + fn);
+
+	fprintf(f, "\n# version 30001\n\ndata_particles\n\nloop_ \n");
+	const char *labels[] = {
+		"rlnImageName", "rlnMicrographName", "rlnCoordinateX", "rlnCoordinateY",
+		"rlnAngleRot", "rlnAngleTilt", "rlnAnglePsi", "rlnDefocusU", "rlnDefocusV",
+		"rlnClassNumber", "rlnGroupNumber", "rlnIsFlip", "rlnBenchmarkExtra"
+	};
+	for (int j = 0; j < 13; j++)
+		fprintf(f, "_%s #%d \n", labels[j], j + 1);
+
+	for (long i = 0; i < rows; i++) {
+		const long mic = i / 500;
+		fprintf(f,
+			"%06ld@Extract/job012/Movies/mic%05ld.mrcs Movies/mic%05ld.mrc %12.6f %12.6f "
+			"%12.6f %12.6f %12.6f %13.6f %13.6f %4ld %4ld %d extra%ld\n",
+			i % 500 + 1, mic, mic, 0.37 * (i % 4096), 0.51 * (i % 4093),
+			(i * 7 % 3600) * 0.1 - 180.0, (i * 11 % 1800) * 0.1, (i * 13 % 3600) * 0.1 - 180.0,
+			10000.0 + i % 20000, 10100.0 + i % 20000, i % 50 + 1, mic % 200 + 1, (int) (i % 2), i % 7
+		);
+	}
+	fprintf(f, "\n");
+	fclose(f);
+}
+
+static bool sameTables(const MetaDataTable &a, const MetaDataTable &b) {
+	if (a.size() != b.size() || !MetaDataTable::compareLabels(a, b)) return false;
+	for (long i = 0; i < a.size(); i++) {
+		for (EMDL::EMDLabel label : a.getActiveLabels()) {
+			if (label == EMDL::UNKNOWN_LABEL) continue;
+			if (a.getValueToString(label, i) != b.getValueToString(label, i)) return false;
+		}
+	}
+	return true;
+}
+
+int main(int argc, char *argv[]) {
+	IOParser parser;
+
+	parser.setCommandLine(argc, argv);
+	parser.addSection("General options");
+	const FileName dir = parser.getOption("--dir", "Directory for the temporary STAR files", ".");
+	const long min_rows = textToInteger(parser.getOption("--min_rows", "Smallest number of rows", "10000"));
+	const long max_rows = textToInteger(parser.getOption("--max_rows", "Largest number of rows", "10000000"));
+	const int nr_threads = textToInteger(parser.getOption("--j", "Number of threads for the parallel reader", "-1"));
+	const bool do_check = !parser.checkOption("--no_check", "Do not check that both readers give the same table");
+
+	if (parser.checkForErrors()) return RELION_EXIT_FAILURE;
+
+	if (nr_threads > 0) omp_set_num_threads(nr_threads);
+
+	typedef std::chrono::steady_clock clock;
+	const auto seconds = [] (clock::time_point t0, clock::time_point t1) {
+		return std::chrono::duration<double>(t1 - t0).count();
+	};
+
+	std::cout << "      rows   stream (s)  parallel (s)  speed-up  threads" << std::endl;
+
+	for (long rows = min_rows; rows <= max_rows; rows *= 10) {
+		const FileName fn = dir + "/star_read_benchmark_" + integerToString(rows) + ".star";
+		writeParticles(fn, rows);
+
+		MetaDataTable stream_mdt, parallel_mdt;
+
+		const auto t0 = clock::now();
+		{
+			std::ifstream in (fn.c_str(), std::ios_base::in);
+			stream_mdt.readStar(in, "particles");
+		}
+		const auto t1 = clock::now();
+		parallel_mdt.read(fn, "particles");
+		const auto t2 = clock::now();
+
+		const double t_stream = seconds(t0, t1), t_parallel = seconds(t1, t2);
+		printf("%10ld %12.3f %13.3f %9.1f %8d\n",
+			rows, t_stream, t_parallel, t_stream / t_parallel, omp_get_max_threads());
+
+		if (do_check && !sameTables(stream_mdt, parallel_mdt)) {
+			std::cerr << "ERROR: the readers disagree on " << fn << std::endl;
+			return RELION_EXIT_FAILURE;
+		}
+
+		remove(fn.c_str());
+	}
+
+	return RELION_EXIT_SUCCESS;
+}
@@ -26,6 +26,8 @@
 #include "src/multidim_array_statistics.h"
 #include "src/plot_metadata.h"
 #include <memory>  // std::unique_ptr
+#include <omp.h>
+#include <unistd.h>  // sysconf
 
 // #define DEBUG
 // #define DEBUG_HELIX
@@ -182,6 +184,8 @@ void AutoPicker::read(int argc, char **argv) {
     workFrac = textToFloat(parser.getOption("--shrink", "Reduce micrograph to this fraction size, during correlation calc (saves memory and time)", "1.0"));
     LoG_max_search = textToFloat(parser.getOption("--Log_max_search", "Maximum diameter in LoG-picking multi-scale approach is this many times the min/max diameter", "5."));
     extra_padding = textToInteger(parser.getOption("--extra_pad", "Number of pixels for additional padding of the original micrograph", "0"));
+    nr_threads = textToInteger(parser.getOption("--j", "Number of threads for template-based picking on the CPU", "1"));
+    ref_cache_memory = textToFloat(parser.getOption("--ref_cache_mem", "Maximum memory (in Gigabytes, per process) to keep the rotated references in between micrographs (0: calculate them for every micrograph; by default a quarter of the RAM, divided over the MPI processes on each host)", "-1"));
 
     // Check for errors in the command-line option
     if (parser.checkForErrors())
@@ -753,6 +757,9 @@ void AutoPicker::initialise() {
         if (verb > 0)
             progress_bar(Mrefs.size());
 
+        if (!do_gpu && !do_read_fom_maps)
+            precalculateRotatedReferences();
+
     }
     }
 
@@ -762,6 +769,42 @@ void AutoPicker::initialise() {
     #endif
 }
 
+void AutoPicker::precalculateRotatedReferences() {
+    psis.clear();
+    for (RFLOAT psi = 0.0; psi < 360.0; psi += psi_sampling)
+        psis.push_back(psi);
+
+    Frefs_rot.clear();
+    const RFLOAT required_memory = (RFLOAT) PPref.size() * psis.size() * downsize_mic * (downsize_mic / 2 + 1) * sizeof(Complex) / (1024. * 1024. * 1024.);
+    RFLOAT max_memory = ref_cache_memory;
+    if (max_memory < 0) {
+        const RFLOAT ram = (RFLOAT) sysconf(_SC_PHYS_PAGES) * sysconf(_SC_PAGE_SIZE) / (1024. * 1024. * 1024.);
+        max_memory = ram / 4 / nr_processes_on_node;
+    }
+    if (required_memory > max_memory) {
+        if (verb > 0 && ref_cache_memory != 0)
+            std::cout << " + The rotated references would take " << required_memory << " GB (more than the " << max_memory << " GB allowed by --ref_cache_mem), so they will be calculated for every micrograph." << std::endl;
+        return;
+    }
+
+    Frefs_rot.resize(PPref.size(), std::vector<MultidimArray<Complex> >(psis.size()));
+    const long int n_total = PPref.size() * psis.size();
+    #pragma omp parallel for num_threads(nr_threads) schedule(dynamic)
+    for (long int i = 0; i < n_total; i++) {
+        const int iref = i / psis.size(), ipsi = i % psis.size();
+        Frefs_rot[iref][ipsi] = PPref[iref].get2DFourierTransform(
+            downsize_mic / 2 + 1, downsize_mic, 1, Euler::angles2matrix(0.0, 0.0, psis[ipsi])
+        );
+    }
+}
+
+MultidimArray<Complex> AutoPicker::getRotatedReference(int iref, int ipsi) const {
+    if (!Frefs_rot.empty()) return Frefs_rot[iref][ipsi];
+    return PPref[iref].get2DFourierTransform(
+        downsize_mic / 2 + 1, downsize_mic, 1, Euler::angles2matrix(0.0, 0.0, psis[ipsi])
+    );
+}
+
 #ifdef CUDA
 int AutoPicker::deviceInitialise() {
     int devCount;
@@ -2728,153 +2771,141 @@ void AutoPicker::autoPickOneMicrograph(FileName &fn_mic, long int imic) {
         } else {
             {
             ifdefTIMING(TicToc tt (timer, TIMING_B3);)
-            Mccf_best = -LARGE_NUMBER;
-            bool is_first_psi = true;
-            for (RFLOAT psi = 0.0; psi < 360.0; psi += psi_sampling) {
-                // Get the Euler matrix
-                const auto A = Euler::angles2matrix(0.0, 0.0, psi);
-
-                // Now get the FT of the rotated (non-ctf-corrected) template
-                auto Faux = PPref[iref].get2DFourierTransform(downsize_mic / 2 + 1, downsize_mic, 1, A);
+            {
+            ifdefTIMING(TicToc tt (timer, TIMING_B5);)
+            // Calculate the expected ratio of probabilities for this CTF-corrected reference
+            // and the sum_ref_under_circ_mask and sum_ref2_under_circ_mask (from the reference at the first psi)
+            // Do this also if we're not recalculating the fom maps...
+            // This calculation needs to be done on an "non-shrinked" micrograph, in order to get the correct I^2 statistics
+            auto Faux = getRotatedReference(iref, 0);
+
+            // Apply the CTF on-the-fly (so same PPref can be used for many different micrographs)
+            if (do_ctf) {
+                ifdefTIMING(TicToc tt (timer, TIMING_B4);)
+                Faux *= Fctf;
+            }
 
+            Faux2 = windowFourierTransform(Faux, micrograph_size);
+            CenterFFTbySign(Faux2);
+            Maux.resize(micrograph_size, micrograph_size);
+            Maux = transformer.inverseFourierTransform(Faux2);
+            Maux.setXmippOrigin();
+            #ifdef DEBUG
+            Image<RFLOAT> ttt;
+            ttt() = Maux;
+            ttt.write("Maux.spi");
+            #endif
+            sum_ref_under_circ_mask = 0.0;
+            sum_ref2_under_circ_mask = 0.0;
+            RFLOAT suma2 = 0.0;
+            RFLOAT sumn = 1.0;
+            MultidimArray<RFLOAT> Mctfref(particle_size, particle_size);
+            Mctfref.setXmippOrigin();
+            FOR_ALL_ELEMENTS_IN_ARRAY2D(Mctfref, i, j) {
+                // only loop over smaller Mctfref, but take values from large Maux!
+                if (i * i + j * j < particle_radius2) {
+                    suma2 += Maux.elem(i, j) * Maux.elem(i, j);
+                    suma2 += 2.0 * Maux.elem(i, j) * rnd_gaus(0.0, 1.0);
+                    sum_ref_under_circ_mask  += Maux.elem(i, j);
+                    sum_ref2_under_circ_mask += Maux.elem(i, j) * Maux.elem(i, j);
+                    sumn += 1.0;
+                }
                 #ifdef DEBUG
-                std::cerr << " psi= " << psi << std::endl;
-                Faux2 = windowFourierTransform(Faux, micrograph_size);
-                CenterFFTbySign(Faux2);
-                tt().resize(micrograph_size, micrograph_size);
-                tt() = transformer.inverseFourierTransform(Faux2);
-                tt.write("Mref_rot.spi");
-
-                Faux2 = windowFourierTransform(Fmic, micrograph_size);
-                CenterFFTbySign(Faux2);
-                tt() = transformer.inverseFourierTransform(Faux2);
-                tt.write("Mmic.spi");
+                Mctfref.elem(i, j) = Maux.elem(i, j);
                 #endif
+            }
+            sum_ref_under_circ_mask  /= sumn;
+            sum_ref2_under_circ_mask /= sumn;
+            expected_Pratio = exp(suma2 / (2.0 * sumn));
+            #ifdef DEBUG
+            std::cerr << " expected_Pratio[" << iref << "]= " << expected_Pratio << std::endl;
+            tt() = Mctfref;
+            tt.write("Mctfref.spi");
+            std::cerr << "suma2 " << suma2 << " sumn " << sumn << " suma2/2sumn=" << suma2 / (2.0 * sumn) << std::endl;
+            std::cerr << " nr_pixels_under_mask= " << nr_pixels_circular_mask << " nr_pixels_under_invmask= " << nr_pixels_circular_invmask << std::endl;
+            std::cerr << "sum_ref_under_circ_mask " << sum_ref_under_circ_mask << std::endl;
+            std::cerr << "sum_ref2_under_circ_mask " << sum_ref2_under_circ_mask << std::endl;
+            std::cerr << "expected_Pratio " << expected_Pratio << std::endl;
+            #endif
+            }
 
-                // Apply the CTF on-the-fly (so same PPref can be used for many different micrographs)
-                if (do_ctf) {
-                    {
-                    ifdefTIMING(TicToc tt (timer, TIMING_B4);)
-                    Faux *= Fctf;
-                    }
-                    #ifdef DEBUG
-                    MultidimArray<RFLOAT> ttt(micrograph_size, micrograph_size);
-                    Faux2 = windowFourierTransform(Faux, micrograph_size);
-                    CenterFFTbySign(Faux2);
-                    ttt = transformer.inverseFourierTransform(Faux);
-                    ttt.setXmippOrigin();
-                    tt().resize(particle_size, particle_size);
-                    tt().setXmippOrigin();
-                    FOR_ALL_ELEMENTS_IN_ARRAY2D(tt(), i, j) {
-                        tt.elem(i, j) = ttt.elem(i, j);
+            {
+            ifdefTIMING(TicToc tt (timer, TIMING_B6);)
+            // Cross-correlate the micrograph with all in-plane rotations of the reference in parallel.
+            // Every thread keeps the best values (and their psi) of its own rotations,
+            // which are combined into Mccf_best and Mpsi_best at the end.
+            const int n_psi = psis.size();
+            const int my_nr_threads = std::max(1, std::min(nr_threads, n_psi));
+            std::vector<MultidimArray<RFLOAT> > Mccf_thread (my_nr_threads), Mpsi_thread (my_nr_threads);
+
+            #pragma omp parallel num_threads(my_nr_threads)
+            {
+                const int ithread = omp_get_thread_num();
+                MultidimArray<RFLOAT> &my_ccf_best = Mccf_thread[ithread], &my_psi_best = Mpsi_thread[ithread];
+                my_ccf_best.resize(workSize, workSize);
+                my_ccf_best = -LARGE_NUMBER;
+                my_psi_best.resize(workSize, workSize);
+                my_psi_best = 0.0;
+
+                FourierTransformer my_transformer;
+                MultidimArray<Complex> my_Faux2;
+                MultidimArray<RFLOAT> my_Maux;
+
+                #pragma omp for schedule(dynamic)
+                for (int ipsi = 0; ipsi < n_psi; ipsi++) {
+                    const RFLOAT psi = psis[ipsi];
+
+                    // Now get the FT of the rotated (non-ctf-corrected) template
+                    auto Faux = getRotatedReference(iref, ipsi);
+
+                    // Apply the CTF on-the-fly (so same PPref can be used for many different micrographs)
+                    if (do_ctf) Faux *= Fctf;
+
+                    // Now multiply template and micrograph to calculate the cross-correlation
+                    for (long int n = 0; n < Faux.size(); n++) {
+                        Faux[n] = conj(Faux[n]) * Fmic[n];
                     }
-                    tt.write("Mref_rot_ctf.spi");
-                    #endif
-                }
 
-                if (is_first_psi) {
-                    {
-                    ifdefTIMING(TicToc tt (timer, TIMING_B5);)
-                    // Calculate the expected ratio of probabilities for this CTF-corrected reference
-                    // and the sum_ref_under_circ_mask and sum_ref_under_circ_mask2
-                    // Do this also if we're not recalculating the fom maps...
-                    // This calculation needs to be done on an "non-shrinked" micrograph, in order to get the correct I^2 statistics
-                    Faux2 = windowFourierTransform(Faux, micrograph_size);
-                    CenterFFTbySign(Faux2);
-                    Maux.resize(micrograph_size, micrograph_size);
-                    Maux = transformer.inverseFourierTransform(Faux2);
-                    Maux.setXmippOrigin();
-                    #ifdef DEBUG
-                    Image<RFLOAT> ttt;
-                    ttt() = Maux;
-                    ttt.write("Maux.spi");
-                    #endif
-                    sum_ref_under_circ_mask = 0.0;
-                    sum_ref2_under_circ_mask = 0.0;
-                    RFLOAT suma2 = 0.0;
-                    RFLOAT sumn = 1.0;
-                    MultidimArray<RFLOAT> Mctfref(particle_size, particle_size);
-                    Mctfref.setXmippOrigin();
-                    FOR_ALL_ELEMENTS_IN_ARRAY2D(Mctfref, i, j) {
-                        // only loop over smaller Mctfref, but take values from large Maux!
-                        if (i * i + j * j < particle_radius2) {
-                            suma2 += Maux.elem(i, j) * Maux.elem(i, j);
-                            suma2 += 2.0 * Maux.elem(i, j) * rnd_gaus(0.0, 1.0);
-                            sum_ref_under_circ_mask  += Maux.elem(i, j);
-                            sum_ref2_under_circ_mask += Maux.elem(i, j) * Maux.elem(i, j);
-                            sumn += 1.0;
+                    // If we're not doing shrink, then Faux is bigger than Faux2!
+                    my_Faux2 = windowFourierTransform(Faux, workSize);
+                    CenterFFTbySign(my_Faux2);
+                    my_Maux = my_transformer.inverseFourierTransform(my_Faux2);
+
+                    // Calculate ratio of prabilities P(ref)/P(zero)
+                    // Keep track of the best values and their corresponding iref and psi
+
+                    // So now we already had precalculated: Mdiff2 = 1/sig*Sum(X^2) - 2/sig*Sum(X) + mu^2/sig*Sum(1)
+                    // Still to do (per reference): - 2/sig*Sum(AX) + 2*mu/sig*Sum(A) + Sum(A^2)
+                    for (long int n = 0; n < my_Maux.size(); n++) {
+                        RFLOAT diff2 = -2.0 * normfft * my_Maux[n];
+                        diff2 += 2.0 * Mmean[n] * sum_ref_under_circ_mask;
+                        if (Mstddev[n] > 1E-10) { diff2 /= Mstddev[n]; }
+                        diff2 += sum_ref2_under_circ_mask;
+                        diff2 = exp(-diff2 / 2.0); // exponentiate to reflect the Gaussian error model. sigma=1 after normalization, 0.4=1/sqrt(2pi)
+
+                        // Store fraction of (1 - probability-ratio) wrt  (1 - expected Pratio)
+                        diff2 = (diff2 - 1.0) / (expected_Pratio - 1.0);
+                        if (diff2 > my_ccf_best[n]) {
+                            my_ccf_best[n] = diff2;
+                            my_psi_best[n] = psi;
                         }
-                        #ifdef DEBUG
-                        Mctfref.elem(i, j) = Maux.elem(i, j);
-                        #endif
-                    }
-                    sum_ref_under_circ_mask  /= sumn;
-                    sum_ref2_under_circ_mask /= sumn;
-                    expected_Pratio = exp(suma2 / (2.0 * sumn));
-                    #ifdef DEBUG
-                    std::cerr << " expected_Pratio[" << iref << "]= " << expected_Pratio << std::endl;
-                    tt() = Mctfref;
-                    tt.write("Mctfref.spi");
-                    std::cerr << "suma2 " << suma2 << " sumn " << sumn << " suma2/2sumn=" << suma2 / (2.0 * sumn) << std::endl;
-                    std::cerr << " nr_pixels_under_mask= " << nr_pixels_circular_mask << " nr_pixels_under_invmask= " << nr_pixels_circular_invmask << std::endl;
-                    std::cerr << "sum_ref_under_circ_mask " << sum_ref_under_circ_mask << std::endl;
-                    std::cerr << "sum_ref2_under_circ_mask " << sum_ref2_under_circ_mask << std::endl;
-                    std::cerr << "expected_Pratio " << expected_Pratio << std::endl;
-                    #endif
-
-                    // Maux goes back to the workSize
-                    Maux.resize(workSize, workSize);
                     }
                 }
 
-                {
-                ifdefTIMING(TicToc tt (timer, TIMING_B6);)
-                // Now multiply template and micrograph to calculate the cross-correlation
-                for (long int n = 0; n < Faux.size(); n++) {
-                    Faux[n] = conj(Faux[n]) * Fmic[n];
-                }
-
-                // If we're not doing shrink, then Faux is bigger than Faux2!
-                Faux2 = windowFourierTransform(Faux, workSize);
-                CenterFFTbySign(Faux2);
-                Maux = transformer.inverseFourierTransform(Faux2);
-                #ifdef DEBUG
-                tt() = Maux * normfft;
-                tt.write("Mcc.spi");
-                #endif
-
-                // Calculate ratio of prabilities P(ref)/P(zero)
-                // Keep track of the best values and their corresponding iref and psi
-
-                // So now we already had precalculated: Mdiff2 = 1/sig*Sum(X^2) - 2/sig*Sum(X) + mu^2/sig*Sum(1)
-                // Still to do (per reference): - 2/sig*Sum(AX) + 2*mu/sig*Sum(A) + Sum(A^2)
-                for (long int n = 0; n < Maux.size(); n++) {
-                    RFLOAT diff2 = -2.0 * normfft * Maux[n];
-                    diff2 += 2.0 * Mmean[n] * sum_ref_under_circ_mask;
-                    if (Mstddev[n] > 1E-10) { diff2 /= Mstddev[n]; }
-                    diff2 += sum_ref2_under_circ_mask;
-                    diff2 = exp(-diff2 / 2.0); // exponentiate to reflect the Gaussian error model. sigma=1 after normalization, 0.4=1/sqrt(2pi)
-
-                    // Store fraction of (1 - probability-ratio) wrt  (1 - expected Pratio)
-                    diff2 = (diff2 - 1.0) / (expected_Pratio - 1.0);
-                    #ifdef DEBUG
-                    Maux[n] = diff2;
-                    #endif
-                    if (diff2 > Mccf_best[n]) {
-                        Mccf_best[n] = diff2;
-                        Mpsi_best[n] = psi;
+                // Max-reduction over the threads (on ties, the smallest psi wins, as in a serial search)
+                #pragma omp for
+                for (long int n = 0; n < Mccf_best.size(); n++) {
+                    Mccf_best[n] = -LARGE_NUMBER;
+                    Mpsi_best[n] = 0.0;
+                    for (int i = 0; i < my_nr_threads; i++) {
+                        const RFLOAT ccf = Mccf_thread[i][n], psi = Mpsi_thread[i][n];
+                        if (ccf > Mccf_best[n] || ccf == Mccf_best[n] && psi < Mpsi_best[n]) {
+                            Mccf_best[n] = ccf;
+                            Mpsi_best[n] = psi;
+                        }
                     }
                 }
-                #ifdef DEBUG
-                std::cerr << " Maux.max()= " << Maux.max() << std::endl;
-                tt() = Maux;
-                tt.write("Mccf.spi");
-                std::cerr << " Press any key to continue... "  << std::endl;
-                char c;
-                std::cin >> c;
-                #endif
-                is_first_psi = false;
-                }
+            }
             }
             }
 
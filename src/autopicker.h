@@ -147,6 +147,20 @@ class AutoPicker {
     // FTs of the reference images (either for autopicking or for feature calculation)
     std::vector<Projector> PPref;
 
+    // In-plane rotations (in degrees) at which the references are compared to the micrographs
+    std::vector<RFLOAT> psis;
+
+    // FTs of the references at every in-plane rotation (Frefs_rot[iref][ipsi]), calculated once for all micrographs
+    // (unless they would take more than ref_cache_memory Gigabytes; then they are calculated for every micrograph)
+    std::vector<std::vector<MultidimArray<Complex> > > Frefs_rot;
+    RFLOAT ref_cache_memory;  // Negative: a quarter of the RAM of the host, divided over the processes on it
+
+    // Number of processes (MPI ranks) on this host, which share its RAM
+    int nr_processes_on_node;
+
+    // Number of threads for template-based picking on the CPU
+    int nr_threads;
+
     // Use Laplacian-of-Gaussian filters instead of template-based picking
     bool do_LoG;
 
@@ -271,7 +285,8 @@ class AutoPicker {
     #endif
 
     AutoPicker(): 
-    available_memory(0), available_gpu_memory(0), requested_gpu_memory(0)
+    available_memory(0), available_gpu_memory(0), requested_gpu_memory(0),
+    nr_processes_on_node(1)
     {}
 
     // Read command line arguments
@@ -350,6 +365,12 @@ class AutoPicker {
     void autoPickLoGOneMicrograph(const FileName &fn_mic, long int imic);
     void autoPickOneMicrograph(FileName &fn_mic, long int imic);
 
+    // FT of reference iref at in-plane rotation psis[ipsi] (at downsize_mic, without the CTF)
+    MultidimArray<Complex> getRotatedReference(int iref, int ipsi) const;
+
+    // Calculate Frefs_rot (if it fits in ref_cache_memory)
+    void precalculateRotatedReferences();
+
     // Get the output coordinate filename given the micrograph filename
     FileName getOutputRootName(FileName fn_mic);
     // Uses Roseman2003 formulae to calculate stddev under the mask through FFTs
@@ -30,6 +30,9 @@ void AutoPickerMpi::read(int argc, char **argv) {
     // First read in non-parallelisation-dependent variables
     AutoPicker::read(argc, argv);
 
+    // The ranks on a host share its RAM for the rotated references
+    MPI_Comm_size(node->nodeC, &nr_processes_on_node);
+
     // Don't put any output to screen for mpi followers
     if (!node->isLeader())
         verb = 0;
@@ -24,7 +24,58 @@
  *      Author: scheres
  */
 
+#include <sys/resource.h>
 #include "src/backprojector.h"
+#include "src/fftw_plans.h"
+
+// FOR_ALL_ELEMENTS_IN_FFTW_TRANSFORM, with the slices of V divided over nr_threads threads
+#define FOR_ALL_ELEMENTS_IN_FFTW_TRANSFORM_PARALLEL(V) \
+    _Pragma("omp parallel for num_threads(nr_threads)") \
+    for (long int k = 0; k < Zsize(V); k++) \
+    for (long int j = 0, kp = Fourier::K(V, k), jp = 0; j < Ysize(V); j++, jp = Fourier::J(V, j)) \
+    for (long int i = 0, ip = 0; i < Xsize(V); i++, ip = i)
+
+namespace {
+
+    // Transform F in place on nr_threads threads, to or from the real-space map of xdim x Ysize(F) x Zsize(F) pixels
+    // that FFTW keeps in the same memory (with every row padded to 2 * Xsize(F) numbers)
+    void transformInPlace(MultidimArray<Complex> &F, long int xdim, FftwPlans::Kind kind, int nr_threads) {
+        const int n[] = {(int) Zsize(F), (int) Ysize(F), (int) xdim};
+        const int rank = Zsize(F) > 1 ? 3 : Ysize(F) > 1 ? 2 : 1;
+        RFLOAT *const p = (RFLOAT*) F.data;
+        if (kind == FftwPlans::R2C) {
+            FFTW_EXECUTE_DFT_R2C(FftwPlans::get(kind, rank, n + 3 - rank, p, p, FFTW_ESTIMATE, nr_threads), p, (FFTW_COMPLEX*) p);
+        } else {
+            FFTW_EXECUTE_DFT_C2R(FftwPlans::get(kind, rank, n + 3 - rank, p, p, FFTW_ESTIMATE, nr_threads), (FFTW_COMPLEX*) p, p);
+        }
+    }
+
+    // windowFourierTransform(F, newdim) to a smaller size, in the memory of F
+    void shrinkFourierTransform(MultidimArray<Complex> &F, long int newdim) {
+        const long int newhdim = newdim / 2 + 1;
+        const long int newzdim = Zsize(F) > 1 ? newdim : 1;
+        // Every element moves to a lower address, so the elements still to be read are never overwritten
+        for (long int k = 0; k < newzdim; k++) {
+            const long int kp = k < newhdim ? k : k - newzdim;
+            const long int kin = kp < 0 ? kp + Zsize(F) : kp;
+            for (long int j = 0; j < newdim; j++) {
+                const long int jp = j < newhdim ? j : j - newdim;
+                const long int jin = jp < 0 ? jp + Ysize(F) : jp;
+                for (long int i = 0; i < newhdim; i++)
+                    F.data[(k * newdim + j) * newhdim + i] = direct::elem(F, i, jin, kin);
+            }
+        }
+        F.setDimensions(newhdim, newdim, newzdim);
+    }
+
+    // Peak resident memory of this process, in Gb
+    double peakMemoryGb() {
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_maxrss / (1024.0 * 1024.0);  // ru_maxrss is in kb
+    }
+
+}
 
 void BackProjector::initialiseDataAndWeight(int current_size) {
     initialiseData(current_size);
@@ -1149,9 +1200,8 @@ MultidimArray<RFLOAT> BackProjector::reconstruct(
     const MultidimArray<RFLOAT> &tau2,
     RFLOAT tau2_fudge, RFLOAT normalise,
     int minres_map, bool printTimes,
-    Image<RFLOAT> *weight_out
+    Image<RFLOAT> *weight_out, int nr_threads
 ) {
-    #ifdef TIMING
     Timer ReconTimer;
     int ReconS[] = {
         ReconTimer.setNew(" RcS1_Init "),
@@ -1173,25 +1223,20 @@ MultidimArray<RFLOAT> BackProjector::reconstruct(
         ReconTimer.setNew(" RcS16_blobNorm2 "),
         ReconTimer.setNew(" RcS17_WindowReal "),
         ReconTimer.setNew(" RcS18_GriddingCorrect "),
-        ReconTimer.setNew(" RcS19_tauInit "),      // Unused
-        ReconTimer.setNew(" RcS20_tausetReal "),   // Unused
-        ReconTimer.setNew(" RcS21_tauTransform "), // Unused
-        ReconTimer.setNew(" RcS22_tautauRest "),   // Unused
-        ReconTimer.setNew(" RcS23_tauShrinkToFit "),
-        ReconTimer.setNew(" RcS24_extra "),        // Unused
+        ReconTimer.setNew(" RcS19_shrinkToFit "),
     };
-    #endif
 
-    RFLOAT oversampling_correction;
-    FourierTransformer transformer;
     const int max_r2 = round(r_max * padding_factor) * round(r_max * padding_factor);
-    /// TODO: Turn this block into an init function.
-    MultidimArray<RFLOAT> vol_out;
-    auto &Fconv = [&] () -> MultidimArray<Complex> & {
-    ifdefTIMING(TicToc tt (ReconTimer, ReconS[0]);)
-    oversampling_correction = ref_dim == 3 ?
+    const RFLOAT oversampling_correction = ref_dim == 3 ?
         padding_factor * padding_factor * padding_factor :
         padding_factor * padding_factor;
+    MultidimArray<RFLOAT> vol_out;
+
+    // Fconv is the only padded complex array: the Fourier transforms are done in its own memory
+    MultidimArray<Complex> Fconv;
+    MultidimArray<RFLOAT> Fweight;
+    {
+    TicToc tt (ReconTimer, ReconS[0]);
 
     // #define DEBUG_RECONSTRUCT
     #ifdef DEBUG_RECONSTRUCT
@@ -1200,34 +1245,32 @@ MultidimArray<RFLOAT> BackProjector::reconstruct(
     #endif
 
     // Set Fconv to the right size
-    if (ref_dim == 2) {
-        vol_out.setDimensions(pad_size, pad_size);
-    } else {
-        // Too costly to actually allocate the space
-        // Trick transformer with the right dimensions
-        vol_out.setDimensions(pad_size, pad_size, pad_size);
+    Fconv.reshape(pad_size / 2 + 1, pad_size, ref_dim == 2 ? 1 : pad_size);
+    Fweight.reshape(Fconv);
     }
 
-    transformer.setReal(vol_out);  // Fake set real. 1. Allocate space for Fconv 2. calculate plans.
-    vol_out.clear();  // Reset dimensions to 0
-    return transformer.getFourier();
-    }();
-
-    MultidimArray<RFLOAT> Fweight;
-    Fweight.reshape(Fconv);
     {
-    ifdefTIMING(TicToc tt (ReconTimer, ReconS[1]);)
+    TicToc tt (ReconTimer, ReconS[1]);
     // Go from projector-centered to FFTW-uncentered
-    Fweight = Projector::decentered(weight, max_r2, pad_size / 2 + 1, pad_size, pad_size);
+    decenter(weight, Fweight, max_r2, nr_threads);
     }
 
     {
-    ifdefTIMING(TicToc tt (ReconTimer, ReconS[2]);)
+    TicToc tt (ReconTimer, ReconS[2]);
     // Apply MAP-additional term to the Fweight array
     // This will regularise the actual reconstruction
     if (do_map) {
+        // Check the tau2-spectrum before the threads start
+        const int max_ires = max_r2 > 0 ? round(sqrt((RFLOAT) (max_r2 - 1)) / padding_factor) : -1;
+        for (int ires = 0; ires <= max_ires && ires < Xsize(tau2); ires++) {
+            if (!(direct::elem(tau2, ires) > 0.0 || direct::elem(tau2, ires) < 1e-20)) {
+                std::cerr << " tau2= " << tau2 << std::endl;
+                REPORT_ERROR("ERROR BackProjector::reconstruct: Negative or zero values encountered for tau2 spectrum!");
+            }
+        }
+
         // Then, add the inverse of tau2-spectrum values to the weight
-        FOR_ALL_ELEMENTS_IN_FFTW_TRANSFORM(Fconv) {
+        FOR_ALL_ELEMENTS_IN_FFTW_TRANSFORM_PARALLEL(Fweight) {
             int r2 = hypot2(ip, jp, kp);
             if (r2 < max_r2) {
                 int ires = round(sqrt((RFLOAT) r2) / padding_factor);
@@ -1237,12 +1280,9 @@ MultidimArray<RFLOAT> BackProjector::reconstruct(
                 if (direct::elem(tau2, ires) > 0.0) {
                     // Calculate inverse of tau2
                     invtau2 = 1.0 / (oversampling_correction * tau2_fudge * direct::elem(tau2, ires));
-                } else if (direct::elem(tau2, ires) < 1e-20) {
+                } else {
                     // If tau2 is zero, use small value instead
                     invtau2 = invw > 1e-20 ? 1.0 / (0.001 * invw) : 0.0;
-                } else {
-                    std::cerr << " tau2= " << tau2 << std::endl;
-                    REPORT_ERROR("ERROR BackProjector::reconstruct: Negative or zero values encountered for tau2 spectrum!");
                 }
 
                 // Only for (ires >= minres_map) add Wiener-filter like term
@@ -1257,8 +1297,8 @@ MultidimArray<RFLOAT> BackProjector::reconstruct(
     }
 
     if (skip_gridding) {
-        ifdefTIMING(ReconTimer.tic(ReconS[3]);)  // BUG: No toc!
-        Fconv = Projector::decentered(data, max_r2, pad_size / 2 + 1, pad_size, pad_size);
+        TicToc tt (ReconTimer, ReconS[3]);
+        decenter(data, Fconv, max_r2, nr_threads);
 
         // Prevent divisions by zero: set Fweight to at least 1/1000th of the radially averaged weight at that resolution
         // beyond r_max, set Fweight to at least 1/1000th of the radially averaged weight at r_max;
@@ -1320,32 +1360,40 @@ MultidimArray<RFLOAT> BackProjector::reconstruct(
     } else {
 
         {
-        ifdefTIMING(TicToc tt (ReconTimer, ReconS[4]);)
+        TicToc tt (ReconTimer, ReconS[4]);
         // Divide both data and Fweight by normalisation factor to prevent FFT's with very large values....
         #ifdef DEBUG_RECONSTRUCT
         std::cerr << " normalise= " << normalise << std::endl;
         #endif
-        Fweight /= normalise;
-        data /= (Complex) normalise;
+        #pragma omp parallel for num_threads(nr_threads)
+        for (long int n = 0; n < Fweight.size(); n++)
+            Fweight[n] /= normalise;
+        #pragma omp parallel for num_threads(nr_threads)
+        for (long int n = 0; n < data.size(); n++)
+            data[n] /= (Complex) normalise;
         }
 
         // Fnewweight can become too large for a float: always keep this one in double-precision
-        MultidimArray<double> Fnewweight = [&] () {
-        ifdefTIMING(TicToc tt (ReconTimer, ReconS[5]);)
+        MultidimArray<double> Fnewweight;
+        {
+        TicToc tt (ReconTimer, ReconS[5]);
         // Initialise Fnewweight with 1's and 0's. (also see comments below)
         /// XXX: But this is changing weight!?
-        FOR_ALL_ELEMENTS_IN_ARRAY3D(weight, i, j, k) {
+        #pragma omp parallel for num_threads(nr_threads)
+        for (long int k = Zinit(weight); k <= Zlast(weight); k++)
+        for (long int j = Yinit(weight); j <= Ylast(weight); j++)
+        for (long int i = Xinit(weight); i <= Xlast(weight); i++) {
             weight.elem(i, j, k) = hypot2(i, j, k) < max_r2;
         }
-        return decentered(weight, max_r2, pad_size / 2 + 1, pad_size, pad_size);
-        }();
+        Fnewweight.reshape(Fconv);
+        decenter(weight, Fnewweight, max_r2, nr_threads);
+        }
 
         // Iterative algorithm as in Eq. 14 in Pipe & Menon (1999)
         // or Eq. 4 in Matej (2001)
         for (int iter = 0; iter < max_iter_preweight; iter++) {
             // std::cout << "    iteration " << iter + 1 << "/" << max_iter_preweight << "\n";
-            {
-            ifdefTIMING(TicToc tt (ReconTimer, ReconS[6]);)
+            TicToc tt (ReconTimer, ReconS[6]);
             // Set Fnewweight * Fweight in the transformer
             // In Matej et al (2001), weights w_P^i are convoluted with the kernel,
             // and the initial w_P^0 are 1 at each sampling point
@@ -1353,19 +1401,23 @@ MultidimArray<RFLOAT> BackProjector::reconstruct(
             // but each "sampling point" counts "Fweight" times!
             // That is why Fnewweight is multiplied by Fweight prior to the convolution
 
-            Fconv = Fnewweight * Fweight;
+            #pragma omp parallel for num_threads(nr_threads)
+            for (long int n = 0; n < Fconv.size(); n++)
+                Fconv[n] = Fnewweight[n] * Fweight[n];
 
             // convolute through Fourier-transform (as both grids are rectangular)
-            // Note that convoluteRealSpace acts on the complex array inside the transformer
-            convoluteBlobRealSpace(transformer, false);
+            convoluteBlobRealSpace(Fconv, false, nr_threads);
 
-            RFLOAT w, corr_min = LARGE_NUMBER, corr_max = -LARGE_NUMBER, corr_avg = 0.0, corr_nn = 0.0;
+            RFLOAT corr_min = LARGE_NUMBER, corr_max = -LARGE_NUMBER, corr_avg = 0.0, corr_nn = 0.0;
 
-            FOR_ALL_ELEMENTS_IN_FFTW_TRANSFORM(Fconv) {
+            #pragma omp parallel for num_threads(nr_threads) reduction(min:corr_min) reduction(max:corr_max) reduction(+:corr_avg,corr_nn)
+            for (long int k = 0; k < Zsize(Fconv); k++)
+            for (long int j = 0, kp = Fourier::K(Fconv, k), jp = 0; j < Ysize(Fconv); j++, jp = Fourier::J(Fconv, j))
+            for (long int i = 0, ip = 0; i < Xsize(Fconv); i++, ip = i) {
                 if (hypot2(ip, jp, kp) < max_r2) {
 
                     // Make sure no division by zero can occur....
-                    w = std::max(1e-6, abs(direct::elem(Fconv, i, j, k)));
+                    RFLOAT w = std::max(1e-6, abs(direct::elem(Fconv, i, j, k)));
                     // Monitor min, max and avg conv_weight
                     corr_min = std::min(corr_min, w);
                     corr_max = std::max(corr_max, w);
@@ -1376,8 +1428,6 @@ MultidimArray<RFLOAT> BackProjector::reconstruct(
                 }
             }
 
-            }
-
             #ifdef DEBUG_RECONSTRUCT
             std::cerr << " PREWEIGHTING ITERATION: " << iter + 1 << " OF " << max_iter_preweight << std::endl;
             // report of maximum and minimum values of current conv_weight
@@ -1388,7 +1438,7 @@ MultidimArray<RFLOAT> BackProjector::reconstruct(
         }
 
         {
-        ifdefTIMING(TicToc tt (ReconTimer, ReconS[7]);)
+        TicToc tt (ReconTimer, ReconS[7]);
 
         #ifdef DEBUG_RECONSTRUCT
         Image<double> img (Fnewweight);
@@ -1399,14 +1449,15 @@ MultidimArray<RFLOAT> BackProjector::reconstruct(
         img.write("reconstruct_gridding_correction_term.spi");
         #endif
 
-        // Clear memory
-        Fweight.clear();
+        // Clear memory (unless the weights are wanted)
+        if (!weight_out) Fweight.clear();
 
         // Note that Fnewweight now holds the approximation of the inverse of the weights on a regular grid
 
         // Now do the actual reconstruction with the data array
         // Apply the iteratively determined weight
-        Fconv = Projector::decentered(data, max_r2, pad_size / 2 + 1, pad_size, pad_size);
+        decenter(data, Fconv, max_r2, nr_threads);
+        #pragma omp parallel for num_threads(nr_threads)
         for (long int n = 0; n < Fconv.size(); n++) {
             #ifdef RELION_SINGLE_PRECISION
             // Prevent numerical instabilities in single-precision reconstruction with very unevenly sampled orientations
@@ -1431,12 +1482,12 @@ MultidimArray<RFLOAT> BackProjector::reconstruct(
     // Apply the same blob-convolution as above to the data array
     // Mask real-space map beyond its original size to prevent aliasing in the downsampling step below
     {
-    ifdefTIMING(TicToc tt (ReconTimer, ReconS[8]);)
-    convoluteBlobRealSpace(transformer, true);
+    TicToc tt (ReconTimer, ReconS[8]);
+    convoluteBlobRealSpace(Fconv, true, nr_threads);
     }
 
     {
-    ifdefTIMING(TicToc tt (ReconTimer, ReconS[9]);)
+    TicToc tt (ReconTimer, ReconS[9]);
     // Now just pick every 3rd pixel in Fourier-space (i.e. down-sample)
     // and do a final inverse FT
     if (ref_dim == 2) {
@@ -1446,54 +1497,54 @@ MultidimArray<RFLOAT> BackProjector::reconstruct(
     }
     }
 
-    auto Ftmp = [&] () -> MultidimArray<Complex> {
-    ifdefTIMING(TicToc tt (ReconTimer, ReconS[10]);)
-    FourierTransformer transformer;  // Different transformer from outer scope, to preserve Fconv.
-    transformer.setReal(vol_out);
-    return transformer.getFourier();  // std::move?
+    FourierTransformer transformer2;
+    auto &Ftmp = [&] () -> MultidimArray<Complex> & {
+    TicToc tt (ReconTimer, ReconS[10]);
+    transformer2.setReal(vol_out);
+    return transformer2.getFourier();
     }();
 
     {
-    ifdefTIMING(TicToc tt (ReconTimer, ReconS[11]);)
+    TicToc tt (ReconTimer, ReconS[11]);
     FOR_ALL_ELEMENTS_IN_FFTW_TRANSFORM(Ftmp) {
         direct::elem(Ftmp, i, j, k) = hypot2(ip, jp, kp) < r_max * r_max ?
             FFTW::elem(Fconv, ip * padding_factor, jp * padding_factor, kp * padding_factor) :
-            0.0;
+            Complex(0.0);
         }
     }
 
     // Any particular reason why 13 comes before 12?
 
     {
-    ifdefTIMING(TicToc tt (ReconTimer, ReconS[13]);)
+    TicToc tt (ReconTimer, ReconS[13]);
     CenterFFTbySign(Ftmp);
     }
 
     {
-    ifdefTIMING(TicToc tt (ReconTimer, ReconS[12]);)
+    TicToc tt (ReconTimer, ReconS[12]);
     // inverse FFT leaves result in vol_out
     transformer2.inverseFourierTransform();
     }
 
     {
-    ifdefTIMING(TicToc tt (ReconTimer, ReconS[14]);)
+    TicToc tt (ReconTimer, ReconS[14]);
     // Un-normalize FFTW (because original FFTs were done with the size of 2D FFTs)
     if (ref_dim == 3) { vol_out /= ori_size; }
     }
 
     {
-    ifdefTIMING(TicToc tt (ReconTimer, ReconS[15]);)
+    TicToc tt (ReconTimer, ReconS[15]);
     // Mask out corners to prevent aliasing artefacts
     softMaskOutsideMap(vol_out);
     }
 
     {
-    ifdefTIMING(TicToc tt (ReconTimer, ReconS[16]);)
+    TicToc tt (ReconTimer, ReconS[16]);
     // Gridding correction for the blob
     RFLOAT normftblob = tab_ftblob(0.0);
     FOR_ALL_ELEMENTS_IN_ARRAY3D(vol_out, i, j, k) {
 
-        RFLOAT r = hypot(i, j, k);
+        RFLOAT r = hypot((double) i, j, k);
         RFLOAT rval = r / (ori_size * padding_factor);
         vol_out.elem(i, j, k) /= tab_ftblob(rval) / normftblob;
         // if (k == 0 && i == 0)
@@ -1513,11 +1564,9 @@ MultidimArray<RFLOAT> BackProjector::reconstruct(
     //}
 
     // Now do inverse FFT and window to original size in real-space
-    // Pass the transformer to prevent making and clearing a new one before clearing the one declared above....
-    // The latter may give memory problems as detected by electric fence....
     {
-    ifdefTIMING(TicToc tt (ReconTimer, ReconS[17]);)
-    windowToOridimRealSpace(transformer, vol_out, printTimes);
+    TicToc tt (ReconTimer, ReconS[17]);
+    windowToOridimRealSpace(Fconv, vol_out, nr_threads, printTimes);
     }
 
     #endif
@@ -1528,21 +1577,21 @@ MultidimArray<RFLOAT> BackProjector::reconstruct(
 
     // Correct for the linear/nearest-neighbour interpolation that led to the data array
     {
-    ifdefTIMING(TicToc tt (ReconTimer, ReconS[18]);)
-    griddingCorrect(vol_out);
+    TicToc tt (ReconTimer, ReconS[18]);
+    griddingCorrect(vol_out, nr_threads);
     }
 
     {
-    ifdefTIMING(TicToc tt (ReconTimer, ReconS[23]);)
-    // Completely empty the transformer object
-    transformer.cleanup();
+    TicToc tt (ReconTimer, ReconS[19]);
     // Now can use extra mem to move data into smaller array space
+    Fconv.clear();
     vol_out.shrinkToFit();
     }
 
-    #ifdef TIMING
-    if (printTimes) ReconTimer.printTimes(true);
-    #endif
+    if (printTimes) {
+        ReconTimer.printTimes(true);
+        std::cout << " Peak memory use (this process): " << peakMemoryGb() << " Gb" << std::endl;
+    }
 
     #ifdef DEBUG_RECONSTRUCT
     std::cerr << "done with reconstruct" << std::endl;
@@ -1765,148 +1814,155 @@ void BackProjector::applyPointGroupSymmetry(int threads) {
     std::cerr << " SL.true_symNo= " << SL.true_symNo << std::endl;
     #endif
 
-    int rmax2 = round(r_max * padding_factor) * round(r_max * padding_factor);
-    if (SL.SymsNo() > 0 && ref_dim == 3) {
-        Matrix<RFLOAT> L(4, 4), R(4, 4);  // A matrix from the list
-        // First symmetry operator (not stored in SL) is the identity matrix
-        MultidimArray<RFLOAT>  sum_weight = weight;
-        MultidimArray<Complex> sum_data   = data;
-
-        // Loop over all other symmetry operators
-        for (int isym = 0; isym < SL.SymsNo(); isym++) {
-            SL.get_matrices(isym, L, R);
-            #ifdef DEBUG_SYMM
-            std::cerr << " isym= " << isym << " R= " << R << std::endl;
-            #endif
-            // Loop over all points in the output (i.e. rotated, or summed) array
+    const int rmax2 = round(r_max * padding_factor) * round(r_max * padding_factor);
+    if (SL.SymsNo() <= 0 || ref_dim != 3) return;
+
+    // All symmetry operators but the first one, the identity matrix (not stored in SL)
+    std::vector<Matrix<RFLOAT>> Rs;
+    Rs.reserve(SL.SymsNo());
+    Matrix<RFLOAT> L(4, 4), R(4, 4);  // A matrix from the list
+    for (int isym = 0; isym < SL.SymsNo(); isym++) {
+        SL.get_matrices(isym, L, R);
+        #ifdef DEBUG_SYMM
+        std::cerr << " isym= " << isym << " R= " << R << std::endl;
+        #endif
+        Rs.push_back(R);
+    }
 
-            #pragma omp parallel for num_threads(threads)
-            for (long int k = Zinit(sum_weight); k <= Zlast(sum_weight); k++)
-            for (long int i = Yinit(sum_weight); i <= Ylast(sum_weight); i++)
-            for (long int j = Xinit(sum_weight); j <= Xlast(sum_weight); j++) {
-                RFLOAT x = j;  // Xinit(sum_weight) is zero!
-                RFLOAT y = i;
-                RFLOAT z = k;
-                RFLOAT r2 = hypot2(x, y, z);
+    MultidimArray<RFLOAT>  sum_weight = weight;
+    MultidimArray<Complex> sum_data   = data;
 
-                if (r2 <= rmax2) {
-                    // coords_output(x,y) = A * coords_input (xp,yp)
-                    RFLOAT xp = x * R(0, 0) + y * R(0, 1) + z * R(0, 2);
-                    RFLOAT yp = x * R(1, 0) + y * R(1, 1) + z * R(1, 2);
-                    RFLOAT zp = x * R(2, 0) + y * R(2, 1) + z * R(2, 2);
+    // A single pass over the output (i.e. rotated, or summed) arrays, in which every point gathers from all of its symmetry mates,
+    // instead of one pass over the whole arrays for every operator.
+    // The operators are added in the same order as before, so the sums do not change.
+    #pragma omp parallel for num_threads(threads)
+    for (long int k = Zinit(sum_weight); k <= Zlast(sum_weight); k++)
+    for (long int i = Yinit(sum_weight); i <= Ylast(sum_weight); i++) {
+        const RFLOAT y = i;
+        const RFLOAT z = k;
+        if (y * y + z * z > rmax2) continue;
+
+        for (long int j = Xinit(sum_weight); j <= Xlast(sum_weight); j++) {
+            const RFLOAT x = j;  // Xinit(sum_weight) is zero!
+            if (hypot2(x, y, z) > rmax2) continue;
+
+            Complex &sum_d = sum_data  .elem(j, i, k);
+            RFLOAT  &sum_w = sum_weight.elem(j, i, k);
+
+            for (const Matrix<RFLOAT> &R : Rs) {
+                // coords_output(x,y) = A * coords_input (xp,yp)
+                RFLOAT xp = x * R(0, 0) + y * R(0, 1) + z * R(0, 2);
+                RFLOAT yp = x * R(1, 0) + y * R(1, 1) + z * R(1, 2);
+                RFLOAT zp = x * R(2, 0) + y * R(2, 1) + z * R(2, 2);
 
-                    const bool is_neg_x = xp < 0;
+                const bool is_neg_x = xp < 0;
 
-                    // Only asymmetric half is stored
-                    if (is_neg_x) {
-                        // Get complex conjugated hermitian symmetry pair
-                        xp = -xp;
-                        yp = -yp;
-                        zp = -zp;
-                    }
+                // Only asymmetric half is stored
+                if (is_neg_x) {
+                    // Get complex conjugated hermitian symmetry pair
+                    xp = -xp;
+                    yp = -yp;
+                    zp = -zp;
+                }
 
-                    // Trilinear interpolation (with physical coords)
-                    // Subtract Yinit and Zinit to accelerate access to data (Xinit=0)
-                    // In that way use direct::elem, rather than elem
-                    int x0 = floor(xp);
-                    RFLOAT fx = xp - x0;
-                    // x0 -= Xinit(data);
-                    int x1 = x0 + 1;
+                // Trilinear interpolation (with physical coords)
+                // Subtract Yinit and Zinit to accelerate access to data (Xinit=0)
+                // In that way use direct::elem, rather than elem
+                int x0 = floor(xp);
+                RFLOAT fx = xp - x0;
+                // x0 -= Xinit(data);
+                int x1 = x0 + 1;
 
-                    int y0 = floor(yp);
-                    RFLOAT fy = yp - y0;
-                    y0 -= Yinit(data);
-                    int y1 = y0 + 1;
+                int y0 = floor(yp);
+                RFLOAT fy = yp - y0;
+                y0 -= Yinit(data);
+                int y1 = y0 + 1;
 
-                    int z0 = floor(zp);
-                    RFLOAT fz = zp - z0;
-                    z0 -= Zinit(data);
-                    int z1 = z0 + 1;
-
-                    #ifdef CHECK_SIZE
-                    if (
-                        x0 < 0 || y0 < 0 || z0 < 0 ||
-                        x1 < 0 || y1 < 0 || z1 < 0 ||
-                        x0 >= Xsize(data) || y0  >= Ysize(data) || z0 >= Zsize(data) ||
-                        x1 >= Xsize(data) || y1  >= Ysize(data) || z1 >= Zsize(data)
-                    ) {
-                        std::cerr << " x0= " << x0 << " y0= " << y0 << " z0= " << z0 << std::endl;
-                        std::cerr << " x1= " << x1 << " y1= " << y1 << " z1= " << z1 << std::endl;
-                        data.printShape();
-                        REPORT_ERROR("BackProjector::applyPointGroupSymmetry: checksize!!!");
-                    }
-                    #endif
-                    // First interpolate (complex) data
-                    Complex d000 = direct::elem(data, x0, y0, z0);
-                    Complex d001 = direct::elem(data, x1, y0, z0);
-                    Complex d010 = direct::elem(data, x0, y1, z0);
-                    Complex d011 = direct::elem(data, x1, y1, z0);
-                    Complex d100 = direct::elem(data, x0, y0, z1);
-                    Complex d101 = direct::elem(data, x1, y0, z1);
-                    Complex d110 = direct::elem(data, x0, y1, z1);
-                    Complex d111 = direct::elem(data, x1, y1, z1);
-
-                    Complex dx00 = LIN_INTERP(fx, d000, d001);
-                    Complex dx01 = LIN_INTERP(fx, d100, d101);
-                    Complex dx10 = LIN_INTERP(fx, d010, d011);
-                    Complex dx11 = LIN_INTERP(fx, d110, d111);
-
-                    Complex dxy0 = LIN_INTERP(fy, dx00, dx10);
-                    Complex dxy1 = LIN_INTERP(fy, dx01, dx11);
-
-                    // Take complex conjugated for half with negative x
-                    sum_data.elem(i, j, k) += is_neg_x ?
-                        conj(LIN_INTERP(fz, dxy0, dxy1)) : LIN_INTERP(fz, dxy0, dxy1);
-
-                    // Then interpolate (real) weight
-                    RFLOAT dd000 = direct::elem(weight, x0, y0, z0);
-                    RFLOAT dd001 = direct::elem(weight, x1, y0, z0);
-                    RFLOAT dd010 = direct::elem(weight, x0, y1, z0);
-                    RFLOAT dd011 = direct::elem(weight, x1, y1, z0);
-                    RFLOAT dd100 = direct::elem(weight, x0, y0, z1);
-                    RFLOAT dd101 = direct::elem(weight, x1, y0, z1);
-                    RFLOAT dd110 = direct::elem(weight, x0, y1, z1);
-                    RFLOAT dd111 = direct::elem(weight, x1, y1, z1);
-
-                    RFLOAT ddx00 = LIN_INTERP(fx, dd000, dd001);
-                    RFLOAT ddx01 = LIN_INTERP(fx, dd100, dd101);
-                    RFLOAT ddx10 = LIN_INTERP(fx, dd010, dd011);
-                    RFLOAT ddx11 = LIN_INTERP(fx, dd110, dd111);
-
-                    RFLOAT ddxy0 = LIN_INTERP(fy, ddx00, ddx10);
-                    RFLOAT ddxy1 = LIN_INTERP(fy, ddx01, ddx11);
-
-                    sum_weight.elem(i, j, k) += LIN_INTERP(fz, ddxy0, ddxy1);
+                int z0 = floor(zp);
+                RFLOAT fz = zp - z0;
+                z0 -= Zinit(data);
+                int z1 = z0 + 1;
 
+                #ifdef CHECK_SIZE
+                if (
+                    x0 < 0 || y0 < 0 || z0 < 0 ||
+                    x1 < 0 || y1 < 0 || z1 < 0 ||
+                    x0 >= Xsize(data) || y0  >= Ysize(data) || z0 >= Zsize(data) ||
+                    x1 >= Xsize(data) || y1  >= Ysize(data) || z1 >= Zsize(data)
+                ) {
+                    std::cerr << " x0= " << x0 << " y0= " << y0 << " z0= " << z0 << std::endl;
+                    std::cerr << " x1= " << x1 << " y1= " << y1 << " z1= " << z1 << std::endl;
+                    data.printShape();
+                    REPORT_ERROR("BackProjector::applyPointGroupSymmetry: checksize!!!");
                 }
+                #endif
+                // First interpolate (complex) data
+                Complex d000 = direct::elem(data, x0, y0, z0);
+                Complex d001 = direct::elem(data, x1, y0, z0);
+                Complex d010 = direct::elem(data, x0, y1, z0);
+                Complex d011 = direct::elem(data, x1, y1, z0);
+                Complex d100 = direct::elem(data, x0, y0, z1);
+                Complex d101 = direct::elem(data, x1, y0, z1);
+                Complex d110 = direct::elem(data, x0, y1, z1);
+                Complex d111 = direct::elem(data, x1, y1, z1);
+
+                Complex dx00 = LIN_INTERP(fx, d000, d001);
+                Complex dx01 = LIN_INTERP(fx, d100, d101);
+                Complex dx10 = LIN_INTERP(fx, d010, d011);
+                Complex dx11 = LIN_INTERP(fx, d110, d111);
+
+                Complex dxy0 = LIN_INTERP(fy, dx00, dx10);
+                Complex dxy1 = LIN_INTERP(fy, dx01, dx11);
+
+                // Take complex conjugated for half with negative x
+                sum_d += is_neg_x ?
+                    conj(LIN_INTERP(fz, dxy0, dxy1)) : LIN_INTERP(fz, dxy0, dxy1);
+
+                // Then interpolate (real) weight
+                RFLOAT dd000 = direct::elem(weight, x0, y0, z0);
+                RFLOAT dd001 = direct::elem(weight, x1, y0, z0);
+                RFLOAT dd010 = direct::elem(weight, x0, y1, z0);
+                RFLOAT dd011 = direct::elem(weight, x1, y1, z0);
+                RFLOAT dd100 = direct::elem(weight, x0, y0, z1);
+                RFLOAT dd101 = direct::elem(weight, x1, y0, z1);
+                RFLOAT dd110 = direct::elem(weight, x0, y1, z1);
+                RFLOAT dd111 = direct::elem(weight, x1, y1, z1);
+
+                RFLOAT ddx00 = LIN_INTERP(fx, dd000, dd001);
+                RFLOAT ddx01 = LIN_INTERP(fx, dd100, dd101);
+                RFLOAT ddx10 = LIN_INTERP(fx, dd010, dd011);
+                RFLOAT ddx11 = LIN_INTERP(fx, dd110, dd111);
+
+                RFLOAT ddxy0 = LIN_INTERP(fy, ddx00, ddx10);
+                RFLOAT ddxy1 = LIN_INTERP(fy, ddx01, ddx11);
+
+                sum_w += LIN_INTERP(fz, ddxy0, ddxy1);
             }
         }
+    }
 
-        data   = sum_data;
-        weight = sum_weight;
-        // Average
-        // The division should only be done if we would search all (C1) directions, not if we restrict the angular search!
-        /*
-        for (long int n = 0; n < data.size(); n++) {
-            data[n] = sum_data[n] / (RFLOAT)(SL.SymsNo() + 1);
-            weight[n] = sum_weight[n] / (RFLOAT)(SL.SymsNo() + 1);
-        }
-        */
+    data   = std::move(sum_data);
+    weight = std::move(sum_weight);
+    // Average
+    // The division should only be done if we would search all (C1) directions, not if we restrict the angular search!
+    /*
+    for (long int n = 0; n < data.size(); n++) {
+        data[n] = sum_data[n] / (RFLOAT)(SL.SymsNo() + 1);
+        weight[n] = sum_weight[n] / (RFLOAT)(SL.SymsNo() + 1);
     }
+    */
 }
 
-void BackProjector::convoluteBlobRealSpace(FourierTransformer &transformer, bool do_mask) {
+void BackProjector::convoluteBlobRealSpace(MultidimArray<Complex> &Fconv, bool do_mask, int nr_threads) {
 
-    // Set up right dimension of real-space array
+    // inverse FFT, into the same memory
     // TODO: resize this according to r_max!!!
-    MultidimArray<RFLOAT> Mconv (pad_size, pad_size, ref_dim == 2 ? 1 : pad_size);
-
-    // inverse FFT
-    transformer.setReal(Mconv);
-    transformer.inverseFourierTransform();
+    transformInPlace(Fconv, pad_size, FftwPlans::C2R, nr_threads);
+    RFLOAT *const Mconv = (RFLOAT*) Fconv.data;
+    const long int row = 2 * Xsize(Fconv);  // Padded length of the real-space rows
 
     // Blob normalisation in Fourier space
-    RFLOAT normftblob = tab_ftblob(0.0);
+    const RFLOAT normftblob = tab_ftblob(0.0);
 
     // TMP DEBUGGING
     //struct blobtype blob;
@@ -1916,86 +1972,77 @@ void BackProjector::convoluteBlobRealSpace(FourierTransformer &transformer, bool
 
     // Multiply with FT of the blob kernel
     const int padhdim = pad_size / 2;
-    for (long int k = 0; k < Zsize(Mconv); k++)
-    for (long int j = 0; j < Ysize(Mconv); j++)
-    for (long int i = 0; i < Xsize(Mconv); i++) {
-        int kp = k < padhdim ? k : k - pad_size;
-        int jp = j < padhdim ? j : j - pad_size;
-        int ip = i < padhdim ? i : i - pad_size;
-        RFLOAT rval = hypot((double) ip, jp, kp) / (ori_size * padding_factor);
-        //if (kp==0 && ip==0 && jp > 0)
-        //	std::cerr << " jp= " << jp << " rval= " << rval << " tab_ftblob(rval) / normftblob= " << tab_ftblob(rval) / normftblob << " ori_size/2= " << ori_size/2 << std::endl;
-        // In the final reconstruction: mask the real-space map beyond its original size to prevent aliasing ghosts
-        // Note that rval goes until 1/2 in the oversampled map
-        if (do_mask && 2.0 * padding_factor * rval > 1.0) {
-            direct::elem(Mconv, i, j, k) = 0.0;
-        } else {
-            direct::elem(Mconv, i, j, k) *= tab_ftblob(rval) / normftblob;
+    #pragma omp parallel for collapse(2) num_threads(nr_threads)
+    for (long int k = 0; k < Zsize(Fconv); k++)
+    for (long int j = 0; j < Ysize(Fconv); j++) {
+        RFLOAT *const Mrow = Mconv + (k * Ysize(Fconv) + j) * row;
+        for (long int i = 0; i < pad_size; i++) {
+            int kp = k < padhdim ? k : k - pad_size;
+            int jp = j < padhdim ? j : j - pad_size;
+            int ip = i < padhdim ? i : i - pad_size;
+            RFLOAT rval = hypot((double) ip, jp, kp) / (ori_size * padding_factor);
+            //if (kp==0 && ip==0 && jp > 0)
+            //	std::cerr << " jp= " << jp << " rval= " << rval << " tab_ftblob(rval) / normftblob= " << tab_ftblob(rval) / normftblob << " ori_size/2= " << ori_size/2 << std::endl;
+            // In the final reconstruction: mask the real-space map beyond its original size to prevent aliasing ghosts
+            // Note that rval goes until 1/2 in the oversampled map
+            if (do_mask && 2.0 * padding_factor * rval > 1.0) {
+                Mrow[i] = 0.0;
+            } else {
+                Mrow[i] *= tab_ftblob(rval) / normftblob;
+            }
         }
     }
 
-    // forward FFT to go back to Fourier-space
-    transformer.FourierTransform();
+    // forward FFT to go back to Fourier-space (normalised, as by FourierTransformer)
+    transformInPlace(Fconv, pad_size, FftwPlans::R2C, nr_threads);
+    const RFLOAT npix = (RFLOAT) pad_size * pad_size * Zsize(Fconv);
+    #pragma omp parallel for num_threads(nr_threads)
+    for (long int n = 0; n < Fconv.size(); n++)
+        Fconv[n] /= npix;
 }
 
 void BackProjector::windowToOridimRealSpace(
-    FourierTransformer &transformer, MultidimArray<RFLOAT> &Mout, bool printTimes
+    MultidimArray<Complex> &Fin, MultidimArray<RFLOAT> &Mout, int nr_threads, bool printTimes
 ) {
 
     #ifdef TIMING
-    /// FIXME: These are out of order
     Timer OriDimTimer;
-    int OrD1_getFourier = OriDimTimer.setNew(" OrD1_getFourier ");
-    int OrD2_windowFFT  = OriDimTimer.setNew(" OrD2_windowFFT ");
-    int OrD3_reshape    = OriDimTimer.setNew(" OrD3_reshape ");
-    int OrD4_setReal    = OriDimTimer.setNew(" OrD4_setReal ");
-    int OrD5_invFFT     = OriDimTimer.setNew(" OrD5_invFFT ");
-    int OrD6_centerFFT  = OriDimTimer.setNew(" OrD6_centerFFT ");
-    int OrD7_window     = OriDimTimer.setNew(" OrD7_window ");
-    int OrD8_norm       = OriDimTimer.setNew(" OrD8_norm ");
-    int OrD9_softMask   = OriDimTimer.setNew(" OrD9_softMask ");
+    int OrD1_windowFFT  = OriDimTimer.setNew(" OrD1_windowFFT ");
+    int OrD2_centerFFT  = OriDimTimer.setNew(" OrD2_centerFFT ");
+    int OrD3_invFFT     = OriDimTimer.setNew(" OrD3_invFFT ");
+    int OrD4_window     = OriDimTimer.setNew(" OrD4_window+norm ");
+    int OrD5_softMask   = OriDimTimer.setNew(" OrD5_softMask ");
     #endif
 
-    auto &Fin = [&] () -> MultidimArray<Complex> & {
-        ifdefTIMING(TicToc tt (OriDimTimer, OrD1_getFourier);)
-        // Why are we timing this? It's just a member access.
-        return transformer.getFourier();
-    }();
-
-    int padoridim;  // Size of padded real-space volume
-    {
-    ifdefTIMING(TicToc tt (OriDimTimer, OrD2_windowFFT);)
-    padoridim = round(padding_factor * ori_size);
+    // Size of padded real-space volume
+    int padoridim = round(padding_factor * ori_size);
     // Enforce divisibility by 2
     padoridim += padoridim % 2;
 
+    {
+    ifdefTIMING(TicToc tt (OriDimTimer, OrD1_windowFFT);)
+
     // #define DEBUG_WINDOWORIDIMREALSPACE
     #ifdef DEBUG_WINDOWORIDIMREALSPACE
     MultidimArray<RFLOAT> tmp (Xsize(Fin), Ysize(Fin), Zsize(Fin));
     for (long int n = 0; n < Fin.size(); n++) {
-        tmp()[n] = abs(Fin[n]);
+        tmp[n] = abs(Fin[n]);
     }
     Image<RFLOAT>(tmp).write("windoworidim_Fin.spi");
     #endif
 
     // Resize incoming complex array to the correct size
-    windowFourierTransform(Fin, padoridim);
+    // (in its own memory, unless it has to grow)
+    if (padoridim / 2 + 1 <= Xsize(Fin) && padoridim <= Ysize(Fin)) {
+        shrinkFourierTransform(Fin, padoridim);
+    } else {
+        Fin = windowFourierTransform(Fin, padoridim);
+    }
     }
 
-    const RFLOAT normfft = [&] () {
-        ifdefTIMING(TicToc tt (OriDimTimer, OrD3_reshape);)
-        if (ref_dim == 2) {
-            Mout.reshape(padoridim, padoridim);
-            Mout.setXmippOrigin();
-            return padding_factor * padding_factor
-                * (data_dim == 2 ? 1 : ori_size);
-        } else {
-            Mout.reshape(padoridim, padoridim, padoridim);
-            Mout.setXmippOrigin();
-            return padding_factor * padding_factor * padding_factor
-                * (data_dim == 3 ? 1 : ori_size);
-        }
-    }();
+    const RFLOAT normfft = ref_dim == 2 ?
+        padding_factor * padding_factor * (data_dim == 2 ? 1 : ori_size) :
+        padding_factor * padding_factor * padding_factor * (data_dim == 3 ? 1 : ori_size);
 
     #ifdef DEBUG_WINDOWORIDIMREALSPACE
     tmp.reshape(Xsize(Fin), Ysize(Fin), Zsize(Fin));
@@ -2007,49 +2054,40 @@ void BackProjector::windowToOridimRealSpace(
 
     // Shift the map back to its origin
     {
-    ifdefTIMING(TicToc tt (OriDimTimer, OrD6_centerFFT);)
+    ifdefTIMING(TicToc tt (OriDimTimer, OrD2_centerFFT);)
     CenterFFTbySign(Fin);
     }
 
+    // Do the inverse FFT, into the same memory
     {
-    ifdefTIMING(TicToc tt (OriDimTimer, OrD4_setReal);)
-    transformer.setReal(Mout);
-    }
-
-    // Do the inverse FFT
-    {
-    ifdefTIMING(TicToc tt (OriDimTimer, OrD5_invFFT);)
+    ifdefTIMING(TicToc tt (OriDimTimer, OrD3_invFFT);)
     #ifdef TIMING
     if (printTimes)
-        std::cout << std::endl << "FFTrealDims = (" << transformer.fReal->xdim << " , " << transformer.fReal->ydim << " , " << transformer.fReal->zdim << " ) " << std::endl;
+        std::cout << std::endl << "FFTrealDims = (" << padoridim << " , " << Ysize(Fin) << " , " << Zsize(Fin) << " ) " << std::endl;
     #endif
-    transformer.inverseFourierTransform();
+    transformInPlace(Fin, padoridim, FftwPlans::C2R, nr_threads);
     }
 
-    // Mout = transformer.inverseFourierTransform(Fin);
-
-    Fin.clear();
-    transformer.fReal = nullptr;  // Make sure to re-calculate fftw plan
-    Mout.setXmippOrigin();
-
-    #ifdef DEBUG_WINDOWORIDIMREALSPACE
-    Image<RFLOAT>(Mout).write("windoworidim_Munwindowed.spi");
-    #endif
-
     // Window in real-space
-    {
-    ifdefTIMING(TicToc tt (OriDimTimer, OrD7_window);)
-    const long int init = Xmipp::init(ori_size), last = Xmipp::last(ori_size);
-    Mout = (ref_dim == 2 ?
-        Mout.windowed(init, init, last, last) :
-        Mout.windowed(init, init, init, last, last, last)).setXmippOrigin();
-    }
-
     // Normalisation factor of FFTW
     // The Fourier Transforms are all "normalised" for 2D transforms of size = ori_size * ori_size
     {
-    ifdefTIMING(TicToc tt (OriDimTimer, OrD8_norm);)
-    Mout /= normfft;
+    ifdefTIMING(TicToc tt (OriDimTimer, OrD4_window);)
+    const RFLOAT *const Mpad = (RFLOAT*) Fin.data;
+    const long int row = 2 * Xsize(Fin);  // Padded length of the real-space rows
+    // Offset of the window in the padded map (both have their origins at the centre)
+    const long int offset = padoridim / 2 + Xmipp::init(ori_size);
+    const long int zoffset = ref_dim == 2 ? 0 : offset;
+    Mout.reshape(ori_size, ori_size, ref_dim == 2 ? 1 : ori_size);
+    Mout.setXmippOrigin();
+    #pragma omp parallel for collapse(2) num_threads(nr_threads)
+    for (long int k = 0; k < Zsize(Mout); k++)
+    for (long int j = 0; j < Ysize(Mout); j++) {
+        const RFLOAT *const Mrow = Mpad + ((k + zoffset) * padoridim + j + offset) * row + offset;
+        for (long int i = 0; i < Xsize(Mout); i++)
+            direct::elem(Mout, i, j, k) = Mrow[i] / normfft;
+    }
+    Fin.clear();
     }
 
     #ifdef DEBUG_WINDOWORIDIMREALSPACE
@@ -2058,19 +2096,12 @@ void BackProjector::windowToOridimRealSpace(
 
     // Mask out corners to prevent aliasing artefacts
     {
-    ifdefTIMING(TicToc tt (OriDimTimer, OrD9_softMask);)
+    ifdefTIMING(TicToc tt (OriDimTimer, OrD5_softMask);)
     softMaskOutsideMap(Mout);
     }
 
     #ifdef DEBUG_WINDOWORIDIMREALSPACE
     Image<RFLOAT>(Mout).write("windoworidim_Mwindowed_masked.spi");
-    // FourierTransformer ttf;
-    Fin = FourierTransformer{}.FourierTransform(Mout);
-    imtt().resize(Zsize(Fin), Ysize(Fin), Xsize(Fin));
-    for (long int n = 0; n < Fin.size(); n++) {
-        imtt()[n] = abs(Fin[n]);
-    }
-    imtt.write("windoworidim_Fnew.spi");
     #endif
 
     #ifdef TIMING
@@ -315,6 +315,9 @@ class BackProjector: public Projector {
     /* Get the 3D reconstruction
          * If do_map is true, 1 will be added to all weights
          * alpha will contain the noise-reduction spectrum
+         * Everything runs on nr_threads threads. The Fourier transforms are done in place,
+         * multithreaded if FFTW was built with threads (see FftwPlans).
+         * If printTimes is true, the time spent in each stage and the peak memory use are printed.
     */
     MultidimArray<RFLOAT> reconstruct(
         int max_iter_preweight,
@@ -324,7 +327,8 @@ class BackProjector: public Projector {
         RFLOAT normalise = 1.0,
         int minres_map = -1,
         bool printTimes= false,
-        Image<RFLOAT>* weight_out = 0
+        Image<RFLOAT>* weight_out = 0,
+        int nr_threads = 1
     );
 
     /*	Enforce Hermitian symmetry, apply helical symmetry as well as point-group symmetry
@@ -342,19 +346,21 @@ class BackProjector: public Projector {
     void applyHelicalSymmetry(int nr_helical_asu = 1, RFLOAT helical_twist = 0.0, RFLOAT helical_rise = 0.);
 
     /* Applies the symmetry from the SymList object to the weight and the data array
+     *
+     * In a single pass (over z slabs, on threads threads), in which every point gathers from all of its symmetry mates.
      */
     void applyPointGroupSymmetry(int threads = 1);
 
 
     /* Convolute in Fourier-space with the blob by multiplication in real-space
-     * Note the convolution is done on the complex array inside the transformer object!!
+     * Fconv (of pad_size / 2 + 1 x pad_size x pad_size) is transformed in place: it holds the real-space map in between.
      */
-    void convoluteBlobRealSpace(FourierTransformer &transformer, bool do_mask = false);
+    void convoluteBlobRealSpace(MultidimArray<Complex> &Fconv, bool do_mask = false, int nr_threads = 1);
 
     /* Calculate the inverse FFT of Fin and windows the result to ori_size
-     * Also pass the transformer, to prevent making and clearing a new one before clearing the one in reconstruct()
+     * Fin is windowed and transformed in place, and cleared afterwards.
      */
-    void windowToOridimRealSpace(FourierTransformer &transformer, MultidimArray<RFLOAT> &Mout, bool printTimes = false);
+    void windowToOridimRealSpace(MultidimArray<Complex> &Fin, MultidimArray<RFLOAT> &Mout, int nr_threads = 1, bool printTimes = false);
 
     // Faster than arr1.getDimensions() == arr2.getDimensions()
     #define SAMEDIMENSIONS(arr1, arr2) ((arr1).xdim == (arr2).xdim && (arr1).ydim == (arr2).ydim || (arr1).zdim && (arr2).zdim)
@@ -421,20 +427,23 @@ class BackProjector: public Projector {
         }
     }
 
-    #ifdef RELION_SINGLE_PRECISION
-    // Fnewweight needs decentering, but has to be in double-precision for correct calculations!
-    template <typename T>
-    void decenter(const MultidimArray<T> &Min, MultidimArray<double> &Mout, int my_rmax2) {
-        // Mout should already have the right size
-        // Initialize to zero
-        Mout.initZeros();
-        FOR_ALL_ELEMENTS_IN_FFTW_TRANSFORM(Mout) {
-            if (hypot2(ip, jp, kp) <= my_rmax2) {
-                direct::elem(Mout, i, j, k) = (double) Min.elem(ip, jp, kp);
+    /*
+    * Go from the Projector-centered Min to the FFTW-uncentered Mout, which should already have the right size
+    * (e.g. Fnewweight needs decentering, but has to be in double-precision for correct calculations!)
+    */
+    template <typename T, typename U>
+    void decenter(const MultidimArray<T> &Min, MultidimArray<U> &Mout, int my_rmax2, int nr_threads = 1) {
+        #pragma omp parallel for num_threads(nr_threads)
+        for (long int k = 0; k < Zsize(Mout); k++) {
+            const long int kp = Fourier::K(Mout, k);
+            for (long int j = 0; j < Ysize(Mout); j++) {
+                const long int jp = Fourier::J(Mout, j);
+                for (long int i = 0, ip = 0; i < Xsize(Mout); i++, ip++) {
+                    direct::elem(Mout, i, j, k) = hypot2(ip, jp, kp) <= my_rmax2 ? (U) Min.elem(ip, jp, kp) : (U) 0.0;
+                }
             }
         }
     }
-    #endif
 };
 
 #endif /* BACKPROJECTOR_H_ */
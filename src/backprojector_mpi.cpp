@@ -0,0 +1,477 @@
+/***************************************************************************
+ *
+ * Author: "agent"
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This complete copyright notice must be included in any revised version of the
+ * source code. Additional authorship citations may be added, but existing
+ * author citations must be preserved.
+ ***************************************************************************/
+
+#include <sys/resource.h>
+#include <algorithm>
+#include <vector>
+#include "src/backprojector_mpi.h"
+#include "src/fftw_mpi.h"
+#include "src/time.h"
+
+// For all elements of the Fourier-space slab of fft, with their index idx in the slab and their frequency (ip, jp, kp)
+#define FOR_ALL_ELEMENTS_IN_SLAB(fft) \
+    _Pragma("omp parallel for num_threads(nr_threads)") \
+    for (long int k = 0; k < (fft).zEnd() - (fft).zBegin(); k++) \
+    for (long int j = 0, kp = frequency((fft).zBegin() + k, (fft).n), jp = 0; j < (fft).n; j++, jp = frequency(j, (fft).n)) \
+    for (long int i = 0, ip = 0, idx = (k * (fft).n + j) * (fft).hdim; i < (fft).hdim; i++, ip = i, idx++)
+
+namespace {
+
+    // Frequency of index k of an FFTW-format transform of size n (as Fourier::J and Fourier::K)
+    inline long int frequency(long int k, long int n) { return k < n / 2 + 1 ? k : k - n; }
+
+    // Index of frequency kp in an FFTW-format transform of size n, or -1 if it has none
+    inline long int fourierIndex(long int kp, long int n) {
+        const long int k = kp < 0 ? kp + n : kp;
+        return k >= 0 && k < n && frequency(k, n) == kp ? k : -1;
+    }
+
+    // BackProjector::decenter into the Fourier-space slab out of fft
+    template <typename T, typename U>
+    void decenterSlab(const MultidimArray<T> &Min, U *out, const SlabFourierTransformer &fft, int my_rmax2, int nr_threads) {
+        FOR_ALL_ELEMENTS_IN_SLAB(fft) {
+            out[idx] = hypot2(ip, jp, kp) <= my_rmax2 ? (U) Min.elem(ip, jp, kp) : (U) 0.0;
+        }
+    }
+
+    // BackProjector::convoluteBlobRealSpace (without masking) of the Fourier-space slabs of fft
+    void convoluteBlobRealSpace(const BackProjector &BP, SlabFourierTransformer &fft, int nr_threads) {
+
+        fft.inverseFourierTransform();
+        RFLOAT *const Mconv = fft.real();
+        const long int y0 = fft.yBegin(), ny = fft.yEnd() - y0;
+        const long int row = 2 * fft.hdim;  // Padded length of the real-space rows
+
+        // Blob normalisation in Fourier space
+        const RFLOAT normftblob = BP.tab_ftblob(0.0);
+
+        // Multiply with FT of the blob kernel
+        const int pad_size = fft.n, padhdim = pad_size / 2;
+        #pragma omp parallel for collapse(2) num_threads(nr_threads)
+        for (long int k = 0; k < pad_size; k++)
+        for (long int j = 0; j < ny; j++) {
+            RFLOAT *const Mrow = Mconv + (k * ny + j) * row;
+            const int kp = k < padhdim ? k : k - pad_size;
+            const int jp = y0 + j < padhdim ? y0 + j : y0 + j - pad_size;
+            for (long int i = 0; i < pad_size; i++) {
+                const int ip = i < padhdim ? i : i - pad_size;
+                const RFLOAT rval = hypot((double) ip, jp, kp) / (BP.ori_size * BP.padding_factor);
+                Mrow[i] *= BP.tab_ftblob(rval) / normftblob;
+            }
+        }
+
+        // Forward FFT to go back to Fourier-space (normalised, as by FourierTransformer)
+        fft.FourierTransform();
+        Complex *const Fconv = fft.fourier();
+        const RFLOAT npix = (RFLOAT) pad_size * pad_size * pad_size;
+        #pragma omp parallel for num_threads(nr_threads)
+        for (long int n = 0; n < fft.fourierSize(); n++)
+            Fconv[n] /= npix;
+    }
+
+    // BackProjector::windowToOridimRealSpace of the Fourier-space slabs of fin (which are cleared).
+    // The real-space map is gathered on root; the other ranks get an empty array.
+    MultidimArray<RFLOAT> windowToOridimRealSpace(
+        const BackProjector &BP, SlabFourierTransformer &fin, int root, int nr_threads
+    ) {
+        const int rank = fin.rank, size = fin.size;
+
+        // Size of padded real-space volume
+        int padoridim = round(BP.padding_factor * BP.ori_size);
+        // Enforce divisibility by 2
+        padoridim += padoridim % 2;
+        const long int n = padoridim, hdim = n / 2 + 1;
+
+        // As in windowFourierTransform: when growing, leave the corners empty
+        const bool grow = hdim > fin.hdim;
+        const long int max_r2 = (fin.hdim - 1) * (fin.hdim - 1);
+
+        // Every plane of the window comes from one plane of fin (or is zero): window those of this rank,
+        // and send them to the ranks that hold them in the window
+        std::vector<long int> planes;
+        std::vector<int> send_counts (size, 0), send_displs (size, 0), recv_counts (size, 0), recv_displs (size, 0);
+        for (long int k = 0; k < n; k++) {
+            const long int kin = fourierIndex(frequency(k, n), fin.n);
+            if (kin >= 0 && fin.owner(kin) == rank) {
+                planes.push_back(k);
+                send_counts[SlabFourierTransformer::slabOwner(n, k, size)] += n;
+            }
+        }
+
+        MultidimArray<Complex> sent (planes.size() * n * hdim);
+        #pragma omp parallel for num_threads(nr_threads)
+        for (long int p = 0; p < planes.size(); p++) {
+            const long int kp = frequency(planes[p], n), kin = fourierIndex(kp, fin.n);
+            for (long int j = 0; j < n; j++) {
+                const long int jp = frequency(j, n), jin = fourierIndex(jp, fin.n);
+                const Complex *const from = fin.fourier() + ((kin - fin.zBegin()) * fin.n + jin) * fin.hdim;
+                Complex *const to = sent.data + (p * n + j) * hdim;
+                for (long int i = 0; i < hdim; i++) {
+                    to[i] = jin >= 0 && i < fin.hdim && (!grow || hypot2(i, jp, kp) <= max_r2) ? from[i] : Complex(0.0);
+                }
+            }
+        }
+        fin.clear();
+
+        SlabFourierTransformer fout (fin.comm, n, nr_threads);
+        const long int z0 = fout.zBegin(), nz = fout.zEnd() - z0;
+        for (long int k = z0; k < z0 + nz; k++) {
+            const long int kin = fourierIndex(frequency(k, n), fin.n);
+            if (kin >= 0) recv_counts[fin.owner(kin)] += n;
+        }
+        for (int s = 1; s < size; s++) {
+            send_displs[s] = send_displs[s - 1] + send_counts[s - 1];
+            recv_displs[s] = recv_displs[s - 1] + recv_counts[s - 1];
+        }
+
+        MultidimArray<Complex> received ((recv_displs[size - 1] + recv_counts[size - 1]) * hdim);
+        MPI_Datatype row_type;
+        MPI_Type_contiguous(hdim, relion_MPI::COMPLEX, &row_type);
+        MPI_Type_commit(&row_type);
+        MPI_Alltoallv(
+            sent.data,     send_counts.data(), send_displs.data(), row_type,
+            received.data, recv_counts.data(), recv_displs.data(), row_type, fin.comm
+        );
+        MPI_Type_free(&row_type);
+        sent.clear();
+
+        // From every rank, the planes come in the order of the window
+        std::vector<long int> next (recv_displs.begin(), recv_displs.end());
+        for (long int k = 0; k < nz; k++) {
+            const long int kin = fourierIndex(frequency(z0 + k, n), fin.n);
+            Complex *const to = fout.fourier() + k * n * hdim;
+            if (kin >= 0) {
+                const Complex *const from = received.data + next[fin.owner(kin)] * hdim;
+                std::copy(from, from + n * hdim, to);
+                next[fin.owner(kin)] += n;
+            } else {
+                std::fill(to, to + n * hdim, Complex(0.0));
+            }
+        }
+        received.clear();
+
+        // Shift the map back to its origin (CenterFFTbySign)
+        #pragma omp parallel for collapse(2) num_threads(nr_threads)
+        for (long int k = 0; k < nz; k++)
+        for (long int j = 0; j < n; j++) {
+            Complex *const Frow = fout.fourier() + (k * n + j) * hdim;
+            for (long int i = (j ^ (z0 + k)) & 1 ? 0 : 1; i < hdim; i += 2)
+                Frow[i] *= -1;
+        }
+
+        // Do the inverse FFT, into the same memory
+        fout.inverseFourierTransform();
+
+        // Window in real-space, with the normalisation factor of FFTW
+        const int ori_size = BP.ori_size;
+        const RFLOAT normfft = BP.padding_factor * BP.padding_factor * BP.padding_factor * (BP.data_dim == 3 ? 1 : ori_size);
+        // Offset of the window in the padded map (both have their origins at the centre)
+        const long int offset = padoridim / 2 + Xmipp::init(ori_size);
+        const long int y0 = fout.yBegin(), ny = fout.yEnd() - y0;
+        const long int j0 = std::max(y0 - offset, 0l), j1 = std::min(y0 + ny - offset, (long int) ori_size);
+        const long int nj = std::max(j1 - j0, 0l);
+        MultidimArray<RFLOAT> part (nj * ori_size * ori_size);
+        const RFLOAT *const Mpad = fout.real();
+        const long int row = 2 * fout.hdim;  // Padded length of the real-space rows
+        #pragma omp parallel for collapse(2) num_threads(nr_threads)
+        for (long int k = 0; k < ori_size; k++)
+        for (long int j = 0; j < nj; j++) {
+            const RFLOAT *const Mrow = Mpad + ((k + offset) * ny + j0 + j + offset - y0) * row + offset;
+            RFLOAT *const to = part.data + (k * nj + j) * ori_size;
+            for (long int i = 0; i < ori_size; i++)
+                to[i] = Mrow[i] / normfft;
+        }
+        fout.clear();
+
+        // Gather the rows of all ranks on the root
+        int my_rows[2] = {(int) j0, (int) nj};
+        std::vector<int> rows (rank == root ? 2 * size : 0);
+        MPI_Gather(my_rows, 2, MPI_INT, rows.data(), 2, MPI_INT, root, fin.comm);
+        std::vector<int> counts (size), displs (size);
+        if (rank == root) {
+            for (int s = 0; s < size; s++) {
+                counts[s] = rows[2 * s + 1] * ori_size;
+                displs[s] = s == 0 ? 0 : displs[s - 1] + counts[s - 1];
+            }
+        }
+
+        MultidimArray<RFLOAT> gathered (rank == root ? (long int) ori_size * ori_size * ori_size : 0);
+        MPI_Datatype line_type;
+        MPI_Type_contiguous(ori_size, relion_MPI::DOUBLE, &line_type);
+        MPI_Type_commit(&line_type);
+        MPI_Gatherv(
+            part.data, nj * ori_size, line_type,
+            gathered.data, counts.data(), displs.data(), line_type, root, fin.comm
+        );
+        MPI_Type_free(&line_type);
+        part.clear();
+
+        MultidimArray<RFLOAT> Mout;
+        if (rank != root) return Mout;
+
+        Mout.reshape(ori_size, ori_size, ori_size);
+        for (int s = 0; s < size; s++) {
+            const long int j0_s = rows[2 * s], nj_s = rows[2 * s + 1];
+            #pragma omp parallel for num_threads(nr_threads)
+            for (long int k = 0; k < ori_size; k++)
+            for (long int j = 0; j < nj_s; j++) {
+                const RFLOAT *const from = gathered.data + ((long int) displs[s] + k * nj_s + j) * ori_size;
+                std::copy(from, from + ori_size, &direct::elem(Mout, 0, j0_s + j, k));
+            }
+        }
+        Mout.setXmippOrigin();
+
+        // Mask out corners to prevent aliasing artefacts
+        softMaskOutsideMap(Mout);
+        return Mout;
+    }
+
+    // Peak resident memory of this process, in Gb
+    double peakMemoryGb() {
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_maxrss / (1024.0 * 1024.0);  // ru_maxrss is in kb
+    }
+
+}
+
+MultidimArray<RFLOAT> reconstructDistributed(
+    BackProjector &BP, MPI_Comm comm, bool is_root,
+    int max_iter_preweight, bool do_map,
+    const MultidimArray<RFLOAT> &tau2_in,
+    RFLOAT tau2_fudge, RFLOAT normalise,
+    int minres_map, bool printTimes, int nr_threads
+) {
+    if (BP.ref_dim != 3)
+        REPORT_ERROR("reconstructDistributed: only 3D maps can be reconstructed by several ranks");
+
+    int rank, root, my_root;
+    MPI_Comm_rank(comm, &rank);
+    my_root = is_root ? rank : -1;
+    MPI_Allreduce(&my_root, &root, 1, MPI_INT, MPI_MAX, comm);
+    if (root < 0)
+        REPORT_ERROR("reconstructDistributed BUG: none of the ranks is the root");
+
+    Timer ReconTimer;
+    int ReconS[] = {
+        ReconTimer.setNew(" RcD1_Init "),
+        ReconTimer.setNew(" RcD2_Shape&Noise "),
+        ReconTimer.setNew(" RcD3_Regularize "),
+        ReconTimer.setNew(" RcD4_skipGridding "),
+        ReconTimer.setNew(" RcD5_doGridding_init "),
+        ReconTimer.setNew(" RcD6_doGridding_iter "),
+        ReconTimer.setNew(" RcD7_doGridding_apply "),
+        ReconTimer.setNew(" RcD8_WindowReal "),
+        ReconTimer.setNew(" RcD9_GriddingCorrect "),
+    };
+
+    const int r_max = BP.r_max;
+    const RFLOAT padding_factor = BP.padding_factor;
+    const int max_r2 = round(r_max * padding_factor) * round(r_max * padding_factor);
+    const RFLOAT oversampling_correction = padding_factor * padding_factor * padding_factor;
+
+    // Fconv is in the slabs of fft: every rank has its planes of Fconv, Fweight and Fnewweight
+    SlabFourierTransformer fft (comm, BP.pad_size, nr_threads);
+    Complex *const Fconv = fft.fourier();
+    std::vector<RFLOAT> Fweight;
+    MultidimArray<RFLOAT> tau2 (tau2_in);
+    {
+    TicToc tt (ReconTimer, ReconS[0]);
+    Fweight.resize(fft.fourierSize());
+
+    // Everyone regularises with the tau2-spectrum of the root
+    if (do_map) {
+        long int tau2_size = tau2.size();
+        MPI_Bcast(&tau2_size, 1, MPI_LONG, root, comm);
+        tau2.reshape(tau2_size);
+        MPI_Bcast(tau2.data, tau2_size, relion_MPI::DOUBLE, root, comm);
+    }
+    }
+
+    {
+    TicToc tt (ReconTimer, ReconS[1]);
+    // Go from projector-centered to FFTW-uncentered
+    decenterSlab(BP.weight, Fweight.data(), fft, max_r2, nr_threads);
+    }
+
+    {
+    TicToc tt (ReconTimer, ReconS[2]);
+    // Apply MAP-additional term to the Fweight array
+    // This will regularise the actual reconstruction
+    if (do_map) {
+        // Check the tau2-spectrum before the threads start
+        const int max_ires = max_r2 > 0 ? round(sqrt((RFLOAT) (max_r2 - 1)) / padding_factor) : -1;
+        for (int ires = 0; ires <= max_ires && ires < Xsize(tau2); ires++) {
+            if (!(direct::elem(tau2, ires) > 0.0 || direct::elem(tau2, ires) < 1e-20)) {
+                std::cerr << " tau2= " << tau2 << std::endl;
+                REPORT_ERROR("ERROR BackProjector::reconstruct: Negative or zero values encountered for tau2 spectrum!");
+            }
+        }
+
+        // Then, add the inverse of tau2-spectrum values to the weight
+        FOR_ALL_ELEMENTS_IN_SLAB(fft) {
+            const int r2 = hypot2(ip, jp, kp);
+            if (r2 < max_r2) {
+                const int ires = round(sqrt((RFLOAT) r2) / padding_factor);
+                const RFLOAT invw = Fweight[idx];
+
+                RFLOAT invtau2;
+                if (direct::elem(tau2, ires) > 0.0) {
+                    // Calculate inverse of tau2
+                    invtau2 = 1.0 / (oversampling_correction * tau2_fudge * direct::elem(tau2, ires));
+                } else {
+                    // If tau2 is zero, use small value instead
+                    invtau2 = invw > 1e-20 ? 1.0 / (0.001 * invw) : 0.0;
+                }
+
+                // Only for (ires >= minres_map) add Wiener-filter like term
+                if (ires >= minres_map) Fweight[idx] = invw + invtau2;
+            }
+        }
+    }
+    }
+
+    if (BP.skip_gridding) {
+        TicToc tt (ReconTimer, ReconS[3]);
+        decenterSlab(BP.data, Fconv, fft, max_r2, nr_threads);
+
+        // Prevent divisions by zero: set Fweight to at least 1/1000th of the radially averaged weight at that resolution
+        // beyond r_max, set Fweight to at least 1/1000th of the radially averaged weight at r_max;
+        auto radavg_weight = MultidimArray<RFLOAT>::zeros(r_max), counter = MultidimArray<RFLOAT>::zeros(r_max);
+        const int round_max_r2 = round(r_max * padding_factor * r_max * padding_factor);
+        for (long int k = 0; k < fft.zEnd() - fft.zBegin(); k++)
+        for (long int j = 0, kp = frequency(fft.zBegin() + k, fft.n), jp = 0; j < fft.n; j++, jp = frequency(j, fft.n))
+        for (long int i = 0, ip = 0, idx = (k * fft.n + j) * fft.hdim; i < fft.hdim; i++, ip = i, idx++) {
+            const int r2 = hypot2(ip, jp, kp);
+            if (r2 < round_max_r2) {
+                const int ires = floor(sqrt((RFLOAT) r2) / padding_factor);
+                if (ires >= Xsize(radavg_weight))
+                    REPORT_ERROR("BUG: ires >=Xsize(radavg_weight) ");
+                direct::elem(radavg_weight, ires) += Fweight[idx];
+                direct::elem(counter, ires) += 1.0;
+            }
+        }
+        MPI_Allreduce(MPI_IN_PLACE, radavg_weight.data, r_max, relion_MPI::DOUBLE, MPI_SUM, comm);
+        MPI_Allreduce(MPI_IN_PLACE, counter.data,       r_max, relion_MPI::DOUBLE, MPI_SUM, comm);
+
+        // Calculate 1/1000th of radial averaged weight
+        for (long int i = 0; i < Xsize(radavg_weight); i++) {
+            if (direct::elem(counter, i) > 0.0 || direct::elem(radavg_weight, i) > 0.0) {
+                direct::elem(radavg_weight, i) /= 1000.0 * direct::elem(counter, i);
+            } else {
+                std::cerr << " counter= " << counter << std::endl;
+                std::cerr << " radavg_weight= " << radavg_weight << std::endl;
+                REPORT_ERROR("BUG: zeros in counter or radavg_weight!");
+            }
+        }
+
+        // perform std::max on all weight elements, and do division of data/weight
+        FOR_ALL_ELEMENTS_IN_SLAB(fft) {
+            const int ires = floor(hypot((double) ip, jp, kp) / padding_factor);
+            const RFLOAT weight = std::max(Fweight[idx], direct::elem(radavg_weight, ires < r_max ? ires : r_max - 1));
+            if (weight != 0) Fconv[idx] /= weight;
+        }
+    } else {
+
+        // Fnewweight can become too large for a float: always keep this one in double-precision
+        std::vector<double> Fnewweight;
+        {
+        TicToc tt (ReconTimer, ReconS[4]);
+        // Divide both data and Fweight by normalisation factor to prevent FFT's with very large values....
+        #pragma omp parallel for num_threads(nr_threads)
+        for (long int n = 0; n < Fweight.size(); n++)
+            Fweight[n] /= normalise;
+        #pragma omp parallel for num_threads(nr_threads)
+        for (long int n = 0; n < BP.data.size(); n++)
+            BP.data[n] /= (Complex) normalise;
+
+        // Initialise Fnewweight with 1's and 0's (as BackProjector::reconstruct)
+        MultidimArray<RFLOAT> &weight = BP.weight;
+        #pragma omp parallel for num_threads(nr_threads)
+        for (long int k = Zinit(weight); k <= Zlast(weight); k++)
+        for (long int j = Yinit(weight); j <= Ylast(weight); j++)
+        for (long int i = Xinit(weight); i <= Xlast(weight); i++) {
+            weight.elem(i, j, k) = hypot2(i, j, k) < max_r2;
+        }
+        Fnewweight.resize(fft.fourierSize());
+        decenterSlab(weight, Fnewweight.data(), fft, max_r2, nr_threads);
+        }
+
+        // Iterative algorithm as in Eq. 14 in Pipe & Menon (1999)
+        // or Eq. 4 in Matej (2001)
+        for (int iter = 0; iter < max_iter_preweight; iter++) {
+            TicToc tt (ReconTimer, ReconS[5]);
+            // Each "sampling point" counts "Fweight" times (see BackProjector::reconstruct)
+            #pragma omp parallel for num_threads(nr_threads)
+            for (long int n = 0; n < Fweight.size(); n++)
+                Fconv[n] = Fnewweight[n] * Fweight[n];
+
+            // convolute through Fourier-transform (as both grids are rectangular)
+            convoluteBlobRealSpace(BP, fft, nr_threads);
+
+            FOR_ALL_ELEMENTS_IN_SLAB(fft) {
+                if (hypot2(ip, jp, kp) < max_r2) {
+                    // Make sure no division by zero can occur....
+                    // Apply division of Eq. [14] in Pipe & Menon (1999)
+                    Fnewweight[idx] /= std::max((RFLOAT) 1e-6, (RFLOAT) abs(Fconv[idx]));
+                }
+            }
+        }
+
+        {
+        TicToc tt (ReconTimer, ReconS[6]);
+        std::vector<RFLOAT>().swap(Fweight);
+
+        // Now do the actual reconstruction with the data array
+        // Apply the iteratively determined weight
+        decenterSlab(BP.data, Fconv, fft, max_r2, nr_threads);
+        #pragma omp parallel for num_threads(nr_threads)
+        for (long int n = 0; n < Fnewweight.size(); n++) {
+            #ifdef RELION_SINGLE_PRECISION
+            // Prevent numerical instabilities in single-precision reconstruction with very unevenly sampled orientations
+            if (Fnewweight[n] > 1e20) { Fnewweight[n] = 1e20; }
+            #endif
+            Fconv[n] *= Fnewweight[n];
+        }
+        }
+    }
+    std::vector<RFLOAT>().swap(Fweight);
+
+    // Now do inverse FFT and window to original size in real-space
+    MultidimArray<RFLOAT> vol_out;
+    {
+    TicToc tt (ReconTimer, ReconS[7]);
+    vol_out = windowToOridimRealSpace(BP, fft, root, nr_threads);
+    }
+
+    // Correct for the linear/nearest-neighbour interpolation that led to the data array
+    if (rank == root) {
+        TicToc tt (ReconTimer, ReconS[8]);
+        BP.griddingCorrect(vol_out, nr_threads);
+    }
+
+    double peak = peakMemoryGb(), max_peak = 0.0;
+    MPI_Reduce(&peak, &max_peak, 1, MPI_DOUBLE, MPI_MAX, root, comm);
+    if (printTimes && rank == root) {
+        ReconTimer.printTimes(true);
+        std::cout << " Peak memory use (largest of " << fft.size << " processes): " << max_peak << " Gb" << std::endl;
+    }
+
+    return vol_out;
+}
@@ -0,0 +1,49 @@
+/***************************************************************************
+ *
+ * Author: "agent"
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This complete copyright notice must be included in any revised version of the
+ * source code. Additional authorship citations may be added, but existing
+ * author citations must be preserved.
+ ***************************************************************************/
+
+#ifndef BACKPROJECTOR_MPI_H_
+#define BACKPROJECTOR_MPI_H_
+
+#include "src/mpi.h"
+#include "src/backprojector.h"
+
+/* BackProjector::reconstruct of a 3D map, with the work divided over the ranks of comm.
+ *
+ * All ranks of comm call this together, with equal data and weight arrays in BP and the same arguments
+ * (tau2 is taken from the root). The padded arrays of the gridding iterations and of the final inverse
+ * transform are divided in slabs over the ranks, and transformed with a SlabFourierTransformer, so every
+ * rank needs only its part of their memory. Exactly one rank has is_root set: it gets the map (gridding
+ * corrected, as from BackProjector::reconstruct); the others get an empty array.
+ *
+ * This divides the time of the reconstruction, not the memory of the BackProjector: data and weight are needed
+ * in full by every rank (in MlOptimiserMpi, each follower backprojects into its own copy of them), so every rank
+ * still needs as much memory as for BP, plus its slabs of the padded arrays.
+ */
+MultidimArray<RFLOAT> reconstructDistributed(
+    BackProjector &BP, MPI_Comm comm, bool is_root,
+    int max_iter_preweight, bool do_map,
+    const MultidimArray<RFLOAT> &tau2,
+    RFLOAT tau2_fudge = 1.0,
+    RFLOAT normalise = 1.0,
+    int minres_map = -1,
+    bool printTimes = false,
+    int nr_threads = 1
+);
+
+#endif
@@ -0,0 +1,327 @@
+/***************************************************************************
+ *
+ * Author: "agent"
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This complete copyright notice must be included in any revised version of the
+ * source code. Additional authorship citations may be added, but existing
+ * author citations must be preserved.
+ ***************************************************************************/
+
+#include <cmath>
+#include <algorithm>
+#include "src/ctf_estimator.h"
+#include "src/fftw.h"
+#include "src/jaz/optimization/nelder_mead.h"
+
+// Local refinement of (defU, defV, defAng[, phase shift]), in units of the search steps
+class CtfEstimatorOptimization : public Optimization {
+
+    public:
+
+    CtfEstimatorOptimization(const CtfEstimator &estimator, const std::vector<CtfEstimator::Sample> &samples):
+    estimator(estimator), samples(samples) {}
+
+    double f(const std::vector<double> &x, void *tempStorage) const {
+        const RFLOAT defU = x[0] * estimator.step_defocus, defV = x[1] * estimator.step_defocus;
+        const RFLOAT defAng = x[2] * angle_step;
+        const RFLOAT phase = estimator.do_phaseshift ? x[3] * estimator.phase_step : 0.0;
+        if (defU <= 0.0 || defV <= 0.0) return 1.0 + estimator.penalty(defU, defV);
+        return -CtfEstimator::score(estimator.getCTF(defU, defV, defAng, phase), samples)
+            + estimator.penalty(defU, defV);
+    }
+
+    static constexpr RFLOAT angle_step = 15.0;
+
+    private:
+
+    const CtfEstimator &estimator;
+    const std::vector<CtfEstimator::Sample> &samples;
+
+};
+
+constexpr RFLOAT CtfEstimatorOptimization::angle_step;
+
+MultidimArray<RFLOAT> CtfEstimator::averageSpectrum(const MultidimArray<RFLOAT> &mic) const {
+    const long int N = box_size;
+    if (Xsize(mic) < N || Ysize(mic) < N)
+        REPORT_ERROR("CtfEstimator::averageSpectrum ERROR: the micrograph is smaller than the box size.");
+
+    // Tiles overlap by half their size, and together cover as much of the micrograph as possible
+    const long int step = N / 2;
+    const long int nx = (Xsize(mic) - N) / step + 1, ny = (Ysize(mic) - N) / step + 1;
+    const long int x0 = (Xsize(mic) - N - (nx - 1) * step) / 2, y0 = (Ysize(mic) - N - (ny - 1) * step) / 2;
+
+    MultidimArray<RFLOAT> sum = MultidimArray<RFLOAT>::zeros(N / 2 + 1, N);
+
+    #pragma omp parallel num_threads(nr_threads)
+    {
+        FourierTransformer transformer;
+        MultidimArray<RFLOAT> tile (N, N);
+        MultidimArray<RFLOAT> my_sum = MultidimArray<RFLOAT>::zeros(N / 2 + 1, N);
+
+        #pragma omp for
+        for (long int t = 0; t < nx * ny; t++) {
+            const long int xt = x0 + (t % nx) * step, yt = y0 + (t / nx) * step;
+            RFLOAT avg = 0.0;
+            for (long int j = 0; j < N; j++)
+            for (long int i = 0; i < N; i++)
+                avg += direct::elem(tile, i, j) = direct::elem(mic, xt + i, yt + j);
+            tile -= avg / (N * N);
+
+            const MultidimArray<Complex> &F = transformer.FourierTransform(tile);
+            for (long int n = 0; n < F.size(); n++)
+                my_sum[n] += norm(F[n]);
+        }
+
+        #pragma omp critical
+        sum += my_sum;
+    }
+
+    MultidimArray<RFLOAT> spectrum (N, N);
+    spectrum.setXmippOrigin();
+    FOR_ALL_ELEMENTS_IN_ARRAY2D(spectrum, i, j) {
+        const RFLOAT p = i >= 0 ? FFTW::elem(sum, i, j) : FFTW::elem(sum, -i, -j);
+        spectrum.elem(i, j) = sqrt(p / (nx * ny));
+    }
+    return spectrum;
+}
+
+MultidimArray<RFLOAT> CtfEstimator::subtractBackground(const MultidimArray<RFLOAT> &spectrum) const {
+    MultidimArray<RFLOAT> result = spectrum;
+    result.setXmippOrigin();
+    const long int rmax = ceil(sqrt(2.0) * Xsize(result) / 2) + 1;
+
+    // Rotational average
+    std::vector<RFLOAT> avg (rmax + 1, 0.0), count (rmax + 1, 0.0);
+    FOR_ALL_ELEMENTS_IN_ARRAY2D(result, i, j) {
+        const long int r = round(sqrt((RFLOAT) (i * i + j * j)));
+        avg[r] += result.elem(i, j);
+        count[r] += 1.0;
+    }
+
+    // The background is the rotational average, smoothed over more rings than a Thon ring is wide (at most resolutions)
+    const long int w = std::max(2l, (long int) Xsize(result) / 32);
+    const auto smooth = [&] (const std::vector<RFLOAT> &sums) {
+        std::vector<RFLOAT> smoothed (rmax + 1, 0.0);
+        for (long int r = 0; r <= rmax; r++) {
+            RFLOAT s = 0.0, n = 0.0;
+            for (long int q = std::max(0l, r - w); q <= std::min(rmax, r + w); q++) {
+                s += sums[q];
+                n += count[q];
+            }
+            smoothed[r] = n > 0.0 ? s / n : 0.0;
+        }
+        return smoothed;
+    };
+    const auto interpolate = [] (const std::vector<RFLOAT> &profile, RFLOAT r) {
+        const long int r0 = std::min((long int) r, (long int) profile.size() - 2);
+        const RFLOAT f = r - r0;
+        return (1.0 - f) * profile[r0] + f * profile[r0 + 1];
+    };
+
+    const std::vector<RFLOAT> background = smooth(avg);
+    std::vector<RFLOAT> var (rmax + 1, 0.0);
+    FOR_ALL_ELEMENTS_IN_ARRAY2D(result, i, j) {
+        const RFLOAT r = sqrt((RFLOAT) (i * i + j * j));
+        RFLOAT &v = result.elem(i, j);
+        v -= interpolate(background, r);
+        var[round(r)] += v * v;
+    }
+
+    // Flatten the envelope
+    const std::vector<RFLOAT> stddev = [&] () {
+        std::vector<RFLOAT> s = smooth(var);
+        for (RFLOAT &x : s) x = sqrt(x);
+        return s;
+    }();
+    FOR_ALL_ELEMENTS_IN_ARRAY2D(result, i, j) {
+        const RFLOAT s = interpolate(stddev, sqrt((RFLOAT) (i * i + j * j)));
+        result.elem(i, j) = (i == 0 && j == 0) || s <= 0.0 ? 0.0 : result.elem(i, j) / s;
+    }
+    return result;
+}
+
+std::vector<CtfEstimator::Sample> CtfEstimator::getSamples(
+    const MultidimArray<RFLOAT> &spectrum, RFLOAT res_from, RFLOAT res_to
+) const {
+    const long int N = Xsize(spectrum);
+    const RFLOAT r_from = N * angpix / res_from, r_to = std::min(N * angpix / res_to, (RFLOAT) (N / 2 - 1));
+
+    // Half of the spectrum is enough (it is centrosymmetric)
+    std::vector<Sample> samples;
+    for (long int j = 0; j <= N / 2 - 1; j++)
+    for (long int i = -N / 2; i <= N / 2 - 1; i++) {
+        if (j == 0 && i < 0) continue;
+        const RFLOAT r = sqrt((RFLOAT) (i * i + j * j));
+        if (r < r_from || r > r_to) continue;
+        samples.push_back({i / (N * angpix), j / (N * angpix), spectrum.elem(i, j)});
+    }
+
+    RFLOAT sum = 0.0, sum2 = 0.0;
+    for (const Sample &s : samples) {
+        sum += s.value;
+        sum2 += s.value * s.value;
+    }
+    const RFLOAT avg = samples.empty() ? 0.0 : sum / samples.size();
+    const RFLOAT stddev = samples.empty() ? 0.0 : sqrt(std::max((RFLOAT) 0.0, sum2 / samples.size() - avg * avg));
+    for (Sample &s : samples)
+        s.value = stddev > 0.0 ? (s.value - avg) / stddev : 0.0;
+    return samples;
+}
+
+RFLOAT CtfEstimator::score(const CTF &ctf, const std::vector<Sample> &samples) {
+    // The sample values have zero mean and unit variance
+    RFLOAT sum = 0.0, sum2 = 0.0, cross = 0.0;
+    for (const Sample &s : samples) {
+        const RFLOAT c = ctf(s.x, s.y, false, false, false);
+        const RFLOAT m = c * c;
+        sum += m;
+        sum2 += m * m;
+        cross += m * s.value;
+    }
+    const RFLOAT n = samples.size();
+    const RFLOAT var = sum2 - sum * sum / n;
+    return var > 0.0 ? cross / sqrt(n * var) : 0.0;
+}
+
+RFLOAT CtfEstimator::penalty(RFLOAT defU, RFLOAT defV) const {
+    if (amount_astigmatism <= 0.0) return 0.0;
+    const RFLOAT excess = fabs(defU - defV) - amount_astigmatism;
+    return excess > 0.0 ? excess * excess / (amount_astigmatism * amount_astigmatism) : 0.0;
+}
+
+CtfEstimator::Fit CtfEstimator::fit(const MultidimArray<RFLOAT> &spectrum) const {
+    const std::vector<Sample> samples = getSamples(spectrum, resol_min, resol_max);
+    if (samples.empty())
+        REPORT_ERROR("CtfEstimator::fit ERROR: there are no pixels in the resolution range of the fit.");
+
+    // Grid search over defocus (and phase shift) without astigmatism
+    std::vector<RFLOAT> defoci, phases;
+    for (RFLOAT d = min_defocus; d <= max_defocus; d += step_defocus)
+        defoci.push_back(d);
+    if (do_phaseshift) {
+        for (RFLOAT p = phase_min; p <= phase_max; p += phase_step)
+            phases.push_back(p);
+    } else {
+        phases.push_back(0.0);
+    }
+    if (defoci.empty() || phases.empty())
+        REPORT_ERROR("CtfEstimator::fit ERROR: empty defocus or phase-shift search range.");
+
+    std::vector<RFLOAT> scores (defoci.size() * phases.size());
+    #pragma omp parallel for num_threads(nr_threads)
+    for (long int n = 0; n < scores.size(); n++) {
+        const RFLOAT d = defoci[n % defoci.size()], p = phases[n / defoci.size()];
+        scores[n] = score(getCTF(d, d, 0.0, p), samples);
+    }
+    const long int best = std::max_element(scores.begin(), scores.end()) - scores.begin();
+    const RFLOAT best_defocus = defoci[best % defoci.size()], best_phase = phases[best / defoci.size()];
+
+    // Grid search over astigmatism around it
+    const RFLOAT astig_max = amount_astigmatism > 0.0 ? amount_astigmatism : 2.0 * step_defocus;
+    struct Candidate { RFLOAT defU, defV, defAng; };
+    std::vector<Candidate> candidates { {best_defocus, best_defocus, 0.0} };
+    for (RFLOAT d = best_defocus - step_defocus; d <= best_defocus + step_defocus; d += step_defocus)
+    for (RFLOAT a : {(RFLOAT) 0.5 * astig_max, astig_max})
+    for (RFLOAT angle = 0.0; angle < 180.0; angle += CtfEstimatorOptimization::angle_step) {
+        if (d - a / 2.0 > 0.0)
+            candidates.push_back({d + a / 2.0, d - a / 2.0, angle});
+    }
+    std::vector<RFLOAT> candidate_scores (candidates.size());
+    #pragma omp parallel for num_threads(nr_threads)
+    for (long int n = 0; n < candidates.size(); n++) {
+        const Candidate &c = candidates[n];
+        candidate_scores[n] = score(getCTF(c.defU, c.defV, c.defAng, best_phase), samples) - penalty(c.defU, c.defV);
+    }
+    const Candidate &start = candidates[std::max_element(candidate_scores.begin(), candidate_scores.end()) - candidate_scores.begin()];
+
+    // Local refinement
+    std::vector<double> initial {
+        start.defU / step_defocus, start.defV / step_defocus, start.defAng / CtfEstimatorOptimization::angle_step
+    };
+    if (do_phaseshift) initial.push_back(best_phase / phase_step);
+    const CtfEstimatorOptimization optimization (*this, samples);
+    const std::vector<double> x = NelderMead::optimize(initial, optimization, 0.5, 1e-6, 1000);
+
+    Fit result;
+    result.defU = x[0] * step_defocus;
+    result.defV = x[1] * step_defocus;
+    result.defAng = x[2] * CtfEstimatorOptimization::angle_step;
+    result.phase_shift = do_phaseshift ? x[3] * phase_step : 0.0;
+
+    // Same convention as CTFFIND: defU >= defV, and an angle in [0, 180)
+    if (result.defU < result.defV) {
+        std::swap(result.defU, result.defV);
+        result.defAng += 90.0;
+    }
+    result.defAng -= 180.0 * floor(result.defAng / 180.0);
+    if (do_phaseshift)
+        result.phase_shift -= 360.0 * floor(result.phase_shift / 360.0);
+
+    const CTF ctf = getCTF(result.defU, result.defV, result.defAng, result.phase_shift);
+    result.fom = score(ctf, samples);
+    result.maxres = findMaxres(spectrum, ctf);
+    return result;
+}
+
+RFLOAT CtfEstimator::findMaxres(const MultidimArray<RFLOAT> &spectrum, const CTF &ctf) const {
+    const long int N = Xsize(spectrum), rmax = N / 2 - 1;
+    const long int r_from = std::max(1l, (long int) ceil(N * angpix / resol_min));
+
+    // Correlation statistics of the data and the fitted CTF^2 per ring, up to Nyquist
+    std::vector<RFLOAT> sm (rmax + 1, 0.0), sv (rmax + 1, 0.0), smm (rmax + 1, 0.0),
+                        svv (rmax + 1, 0.0), smv (rmax + 1, 0.0), n (rmax + 1, 0.0);
+    for (long int j = 0; j <= rmax; j++)
+    for (long int i = -N / 2; i <= rmax; i++) {
+        if (j == 0 && i < 0) continue;
+        const long int r = round(sqrt((RFLOAT) (i * i + j * j)));
+        if (r < r_from || r > rmax) continue;
+        const RFLOAT c = ctf(i / (N * angpix), j / (N * angpix), false, false, false);
+        const RFLOAT m = c * c, v = spectrum.elem(i, j);
+        sm[r] += m; sv[r] += v; smm[r] += m * m; svv[r] += v * v; smv[r] += m * v; n[r] += 1.0;
+    }
+
+    // The fit holds up to the first ring where the correlation (over a few rings) drops below a threshold
+    const RFLOAT threshold = 0.3;
+    const long int w = 3;
+    for (long int r = r_from + w; r <= rmax - w; r++) {
+        RFLOAT m = 0.0, v = 0.0, mm = 0.0, vv = 0.0, mv = 0.0, k = 0.0;
+        for (long int q = r - w; q <= r + w; q++) {
+            m += sm[q]; v += sv[q]; mm += smm[q]; vv += svv[q]; mv += smv[q]; k += n[q];
+        }
+        const RFLOAT cov = mv - m * v / k, var_m = mm - m * m / k, var_v = vv - v * v / k;
+        const RFLOAT cc = var_m > 0.0 && var_v > 0.0 ? cov / sqrt(var_m * var_v) : 0.0;
+        if (cc < threshold)
+            return N * angpix / r;
+    }
+    return N * angpix / rmax;
+}
+
+MultidimArray<RFLOAT> CtfEstimator::diagnosticImage(const MultidimArray<RFLOAT> &spectrum, const Fit &result) const {
+    const long int N = Xsize(spectrum);
+    const CTF ctf = getCTF(result.defU, result.defV, result.defAng, result.phase_shift);
+    const RFLOAT r_from = N * angpix / resol_min;
+
+    MultidimArray<RFLOAT> image (N, N);
+    image.setXmippOrigin();
+    FOR_ALL_ELEMENTS_IN_ARRAY2D(image, i, j) {
+        if (i < 0 && sqrt((RFLOAT) (i * i + j * j)) >= r_from) {
+            // CTF^2, on the same scale as the normalised spectrum
+            const RFLOAT c = ctf(i / (N * angpix), j / (N * angpix), false, false, false);
+            image.elem(i, j) = 2.0 * (2.0 * c * c - 1.0);
+        } else {
+            image.elem(i, j) = spectrum.elem(i, j);
+        }
+    }
+    return image;
+}
@@ -0,0 +1,117 @@
+/***************************************************************************
+ *
+ * Author: "agent"
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This complete copyright notice must be included in any revised version of the
+ * source code. Additional authorship citations may be added, but existing
+ * author citations must be preserved.
+ ***************************************************************************/
+
+#ifndef CTF_ESTIMATOR_H_
+#define CTF_ESTIMATOR_H_
+
+#include <vector>
+#include "src/ctf.h"
+#include "src/multidim_array.h"
+
+/* CTF estimation from a micrograph, without an external program.
+ *
+ * As in CTFFIND: the amplitude spectra of overlapping tiles of the micrograph are averaged,
+ * a smooth radial background is subtracted, and the CTF (defocus, astigmatism and possibly
+ * a phase shift) is fitted to the Thon rings between resol_min and resol_max, by a grid search
+ * followed by a local (Nelder-Mead) refinement. All steps use nr_threads OpenMP threads.
+ *
+ * Spectra are square, centred arrays (with the origin in the middle, like the power spectra
+ * written by relion_run_motioncorr).
+ */
+class CtfEstimator {
+
+    public:
+
+    // Size of the tiles (in pixels)
+    int box_size;
+
+    // Pixel size of the micrograph (A)
+    RFLOAT angpix;
+
+    // Resolution range of the fit (A)
+    RFLOAT resol_min, resol_max;
+
+    // Defocus search range and step (A, positive is underfocus)
+    RFLOAT min_defocus, max_defocus, step_defocus;
+
+    // Expected astigmatism (A): larger values are penalised (not if <= 0)
+    RFLOAT amount_astigmatism;
+
+    // Microscope (kV, mm, fraction)
+    RFLOAT voltage, Cs, Q0;
+
+    // Phase-shift search (degrees)
+    bool do_phaseshift;
+    RFLOAT phase_min, phase_max, phase_step;
+
+    int nr_threads;
+
+    struct Fit {
+        RFLOAT defU, defV, defAng;  // A, A, degrees
+        RFLOAT phase_shift;         // degrees
+        RFLOAT fom;                 // Correlation between the fitted CTF and the Thon rings
+        RFLOAT maxres;              // Resolution (A) up to which the fit holds
+    };
+
+    CtfEstimator():
+    box_size(512), angpix(1), resol_min(100), resol_max(7),
+    min_defocus(10000), max_defocus(50000), step_defocus(250), amount_astigmatism(0),
+    voltage(300), Cs(2.7), Q0(0.1),
+    do_phaseshift(false), phase_min(0), phase_max(180), phase_step(10),
+    nr_threads(1)
+    {}
+
+    // Average amplitude spectrum (box_size x box_size) of overlapping tiles of a micrograph
+    MultidimArray<RFLOAT> averageSpectrum(const MultidimArray<RFLOAT> &mic) const;
+
+    // The spectrum minus its smooth radial background, normalised by the local (radial) standard deviation
+    MultidimArray<RFLOAT> subtractBackground(const MultidimArray<RFLOAT> &spectrum) const;
+
+    // Fit the CTF to a background-subtracted spectrum (with a pixel size of angpix)
+    Fit fit(const MultidimArray<RFLOAT> &spectrum) const;
+
+    // Diagnostic image: the fitted CTF^2 in the left half, the spectrum in the right one
+    MultidimArray<RFLOAT> diagnosticImage(const MultidimArray<RFLOAT> &spectrum, const Fit &result) const;
+
+    CTF getCTF(RFLOAT defU, RFLOAT defV, RFLOAT defAng, RFLOAT phase_shift) const {
+        return CTF(defU, defV, defAng, voltage, Cs, Q0, 0.0, 1.0, phase_shift);
+    }
+
+    private:
+
+    // A pixel of the spectrum within the resolution range of the fit
+    struct Sample {
+        RFLOAT x, y;   // Spatial frequency (1/A)
+        RFLOAT value;  // Normalised to zero mean and unit variance over all samples
+    };
+
+    std::vector<Sample> getSamples(const MultidimArray<RFLOAT> &spectrum, RFLOAT res_from, RFLOAT res_to) const;
+
+    // Normalised cross-correlation between CTF^2 and the samples
+    static RFLOAT score(const CTF &ctf, const std::vector<Sample> &samples);
+
+    RFLOAT penalty(RFLOAT defU, RFLOAT defV) const;
+
+    RFLOAT findMaxres(const MultidimArray<RFLOAT> &spectrum, const CTF &ctf) const;
+
+    friend class CtfEstimatorOptimization;
+
+};
+
+#endif
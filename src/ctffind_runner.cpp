@@ -18,6 +18,7 @@
  * author citations must be preserved.
  ***************************************************************************/
 #include "src/ctffind_runner.h"
+#include "src/ctf_estimator.h"
 #include "src/multidim_array_statistics.h"
 #include "src/plot_metadata.h"
 #include <cmath>
@@ -68,7 +69,7 @@ void CtffindRunner::read(int argc, char **argv, int rank) {
     phase_min  = textToFloat(parser.getOption("--phase_min", "Minimum phase shift (in degrees)", "0."));
     phase_max  = textToFloat(parser.getOption("--phase_max", "Maximum phase shift (in degrees)", "180."));
     phase_step = textToFloat(parser.getOption("--phase_step", "Step in phase shift (in degrees)", "10."));
-    nr_threads = textToInteger(parser.getOption("--j", "Number of threads (for CTFIND4 only)", "1"));
+    nr_threads = textToInteger(parser.getOption("--j", "Number of threads (for CTFIND4 and --use_native only)", "1"));
     do_fast_search = parser.checkOption("--fast_search", "Disable \"Slower, more exhaustive search\" in CTFFIND4.1 (faster but less accurate)");
 
     int gctf_section = parser.addSection("Gctf parameters");
@@ -81,6 +82,9 @@ void CtffindRunner::read(int argc, char **argv, int rank) {
     additional_gctf_options = parser.getOption("--extra_gctf_options", "Additional options for Gctf", "");
     gpu_ids = parser.getOption("--gpu", "Device ids for each MPI-thread, e.g 0:1:2:3","");
 
+    int native_section = parser.addSection("Native CTF estimation");
+    do_use_native = parser.checkOption("--use_native", "Estimate the CTFs within RELION instead of with CTFFIND or Gctf (with the CTFFIND parameters)");
+
     // Initialise verb for non-parallel execution
     verb = 1;
 
@@ -115,6 +119,12 @@ void CtffindRunner::initialise() {
     if (shell_name != NULL)
         fn_shell = (std::string) shell_name;
 
+    if (do_use_native && do_use_gctf)
+        REPORT_ERROR("ERROR: --use_native and --use_gctf cannot be combined.");
+
+    if (do_use_native && do_movie_thon_rings)
+        REPORT_ERROR("ERROR: --do_movie_thon_rings is not implemented with --use_native.");
+
     if (do_use_gctf && ctf_win > 0)
         REPORT_ERROR("ERROR: Running Gctf together with --ctfWin is not implemented, please use CTFFIND instead.");
 
@@ -319,7 +329,9 @@ void CtffindRunner::initialise() {
         REPORT_ERROR("CtffindRunner::initialise ERROR: You cannot use a --ctfWin operation on movies.");
 
     if (verb > 0) {
-        if (do_use_gctf) {
+        if (do_use_native) {
+            std::cout << " Using RELION's own CTF estimation" << std::endl;
+        } else if (do_use_gctf) {
             std::cout << " Using Gctf executable in: " << fn_gctf_exe << std::endl;
         } else {
             std::cout << " Using CTFFIND executable in: " << fn_ctffind_exe << std::endl;
@@ -337,7 +349,9 @@ void CtffindRunner::run() {
     if (!do_only_join_results) {
         int barstep;
         if (verb > 0) {
-            if (do_use_gctf) {
+            if (do_use_native) {
+                std::cout << " Estimating CTF parameters within RELION ..." << std::endl;
+            } else if (do_use_gctf) {
                 std::cout << " Estimating CTF parameters using Kai Zhang's Gctf ..." << std::endl;
             } else {
                 if (is_ctffind4) {
@@ -363,7 +377,9 @@ void CtffindRunner::run() {
             AmplitudeContrast = obsModel.opticsMdt.getValue<RFLOAT>(EMDL::CTF_Q0,                optics_group_micrographs[imic] - 1);
             angpix            = obsModel.opticsMdt.getValue<RFLOAT>(EMDL::MICROGRAPH_PIXEL_SIZE, optics_group_micrographs[imic] - 1);
 
-            if (do_use_gctf) {
+            if (do_use_native) {
+                executeNative(imic);
+            } else if (do_use_gctf) {
                 executeGctf(imic, allmicnames, imic + 1 == fn_micrographs.size());
             } else if (is_ctffind4) {
                 executeCtffind4(imic);
@@ -741,12 +757,86 @@ void CtffindRunner::executeCtffind4(long int imic) {
     }
 }
 
+void CtffindRunner::executeNative(long int imic) {
+    FileName fn_mic = getOutputFileWithNewUniqueDate(fn_micrographs_ctf[imic], fn_out);
+    FileName fn_root = fn_mic.withoutExtension();
+
+    CtfEstimator estimator;
+    estimator.box_size = box_size;
+    estimator.angpix = angpix;
+    estimator.resol_min = resol_min;
+    estimator.resol_max = resol_max;
+    estimator.min_defocus = min_defocus;
+    estimator.max_defocus = max_defocus;
+    estimator.step_defocus = step_defocus;
+    estimator.amount_astigmatism = amount_astigmatism;
+    estimator.voltage = Voltage;
+    estimator.Cs = Cs;
+    estimator.Q0 = AmplitudeContrast;
+    estimator.do_phaseshift = do_phaseshift;
+    estimator.phase_min = phase_min;
+    estimator.phase_max = phase_max;
+    estimator.phase_step = phase_step;
+    estimator.nr_threads = nr_threads;
+
+    auto I = Image<RFLOAT>::from_filename(fn_mic);
+    if (Zsize(I()) > 1 || Nsize(I()) > 1)
+        REPORT_ERROR("CtffindRunner::executeNative ERROR: No movies or volumes allowed for " + fn_micrographs_ctf[imic]);
+
+    MultidimArray<RFLOAT> spectrum;
+    if (use_given_ps) {
+        // A centred amplitude spectrum, as written by relion_run_motioncorr
+        if (Xsize(I()) != Ysize(I()))
+            REPORT_ERROR("CtffindRunner::executeNative ERROR: the power spectrum " + fn_micrographs_ctf[imic] + " is not square.");
+        estimator.angpix = I.samplingRateX();
+        spectrum = I();
+        spectrum.setXmippOrigin();
+    } else {
+        // If given, then put a square window of ctf_win on the micrograph for CTF estimation
+        if (ctf_win > 0) {
+            I() = I().setXmippOrigin().windowed(
+                Xmipp::init(ctf_win), Xmipp::last(ctf_win),
+                Xmipp::init(ctf_win), Xmipp::last(ctf_win));
+        }
+        spectrum = estimator.averageSpectrum(I());
+    }
+
+    spectrum = estimator.subtractBackground(spectrum);
+    const CtfEstimator::Fit fit = estimator.fit(spectrum);
+
+    // Diagnostic image, in the same place as CTFFIND's
+    Image<RFLOAT> Ictf (estimator.diagnosticImage(spectrum, fit));
+    Ictf.setSamplingRateInHeader(estimator.angpix);
+    Ictf.write(fn_root + ".ctf:mrc");
+
+    MetaDataTable MDresults;
+    MDresults.name = "ctf";
+    MDresults.isList = true;
+    const long int i = MDresults.addObject();
+    MDresults.setValue(EMDL::CTF_DEFOCUSU,          fit.defU,            i);
+    MDresults.setValue(EMDL::CTF_DEFOCUSV,          fit.defV,            i);
+    MDresults.setValue(EMDL::CTF_DEFOCUS_ANGLE,     fit.defAng,          i);
+    MDresults.setValue(EMDL::CTF_PHASESHIFT,        fit.phase_shift,     i);
+    MDresults.setValue(EMDL::CTF_FOM,               fit.fom,             i);
+    MDresults.setValue(EMDL::CTF_MAXRES,            fit.maxres,          i);
+    MDresults.setValue(EMDL::CTF_VOLTAGE,           Voltage,             i);
+    MDresults.setValue(EMDL::CTF_CS,                Cs,                  i);
+    MDresults.setValue(EMDL::CTF_Q0,                AmplitudeContrast,   i);
+    MDresults.setValue(EMDL::MICROGRAPH_PIXEL_SIZE, estimator.angpix,    i);
+    MDresults.write(fn_root + "_native.star");
+}
+
 bool CtffindRunner::getCtffindResults(
     FileName fn_microot, RFLOAT &defU, RFLOAT &defV, RFLOAT &defAng, RFLOAT &CC,
     RFLOAT &HT, RFLOAT &CS, RFLOAT &AmpCnst, RFLOAT &XMAG, RFLOAT &DStep,
     RFLOAT &maxres, RFLOAT &valscore, RFLOAT &phaseshift, bool do_warn
 ) {
-    if (is_ctffind4) {
+    if (do_use_native) {
+        return getNativeResults(
+            fn_microot, defU, defV, defAng, CC, HT, CS, AmpCnst, XMAG, DStep,
+            maxres, phaseshift, do_warn
+        );
+    } else if (is_ctffind4) {
         return getCtffind4Results(
             fn_microot, defU, defV, defAng, CC, HT, CS, AmpCnst, XMAG, DStep,
             maxres, phaseshift, do_warn
@@ -927,3 +1017,38 @@ bool CtffindRunner::getCtffind4Results(
 
     return Final_is_found;
 }
+
+bool CtffindRunner::getNativeResults(
+    FileName fn_microot, RFLOAT &defU, RFLOAT &defV, RFLOAT &defAng, RFLOAT &CC,
+    RFLOAT &HT, RFLOAT &CS, RFLOAT &AmpCnst, RFLOAT &XMAG, RFLOAT &DStep,
+    RFLOAT &maxres, RFLOAT &phaseshift, bool do_warn
+) {
+    FileName fn_root = getOutputFileWithNewUniqueDate(fn_microot, fn_out);
+    FileName fn_results = fn_root + "_native.star";
+    if (!exists(fn_results))
+        return false;
+
+    MetaDataTable MDresults;
+    MDresults.read(fn_results, "ctf");
+    if (MDresults.size() != 1) {
+        if (do_warn)
+            std::cerr << "WARNING: cannot find the CTF parameters in " << fn_results << std::endl;
+        return false;
+    }
+
+    const long int i = MDresults.size() - 1;
+    defU    = MDresults.getValue<RFLOAT>(EMDL::CTF_DEFOCUSU,          i);
+    defV    = MDresults.getValue<RFLOAT>(EMDL::CTF_DEFOCUSV,          i);
+    defAng  = MDresults.getValue<RFLOAT>(EMDL::CTF_DEFOCUS_ANGLE,     i);
+    CC      = MDresults.getValue<RFLOAT>(EMDL::CTF_FOM,               i);
+    maxres  = MDresults.getValue<RFLOAT>(EMDL::CTF_MAXRES,            i);
+    HT      = MDresults.getValue<RFLOAT>(EMDL::CTF_VOLTAGE,           i);
+    CS      = MDresults.getValue<RFLOAT>(EMDL::CTF_CS,                i);
+    AmpCnst = MDresults.getValue<RFLOAT>(EMDL::CTF_Q0,                i);
+    DStep   = MDresults.getValue<RFLOAT>(EMDL::MICROGRAPH_PIXEL_SIZE, i);
+    XMAG = 10000.0;
+    if (do_phaseshift)
+        phaseshift = MDresults.getValue<RFLOAT>(EMDL::CTF_PHASESHIFT, i);
+
+    return true;
+}
@@ -148,6 +148,9 @@ class CtffindRunner {
 	// Disable "Slower, more exhaustive search?" in CTFFIND 4.1.5-
 	bool do_fast_search;
 
+	// Estimate the CTF within RELION (see CtfEstimator), instead of with CTFFIND or Gctf?
+	bool do_use_native;
+
 	// Which GPU devices to use?
 	std::string gpu_ids;
 	std::vector<std::vector<std::string>> allThreadIDs;
@@ -183,6 +186,9 @@ class CtffindRunner {
 	//void executeGctf( std::vector<std::string> &allmicnames);
 	void executeGctf(long int imic,  std::vector<std::string> &allmicnames, bool is_last, int rank = 0);
 
+	// Estimate the CTF of a single micrograph within RELION
+	void executeNative(long int imic);
+
 	// Get micrograph metadata
 	bool getCtffindResults(FileName fn_mic, RFLOAT &defU, RFLOAT &defV, RFLOAT &defAng, RFLOAT &CC,
 			RFLOAT &HT, RFLOAT &CS, RFLOAT &AmpCnst, RFLOAT &XMAG, RFLOAT &DStep,
@@ -193,6 +199,9 @@ class CtffindRunner {
 	bool getCtffind4Results(FileName fn_mic, RFLOAT &defU, RFLOAT &defV, RFLOAT &defAng, RFLOAT &CC,
 			RFLOAT &HT, RFLOAT &CS, RFLOAT &AmpCnst, RFLOAT &XMAG, RFLOAT &DStep,
 			RFLOAT &maxres, RFLOAT &phaseshift, bool do_warn = true);
+	bool getNativeResults(FileName fn_mic, RFLOAT &defU, RFLOAT &defV, RFLOAT &defAng, RFLOAT &CC,
+			RFLOAT &HT, RFLOAT &CS, RFLOAT &AmpCnst, RFLOAT &XMAG, RFLOAT &DStep,
+			RFLOAT &maxres, RFLOAT &phaseshift, bool do_warn = true);
 };
 
 
@@ -44,7 +44,9 @@ void CtffindRunnerMpi::run() {
 
         int barstep;
         if (verb > 0) {
-            if (do_use_gctf) {
+            if (do_use_native) {
+                std::cout << " Estimating CTF parameters within RELION ..." << std::endl;
+            } else if (do_use_gctf) {
                 std::cout << " Estimating CTF parameters using Kai Zhang's Gctf ..." << std::endl;
             } else {
                 std::cout << " Estimating CTF parameters using Niko Grigorieff's CTFFIND ..." << std::endl;
@@ -66,7 +68,9 @@ void CtffindRunnerMpi::run() {
             AmplitudeContrast = obsModel.opticsMdt.getValue<RFLOAT>(EMDL::CTF_Q0,                optics_group_micrographs[imic] - 1);
             angpix            = obsModel.opticsMdt.getValue<RFLOAT>(EMDL::MICROGRAPH_PIXEL_SIZE, optics_group_micrographs[imic] - 1);
 
-            if (do_use_gctf) {
+            if (do_use_native) {
+                executeNative(imic);
+            } else if (do_use_gctf) {
                 //addToGctfJobList(imic, allmicnames);
                 executeGctf(imic, allmicnames, imic == my_last_micrograph, node->rank);
             } else if (is_ctffind4) {
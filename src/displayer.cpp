@@ -78,7 +78,7 @@ void DisplayBox::draw() {
 }
 
 void DisplayBox::setData(
-    MultidimArray<RFLOAT> &img, MetaDataContainer *MDCin, int _ipos,
+    MultidimArray<RFLOAT> &img, const MetaDataContainer &MDCin, int _ipos,
     RFLOAT _minval, RFLOAT _maxval, RFLOAT _scale, bool do_relion_scale
 ) {
     scale = _scale;
@@ -109,7 +109,7 @@ class DisplayBox: public Fl_Box {
     DisplayBox(int X, int Y, int W, int H, const char *L=0):
         Fl_Box(X, Y, W, H, L), img_data(nullptr), img_label() { MDimg.clear(); }
 
-    void setData(MultidimArray<RFLOAT> &img, MetaDataContainer *MDCin, int ipos, RFLOAT minval, RFLOAT maxval,
+    void setData(MultidimArray<RFLOAT> &img, const MetaDataContainer &MDCin, int ipos, RFLOAT minval, RFLOAT maxval,
                  RFLOAT _scale, bool do_relion_scale = false);
 
     // Destructor
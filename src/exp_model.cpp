@@ -18,6 +18,7 @@
  * author citations must be preserved.
  ***************************************************************************/
 #include "src/exp_model.h"
+#include <sys/stat.h>
 #include <sys/statvfs.h>
 
 long int Experiment::numberOfParticles(int random_subset) {
@@ -377,6 +378,15 @@ void Experiment::initialiseBodies(int nr_bodies) {
     }
 }
 
+void Experiment::getPrereadImage(long int part_id, int img_id, MultidimArray<RFLOAT> &img) const {
+    const ExpImage &image = particles[part_id].images[img_id];
+    if (compressed_images.isEnabled()) {
+        compressed_images.get(image.id, img);
+    } else {
+        img = image.img;
+    }
+}
+
 FileName Experiment::getImageNameOnScratch(long int part_id, int img_id, bool is_ctf_image) {
     const int optics_group = getOpticsGroup(part_id, img_id);
     const long int my_id = particles[part_id].images[img_id].optics_group_id;
@@ -390,7 +400,7 @@ FileName Experiment::getImageNameOnScratch(long int part_id, int img_id, bool is
     #define RETURN(expression) return expression;
     #endif
 
-    if (fn_scratch.empty() || my_id >= nr_parts_on_scratch[optics_group])
+    if (fn_scratch.empty() || my_id >= nr_parts_on_scratch[optics_group] || scratch_stager && !scratch_stager->isStaged(optics_group))
         throw "!";
 
     if (is_3D)
@@ -413,18 +423,27 @@ void Experiment::setScratchDirectory(const FileName &fn_scratch, bool do_reuse_s
     if (do_reuse_scratch) {
         nr_parts_on_scratch.resize(numberOfOpticsGroups(), 0);
         for (int optics_group = 0; optics_group < numberOfOpticsGroups(); optics_group++) {
+            // Of an interrupted copy, only the part in the manifest is there
+            const FileName fn_group = this->fn_scratch + "opticsgroup" + integerToString(optics_group + 1);
+            long int nr_images = 0;
+            const long int nr_copied = ScratchStager::copiedImages(fn_group + "_manifest.txt", &nr_images);
             if (is_3D) {
-                FileName fn_tmp = this->fn_scratch + "opticsgroup" + integerToString(optics_group + 1) + "_particle*.mrc";
+                FileName fn_tmp = fn_group + "_particle*.mrc";
                 std::vector<FileName> fn_all;
                 fn_tmp.globFiles(fn_all, true);
                 nr_parts_on_scratch[optics_group] = fn_all.size();
+                // A manifest counts CTF images too, so only trust complete copies
+                if (nr_copied >= 0 && nr_copied < nr_images)
+                    nr_parts_on_scratch[optics_group] = 0;
 
             } else {
-                FileName fn_tmp = this->fn_scratch + "opticsgroup" + integerToString(optics_group + 1) + "_particles.mrcs";
+                FileName fn_tmp = fn_group + "_particles.mrcs";
                 if (exists(fn_tmp)) {
                     Image<RFLOAT> Itmp;
                     Itmp.read(fn_tmp, false);
                     nr_parts_on_scratch[optics_group] = Nsize(Itmp());
+                    if (nr_copied >= 0)
+                        nr_parts_on_scratch[optics_group] = std::min(nr_parts_on_scratch[optics_group], nr_copied);
                 }
                 #ifdef DEBUG_SCRATCH
                 if (verb > 0)
@@ -449,7 +468,7 @@ FileName Experiment::initialiseScratchLock(const FileName &fn_out) {
     return fn_lock;
 }
 
-bool Experiment::prepareScratchDirectory(const FileName &fn_scratch, const FileName &fn_lock) {
+bool Experiment::prepareScratchDirectory(const FileName &fn_scratch, const FileName &fn_lock, bool do_resume) {
     if (!fn_lock.empty() && exists(fn_lock)) {
         // Still measure how much free space there is
         struct statvfs vfs;
@@ -459,20 +478,18 @@ bool Experiment::prepareScratchDirectory(const FileName &fn_scratch, const FileN
         free_space_Gb = (RFLOAT) vfs.f_bsize * vfs.f_bfree / (1024 * 1024 * 1024);
         return false;
     } else {
-        // Wipe the directory clean and make a new one
-        deleteDataOnScratch();
+        // Wipe the directory clean and make a new one (unless an interrupted copy is to be resumed)
+        if (!do_resume)
+            deleteDataOnScratch();
 
         // Make the scratch directory with write permissions
-        const std::string command = "install -d -m 0777 " + this->fn_scratch;
-        if (system(command.c_str()))
-            REPORT_ERROR("ERROR: cannot execute: " + command);
+        if (mktree(this->fn_scratch) || chmod(this->fn_scratch.c_str(), 0777))
+            REPORT_ERROR("ERROR: cannot make the scratch directory " + this->fn_scratch);
 
         // Touch the lock file
-        if (fn_lock.empty()) {
+        if (!fn_lock.empty()) {
             touch(fn_lock);
-            const std::string command = "chmod 0777 " + fn_lock;
-            if (system(command.c_str()))
-                REPORT_ERROR("ERROR: cannot execute: " + command);
+            chmod(fn_lock.c_str(), 0777);
         }
 
         // Measure how much free space there is
@@ -488,6 +505,9 @@ bool Experiment::prepareScratchDirectory(const FileName &fn_scratch, const FileN
 }
 
 void Experiment::deleteDataOnScratch() {
+    // Stop copying into it
+    if (scratch_stager) scratch_stager->stop();
+
     // Wipe the scratch directory
     if (!fn_scratch.empty() && exists(fn_scratch)) {
         const std::string command = " rm -rf " + fn_scratch;
@@ -496,16 +516,13 @@ void Experiment::deleteDataOnScratch() {
     }
 }
 
-void Experiment::copyParticlesToScratch(int verb, bool do_copy, bool also_do_ctf_image, RFLOAT keep_free_scratch_Gb) {
+void Experiment::copyParticlesToScratch(
+    int verb, bool do_copy, bool also_do_ctf_image, RFLOAT keep_free_scratch_Gb,
+    int nr_threads, bool do_resume, bool do_background
+) {
     // This function relies on prepareScratchDirectory() being called before!
 
     long int nr_part = MDimg.size();
-    int barstep;
-    if (verb > 0 && do_copy) {
-        std::cout << " Copying particles to scratch directory: " << fn_scratch << std::endl;
-        init_progress_bar(nr_part);
-        barstep = std::max(1, (int) nr_part / 60);
-    }
 
     long int one_part_space, used_space = 0.0;
     long int max_space = (free_space_Gb - keep_free_scratch_Gb) * 1024 * 1024 * 1024; // in bytes
@@ -513,10 +530,20 @@ void Experiment::copyParticlesToScratch(int verb, bool do_copy, bool also_do_ctf
     std::cerr << " free_space_Gb = " << free_space_Gb << " GB, keep_free_scratch_Gb = " << keep_free_scratch_Gb << " GB.\n";
     std::cerr << " Max space RELION can use = " << max_space << " bytes" << std::endl;
     #endif
-    // Loop over all particles and copy them one-by-one
-    FileName fn_open_stack = "";
+    // Loop over all particles to decide which ones go where (the copying is done by a ScratchStager)
     long int total_nr_parts_on_scratch = 0;
     nr_parts_on_scratch.resize(numberOfOpticsGroups(), 0);
+    std::vector<ScratchStager::Group> groups (numberOfOpticsGroups());
+
+    // When resuming, the images that were already copied are on the scratch disk (and not in free_space_Gb):
+    // they do not take more space, and should not make fewer particles fit than before
+    std::vector<long int> nr_imgs_staged (numberOfOpticsGroups(), 0);
+    if (do_copy && do_resume) {
+        for (int optics_group = 0; optics_group < numberOfOpticsGroups(); optics_group++) {
+            const FileName fn_manifest = fn_scratch + "opticsgroup" + integerToString(optics_group + 1) + "_manifest.txt";
+            nr_imgs_staged[optics_group] = std::max(ScratchStager::copiedImages(fn_manifest), 0L);
+        }
+    }
 
     const int check_abort_frequency = 100;
 
@@ -536,6 +563,8 @@ void Experiment::copyParticlesToScratch(int verb, bool do_copy, bool also_do_ctf
                 return 0;
             };
         }();
+        ScratchStager::Group &group = groups[optics_group];
+        const FileName fn_group = fn_scratch + "opticsgroup" + integerToString(optics_group + 1);
 
         // Get the size of the first particle
         if (nr_parts_on_scratch[optics_group] == 0) {
@@ -551,17 +580,23 @@ void Experiment::copyParticlesToScratch(int verb, bool do_copy, bool also_do_ctf
             #ifdef DEBUG_SCRATCH
             std::cerr << "one_part_space[" << optics_group << "] = " << one_part_space << std::endl;
             #endif
+            group.fn_manifest = fn_group + "_manifest.txt";
+            if (!is_3D) group.fn_stack = fn_group + "_particles.mrcs";
+            group.xdim = Xsize(tmp());
+            group.ydim = Ysize(tmp());
+            group.angpix = tmp.samplingRateX();
         }
 
         bool is_duplicate = prev_img_name == fn_img && prev_optics_group == optics_group;
-        // Read in the particle image, and write out on scratch
+        // Plan to copy the particle image to scratch
         if (do_copy && !is_duplicate) {
             #ifdef DEBUG_SCRATCH
             std::cerr << "used_space = " << used_space << std::endl;
             #endif
-            // Now we have the particle in memory
-            // See how much space it occupies
-            used_space += one_part_space;
+            // See how much space it occupies (unless it is already there)
+            const long int nr_imgs = is_3D && also_do_ctf_image ? 2 : 1;
+            if (group.fn_imgs.size() + nr_imgs > nr_imgs_staged[optics_group])
+                used_space += one_part_space;
             // If there is no more space, exit the loop over all objects to stop copying files and change filenames in MDimg
             if (used_space > max_space) {
                 char nodename[64] = "undefined";
@@ -571,69 +606,47 @@ void Experiment::copyParticlesToScratch(int verb, bool do_copy, bool also_do_ctf
                 break;
             }
 
+            group.fn_imgs.push_back(fn_img);
             if (is_3D) {
-                // For subtomograms, write individual .mrc files,possibly also CTF images
-                const FileName new_fn_img = fn_scratch + "opticsgroup" + integerToString(optics_group + 1) + "_particle" + integerToString(nr_parts_on_scratch[optics_group] + 1) + ".mrc";
-                Image<RFLOAT>::from_filename(fn_img).write(new_fn_img);
+                // For subtomograms, write individual .mrc files, possibly also CTF images
+                const std::string suffix = integerToString(nr_parts_on_scratch[optics_group] + 1) + ".mrc";
+                group.fn_copies.push_back(fn_group + "_particle" + suffix);
                 if (also_do_ctf_image) {
-                    const FileName fn_ctf = MDimg.getValue<std::string>(EMDL::CTF_IMAGE, MDimg.size() - 1);
-                    const FileName new_fn_ctf = fn_scratch + "opticsgroup" + integerToString(optics_group + 1) + "_particle_ctf" + integerToString(nr_parts_on_scratch[optics_group] + 1) + ".mrc";
-                    Image<RFLOAT>::from_filename(fn_ctf).write(new_fn_ctf);
-                }
-            } else {
-                // Only open/close new stacks, so check if this is a new stack
-                long int imgno;
-                FileName fn_stack;
-                fn_img.decompose(imgno, fn_stack);
-                fImageHandler hFile;
-                if (fn_stack != fn_open_stack) {
-                    // Manual closing isn't necessary: if still open, then openFile will first close the filehandler
-                    // Also closing the last one isn't necessary, as destructor will do this.
-                    //if (fn_open_stack != "")
-                    //	hFile.closeFile();
-                    hFile.openFile(fn_stack, WRITE_READONLY);
-                    fn_open_stack = fn_stack;
-                }
-                Image<RFLOAT> img;
-                img.readFromOpenFile(fn_img, hFile, -1, false);
-
-                const auto fn_new = FileName::compose(nr_parts_on_scratch[optics_group] + 1, fn_scratch + "opticsgroup" + integerToString(optics_group + 1) + "_particles.mrcs");
-                if (nr_parts_on_scratch[optics_group] == 0) {
-                    img.write(fn_new, -1, false, WRITE_OVERWRITE);
-                } else {
-                    img.write(fn_new, -1, true, WRITE_APPEND);
+                    group.fn_imgs.push_back(MDimg.getValue<std::string>(EMDL::CTF_IMAGE, i));
+                    group.fn_copies.push_back(fn_group + "_particle_ctf" + suffix);
                 }
-
-                #ifdef DEBUG_SCRATCH
-                std::cerr << "Cached " << fn_img << " to " << fn_new << std::endl;
-                #endif
             }
         }
 
-        // Update the counter and progress bar
+        // Update the counter
         if (!is_duplicate)
             nr_parts_on_scratch[optics_group]++;
         total_nr_parts_on_scratch++;
 
         prev_img_name = fn_img;
         prev_optics_group = optics_group;
+    }
 
-        if (verb > 0 && total_nr_parts_on_scratch % barstep == 0)
-            progress_bar(total_nr_parts_on_scratch);
+    if (do_copy) {
+        if (verb > 0)
+            std::cout << " Copying particles to scratch directory: " << fn_scratch << std::endl;
+        scratch_stager = std::make_shared<ScratchStager>(groups, nr_threads, do_resume);
+        if (do_background) {
+            // Until an optics group has been copied, its particles are read from where they were
+            scratch_stager->start();
+            if (verb > 0)
+                std::cout << " (in the background, on " << nr_threads << " threads: each optics group will be read from there once it has been copied)" << std::endl;
+        } else {
+            scratch_stager->run(verb);
+            scratch_stager.reset();
+        }
     }
 
     if (verb) {
-        progress_bar(nr_part);
         for (int i = 0; i < nr_parts_on_scratch.size(); i++) {
             std::cout << " For optics_group " << i + 1 << ", there are " << nr_parts_on_scratch[i] << " particles on the scratch disk." << std::endl;
         }
     }
-
-    if (do_copy && total_nr_parts_on_scratch > 1) {
-        const std::string command = " chmod -R 777 " + fn_scratch + "/";
-        if (system(command.c_str()))
-            REPORT_ERROR("ERROR in executing: " + command);
-    }
 }
 
 // Read from file
@@ -683,6 +696,7 @@ void Experiment::read(
 
         // allocate 1 block of memory
         particles.reserve(Nsize(img()));
+        if (do_preread_images && compressed_images.isEnabled()) compressed_images.reserve(Nsize(img()));
         nr_images_per_optics_group.resize(1, 0);
 
         for (long int n = 0; n < Nsize(img()); n++) {
@@ -702,7 +716,11 @@ void Experiment::read(
                 }
                 Image<float> img;
                 img.readFromOpenFile(fn_img, hFile, -1, false);
-                particles[part_id].images[0].img = img().setXmippOrigin();
+                if (compressed_images.isEnabled()) {
+                    compressed_images.add(n, img());
+                } else {
+                    particles[part_id].images[0].img = img().setXmippOrigin();
+                }
             }
 
             // Set the filename and other metadata parameters
@@ -753,6 +771,7 @@ void Experiment::read(
         #endif
         // allocate 1 block of memory
         particles.reserve(MDimg.size());
+        if (do_preread_images && compressed_images.isEnabled()) compressed_images.reserve(MDimg.size());
 
         // Now Loop over all objects in the metadata file and fill the logical tree of the experiment
         long int last_part_id = -1;
@@ -891,7 +910,11 @@ void Experiment::read(
                 }
                 Image<float> img;
                 img.readFromOpenFile(img_name, hFile, -1, false);
-                particles[part_id].images[img_id].img = img().setXmippOrigin();
+                if (compressed_images.isEnabled()) {
+                    compressed_images.add(ori_img_id, img());
+                } else {
+                    particles[part_id].images[img_id].img = img().setXmippOrigin();
+                }
             }
 
             #ifdef DEBUG_READ
@@ -995,11 +1018,14 @@ void Experiment::read(
 }
 
 // Write to file
-void Experiment::write(FileName fn_root) {
+void Experiment::write(FileName fn_root, bool do_write_binary) {
+    // Written to a temporary file and renamed, like MetaDataTable::write, so that the STAR file
+    // gets a new inode (which tells MetaDataTable::read that an old binary copy is out of date)
     const FileName fn_tmp = fn_root + "_data.star";
-    std::ofstream fh ((fn_tmp).c_str(), std::ios::out);
+    const FileName fn_star_tmp = fn_tmp + ".tmp";
+    std::ofstream fh ((fn_star_tmp).c_str(), std::ios::out);
     if (!fh)
-        REPORT_ERROR((std::string) "Experiment::write: Cannot write file: " + fn_tmp);
+        REPORT_ERROR((std::string) "Experiment::write: Cannot write file: " + fn_star_tmp);
 
     obsModel.opticsMdt.name = "optics";
     obsModel.opticsMdt.write(fh);
@@ -1014,4 +1040,32 @@ void Experiment::write(FileName fn_root) {
         }
     }
 
+    fh.close();
+    if (!fh || std::rename(fn_star_tmp.c_str(), fn_tmp.c_str()))
+        REPORT_ERROR((std::string) "Experiment::write: Cannot write file: " + fn_tmp);
+
+    // The same tables in binary, which MetaDataTable::read will prefer while the STAR file is unchanged
+    // (written to a temporary file first, so that an interrupted write never leaves an incomplete one)
+    if (do_write_binary) {
+        const FileName fn_bin = fn_tmp + ".bin";
+        const FileName fn_bin_tmp = fn_bin + ".tmp";
+        std::ofstream fhb (fn_bin_tmp.c_str(), std::ios::out | std::ios::binary);
+        if (!fhb)
+            REPORT_ERROR((std::string) "Experiment::write: Cannot write file: " + fn_bin_tmp);
+        obsModel.opticsMdt.writeBinary(fhb, fn_tmp);
+        MDimg.writeBinary(fhb, fn_tmp);
+        if (nr_bodies > 1) {
+            for (int ibody = 0; ibody < nr_bodies; ibody++) {
+                MDbodies[ibody].writeBinary(fhb, fn_tmp);
+            }
+        }
+        fhb.close();
+        if (!fhb) {
+            std::remove(fn_bin_tmp.c_str());
+            REPORT_ERROR((std::string) "Experiment::write: Cannot write file: " + fn_bin_tmp);
+        }
+        if (std::rename(fn_bin_tmp.c_str(), fn_bin.c_str()))
+            REPORT_ERROR((std::string) "Experiment::write: Cannot write file: " + fn_bin);
+    }
+
 }
@@ -26,6 +26,8 @@
 #include "src/metadata_table.h"
 #include "src/time.h"
 #include "src/ctf.h"
+#include "src/particle_cache.h"
+#include "src/scratch_stager.h"
 #include "src/jaz/obs_model.h"
 
 /// Reserve large vectors with some reasonable estimate
@@ -253,9 +255,15 @@ class Experiment {
     // Number of Gb on scratch disk before copying particles
     RFLOAT free_space_Gb;
 
+    // Copying particles to the scratch disk in the background (if it is)
+    std::shared_ptr<ScratchStager> scratch_stager;
+
     // Is this sub-tomograms?
     bool is_3D;
 
+    // Pre-read images in compressed form (if its format is set before read(); otherwise they are kept in ExpImage::img)
+    ParticleImageCache compressed_images;
+
     // Empty Constructor
     Experiment() {
         clear();
@@ -276,12 +284,14 @@ class Experiment {
         nr_bodies = 1;
         fn_scratch = "";
         nr_parts_on_scratch.clear();
+        scratch_stager.reset();
         free_space_Gb = 10;
         is_3D = false;
         MDimg.clear();
         MDimg.isList = false;
         MDbodies.clear();
         MDimg.name = "images";
+        compressed_images.clear();
     }
 
     // Calculate the total number of particles in this experiment
@@ -361,6 +371,9 @@ class Experiment {
     // Get the image name for a given part_id
     FileName getImageNameOnScratch(long int part_id, int img_id, bool is_ctf_image = false);
 
+    // Get a pre-read image (decompressing it if need be)
+    void getPrereadImage(long int part_id, int img_id, MultidimArray<RFLOAT> &img) const;
+
     // For parallel executions, lock the scratch directory with a unique code, so we won't copy the same data many times to the same position
     // This determines the lockname and removes the lock if it exists
     FileName initialiseScratchLock(const FileName &fn_out);
@@ -368,7 +381,8 @@ class Experiment {
     // Returns true if particles need to be copied, and creates a lock file.
     // Returns false if the particles do not need to be copied. In that case, only the number of particles on the scratch disk needs to be counted
     // Also checks how much free space there is on the scratch dir
-    bool prepareScratchDirectory(const FileName &fn_scratch, const FileName &fn_lock = "");
+    // With do_resume, what is already on the scratch dir is kept, for copyParticlesToScratch() to resume an interrupted copy
+    bool prepareScratchDirectory(const FileName &fn_scratch, const FileName &fn_lock = "", bool do_resume = false);
 
     void setScratchDirectory(const FileName &fn_scratch, bool do_reuse_scratch, int verb=0);
 
@@ -378,7 +392,13 @@ class Experiment {
     // Copy particles from their original position to a scratch directory
     // Monitor when the scratch disk gets to have fewer than free_scratch_Gb space,
     // in that case, stop copying, and keep reading particles from where they were...
-    void copyParticlesToScratch(int verb, bool do_copy = true, bool also_do_ctf_image = false, RFLOAT free_scratch_Gb = 10);
+    // The copying is done on nr_threads threads, resuming an interrupted copy of the same particles (with do_resume).
+    // With do_background, it is done in the background, and getImageNameOnScratch() only returns the names of
+    // the particles of the optics groups that have been copied completely.
+    void copyParticlesToScratch(
+        int verb, bool do_copy = true, bool also_do_ctf_image = false, RFLOAT free_scratch_Gb = 10,
+        int nr_threads = 1, bool do_resume = false, bool do_background = false
+    );
 
     // Read from file
     void read(
@@ -387,8 +407,8 @@ class Experiment {
         bool do_ignore_group_name = false, bool do_preread_images = false,
         bool need_tiltpsipriors_for_helical_refine = false, int verb = 0);
 
-    // Write
-    void write(FileName fn_root);
+    // Write (and, if do_write_binary, also write a binary copy next to the STAR file)
+    void write(FileName fn_root, bool do_write_binary = false);
 
 
 private:
@@ -45,6 +45,7 @@
 
 #include "src/macros.h"
 #include "src/fftw.h"
+#include "src/fftw_plans.h"
 #include "src/args.h"
 #include <string.h>
 #include <math.h>
@@ -53,9 +54,6 @@
 using RealArray = MultidimArray<RFLOAT>;
 using ComplexArray = MultidimArray<Complex>;
 
-// Anything to do with plans has to be protected for threads
-static pthread_mutex_t fftw_plan_mutex = PTHREAD_MUTEX_INITIALIZER;
-
 // #define TIMING_FFTW
 #ifdef TIMING_FFTW
 #include "src/time.h"
@@ -104,11 +102,8 @@ void FourierTransformer::clear() {
 }
 
 void FourierTransformer::cleanup() {
-    // First clear object and destroy plans
+    // The plans are shared by all transformers (see FftwPlans), so fftw_cleanup() may no longer be called
     clear();
-    // Then clean up all the junk fftw keeps lying around
-    // SOMEHOW THE FOLLOWING IS NOT ALLOWED WHEN USING MULTPLE TRANSFORMER OBJECTS....
-    FFTW_CLEANUP();
 
     #ifdef DEBUG_PLANS
     std::cerr << "CLEANED-UP this= " << this << std::endl;
@@ -117,12 +112,10 @@ void FourierTransformer::cleanup() {
 }
 
 void FourierTransformer::destroyPlans() {
-    if (plans_are_set) {
-        pthread_lock_guard guard (&fftw_plan_mutex);
-        FFTW_DESTROY_PLAN(fPlanForward);
-        FFTW_DESTROY_PLAN(fPlanBackward);
-        plans_are_set = false;
-    }
+    // The plans belong to FftwPlans
+    fPlanForward  = nullptr;
+    fPlanBackward = nullptr;
+    plans_are_set = false;
 }
 
 // Initialization ----------------------------------------------------------
@@ -161,24 +154,15 @@ void FourierTransformer::computePlans(const MultidimArray<RFLOAT> &input) {
     const int rank = get_array_rank(input);
     const int *const n = new_n(input, rank);
 
-    // Destroy any existing plans
-    destroyPlans();
-
-    // Make new plans
+    // Look up the plans (made the first time this shape is seen)
     {
     ifdefTIMING_FFTW(TicToc tt (timer_fftw, TIMING_FFTW_PLAN);)
-    pthread_lock_guard guard (&fftw_plan_mutex);
-    fPlanForward  = FFTW_PLAN_DFT_R2C(rank, n,
-        fReal->data, (FFTW_COMPLEX*) fFourier.data, FFTW_ESTIMATE);
-    fPlanBackward = FFTW_PLAN_DFT_C2R(rank, n,
-        (FFTW_COMPLEX*) fFourier.data, fReal->data, FFTW_ESTIMATE);
+    fPlanForward  = FftwPlans::get(FftwPlans::R2C, rank, n, fReal->data, (RFLOAT*) fFourier.data);
+    fPlanBackward = FftwPlans::get(FftwPlans::C2R, rank, n, (RFLOAT*) fFourier.data, fReal->data);
     }
 
     delete[] n;
 
-    if (!fPlanForward || !fPlanBackward)
-        REPORT_ERROR("FFTW plans could not be created");
-
     #ifdef DEBUG_PLANS
     std::cerr << " SETREAL fPlanForward= " << fPlanForward << " fPlanBackward= " << fPlanBackward  << " this= " << this << std::endl;
     #endif
@@ -193,23 +177,14 @@ void FourierTransformer::computePlans(const MultidimArray<Complex> &input) {
     const int rank = get_array_rank(input);
     const int *const n = new_n(input, rank);
 
-    // Destroy both forward and backward plans if they already exist
-    destroyPlans();
-
     {
     ifdefTIMING_FFTW(TicToc tt (timer_fftw, TIMING_FFTW_PLAN);)
-    pthread_lock_guard guard (&fftw_plan_mutex);
-    fPlanForward  = FFTW_PLAN_DFT(rank, n, (FFTW_COMPLEX*) fComplex->data,
-        (FFTW_COMPLEX*) fFourier.data,  FFTW_FORWARD,  FFTW_ESTIMATE);
-    fPlanBackward = FFTW_PLAN_DFT(rank, n, (FFTW_COMPLEX*) fFourier.data,
-        (FFTW_COMPLEX*) fComplex->data, FFTW_BACKWARD, FFTW_ESTIMATE);
+    fPlanForward  = FftwPlans::get(FftwPlans::C2C_FORWARD,  rank, n, (RFLOAT*) fComplex->data, (RFLOAT*) fFourier.data);
+    fPlanBackward = FftwPlans::get(FftwPlans::C2C_BACKWARD, rank, n, (RFLOAT*) fFourier.data, (RFLOAT*) fComplex->data);
     }
 
     delete[] n;
 
-    if (!fPlanForward || !fPlanBackward)
-        REPORT_ERROR("FFTW plans could not be created");
-
     plans_are_set = true;
     complexDataPtr = fComplex->data;
 }
@@ -291,6 +266,63 @@ void FourierTransformer::inverseFourierTransform() {
     Transform(FFTW_BACKWARD);
 }
 
+// Batched transforms ------------------------------------------------------
+void BatchFourierTransformer::resize(long int n, long int xdim, long int ydim, long int zdim) {
+    fReal.reshape(xdim, ydim, zdim, n);
+    fFourier.reshape(xdim / 2 + 1, ydim, zdim, n);
+}
+
+std::vector<int> BatchFourierTransformer::dimensions() const {
+    // Slowest first
+    std::vector<int> n;
+    if (Zsize(fReal) > 1) n.push_back(Zsize(fReal));
+    if (Ysize(fReal) > 1) n.push_back(Ysize(fReal));
+    n.push_back(Xsize(fReal));
+    return n;
+}
+
+void BatchFourierTransformer::setReal(long int i, const MultidimArray<RFLOAT> &img) {
+    if (img.size() != imageSize(fReal))
+        REPORT_ERROR("BatchFourierTransformer::setReal: the image has the wrong size");
+    std::copy(img.begin(), img.end(), real(i));
+}
+
+void BatchFourierTransformer::getReal(long int i, MultidimArray<RFLOAT> &img) {
+    img.reshape(Xsize(fReal), Ysize(fReal), Zsize(fReal));
+    std::copy_n(real(i), img.size(), img.begin());
+}
+
+void BatchFourierTransformer::setFourier(long int i, const MultidimArray<Complex> &F) {
+    if (F.size() != imageSize(fFourier))
+        REPORT_ERROR("BatchFourierTransformer::setFourier: the transform has the wrong size");
+    std::copy(F.begin(), F.end(), fourier(i));
+}
+
+void BatchFourierTransformer::getFourier(long int i, MultidimArray<Complex> &F) {
+    F.reshape(Xsize(fFourier), Ysize(fFourier), Zsize(fFourier));
+    std::copy_n(fourier(i), F.size(), F.begin());
+}
+
+void BatchFourierTransformer::FourierTransform() {
+    if (size() == 0) return;
+    const std::vector<int> n = dimensions();
+    FFTW_EXECUTE_DFT_R2C(
+        FftwPlans::getMany(FftwPlans::R2C, n.size(), n.data(), size(), fReal.data, (RFLOAT*) fFourier.data),
+        fReal.data, (FFTW_COMPLEX*) fFourier.data
+    );
+    const RFLOAT n_pixels = imageSize(fReal);
+    for (auto &x : fFourier) { x /= n_pixels; }
+}
+
+void BatchFourierTransformer::inverseFourierTransform() {
+    if (size() == 0) return;
+    const std::vector<int> n = dimensions();
+    FFTW_EXECUTE_DFT_C2R(
+        FftwPlans::getMany(FftwPlans::C2R, n.size(), n.data(), size(), (RFLOAT*) fFourier.data, fReal.data),
+        (FFTW_COMPLEX*) fFourier.data, fReal.data
+    );
+}
+
 /** Enforce Hermitian symmetry:
  *      conj(f(x)) = f(-x)
  */
@@ -329,11 +329,11 @@ class FourierTransformer {
     /** Clear object */
     void clear();
 
-    /** This calls fftw_cleanup.
+    /** Clear object (the plans are kept by FftwPlans for the whole process)
     */
     void cleanup();
 
-    /** Destroy both forward and backward fftw planes (mutex locked */
+    /** Forget the forward and backward fftw plans (they are owned by FftwPlans) */
     void destroyPlans();
 
     /** Computes the transform, specified in Init() function
@@ -362,10 +362,10 @@ class FourierTransformer {
         of img cannot change between calls. */
     void setReal(const MultidimArray<Complex> &img);
 
-    // Call FFTW_PLAN_DFT_R2C and FFTW_PLAN_DFT_C2R
+    // Look up the r2c and c2r plans (see FftwPlans)
     void computePlans(const MultidimArray<RFLOAT> &input);
 
-    // Call FFTW_PLAN_DFT
+    // Look up the forward and backward c2c plans
     void computePlans(const MultidimArray<Complex> &input);
 
     /** Set a Multidimarray for the Fourier transform.
@@ -377,6 +377,62 @@ class FourierTransformer {
 
 };
 
+/** Batched Fourier transforms of images of one size.
+ * @ingroup FourierW
+ *
+ * The images are held one after the other in the Nsize() slices of fReal, and
+ * their transforms in those of fFourier. All of them are transformed at once with
+ * a single plan (fftw_plan_many_dft_r2c, which MKL's FFTW interface also provides),
+ * which for small boxes costs much less than one FourierTransformer call per image.
+ * Forward transforms are normalised, as in FourierTransformer.
+ *
+ * @code
+ * BatchFourierTransformer batch;
+ * batch.resize(n, 256, 256);
+ * for (int i = 0; i < n; i++) batch.setReal(i, images[i]);
+ * batch.FourierTransform();
+ * for (int i = 0; i < n; i++) batch.getFourier(i, Fimages[i]);
+ * @endcode
+ */
+class BatchFourierTransformer {
+
+    public:
+
+    MultidimArray<RFLOAT>  fReal;
+    MultidimArray<Complex> fFourier;
+
+    /** Make room for n images of xdim x ydim x zdim pixels (the contents are undefined) */
+    void resize(long int n, long int xdim, long int ydim = 1, long int zdim = 1);
+
+    long int size() const { return Nsize(fReal); }
+
+    /** Pixels of image i */
+    RFLOAT  *real(long int i)    { return fReal.data    + i * imageSize(fReal); }
+    Complex *fourier(long int i) { return fFourier.data + i * imageSize(fFourier); }
+
+    /** Copy an image (of the right size) into slot i, or out of it (keeping the origin of img) */
+    void setReal(long int i, const MultidimArray<RFLOAT> &img);
+    void getReal(long int i, MultidimArray<RFLOAT> &img);
+
+    /** Copy the transform in slot i into, or out of, an array of Xsize / 2 + 1 x Ysize x Zsize */
+    void setFourier(long int i, const MultidimArray<Complex> &F);
+    void getFourier(long int i, MultidimArray<Complex> &F);
+
+    /** Transform all images (normalised) */
+    void FourierTransform();
+
+    /** Transform all Fourier transforms back into the images (this overwrites fFourier) */
+    void inverseFourierTransform();
+
+    private:
+
+    template <typename T>
+    static long int imageSize(const MultidimArray<T> &arr) { return Xsize(arr) * Ysize(arr) * Zsize(arr); }
+
+    std::vector<int> dimensions() const;
+
+};
+
 // Randomize phases beyond the given F-space shell (index) of R-space input image
 MultidimArray<RFLOAT> randomizePhasesBeyond(MultidimArray<RFLOAT> I, int index);
 
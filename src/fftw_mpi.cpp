@@ -0,0 +1,181 @@
+/***************************************************************************
+ *
+ * Author: "agent"
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This complete copyright notice must be included in any revised version of the
+ * source code. Additional authorship citations may be added, but existing
+ * author citations must be preserved.
+ ***************************************************************************/
+
+#include <algorithm>
+#include <vector>
+#include "src/fftw_mpi.h"
+#include "src/fftw_plans.h"
+
+namespace {
+
+    // Execute a plan of FftwPlans in place, in either precision
+    inline void executeC2C(fftw_plan  p, Complex *x) { fftw_execute_dft (p, (fftw_complex*)  x, (fftw_complex*)  x); }
+    inline void executeC2C(fftwf_plan p, Complex *x) { fftwf_execute_dft(p, (fftwf_complex*) x, (fftwf_complex*) x); }
+    inline void executeR2C(fftw_plan  p, Complex *x) { fftw_execute_dft_r2c (p, (double*) x, (fftw_complex*)  x); }
+    inline void executeR2C(fftwf_plan p, Complex *x) { fftwf_execute_dft_r2c(p, (float*)  x, (fftwf_complex*) x); }
+    inline void executeC2R(fftw_plan  p, Complex *x) { fftw_execute_dft_c2r (p, (fftw_complex*)  x, (double*) x); }
+    inline void executeC2R(fftwf_plan p, Complex *x) { fftwf_execute_dft_c2r(p, (fftwf_complex*) x, (float*)  x); }
+
+    // howmany transforms along an axis of n elements, stride complex numbers apart, of the transforms from x on
+    void transformAxis(FftwPlans::Kind kind, Complex *x, long int n, long int howmany, long int stride) {
+        RFLOAT *const p = (RFLOAT*) x;
+        executeC2C(FftwPlans::getStrided(kind, n, howmany, stride, 1, p, p), x);
+    }
+
+}
+
+SlabFourierTransformer::SlabFourierTransformer(MPI_Comm comm, long int n, int nr_threads):
+    comm(comm), n(n), hdim(n / 2 + 1), nr_threads(nr_threads)
+{
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    MPI_Type_contiguous(hdim, relion_MPI::COMPLEX, &row_type);
+    MPI_Type_commit(&row_type);
+
+    // (zEnd() - zBegin()) * n rows in Fourier space, as many as n * (yEnd() - yBegin()) in real space
+    data.reshape(fourierSize());
+}
+
+SlabFourierTransformer::~SlabFourierTransformer() {
+    MPI_Type_free(&row_type);
+}
+
+int SlabFourierTransformer::slabOwner(long int n, long int k, int size) {
+    int r = std::min((int) (k * size / n), size - 1);
+    while (r > 0 && k < slabBegin(n, r, size)) r--;
+    while (k >= slabBegin(n, r + 1, size)) r++;
+    return r;
+}
+
+void SlabFourierTransformer::clear() {
+    data.clear();
+    buffer.clear();
+}
+
+void SlabFourierTransformer::scatterRows() {
+    const long int nz = zEnd() - zBegin(), ny = yEnd() - yBegin();
+
+    // Rank s gets rows yBegin(s) ... yEnd(s) - 1 of every plane of this slab,
+    // which end up in the order of its real-space slab: plane after plane of the map
+    std::vector<int> send_counts (size), send_displs (size), recv_counts (size), recv_displs (size);
+    for (int s = 0; s < size; s++) {
+        const long int first = slabBegin(n, s, size), ny_s = slabBegin(n, s + 1, size) - first;
+        send_counts[s] = nz * ny_s;
+        send_displs[s] = nz * first;
+        recv_counts[s] = ny * ny_s;  // The slab of rank s has as many planes as rows
+        recv_displs[s] = ny * first;
+    }
+
+    buffer.reshape(fourierSize());
+    #pragma omp parallel for num_threads(nr_threads)
+    for (long int k = 0; k < nz; k++) {
+        for (int s = 0; s < size; s++) {
+            const long int first = slabBegin(n, s, size), ny_s = slabBegin(n, s + 1, size) - first;
+            const Complex *const from = data.data + (k * n + first) * hdim;
+            std::copy(from, from + ny_s * hdim, buffer.data + (nz * first + k * ny_s) * hdim);
+        }
+    }
+
+    MPI_Alltoallv(
+        buffer.data, send_counts.data(), send_displs.data(), row_type,
+        data.data,   recv_counts.data(), recv_displs.data(), row_type, comm
+    );
+}
+
+void SlabFourierTransformer::gatherRows() {
+    const long int nz = zEnd() - zBegin(), ny = yEnd() - yBegin();
+
+    std::vector<int> send_counts (size), send_displs (size), recv_counts (size), recv_displs (size);
+    for (int s = 0; s < size; s++) {
+        const long int first = slabBegin(n, s, size), ny_s = slabBegin(n, s + 1, size) - first;
+        send_counts[s] = ny * ny_s;
+        send_displs[s] = ny * first;
+        recv_counts[s] = nz * ny_s;
+        recv_displs[s] = nz * first;
+    }
+
+    buffer.reshape(fourierSize());
+    MPI_Alltoallv(
+        data.data,   send_counts.data(), send_displs.data(), row_type,
+        buffer.data, recv_counts.data(), recv_displs.data(), row_type, comm
+    );
+
+    #pragma omp parallel for num_threads(nr_threads)
+    for (long int k = 0; k < nz; k++) {
+        for (int s = 0; s < size; s++) {
+            const long int first = slabBegin(n, s, size), ny_s = slabBegin(n, s + 1, size) - first;
+            const Complex *const from = buffer.data + (nz * first + k * ny_s) * hdim;
+            std::copy(from, from + ny_s * hdim, data.data + (k * n + first) * hdim);
+        }
+    }
+}
+
+void SlabFourierTransformer::inverseFourierTransform() {
+    const long int nz = zEnd() - zBegin(), ny = yEnd() - yBegin();
+
+    // Along y, in every plane of this slab
+    #pragma omp parallel for num_threads(nr_threads)
+    for (long int k = 0; k < nz; k++)
+        transformAxis(FftwPlans::C2C_BACKWARD, data.data + k * n * hdim, n, hdim, hdim);
+
+    scatterRows();
+
+    // Along z, for every row of this slab
+    #pragma omp parallel for num_threads(nr_threads)
+    for (long int j = 0; j < ny; j++)
+        transformAxis(FftwPlans::C2C_BACKWARD, data.data + j * hdim, n, hdim, ny * hdim);
+
+    // Along x, into the padded real rows
+    const int nx = n;
+    #pragma omp parallel for num_threads(nr_threads)
+    for (long int k = 0; k < n; k++) {
+        Complex *const plane = data.data + k * ny * hdim;
+        RFLOAT *const p = (RFLOAT*) plane;
+        if (ny > 0) executeC2R(FftwPlans::getMany(FftwPlans::C2R, 1, &nx, ny, p, p), plane);
+    }
+
+    buffer.clear();
+}
+
+void SlabFourierTransformer::FourierTransform() {
+    const long int nz = zEnd() - zBegin(), ny = yEnd() - yBegin();
+
+    // Along x, from the padded real rows
+    const int nx = n;
+    #pragma omp parallel for num_threads(nr_threads)
+    for (long int k = 0; k < n; k++) {
+        Complex *const plane = data.data + k * ny * hdim;
+        RFLOAT *const p = (RFLOAT*) plane;
+        if (ny > 0) executeR2C(FftwPlans::getMany(FftwPlans::R2C, 1, &nx, ny, p, p), plane);
+    }
+
+    // Along z, for every row of this slab
+    #pragma omp parallel for num_threads(nr_threads)
+    for (long int j = 0; j < ny; j++)
+        transformAxis(FftwPlans::C2C_FORWARD, data.data + j * hdim, n, hdim, ny * hdim);
+
+    gatherRows();
+
+    // Along y, in every plane of this slab
+    #pragma omp parallel for num_threads(nr_threads)
+    for (long int k = 0; k < nz; k++)
+        transformAxis(FftwPlans::C2C_FORWARD, data.data + k * n * hdim, n, hdim, hdim);
+
+    buffer.clear();
+}
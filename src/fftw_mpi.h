@@ -0,0 +1,95 @@
+/***************************************************************************
+ *
+ * Author: "agent"
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This complete copyright notice must be included in any revised version of the
+ * source code. Additional authorship citations may be added, but existing
+ * author citations must be preserved.
+ ***************************************************************************/
+
+#ifndef FFTW_MPI_H_
+#define FFTW_MPI_H_
+
+#include "src/mpi.h"
+#include "src/multidim_array.h"
+#include "src/complex.h"
+
+/* The 3D Fourier transform of an n x n x n map, divided in slabs over the ranks of an MPI communicator.
+ *
+ * In Fourier space, every rank holds the planes zBegin() ... zEnd() - 1 of the FFTW-format transform,
+ * as a (n / 2 + 1) x n x (zEnd() - zBegin()) array in fourier().
+ * In real space, every rank holds the rows yBegin() ... yEnd() - 1 of every plane of the map,
+ * as a n x (yEnd() - yBegin()) x n array in real(), with every row padded to 2 * (n / 2 + 1) numbers.
+ * Both are kept in the same memory and transformed in place, like FFTW's in-place transforms.
+ * As in FFTW (but unlike FourierTransformer), neither transform is normalised.
+ *
+ * All ranks of the communicator have to call the transforms together.
+ */
+class SlabFourierTransformer {
+
+    public:
+
+    const MPI_Comm comm;
+    const long int n, hdim;  // hdim = n / 2 + 1
+    int rank, size;
+
+    SlabFourierTransformer(MPI_Comm comm, long int n, int nr_threads = 1);
+
+    ~SlabFourierTransformer();
+
+    // First plane (or row) of the slab of rank r, for a map of n planes divided over size ranks
+    static long int slabBegin(long int n, int r, int size) { return n * r / size; }
+
+    // The rank that holds plane (or row) k of n
+    static int slabOwner(long int n, long int k, int size);
+    int owner(long int k) const { return slabOwner(n, k, size); }
+
+    long int zBegin() const { return slabBegin(n, rank,     size); }
+    long int zEnd()   const { return slabBegin(n, rank + 1, size); }
+    long int yBegin() const { return zBegin(); }
+    long int yEnd()   const { return zEnd(); }
+
+    Complex *fourier() { return data.data; }
+    RFLOAT  *real()    { return (RFLOAT*) data.data; }
+
+    // Number of complex numbers in the Fourier-space slab
+    long int fourierSize() const { return (zEnd() - zBegin()) * n * hdim; }
+
+    // From the Fourier-space slabs to the real-space ones
+    void inverseFourierTransform();
+
+    // From the real-space slabs to the Fourier-space ones
+    void FourierTransform();
+
+    // Free all memory (the transformer cannot be used afterwards)
+    void clear();
+
+    private:
+
+    int nr_threads;
+    MPI_Datatype row_type;  // hdim complex numbers
+
+    MultidimArray<Complex> data, buffer;
+
+    // Send the rows of every Fourier-space plane to the ranks that hold them in real space
+    void scatterRows();
+
+    // The inverse of scatterRows()
+    void gatherRows();
+
+    SlabFourierTransformer(const SlabFourierTransformer&);
+    SlabFourierTransformer& operator=(const SlabFourierTransformer&);
+
+};
+
+#endif
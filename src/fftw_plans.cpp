@@ -0,0 +1,344 @@
+/***************************************************************************
+ *
+ * Author: "agent"
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This complete copyright notice must be included in any revised version of the
+ * source code. Additional authorship citations may be added, but existing
+ * author citations must be preserved.
+ ***************************************************************************/
+
+#include "src/fftw_plans.h"
+#include "src/error.h"
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace {
+
+    struct Key {
+        int kind, rank, n[3], howmany;
+        int stride, dist;  // 1 and 0 for transforms that follow each other without gaps
+        unsigned flags;  // Including the rigor and FFTW_UNALIGNED
+        bool in_place;
+        int nr_threads;
+
+        bool operator == (const Key &other) const {
+            return kind == other.kind && rank == other.rank &&
+                n[0] == other.n[0] && n[1] == other.n[1] && n[2] == other.n[2] && howmany == other.howmany &&
+                stride == other.stride && dist == other.dist && flags == other.flags && in_place == other.in_place && nr_threads == other.nr_threads;
+        }
+    };
+
+    struct KeyHash {
+        size_t operator () (const Key &key) const {
+            size_t h = key.kind;
+            for (int x : {key.rank, key.n[0], key.n[1], key.n[2], key.howmany, key.stride, key.dist, (int) key.flags, (int) key.in_place, key.nr_threads})
+                h = h * 1000003 ^ std::hash<int>()(x);
+            return h;
+        }
+    };
+
+    const unsigned rigor_flags = FFTW_ESTIMATE | FFTW_MEASURE | FFTW_PATIENT | FFTW_EXHAUSTIVE;
+
+    // Higher is more patient (FFTW_MEASURE is 0)
+    int patience(unsigned flags) {
+        if (flags & FFTW_EXHAUSTIVE) return 3;
+        if (flags & FFTW_PATIENT)    return 2;
+        if (flags & FFTW_ESTIMATE)   return 0;
+        return 1;
+    }
+
+    unsigned configuredRigor() {
+        static const unsigned rigor = [] () -> unsigned {
+            const char *text = getenv("RELION_FFTW_PLANNING");
+            if (!text) return FFTW_ESTIMATE;
+            const std::string s (text);
+            if (s == "estimate") return FFTW_ESTIMATE;
+            if (s == "measure")  return FFTW_MEASURE;
+            if (s == "patient")  return FFTW_PATIENT;
+            REPORT_ERROR("RELION_FFTW_PLANNING should be estimate, measure or patient, not " + s);
+        }();
+        return rigor;
+    }
+
+    // The FFTW planner is not thread-safe (in either precision)
+    std::mutex planner_mutex;
+    std::atomic<int> nr_threads (1);
+
+    template <typename T> struct Fftw;
+
+    template <> struct Fftw<double> {
+        typedef fftw_plan plan;
+        static const char *name() { return "double"; }
+        static void *malloc(size_t bytes) { return fftw_malloc(bytes); }
+        static void free(void *p) { fftw_free(p); }
+        static int alignmentOf(double *p) { return fftw_alignment_of(p); }
+        #ifdef FFTW_THREADS
+        static int initThreads() { return fftw_init_threads(); }
+        #endif
+        #if defined(FFTW_THREADS) || defined(MKLFFT)
+        static void planWithThreads(int n) { fftw_plan_with_nthreads(n); }
+        #else
+        static void planWithThreads(int) {}
+        #endif
+        // howmany transforms, real_dist and complex_dist apart, of elements stride apart
+        static plan make(
+            FftwPlans::Kind kind, int rank, const int *n, int howmany, int stride, int real_dist, int complex_dist,
+            double *in, double *out, unsigned flags
+        ) {
+            fftw_complex *cin = (fftw_complex*) in, *cout = (fftw_complex*) out;
+            switch (kind) {
+                case FftwPlans::R2C:          return fftw_plan_many_dft_r2c(rank, n, howmany, in,  nullptr, stride, real_dist,    cout, nullptr, stride, complex_dist, flags);
+                case FftwPlans::C2R:          return fftw_plan_many_dft_c2r(rank, n, howmany, cin, nullptr, stride, complex_dist, out,  nullptr, stride, real_dist,    flags);
+                case FftwPlans::C2C_FORWARD:  return fftw_plan_many_dft(rank, n, howmany, cin, nullptr, stride, real_dist, cout, nullptr, stride, real_dist, FFTW_FORWARD,  flags);
+                case FftwPlans::C2C_BACKWARD: return fftw_plan_many_dft(rank, n, howmany, cin, nullptr, stride, real_dist, cout, nullptr, stride, real_dist, FFTW_BACKWARD, flags);
+            }
+            return nullptr;
+        }
+        static int importWisdom(const char *fn) { return fftw_import_wisdom_from_filename(fn); }
+        static int exportWisdom(const char *fn) { return fftw_export_wisdom_to_filename(fn); }
+    };
+
+    template <> struct Fftw<float> {
+        typedef fftwf_plan plan;
+        static const char *name() { return "single"; }
+        static void *malloc(size_t bytes) { return fftwf_malloc(bytes); }
+        static void free(void *p) { fftwf_free(p); }
+        static int alignmentOf(float *p) { return fftwf_alignment_of(p); }
+        #ifdef FFTW_THREADS
+        static int initThreads() { return fftwf_init_threads(); }
+        static void planWithThreads(int n) { fftwf_plan_with_nthreads(n); }
+        #elif defined(MKLFFT)
+        static void planWithThreads(int n) { fftw_plan_with_nthreads(n); }  // MKL has one setting for both precisions
+        #else
+        static void planWithThreads(int) {}
+        #endif
+        // howmany transforms, real_dist and complex_dist apart, of elements stride apart
+        static plan make(
+            FftwPlans::Kind kind, int rank, const int *n, int howmany, int stride, int real_dist, int complex_dist,
+            float *in, float *out, unsigned flags
+        ) {
+            fftwf_complex *cin = (fftwf_complex*) in, *cout = (fftwf_complex*) out;
+            switch (kind) {
+                case FftwPlans::R2C:          return fftwf_plan_many_dft_r2c(rank, n, howmany, in,  nullptr, stride, real_dist,    cout, nullptr, stride, complex_dist, flags);
+                case FftwPlans::C2R:          return fftwf_plan_many_dft_c2r(rank, n, howmany, cin, nullptr, stride, complex_dist, out,  nullptr, stride, real_dist,    flags);
+                case FftwPlans::C2C_FORWARD:  return fftwf_plan_many_dft(rank, n, howmany, cin, nullptr, stride, real_dist, cout, nullptr, stride, real_dist, FFTW_FORWARD,  flags);
+                case FftwPlans::C2C_BACKWARD: return fftwf_plan_many_dft(rank, n, howmany, cin, nullptr, stride, real_dist, cout, nullptr, stride, real_dist, FFTW_BACKWARD, flags);
+            }
+            return nullptr;
+        }
+        static int importWisdom(const char *fn) { return fftwf_import_wisdom_from_filename(fn); }
+        static int exportWisdom(const char *fn) { return fftwf_export_wisdom_to_filename(fn); }
+    };
+
+    // All plans of one precision (guarded by planner_mutex)
+    template <typename T>
+    class PlanStore {
+
+        typedef typename Fftw<T>::plan Plan;
+
+        std::unordered_map<Key, Plan, KeyHash> plans;
+        bool wisdom_read, wisdom_changed;
+
+        PlanStore(): wisdom_read(false), wisdom_changed(false) {
+            #ifdef FFTW_THREADS
+            std::lock_guard<std::mutex> lock (planner_mutex);
+            if (!Fftw<T>::initThreads())
+                REPORT_ERROR("The FFTW threads could not be initialised");
+            #endif
+        }
+
+        // Plans are kept to the end, as other static objects may still use them
+        ~PlanStore() {
+            #ifndef MKLFFT
+            if (!wisdom_changed) return;
+            const std::string fn = wisdomFile();
+            if (fn.empty()) return;
+            std::lock_guard<std::mutex> lock (planner_mutex);
+            // Keep what other processes on this host have learnt meanwhile
+            Fftw<T>::importWisdom(fn.c_str());
+            const std::string tmp = fn + ".tmp" + std::to_string(getpid());
+            if (Fftw<T>::exportWisdom(tmp.c_str()))
+                std::rename(tmp.c_str(), fn.c_str());
+            else
+                std::remove(tmp.c_str());
+            #endif
+        }
+
+        static std::string wisdomFile() {
+            const char *dir = getenv("RELION_FFTW_WISDOM");
+            if (!dir || !*dir) return "";
+            char host[256] = "";
+            gethostname(host, sizeof(host) - 1);
+            return std::string(dir) + "/fftw_wisdom_" + host + "_" + Fftw<T>::name();
+        }
+
+        public:
+
+        static PlanStore &instance() {
+            static PlanStore store;
+            return store;
+        }
+
+        Plan get(const Key &key, T *in, T *out) {
+            std::lock_guard<std::mutex> lock (planner_mutex);
+
+            const auto it = plans.find(key);
+            if (it != plans.end()) return it->second;
+
+            #ifndef MKLFFT
+            if (!wisdom_read) {
+                const std::string fn = wisdomFile();
+                if (!fn.empty()) Fftw<T>::importWisdom(fn.c_str());
+                wisdom_read = true;
+            }
+            #endif
+
+            // Distance between the transforms (in real or complex numbers)
+            size_t nr_real = 1;
+            for (int i = 0; i < key.rank; i++) nr_real *= key.n[i];
+            const size_t nr_complex = key.kind == FftwPlans::R2C || key.kind == FftwPlans::C2R ?
+                nr_real / key.n[key.rank - 1] * (key.n[key.rank - 1] / 2 + 1) : nr_real;
+
+            // Apart from FFTW_ESTIMATE, the planner overwrites the arrays: plan on scratch arrays
+            const bool measure = patience(key.flags) > 0;
+            T *scratch_in = nullptr, *scratch_out = nullptr;
+            if (measure) {
+                size_t in_size, out_size;
+                switch (key.kind) {
+                    case FftwPlans::R2C: in_size = nr_real;        out_size = 2 * nr_complex; break;
+                    case FftwPlans::C2R: in_size = 2 * nr_complex; out_size = nr_real;        break;
+                    default:             in_size = out_size = 2 * nr_real;
+                }
+                in_size *= key.howmany;
+                out_size *= key.howmany;
+                if (key.dist > 0)  // Strided complex transforms, which may interleave
+                    in_size = out_size = 2 * ((size_t) (key.howmany - 1) * key.dist + (size_t) (key.n[0] - 1) * key.stride + 1);
+                if (key.in_place) in_size = out_size = std::max(in_size, out_size);
+                scratch_in = (T*) Fftw<T>::malloc(in_size * sizeof(T));
+                scratch_out = key.in_place ? scratch_in : (T*) Fftw<T>::malloc(out_size * sizeof(T));
+                if (!scratch_in || !scratch_out)
+                    REPORT_ERROR("Not enough memory to plan an FFT");
+                in = scratch_in;
+                out = scratch_out;
+            }
+
+            // In place, every real row is padded to the length of a complex one
+            const size_t real_dist = key.dist > 0 ? key.dist :
+                key.in_place && key.kind != FftwPlans::C2C_FORWARD && key.kind != FftwPlans::C2C_BACKWARD ?
+                2 * nr_complex : nr_real;
+            Fftw<T>::planWithThreads(key.nr_threads);
+            const Plan plan = Fftw<T>::make(
+                (FftwPlans::Kind) key.kind, key.rank, key.n, key.howmany, key.stride,
+                real_dist, key.dist > 0 ? key.dist : nr_complex, in, out, key.flags
+            );
+            // Plans made outside FftwPlans (MklFFT) get the number of setThreads
+            Fftw<T>::planWithThreads(nr_threads);
+
+            if (measure) {
+                if (scratch_out != scratch_in) Fftw<T>::free(scratch_out);
+                Fftw<T>::free(scratch_in);
+                wisdom_changed = true;
+            }
+
+            if (!plan)
+                REPORT_ERROR("FFTW plans could not be created");
+
+            plans[key] = plan;
+            return plan;
+        }
+
+    };
+
+    template <typename T>
+    typename Fftw<T>::plan getPlan(
+        FftwPlans::Kind kind, int rank, const int *n, int howmany, int stride, int dist, T *in, T *out, unsigned flags,
+        int threads = 0
+    ) {
+        if (rank < 1 || rank > 3)
+            REPORT_ERROR("FftwPlans: only 1D, 2D and 3D transforms are supported");
+
+        // The environment can make plans more patient, not less
+        if (patience(configuredRigor()) > patience(flags))
+            flags = (flags & ~rigor_flags) | configuredRigor();
+
+        #ifndef MKLFFT
+        if (Fftw<T>::alignmentOf(in) != 0 || Fftw<T>::alignmentOf(out) != 0)
+            flags |= FFTW_UNALIGNED;
+        #endif
+
+        Key key;
+        key.kind = kind;
+        key.rank = rank;
+        for (int i = 0; i < 3; i++) key.n[i] = i < rank ? n[i] : 1;
+        key.howmany = howmany;
+        key.stride = stride;
+        key.dist = dist;
+        key.flags = flags;
+        key.in_place = in == out;
+        key.nr_threads = threads > 0 ? threads : nr_threads.load();
+
+        // Plans are never destroyed, so each thread can remember the ones it has used
+        static thread_local std::unordered_map<Key, typename Fftw<T>::plan, KeyHash> known;
+        const auto it = known.find(key);
+        if (it != known.end()) return it->second;
+
+        return known[key] = PlanStore<T>::instance().get(key, in, out);
+    }
+
+}
+
+fftw_plan FftwPlans::get(Kind kind, int rank, const int *n, double *in, double *out, unsigned flags, int threads) {
+    return getPlan(kind, rank, n, 1, 1, 0, in, out, flags, threads);
+}
+
+fftwf_plan FftwPlans::get(Kind kind, int rank, const int *n, float *in, float *out, unsigned flags, int threads) {
+    return getPlan(kind, rank, n, 1, 1, 0, in, out, flags, threads);
+}
+
+fftw_plan FftwPlans::getMany(Kind kind, int rank, const int *n, int howmany, double *in, double *out, unsigned flags) {
+    return getPlan(kind, rank, n, howmany, 1, 0, in, out, flags);
+}
+
+fftwf_plan FftwPlans::getMany(Kind kind, int rank, const int *n, int howmany, float *in, float *out, unsigned flags) {
+    return getPlan(kind, rank, n, howmany, 1, 0, in, out, flags);
+}
+
+fftw_plan FftwPlans::getStrided(Kind kind, int n, int howmany, int stride, int dist, double *in, double *out, unsigned flags) {
+    if ((kind != C2C_FORWARD && kind != C2C_BACKWARD) || stride < 1 || dist < 1)
+        REPORT_ERROR("FftwPlans::getStrided: only complex-to-complex transforms with positive strides are supported");
+    return getPlan(kind, 1, &n, howmany, stride, dist, in, out, flags);
+}
+
+fftwf_plan FftwPlans::getStrided(Kind kind, int n, int howmany, int stride, int dist, float *in, float *out, unsigned flags) {
+    if ((kind != C2C_FORWARD && kind != C2C_BACKWARD) || stride < 1 || dist < 1)
+        REPORT_ERROR("FftwPlans::getStrided: only complex-to-complex transforms with positive strides are supported");
+    return getPlan(kind, 1, &n, howmany, stride, dist, in, out, flags);
+}
+
+std::mutex &FftwPlans::plannerMutex() {
+    return planner_mutex;
+}
+
+void FftwPlans::setThreads(int n) {
+    std::lock_guard<std::mutex> lock (planner_mutex);
+    #ifdef MKLFFT
+    fftw_plan_with_nthreads(std::max(n, 1));
+    #endif
+    nr_threads = std::max(n, 1);
+}
@@ -0,0 +1,79 @@
+/***************************************************************************
+ *
+ * Author: "agent"
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This complete copyright notice must be included in any revised version of the
+ * source code. Additional authorship citations may be added, but existing
+ * author citations must be preserved.
+ ***************************************************************************/
+
+#ifndef FFTW_PLANS_H_
+#define FFTW_PLANS_H_
+
+#include <mutex>
+#include <fftw3.h>
+
+/* The FFTW plans of the whole process (FourierTransformer, ParFourierTransformer and NewFFT).
+ *
+ * A plan is made once for every shape, precision, kind of transform, alignment and placement
+ * (in or out of place) of the arrays, and kept until the process ends. Plans are executed with
+ * the new-array interface (fftw_execute_dft_r2c etc.), on any arrays like the ones they were
+ * looked up with. After the first look-up of a plan, each thread finds it without locking.
+ *
+ * The planning rigor is FFTW_ESTIMATE, unless the environment variable RELION_FFTW_PLANNING
+ * is "measure" or "patient". Measured plans are worth it for long runs on few shapes: their
+ * wisdom is kept in the directory RELION_FFTW_WISDOM (if set), in one file per host and
+ * precision, read when the first plan is made and updated when the process ends.
+ */
+class FftwPlans {
+
+    public:
+
+    enum Kind { R2C, C2R, C2C_FORWARD, C2C_BACKWARD };
+
+    /* A plan for arrays of rank dimensions n (slowest first, as in fftw_plan_dft), from in to out.
+     * For R2C, C2R and C2C, in and out point at the real or complex arrays (cast to real).
+     * If in == out, the transform is in place, and (as in FFTW) every row of the real array
+     * is padded to 2 * (n[rank - 1] / 2 + 1) numbers.
+     * flags may add algorithmic restrictions (e.g. FFTW_UNALIGNED) or more planning rigor.
+     * The plan runs on threads threads (if positive, else on the number of setThreads).
+     * The plan belongs to FftwPlans: do not destroy it.
+     */
+    static fftw_plan  get(Kind kind, int rank, const int *n, double *in, double *out, unsigned flags = FFTW_ESTIMATE, int threads = 0);
+    static fftwf_plan get(Kind kind, int rank, const int *n, float  *in, float  *out, unsigned flags = FFTW_ESTIMATE, int threads = 0);
+
+    /* A plan for howmany such transforms at once (fftw_plan_many_dft_r2c etc.),
+     * of input and output arrays that follow each other without gaps
+     */
+    static fftw_plan  getMany(Kind kind, int rank, const int *n, int howmany, double *in, double *out, unsigned flags = FFTW_ESTIMATE);
+    static fftwf_plan getMany(Kind kind, int rank, const int *n, int howmany, float  *in, float  *out, unsigned flags = FFTW_ESTIMATE);
+
+    /* A plan for howmany 1D complex transforms (C2C_FORWARD or C2C_BACKWARD) of n elements,
+     * which are stride complex numbers apart, while the transforms start dist complex numbers apart
+     * (as istride and idist of fftw_plan_many_dft). Both arrays have the same layout.
+     */
+    static fftw_plan  getStrided(Kind kind, int n, int howmany, int stride, int dist, double *in, double *out, unsigned flags = FFTW_ESTIMATE);
+    static fftwf_plan getStrided(Kind kind, int n, int howmany, int stride, int dist, float  *in, float  *out, unsigned flags = FFTW_ESTIMATE);
+
+    /* Number of threads of the plans looked up from now on (1 by default).
+     * Plans are multithreaded only if FFTW was built with threads (FFTW_THREADS) or is MKL:
+     * otherwise they all run on the calling thread.
+     */
+    static void setThreads(int nr_threads);
+
+    /* The lock of the FFTW planner: hold it to make or destroy plans outside FftwPlans */
+    static std::mutex &plannerMutex();
+
+};
+
+#endif
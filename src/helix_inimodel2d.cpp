@@ -873,7 +873,7 @@ void HelixAligner::reconstruct2D(int iclass) {
         BP.set2DFourierTransform(myFlines[j], A2D);
     }
     MultidimArray<RFLOAT> tau2;
-    model.Arec[iclass] = BP.reconstruct(10, false, tau2);
+    model.Arec[iclass] = BP.reconstruct(10, false, tau2, 1.0, 1.0, -1, false, nullptr, nr_threads);
 
     if (symmetry > 1) {
 
@@ -18,6 +18,9 @@
  * author citations must be preserved.
  ***************************************************************************/
 #include <memory>
+#include <map>
+#include <mutex>
+#include <sys/stat.h>
 #include "src/image.h"
 #include "src/rwSPIDER.h"
 #include "src/rwIMAGIC.h"
@@ -570,6 +573,163 @@ int Image<T>::readTiffInMemory(
     return err;
 }
 
+template <typename T>
+int Image<T>::readMapped(const FileName &name, long int select_img) {
+    long int index;
+    FileName fn_stack;
+    name.decompose(index, fn_stack);
+    // Subtract 1 to have numbering 0...N-1 instead of 1...N
+    if (select_img == -1) { select_img = index > 0 ? index - 1 : -1; }
+
+    // Only single images from MRC stacks are mapped
+    if (select_img < 0 || !name.getFileFormat().contains("mrcs"))
+        return read(name, true, select_img);
+
+    const auto stack = MappedMRCStack::get(fn_stack.removeFileFormat());
+
+    clear();
+    header.addObject();
+    filename = name;
+    isStack = true;
+    swap = stack->swap;
+    replaceNsize = stack->nimages;
+
+    data.resize(stack->xdim, stack->ydim);
+    stack->copy(select_img, data.data);
+
+    const long int i = header.size() - 1;
+    header.setValue(EMDL::IMAGE_STATS_MIN,    stack->amin,  i);
+    header.setValue(EMDL::IMAGE_STATS_MAX,    stack->amax,  i);
+    header.setValue(EMDL::IMAGE_STATS_AVG,    stack->amean, i);
+    header.setValue(EMDL::IMAGE_STATS_STDDEV, stack->arms,  i);
+    header.setValue(EMDL::IMAGE_DATATYPE,     (int) stack->datatype, i);
+    if (stack->angpix_x > 0) header.setValue(EMDL::IMAGE_SAMPLINGRATE_X, stack->angpix_x, i);
+    if (stack->angpix_y > 0) header.setValue(EMDL::IMAGE_SAMPLINGRATE_Y, stack->angpix_y, i);
+    if (stack->angpix_z > 0) header.setValue(EMDL::IMAGE_SAMPLINGRATE_Z, stack->angpix_z, i);
+
+    return 0;
+}
+
+namespace {
+
+    // All mappings of the process, by file name
+    std::mutex mapped_stacks_mutex;
+    std::map<std::string, std::shared_ptr<const MappedMRCStack> > mapped_stacks;
+
+    // Not to run out of mappings (vm.max_map_count), unused ones are dropped beyond this many
+    const size_t max_mapped_stacks = 4096;
+
+}
+
+std::shared_ptr<const MappedMRCStack> MappedMRCStack::get(const FileName &fn_stack) {
+    struct stat st;
+    if (stat(fn_stack.c_str(), &st) != 0)
+        REPORT_ERROR("MappedMRCStack: cannot read " + fn_stack + ". It doesn't exist!");
+
+    std::lock_guard<std::mutex> lock (mapped_stacks_mutex);
+
+    // Reuse the mapping unless the file has been rewritten
+    const auto it = mapped_stacks.find(fn_stack);
+    if (it != mapped_stacks.end()) {
+        if (it->second->mtime == st.st_mtime && it->second->len == (size_t) st.st_size)
+            return it->second;
+        mapped_stacks.erase(it);
+    }
+
+    if (mapped_stacks.size() >= max_mapped_stacks) {
+        for (auto jt = mapped_stacks.begin(); jt != mapped_stacks.end();) {
+            if (jt->second.use_count() == 1) jt = mapped_stacks.erase(jt);
+            else ++jt;
+        }
+    }
+
+    std::shared_ptr<MappedMRCStack> stack (new MappedMRCStack());
+    stack->filename = fn_stack;
+    stack->mtime = st.st_mtime;
+    stack->len = st.st_size;
+
+    const int fd = open(fn_stack.c_str(), O_RDONLY);
+    if (fd == -1)
+        REPORT_ERROR("MappedMRCStack: cannot open " + fn_stack);
+
+    MRChead header;
+    if (stack->len < MRCSIZE || pread(fd, &header, MRCSIZE, 0) != MRCSIZE) {
+        close(fd);
+        REPORT_ERROR("MappedMRCStack: error in reading header of image " + fn_stack);
+    }
+
+    // Determine byte order and swap bytes if from little-endian machine (as in readMRC)
+    stack->swap = abs(header.mode) > SWAPTRIG || abs(header.nx) > SWAPTRIG;
+    if (stack->swap) {
+        for (int i = 0; i < MRCSIZE - 800; i += 4)  // Don't swap the bytes in the labels
+            swapbytes((char*) &header + i, 4);
+    }
+
+    stack->xdim = header.nx;
+    stack->ydim = header.ny;
+    stack->nimages = header.nz;
+    stack->datatype = determine_datatype(header.mode, header.nx, header.ny);
+    stack->offset = MRCSIZE + header.nsymbt;
+    stack->amin  = header.amin;
+    stack->amax  = header.amax;
+    stack->amean = header.amean;
+    stack->arms  = header.arms;
+    stack->angpix_x = header.mx && header.a != 0 ? (RFLOAT) header.a / header.mx : 0;
+    stack->angpix_y = header.my && header.b != 0 ? (RFLOAT) header.b / header.my : 0;
+    stack->angpix_z = header.mz && header.c != 0 ? (RFLOAT) header.c / header.mz : 0;
+
+    if (stack->offset + stack->nimages * stack->bytesPerImage() > stack->len) {
+        close(fd);
+        REPORT_ERROR("MappedMRCStack: " + fn_stack + " is shorter than its header says");
+    }
+
+    stack->map = mmap(nullptr, stack->len, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);  // The mapping stays valid
+    if (stack->map == MAP_FAILED) {
+        stack->map = nullptr;
+        REPORT_ERROR("MappedMRCStack: mmap of " + fn_stack + " failed");
+    }
+
+    mapped_stacks[fn_stack] = stack;
+    return stack;
+}
+
+void MappedMRCStack::releaseUnused() {
+    std::lock_guard<std::mutex> lock (mapped_stacks_mutex);
+    for (auto it = mapped_stacks.begin(); it != mapped_stacks.end();) {
+        if (it->second.use_count() == 1) it = mapped_stacks.erase(it);
+        else ++it;
+    }
+}
+
+MappedMRCStack::~MappedMRCStack() {
+    if (map) munmap(map, len);
+}
+
+std::vector<char> mrcStackHeader(long int xdim, long int ydim, long int nimages, RFLOAT angpix) {
+    std::vector<char> bytes (MRCSIZE, 0);
+    MRChead &header = *(MRChead*) bytes.data();
+    strncpy(header.map, "MAP ", 4);
+    set_CCP4_machine_stamp(header.machst);
+    header.nx = header.mx = xdim;
+    header.ny = header.my = ydim;
+    header.nz = header.mz = nimages;
+    header.mode = 2;
+    header.a = xdim * angpix;
+    header.b = ydim * angpix;
+    header.c = nimages * angpix;
+    header.alpha = header.beta = header.gamma = 90.0;
+    header.mapc = 1;
+    header.mapr = 2;
+    header.maps = 3;
+    // amax < amin and arms < 0 mean: not determined
+    header.amin = 0.0;
+    header.amax = -1.0;
+    header.amean = -2.0;
+    header.arms = -1.0;
+    return bytes;
+}
+
 // Manually instantiate classes derivable from the Image class template.
 // Required to avoid linker errors.
 // https://www.cs.technion.ac.il/users/yechiel/c++-faq/separate-template-class-defn-from-decl.html
@@ -325,6 +325,88 @@ struct image_mmapper {
 
 };
 
+/** Read-only memory mapping of an MRC stack
+ *
+ * One mapping of a file is shared by all threads (and all images) of the process:
+ * get() maps the file the first time it is asked for, and returns the same mapping
+ * until the file changes on disk. The header is parsed only once, and no file handle
+ * is kept open. Images are read straight from the page cache, either as zero-copy views
+ * (when the data on disk are of type T in native byte order) or by copying them,
+ * with type conversion and byte swapping only when needed.
+ */
+class MappedMRCStack {
+
+    public:
+
+    FileName filename;
+    long int xdim, ydim, nimages;
+    DataType datatype;
+    bool swap;
+    RFLOAT amin, amax, amean, arms;
+    RFLOAT angpix_x, angpix_y, angpix_z;  // 0 if not in the header
+
+    // The mapping of the stack in the file fn_stack (without an image number or format specifier).
+    // Thread-safe.
+    static std::shared_ptr<const MappedMRCStack> get(const FileName &fn_stack);
+
+    // Drop all mappings that are not in use
+    static void releaseUnused();
+
+    ~MappedMRCStack();
+
+    size_t bytesPerImage() const {
+        return datatype == UHalf ? xdim * ydim / 2 : xdim * ydim * RTTI::size(datatype);
+    }
+
+    // Start of image n (0-indexed) in the mapping
+    const char *image(long int n) const {
+        if (n < 0 || n >= nimages)
+            REPORT_ERROR("MappedMRCStack: image " + std::to_string(n + 1) + " exceeds the stack size " + std::to_string(nimages) + " of " + filename);
+        return (const char*) map + offset + n * bytesPerImage();
+    }
+
+    // Image n without copying, or nullptr if it is not stored as T in native byte order.
+    // The view is valid for as long as the mapping is held.
+    template <typename T>
+    const T *view(long int n) const {
+        if (swap || datatype == UHalf || RTTI::index(datatype) != std::type_index(typeid(T))) return nullptr;
+        return (const T*) image(n);
+    }
+
+    // Copy image n (xdim * ydim values) into dest
+    template <typename T>
+    void copy(long int n, T *dest) const {
+        const size_t npix = xdim * ydim;
+        const char *src = image(n);
+        if (const T *v = view<T>(n)) {
+            memcpy(dest, v, npix * sizeof(T));
+        } else if (!swap) {
+            transcription::castFromPage(dest, const_cast<char*>(src), RTTI::index(datatype), npix);
+        } else {
+            // The mapping is read-only, so swap in a copy
+            const size_t bytes = bytesPerImage();
+            std::vector<char> page (src, src + bytes);
+            transcription::swapPage(page.data(), bytes, RTTI::size(datatype));
+            transcription::castFromPage(dest, page.data(), RTTI::index(datatype), npix);
+        }
+    }
+
+    private:
+
+    void *map;
+    size_t len, offset;
+    time_t mtime;
+
+    MappedMRCStack(): map(nullptr), len(0), offset(0), mtime(0) {}
+    MappedMRCStack(const MappedMRCStack&);
+    MappedMRCStack& operator=(const MappedMRCStack&);
+
+};
+
+// The header of an MRC stack of nimages float images of xdim x ydim pixels, for the images to follow right after it.
+// Its statistics are marked as not determined.
+std::vector<char> mrcStackHeader(long int xdim, long int ydim, long int nimages, RFLOAT angpix = 0);
+
 /** Swapping trigger.
  * Threshold file z size above which bytes are swapped.
  */
@@ -472,6 +554,12 @@ class Image {
         return err;
     }
 
+    /** Read one image from an MRC stack (name is e.g. 000001@particles.mrcs)
+     * through the mapping of the stack that is shared by all threads (see MappedMRCStack).
+     * Other formats are read with read().
+     */
+    int readMapped(const FileName &name, long int select_img = -1);
+
     /** General write function
      * select_img = which slice should I replace
      * overwrite = 0, append slice
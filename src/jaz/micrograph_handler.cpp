@@ -19,6 +19,8 @@
  ***************************************************************************/
 
 #include "micrograph_handler.h"
+#include <sstream>
+#include <sys/stat.h>
 #include <src/jaz/stack_helper.h>
 #include <src/renderEER.h>
 #include "src/jaz/obs_model.h"
@@ -37,7 +39,10 @@ ready(false),
 last_gainFn(""),
 corrMicFn(""),
 eer_upsampling(-1),
-eer_grouping(-1) {}
+eer_grouping(-1),
+cacheMemory(0),
+cacheDiskMax(0),
+cacheDir("") {}
 
 void MicrographHandler::init(
     // in:
@@ -85,6 +90,8 @@ void MicrographHandler::init(
 
     loadInitial(mdts, verb, fc, dosePerFrame, metaFn);
 
+    movieCache.init(cacheMemory, cacheDir, cacheDiskMax);
+
     ready = true;
 }
 
@@ -339,6 +346,29 @@ std::vector<std::vector<Image<Complex>>> MicrographHandler::loadMovie(
     }
     std::vector<std::vector<Image<Complex>>> movie;
 
+    std::string key;
+    if (movieCache.enabled()) {
+        if (hasCorrMic) {
+            // The second loadMovie() needs the trajectories of this micrograph
+            FileName fn_pre, fn_jobnr, fn_post;
+            decomposePipelineFileName(mdt.getValueToString(EMDL::MICROGRAPH_NAME, 0), fn_pre, fn_jobnr, fn_post);
+            micrograph = Micrograph(getMetaName(fn_post));
+
+            // The key contains the EER parameters, so set them as below first
+            if (EERRenderer::isEER(micrograph.getMovieFilename())) {
+                if (eer_upsampling < 0)
+                    eer_upsampling = micrograph.getEERUpsampling();
+                if (eer_grouping < 0)
+                    eer_grouping = micrograph.getEERGrouping();
+            }
+        }
+        key = cacheKey(mdt, s, angpix, offsets_in, data_angpix);
+        if (movieCache.get(key, movie, offsets_out)) {
+            if (debug) std::cout << "cached: " << key.substr(0, key.find('\n')) << std::endl;
+            return movie;
+        }
+    }
+
     const int nr_omp_threads = fts.size();
 
     std::string mgFn0 = mdt.getValueToString(EMDL::MICROGRAPH_NAME, 0);
@@ -437,6 +467,7 @@ std::vector<std::vector<Image<Complex>>> MicrographHandler::loadMovie(
             // lastFrame and firstFrame is 0 indexed
             int my_lastFrame = lastFrame < 0 ? renderer.getNFrames() / eer_grouping - 1 : lastFrame;
             int n_frames = my_lastFrame - firstFrame + 1;
+            renderer.setFramesOfInterest(firstFrame * eer_grouping + 1, (my_lastFrame + 1) * eer_grouping);
 
             std::vector<MultidimArray<float> > Iframes(n_frames);
 
@@ -556,9 +587,60 @@ std::vector<std::vector<Image<Complex>>> MicrographHandler::loadMovie(
         StackHelper::varianceNormalize(movie[p], false);
     }
 
+    if (movieCache.enabled())
+        movieCache.put(key, movie, offsets_out);
+
     return movie;
 }
 
+// The size and modification time of a file ("-" if there is no such file)
+static std::string fileStamp(const std::string &fn) {
+    struct stat st;
+    if (fn.empty() || stat(fn.c_str(), &st) != 0) return "-";
+    return std::to_string(st.st_size) + " " + std::to_string(st.st_mtim.tv_sec) + "." + std::to_string(st.st_mtim.tv_nsec);
+}
+
+std::string MicrographHandler::cacheKey(
+    const MetaDataTable &mdt, int s, double angpix,
+    const std::vector<std::vector<gravis::d2Vector>>* offsets_in,
+    double data_angpix
+) {
+    std::stringstream key;
+    key.precision(17);
+
+    const std::string mgFn0 = mdt.getValueToString(EMDL::MICROGRAPH_NAME, 0);
+    FileName fn_pre, fn_jobnr, fn_post;
+    decomposePipelineFileName(mgFn0, fn_pre, fn_jobnr, fn_post);
+
+    key << fn_post << "\n" << (hasCorrMic ? getMetaName(fn_post) : "") << "\n";
+    key << s << " " << angpix << " " << data_angpix << " " << coords_angpix << " " << movie_angpix << " "
+        << firstFrame << " " << lastFrame << " " << hotCutoff << " "
+        << eer_upsampling << " " << eer_grouping << " " << sizeof(RFLOAT) << "\n";
+
+    // The files the movie is made from, so that a persistent cache does not return old movies
+    // when motion correction is redone (or the gain reference replaced) into the same paths
+    if (hasCorrMic) {
+        const std::vector<std::string> sources {
+            getMetaName(fn_post), micrograph.getMovieFilename(), micrograph.getGainFilename(), micrograph.fnDefect
+        };
+        for (const std::string &fn : sources)
+            key << fileStamp(fn) << "\n";
+    }
+
+    for (long int p = 0; p < mdt.size(); p++) {
+        key << mdt.getValue<double>(EMDL::IMAGE_COORD_X, p) << " "
+            << mdt.getValue<double>(EMDL::IMAGE_COORD_Y, p) << "\n";
+    }
+
+    if (offsets_in != 0) {
+        for (const auto &offsets : *offsets_in)
+        for (const d2Vector &d : offsets)
+            key << d.x << " " << d.y << "\n";
+    }
+
+    return key.str();
+}
+
 std::vector<std::vector<Image<Complex>>> MicrographHandler::loadMovie(
     const MetaDataTable &mdt, int s, double angpix,
     std::vector<ParFourierTransformer>& fts,
@@ -26,6 +26,7 @@
 
 #include <src/jaz/gravis/t2Vector.h>
 #include <src/jaz/parallel_ft.h>
+#include <src/jaz/movie_cache.h>
 
 #include <src/micrograph_model.h>
 #include <src/image.h>
@@ -47,6 +48,11 @@ class MicrographHandler
 
 	gravis::t2Vector<int> micrograph_size;
 
+	// Extracted particle movies are cached in up to cacheMemory GB of memory
+	// and in up to cacheDiskMax GB of cacheDir (if not empty)
+	double cacheMemory, cacheDiskMax;
+	std::string cacheDir;
+
 
 	// initialise corrected/uncorrected micrograph dictionary, then
 	// load first movie (or read corrected_micrographs.star) to obtain:
@@ -103,6 +109,14 @@ class MicrographHandler
 	bool hasCorrMic;
 	std::map<std::string, std::string> mic2meta;
 
+	MovieCache movieCache;
+
+	// Identifies the particle movies that loadMovie() would extract
+	std::string cacheKey(
+		const MetaDataTable& mdt, int s, double angpix,
+		const std::vector<std::vector<gravis::d2Vector>>* offsets_in,
+		double data_angpix);
+
 	void loadInitial(
 		const std::vector<MetaDataTable>& mdts, bool verb,
 		int& fc, double& dosePerFrame, std::string& metaFn);
@@ -71,6 +71,9 @@ void MotionRefiner::read(int argc, char **argv) {
     maxMG = textToInteger(parser.getOption("--max_MG", "Last micrograph index (default is to process all)", "-1"));
 
     micrographHandler.saveMem = parser.checkOption("--sbs", "Load movies slice-by-slice to save memory (slower)");
+    micrographHandler.cacheMemory = textToDouble(parser.getOption("--movie_cache_mem", "Keep up to this many GB of extracted particle movies in memory, for re-use", "0"));
+    micrographHandler.cacheDir = parser.getOption("--movie_cache_dir", "Also keep extracted particle movies in this directory, for re-use by later runs with the same parameters", "");
+    micrographHandler.cacheDiskMax = textToDouble(parser.getOption("--movie_cache_dir_max", "Keep at most this many GB in --movie_cache_dir, deleting the least recently used movies", "100"));
 
     parser.addSection("Expert options");
 
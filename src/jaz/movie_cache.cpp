@@ -0,0 +1,284 @@
+/***************************************************************************
+ *
+ * Author: "agent"
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This complete copyright notice must be included in any revised version of the
+ * source code. Additional authorship citations may be added, but existing
+ * author citations must be preserved.
+ ***************************************************************************/
+
+#include "movie_cache.h"
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <functional>
+#include <algorithm>
+#include <unistd.h>
+#include <dirent.h>
+#include <utime.h>
+#include <sys/stat.h>
+#include <src/error.h>
+#include <src/filename.h>
+
+using namespace gravis;
+
+namespace {
+
+    const char MAGIC[8] = {'R', 'L', 'N', 'M', 'O', 'V', 'C', '1'};
+
+    size_t toBytes(double GB) {
+        return GB > 0 ? (size_t) (GB * 1024 * 1024 * 1024) : 0;
+    }
+
+    size_t movieBytes(const std::vector<std::vector<Image<Complex>>>& movie) {
+        size_t bytes = 0;
+        for (const auto& frames : movie)
+        for (const auto& frame : frames)
+            bytes += frame().size() * sizeof(Complex);
+        return bytes;
+    }
+
+    template <typename T>
+    void writeValue(std::ofstream& ofs, const T& value) {
+        ofs.write((const char*) &value, sizeof(T));
+    }
+
+    template <typename T>
+    bool readValue(std::ifstream& ifs, T& value) {
+        return (bool) ifs.read((char*) &value, sizeof(T));
+    }
+
+}
+
+MovieCache::MovieCache():
+max_memory(0),
+used_memory(0),
+max_disk(0),
+directory("") {}
+
+void MovieCache::init(double max_memory_GB, std::string directory, double max_disk_GB) {
+    max_memory = toBytes(max_memory_GB);
+    max_disk = toBytes(max_disk_GB);
+    this->directory = max_disk > 0 ? directory : "";
+
+    if (this->directory != "") {
+        // mktree also fails if the directory exists, so check for the directory instead
+        mktree(this->directory);
+        struct stat st;
+        if (stat(this->directory.c_str(), &st) != 0 || !S_ISDIR(st.st_mode))
+            REPORT_ERROR("MovieCache: unable to create the directory " + this->directory);
+    }
+
+    entries.clear();
+    used_memory = 0;
+}
+
+bool MovieCache::enabled() const {
+    return max_memory > 0 || directory != "";
+}
+
+bool MovieCache::get(
+    const std::string& key,
+    std::vector<std::vector<Image<Complex>>>& movie,
+    std::vector<std::vector<d2Vector>>* offsets
+) {
+    auto it = entries.find(key);
+
+    if (it != entries.end()) {
+        movie = it->second.movie;
+        if (offsets != 0) *offsets = it->second.offsets;
+        return true;
+    }
+
+    if (directory == "") return false;
+
+    std::vector<std::vector<d2Vector>> file_offsets;
+    if (!readFile(key, movie, file_offsets)) return false;
+
+    putInMemory(key, movie, file_offsets);
+    if (offsets != 0) *offsets = file_offsets;
+    return true;
+}
+
+void MovieCache::put(
+    const std::string& key,
+    const std::vector<std::vector<Image<Complex>>>& movie,
+    const std::vector<std::vector<d2Vector>>* offsets
+) {
+    const std::vector<std::vector<d2Vector>> my_offsets = offsets != 0 ? *offsets : std::vector<std::vector<d2Vector>>();
+
+    putInMemory(key, movie, my_offsets);
+
+    if (directory != "" && movieBytes(movie) <= max_disk) {
+        writeFile(key, movie, my_offsets);
+        trimDirectory();
+    }
+}
+
+std::string MovieCache::fileName(const std::string& key) const {
+    std::stringstream sts;
+    sts << directory << "/" << std::hex << std::hash<std::string>()(key) << ".bin";
+    return sts.str();
+}
+
+void MovieCache::putInMemory(
+    const std::string& key,
+    const std::vector<std::vector<Image<Complex>>>& movie,
+    const std::vector<std::vector<d2Vector>>& offsets
+) {
+    // Keep the movies that came first (see above)
+    const size_t bytes = movieBytes(movie);
+    if (used_memory + bytes > max_memory || entries.find(key) != entries.end()) return;
+
+    Entry& entry = entries[key];
+    entry.movie = movie;
+    entry.offsets = offsets;
+    entry.bytes = bytes;
+
+    used_memory += bytes;
+}
+
+bool MovieCache::readFile(
+    const std::string& key,
+    std::vector<std::vector<Image<Complex>>>& movie,
+    std::vector<std::vector<d2Vector>>& offsets
+) const {
+    const std::string fn = fileName(key);
+    std::ifstream ifs(fn, std::ios::binary);
+    if (!ifs) return false;
+
+    // The modification time says when the file was last used (see trimDirectory)
+    utime(fn.c_str(), 0);
+
+    char magic[8];
+    if (!ifs.read(magic, 8) || std::string(magic, 8) != std::string(MAGIC, 8)) return false;
+
+    // The full key is stored as well, in case of hash collisions
+    size_t key_length;
+    if (!readValue(ifs, key_length) || key_length != key.size()) return false;
+    std::string file_key(key_length, ' ');
+    if (!ifs.read(&file_key[0], key_length) || file_key != key) return false;
+
+    int pc, fc, xdim, ydim, has_offsets;
+    if (
+        !readValue(ifs, pc)   || !readValue(ifs, fc) ||
+        !readValue(ifs, xdim) || !readValue(ifs, ydim) ||
+        !readValue(ifs, has_offsets)
+    ) return false;
+
+    offsets.clear();
+    if (has_offsets) {
+        offsets.resize(pc, std::vector<d2Vector>(fc));
+        for (int p = 0; p < pc; p++)
+        for (int f = 0; f < fc; f++) {
+            if (!readValue(ifs, offsets[p][f].x) || !readValue(ifs, offsets[p][f].y)) return false;
+        }
+    }
+
+    movie.resize(pc);
+    for (int p = 0; p < pc; p++) {
+        movie[p].resize(fc);
+        for (int f = 0; f < fc; f++) {
+            movie[p][f] = Image<Complex>(xdim, ydim);
+            if (!ifs.read((char*) movie[p][f]().data, (size_t) xdim * ydim * sizeof(Complex))) return false;
+        }
+    }
+
+    return true;
+}
+
+void MovieCache::writeFile(
+    const std::string& key,
+    const std::vector<std::vector<Image<Complex>>>& movie,
+    const std::vector<std::vector<d2Vector>>& offsets
+) const {
+    const int pc = movie.size();
+    const int fc = pc > 0 ? movie[0].size() : 0;
+    const int xdim = pc > 0 && fc > 0 ? Xsize(movie[0][0]()) : 0;
+    const int ydim = pc > 0 && fc > 0 ? Ysize(movie[0][0]()) : 0;
+    const int has_offsets = !offsets.empty();
+
+    const std::string fn = fileName(key);
+    const std::string fn_tmp = fn + ".tmp" + std::to_string(getpid());
+
+    std::ofstream ofs(fn_tmp, std::ios::binary);
+    if (!ofs) REPORT_ERROR("MovieCache: unable to write " + fn_tmp);
+
+    ofs.write(MAGIC, 8);
+    writeValue(ofs, key.size());
+    ofs.write(key.data(), key.size());
+    writeValue(ofs, pc);
+    writeValue(ofs, fc);
+    writeValue(ofs, xdim);
+    writeValue(ofs, ydim);
+    writeValue(ofs, has_offsets);
+
+    if (has_offsets) {
+        for (int p = 0; p < pc; p++)
+        for (int f = 0; f < fc; f++) {
+            writeValue(ofs, offsets[p][f].x);
+            writeValue(ofs, offsets[p][f].y);
+        }
+    }
+
+    for (int p = 0; p < pc; p++)
+    for (int f = 0; f < fc; f++) {
+        ofs.write((const char*) movie[p][f]().data, (size_t) xdim * ydim * sizeof(Complex));
+    }
+
+    ofs.close();
+    if (!ofs) {
+        std::remove(fn_tmp.c_str());
+        REPORT_ERROR("MovieCache: unable to write " + fn_tmp + " (disk full?)");
+    }
+
+    // Other processes only ever see complete files
+    if (std::rename(fn_tmp.c_str(), fn.c_str()) != 0) {
+        std::remove(fn_tmp.c_str());
+        REPORT_ERROR("MovieCache: unable to rename " + fn_tmp + " to " + fn);
+    }
+}
+
+void MovieCache::trimDirectory() const {
+    struct CacheFile {
+        std::string name;
+        time_t mtime;
+        size_t bytes;
+    };
+
+    DIR* dir = opendir(directory.c_str());
+    if (dir == 0) return;
+
+    std::vector<CacheFile> files;
+    size_t total = 0;
+    while (const dirent* de = readdir(dir)) {
+        const std::string name = de->d_name;
+        if (name.size() < 4 || name.compare(name.size() - 4, 4, ".bin") != 0) continue;
+        const std::string fn = directory + "/" + name;
+        struct stat st;
+        if (stat(fn.c_str(), &st) != 0) continue;
+        files.push_back({fn, st.st_mtime, (size_t) st.st_size});
+        total += st.st_size;
+    }
+    closedir(dir);
+
+    // Least recently used first
+    std::sort(files.begin(), files.end(), [](const CacheFile& a, const CacheFile& b) { return a.mtime < b.mtime; });
+
+    // Another process may delete the same files: that is fine
+    for (const CacheFile& file : files) {
+        if (total <= max_disk) break;
+        std::remove(file.name.c_str());
+        total -= file.bytes;
+    }
+}
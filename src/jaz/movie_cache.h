@@ -0,0 +1,97 @@
+/***************************************************************************
+ *
+ * Author: "agent"
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This complete copyright notice must be included in any revised version of the
+ * source code. Additional authorship citations may be added, but existing
+ * author citations must be preserved.
+ ***************************************************************************/
+
+#ifndef MOVIE_CACHE_H
+#define MOVIE_CACHE_H
+
+#include <string>
+#include <map>
+#include <vector>
+
+#include <src/jaz/gravis/t2Vector.h>
+#include <src/image.h>
+
+/* Cache of the extracted, Fourier-transformed particle movies of MicrographHandler::loadMovie,
+   keyed by a string that identifies the micrograph and all extraction parameters.
+
+   Movies are kept in memory up to max_memory bytes. Polishing loads the micrographs in the same order
+   in every pass over them, so once the memory is full, new movies are not kept, rather than evicting
+   the oldest ones (which would evict every movie just before its next use).
+
+   If a directory is given, movies are also kept on disk, where they survive the process: later polishing
+   runs (e.g. a parameter search) with the same parameters then do not decode the movies again.
+   The directory is kept below max_disk bytes by deleting the least recently used files.
+   Disk entries are written to a temporary file and renamed, so several processes can share a directory. */
+class MovieCache
+{
+	public:
+
+	MovieCache();
+
+	void init(double max_memory_GB, std::string directory, double max_disk_GB);
+
+	bool enabled() const;
+
+	// Returns false if the key is in neither cache
+	bool get(
+		const std::string& key,
+		std::vector<std::vector<Image<Complex>>>& movie,
+		std::vector<std::vector<gravis::d2Vector>>* offsets);
+
+	void put(
+		const std::string& key,
+		const std::vector<std::vector<Image<Complex>>>& movie,
+		const std::vector<std::vector<gravis::d2Vector>>* offsets);
+
+	protected:
+
+	struct Entry
+	{
+		std::vector<std::vector<Image<Complex>>> movie;
+		std::vector<std::vector<gravis::d2Vector>> offsets;
+		size_t bytes;
+	};
+
+	size_t max_memory, used_memory, max_disk;
+	std::string directory;
+
+	std::map<std::string, Entry> entries;
+
+	std::string fileName(const std::string& key) const;
+
+	void putInMemory(
+		const std::string& key,
+		const std::vector<std::vector<Image<Complex>>>& movie,
+		const std::vector<std::vector<gravis::d2Vector>>& offsets);
+
+	bool readFile(
+		const std::string& key,
+		std::vector<std::vector<Image<Complex>>>& movie,
+		std::vector<std::vector<gravis::d2Vector>>& offsets) const;
+
+	void writeFile(
+		const std::string& key,
+		const std::vector<std::vector<Image<Complex>>>& movie,
+		const std::vector<std::vector<gravis::d2Vector>>& offsets) const;
+
+	// Delete the least recently used files of the directory until it holds at most max_disk bytes
+	void trimDirectory() const;
+};
+
+#endif
@@ -22,11 +22,11 @@
 
 #include "src/macros.h"
 #include "src/fftw.h"
+#include "src/fftw_plans.h"
 #include "src/args.h"
 #include <string.h>
 #include <math.h>
 
-pthread_mutex_t NewFFT::fftw_plan_mutex_new = PTHREAD_MUTEX_INITIALIZER;
 
 
 void NewFFT::FourierTransform(
@@ -287,29 +287,9 @@ complexPtr(0)
 
     const int ndim = N.size();
 
-    pthread_mutex_lock(&fftw_plan_mutex_new);
-
-    fftw_plan planForward = fftw_plan_dft_r2c(
-        ndim, &N[0],
-        realDummy.data,
-        (fftw_complex*) complexDummy.data,
-        FFTW_UNALIGNED | flags
-    );
-
-    fftw_plan planBackward = fftw_plan_dft_c2r(
-        ndim, &N[0],
-        (fftw_complex*) complexDummy.data,
-        realDummy.data,
-        FFTW_UNALIGNED | flags
-    );
-
-    pthread_mutex_unlock(&fftw_plan_mutex_new);
-
-    if (!planForward || !planBackward) {
-        REPORT_ERROR("FFTW plans cannot be created");
-    }
-
-    plan = std::shared_ptr<Plan>(new Plan(planForward, planBackward));
+    plan = std::shared_ptr<Plan>(new Plan);
+    plan->forward  = FftwPlans::get(FftwPlans::R2C, ndim, &N[0], realDummy.data, (double*) complexDummy.data, FFTW_UNALIGNED | flags);
+    plan->backward = FftwPlans::get(FftwPlans::C2R, ndim, &N[0], (double*) complexDummy.data, realDummy.data, FFTW_UNALIGNED | flags);
 }
 
 NewFFT::DoublePlan::DoublePlan(
@@ -329,29 +309,9 @@ complexPtr((double*)complex.data)
 
     const int ndim = N.size();
 
-    pthread_mutex_lock(&fftw_plan_mutex_new);
-
-    fftw_plan planForward = fftw_plan_dft_r2c(
-        ndim, &N[0],
-        real.data,
-        (fftw_complex*) complex.data,
-        flags
-    );
-
-    fftw_plan planBackward = fftw_plan_dft_c2r(
-        ndim, &N[0],
-        (fftw_complex*) complex.data,
-        real.data,
-        flags
-    );
-
-    pthread_mutex_unlock(&fftw_plan_mutex_new);
-
-    if (!planForward || !planBackward) {
-        REPORT_ERROR("FFTW plans cannot be created");
-    }
-
-    plan = std::shared_ptr<Plan>(new Plan(planForward, planBackward));
+    plan = std::shared_ptr<Plan>(new Plan);
+    plan->forward  = FftwPlans::get(FftwPlans::R2C, ndim, &N[0], real.data, (double*) complex.data, flags);
+    plan->backward = FftwPlans::get(FftwPlans::C2R, ndim, &N[0], (double*) complex.data, real.data, flags);
 }
 
 NewFFT::FloatPlan::FloatPlan(int w, int h, int d, unsigned int flags):
@@ -370,29 +330,9 @@ complexPtr(0)
 
     const int ndim = N.size();
 
-    pthread_mutex_lock(&fftw_plan_mutex_new);
-
-    fftwf_plan planForward = fftwf_plan_dft_r2c(
-        ndim, &N[0],
-        realDummy.data,
-        (fftwf_complex*) complexDummy.data,
-        FFTW_UNALIGNED | flags
-    );
-
-    fftwf_plan planBackward = fftwf_plan_dft_c2r(
-        ndim, &N[0],
-        (fftwf_complex*) complexDummy.data,
-        realDummy.data,
-        FFTW_UNALIGNED | flags
-    );
-
-    pthread_mutex_unlock(&fftw_plan_mutex_new);
-
-    if (!planForward || !planBackward) {
-        REPORT_ERROR("FFTW plans cannot be created");
-    }
-
-    plan = std::shared_ptr<Plan>(new Plan(planForward, planBackward));
+    plan = std::shared_ptr<Plan>(new Plan);
+    plan->forward  = FftwPlans::get(FftwPlans::R2C, ndim, &N[0], realDummy.data, (float*) complexDummy.data, FFTW_UNALIGNED | flags);
+    plan->backward = FftwPlans::get(FftwPlans::C2R, ndim, &N[0], (float*) complexDummy.data, realDummy.data, FFTW_UNALIGNED | flags);
 }
 
 NewFFT::FloatPlan::FloatPlan(
@@ -412,27 +352,7 @@ complexPtr((float*) complex.data)
 
     const int ndim = N.size();
 
-    pthread_mutex_lock(&fftw_plan_mutex_new);
-
-    fftwf_plan planForward = fftwf_plan_dft_r2c(
-        ndim, &N[0],
-        real.data,
-        (fftwf_complex*) complex.data,
-        flags
-    );
-
-    fftwf_plan planBackward = fftwf_plan_dft_c2r(
-        ndim, &N[0],
-        (fftwf_complex*) complex.data,
-        real.data,
-        flags
-    );
-
-    pthread_mutex_unlock(&fftw_plan_mutex_new);
-
-    if (!planForward || !planBackward) {
-        REPORT_ERROR("FFTW plans cannot be created");
-    }
-
-    plan = std::shared_ptr<Plan>(new Plan(planForward, planBackward));
+    plan = std::shared_ptr<Plan>(new Plan);
+    plan->forward  = FftwPlans::get(FftwPlans::R2C, ndim, &N[0], real.data, (float*) complex.data, flags);
+    plan->backward = FftwPlans::get(FftwPlans::C2R, ndim, &N[0], (float*) complex.data, real.data, flags);
 }
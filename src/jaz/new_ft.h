@@ -203,9 +203,8 @@ class NewFFT {
 
     /* These plan classes can be copied freely.
         The corresponding pairs of fftw_plan instances
-        will be automatically deallocated using fftw_destroy_plan()
-        when no instance of Double/FloatPlan points to them.
-        (note the std::shared_ptr<Plan> 'plan') */
+        are shared by the whole process (see src/fftw_plans.h),
+        and never destroyed. */
     class DoublePlan {
 
         public:
@@ -219,6 +218,8 @@ class NewFFT {
             'flags' allows for controlling planning rigor and
                 setting algorithmic restrictions.
                 (cf. http://www.fftw.org/fftw3_doc/Planner-Flags.html)
+                The rigor is raised to that of RELION_FFTW_PLANNING,
+                if that is more patient.
         */
         DoublePlan(int w, int h = 1, int d = 1,
                     unsigned int flags = FFTW_ESTIMATE);
@@ -250,22 +251,7 @@ class NewFFT {
 
             private:
 
-            class Plan {
-
-                public:
-
-                Plan(fftw_plan forward, fftw_plan backward): 
-                forward(forward), backward(backward) {}
-
-                ~Plan() {
-                    pthread_mutex_lock(&fftw_plan_mutex_new);
-
-                    fftw_destroy_plan(forward);
-                    fftw_destroy_plan(backward);
-
-                    pthread_mutex_unlock(&fftw_plan_mutex_new);
-                }
-
+            struct Plan {
                 fftw_plan forward, backward;
             };
 
@@ -309,22 +295,7 @@ class NewFFT {
 
             private:
 
-            class Plan {
-
-                public:
-
-                Plan(fftwf_plan forward, fftwf_plan backward): 
-                forward(forward), backward(backward) {}
-
-                ~Plan() {
-                    pthread_mutex_lock(&fftw_plan_mutex_new);
-
-                    fftwf_destroy_plan(forward);
-                    fftwf_destroy_plan(backward);
-
-                    pthread_mutex_unlock(&fftw_plan_mutex_new);
-                }
-
+            struct Plan {
                 fftwf_plan forward, backward;
             };
             
@@ -335,8 +306,6 @@ class NewFFT {
 
         };
 
-        static pthread_mutex_t fftw_plan_mutex_new;
-
 };
 
 // This is to get NewFFTPlan::Plan<RFLOAT>
@@ -21,12 +21,11 @@
 #include "src/macros.h"
 #include "src/jaz/parallel_ft.h"
 #include "src/fftw.h"
+#include "src/fftw_plans.h"
 #include "src/args.h"
 #include <string.h>
 #include <math.h>
 
-static pthread_mutex_t fftw_plan_mutex_par = PTHREAD_MUTEX_INITIALIZER;
-
 // #define DEBUG_PLANS
 
 // Constructors and destructors --------------------------------------------
@@ -47,36 +46,23 @@ ParFourierTransformer::ParFourierTransformer(const ParFourierTransformer& op) {
 
 // Initialization ----------------------------------------------------------
 void ParFourierTransformer::setReal(MultidimArray<RFLOAT> &input) {
+    // Plans are shared (see FftwPlans), so a new look-up is cheap.
+    // It is needed when the alignment of the arrays may have changed.
     bool recomputePlan =
         !fReal ||
-        // dataPtr != input.data ||
+        dataPtr != input.data ||
         !fReal->sameShape(input);
 
     fFourier.reshape(Xsize(input) / 2 + 1, Ysize(input), Zsize(input));
     fReal = &input;
 
-    if (recomputePlan) {
+    if (recomputePlan || complexDataPtr != fFourier.data) {
         const int rank = get_array_rank(input);
         const int *const n = new_n(input, rank);
 
-        // Destroy any forward or backward plans
-        destroyPlans();
-
-        // Make new plans
         plans_are_set = true;
-
-        {
-        pthread_lock_guard guard (&fftw_plan_mutex_par);
-        fPlanForward = FFTW_PLAN_DFT_R2C(
-            rank, n, fReal->data, (FFTW_COMPLEX*) fFourier.data, FFTW_ESTIMATE
-        );
-        fPlanBackward = FFTW_PLAN_DFT_C2R(
-            rank, n, (FFTW_COMPLEX*) fFourier.data, fReal->data, FFTW_ESTIMATE
-        );
-        }
-
-        if (!fPlanForward || !fPlanBackward)
-            REPORT_ERROR("FFTW plans cannot be created");
+        fPlanForward  = FftwPlans::get(FftwPlans::R2C, rank, n, fReal->data, (RFLOAT*) fFourier.data);
+        fPlanBackward = FftwPlans::get(FftwPlans::C2R, rank, n, (RFLOAT*) fFourier.data, fReal->data);
 
         #ifdef DEBUG_PLANS
         std::cerr << " SETREAL fPlanForward= " << fPlanForward << " fPlanBackward= " << fPlanBackward  <<" this= " << this << std::endl;
@@ -84,13 +70,14 @@ void ParFourierTransformer::setReal(MultidimArray<RFLOAT> &input) {
 
         delete[] n;
         dataPtr = fReal->data;
+        complexDataPtr = fFourier.data;
     }
 }
 
 void ParFourierTransformer::setReal(MultidimArray<Complex> &input) {
     bool recomputePlan =
         !fComplex ||
-        // complexDataPtr != input.data ||
+        complexDataPtr != input.data ||
         !fComplex->sameShape(input);
 
     fFourier.resize(input);
@@ -100,25 +87,9 @@ void ParFourierTransformer::setReal(MultidimArray<Complex> &input) {
         const int rank = get_array_rank(input);
         const int *const n = new_n(input, rank);
 
-        // Destroy any forward or backward plans
-        destroyPlans();
-
         plans_are_set = true;
-
-        {
-        pthread_lock_guard guard (&fftw_plan_mutex_par);
-        fPlanForward = FFTW_PLAN_DFT(
-            rank, n, (FFTW_COMPLEX*) fComplex->data,
-            (FFTW_COMPLEX*) fFourier.data, FFTW_FORWARD, FFTW_ESTIMATE
-        );
-        fPlanBackward = FFTW_PLAN_DFT(
-            rank, n, (FFTW_COMPLEX*) fFourier.data,
-            (FFTW_COMPLEX*) fComplex->data, FFTW_BACKWARD, FFTW_ESTIMATE
-        );
-        }
-
-        if (!fPlanForward || !fPlanBackward)
-            REPORT_ERROR("FFTW plans cannot be created");
+        fPlanForward  = FftwPlans::get(FftwPlans::C2C_FORWARD,  rank, n, (RFLOAT*) fComplex->data, (RFLOAT*) fFourier.data);
+        fPlanBackward = FftwPlans::get(FftwPlans::C2C_BACKWARD, rank, n, (RFLOAT*) fFourier.data, (RFLOAT*) fComplex->data);
 
         delete[] n;
         complexDataPtr = fComplex->data;
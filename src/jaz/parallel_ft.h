@@ -44,6 +44,9 @@
   Otherwise, the two classes are identical.
 
           -- J. Zivanov, Feb. 9th 2018
+
+  Both classes now look up their plans in FftwPlans (src/fftw_plans.h),
+  which makes each plan once per process.
 */
 class ParFourierTransformer: public FourierTransformer {
 
@@ -165,28 +165,45 @@ std::vector<Image<Complex>> StackHelper::loadStackFS(
 
     const int s = dummy.data.xdim;
 
-    NewFFTPlan<RFLOAT>::type plan(s, s, 1);
+    // Transform the images in batches of up to 64 (and 4M pixels), with one FFT each
+    const long batch_size = std::max(1L, std::min(64L, (4L << 20) / ((long) s * s)));
+    const long nr_batches = (ic + batch_size - 1) / batch_size;
+
+    #pragma omp parallel num_threads(threads)
+    {
+    BatchFourierTransformer batch;
+
+    #pragma omp for schedule(dynamic)
+    for (long b = 0; b < nr_batches; b++) {
+        const long first = b * batch_size;
+        const long n = std::min(batch_size, ic - first);
+        batch.resize(n, s, s);
+
+        for (long j = 0; j < n; j++) {
+            std::string sliceName = mdt.getValue<std::string>(EMDL::IMAGE_NAME, first + j);
+            Image<RFLOAT> in;
+            in.read(sliceName, true, -1, nullptr, true);
+            batch.setReal(j, in());
+        }
 
-    #pragma omp parallel for num_threads(threads)
-    for (long i = 0; i < ic; i++) {
-        int optGroup = obs->getOpticsGroup(mdt, i);
-        double angpix = obs->getPixelSize(optGroup);
+        batch.FourierTransform();
 
-        std::string sliceName = mdt.getValue<std::string>(EMDL::IMAGE_NAME, i);
-        Image<RFLOAT> in;
-        in.read(sliceName, true, -1, nullptr, true);
+        for (long j = 0; j < n; j++) {
+            const long i = first + j;
+            batch.getFourier(j, out[i]());
 
-        NewFFT::FourierTransform(in(), out[i](), plan);
+            if (centerParticle) {
+                int optGroup = obs->getOpticsGroup(mdt, i);
+                double angpix = obs->getPixelSize(optGroup);
 
-        if (centerParticle) {
-            const int s = in.data.ydim;
+                const double xoff = mdt.getValue<double>(EMDL::ORIENT_ORIGIN_X_ANGSTROM, i) / angpix;
+                const double yoff = mdt.getValue<double>(EMDL::ORIENT_ORIGIN_Y_ANGSTROM, i) / angpix;
 
-            const double xoff = mdt.getValue<double>(EMDL::ORIENT_ORIGIN_X_ANGSTROM, i) / angpix;
-            const double yoff = mdt.getValue<double>(EMDL::ORIENT_ORIGIN_Y_ANGSTROM, i) / angpix;
-
-            shiftImageInFourierTransform(out[i](), s, xoff - s / 2, yoff - s / 2);
+                shiftImageInFourierTransform(out[i](), s, xoff - s / 2, yoff - s / 2);
+            }
         }
     }
+    }
 
     return out;
 }
@@ -19,6 +19,11 @@
  ***************************************************************************/
 
 #include "src/local_symmetry.h"
+#include <array>
+#include <atomic>
+#include <map>
+#include <numeric>
+#include <omp.h>
 
 //#define DEBUG
 #define NEW_APPLY_SYMMETRY_METHOD
@@ -1574,15 +1579,180 @@ void getLocalSearchOperatorSamplings(
         REPORT_ERROR("ERROR: No sampling points!");
 }
 
+namespace {
+
+    // Weighted rms difference under the mask between src and dest transformed by op (lower is better)
+    RFLOAT operatorCC(
+        const MultidimArray<RFLOAT> &src, const MultidimArray<RFLOAT> &dest, const MultidimArray<RFLOAT> &mask,
+        const Vector<RFLOAT> &op, RFLOAT mask_val_sum
+    ) {
+        Matrix<RFLOAT> op_mat;
+        Localsym_operator2matrix(op, op_mat, LOCALSYM_OP_DO_INVERT);
+        const MultidimArray<RFLOAT> vol = applyGeometry(dest, op_mat, IS_NOT_INV, DONT_WRAP);
+
+        RFLOAT cc = 0.0;
+        for (long int k = 0; k < Zsize(vol); k++)
+        for (long int j = 0; j < Ysize(vol); j++)
+        for (long int i = 0; i < Xsize(vol); i++) {
+            const RFLOAT mask_val = direct::elem(mask, i, j, k);
+            if (mask_val < Xmipp::epsilon<RFLOAT>())
+                continue;
+
+            const RFLOAT val = direct::elem(vol, i, j, k) - direct::elem(src, i, j, k);
+            cc += mask_val * val * val; // weighted by mask value ?
+        }
+        return sqrt(cc / mask_val_sum);
+    }
+
+    // Zero-padded copy (of twice the size) of a cubic array, so that FFT cross-correlations do not wrap around
+    MultidimArray<RFLOAT> padded(const MultidimArray<RFLOAT> &v) {
+        MultidimArray<RFLOAT> p = MultidimArray<RFLOAT>::zeros(2 * Xsize(v), 2 * Ysize(v), 2 * Zsize(v));
+        for (long int k = 0; k < Zsize(v); k++)
+        for (long int j = 0; j < Ysize(v); j++)
+        for (long int i = 0; i < Xsize(v); i++)
+            direct::elem(p, i, j, k) = direct::elem(v, i, j, k);
+        return p;
+    }
+
+}
+
+// dest(R x + t) is the rotated dest, u(x) = dest(R x), shifted by R^T t,
+// so that the masked squared differences for all shifts of u come from one FFT cross-correlation per rotation:
+// sum_x m(x) (u(x + s) - src(x))^2 = sum_x m src^2 - 2 sum_x (m src)(x) u(x + s) + sum_x m(x) u^2(x + s).
+// These are interpolated at the (scaled) translations of the samplings with that rotation.
+std::vector<RFLOAT> coarseOperatorCCs(
+    const MultidimArray<RFLOAT> &src, const MultidimArray<RFLOAT> &dest, const MultidimArray<RFLOAT> &mask,
+    const std::vector<Vector<RFLOAT>> &op_samplings, int nr_threads, bool verb
+) {
+    const long int N = Xsize(src);
+    long int Nc = N;
+    while (Nc / 2 >= 32) { Nc /= 2; }
+    if (Nc % 2) { Nc++; }
+    const RFLOAT scale = RFLOAT(Nc) / RFLOAT(N);
+
+    MultidimArray<RFLOAT> src_c = src, dest_c = dest, mask_c = mask;
+    if (Nc != N) {
+        resizeMap(src_c, Nc);
+        resizeMap(dest_c, Nc);
+        resizeMap(mask_c, Nc);
+        truncateMultidimArray(mask_c, 0.0, 1.0);
+    }
+    src_c.setXmippOrigin();
+    dest_c.setXmippOrigin();
+    mask_c.setXmippOrigin();
+
+    RFLOAT mask_sum = 0.0, sum_ms2 = 0.0;
+    MultidimArray<RFLOAT> ms = src_c;
+    for (long int n = 0; n < ms.size(); n++) {
+        mask_sum += mask_c[n];
+        sum_ms2 += mask_c[n] * src_c[n] * src_c[n];
+        ms[n] *= mask_c[n];
+    }
+
+    // Samplings with the same rotation
+    std::map<std::array<RFLOAT, 3>, std::vector<long int>> by_rotation;
+    for (long int n = 0; n < op_samplings.size(); n++) {
+        const Vector<RFLOAT> &op = op_samplings[n];
+        by_rotation[{op[AA_POS], op[BB_POS], op[GG_POS]}].push_back(n);
+    }
+    const std::vector<std::vector<long int>> groups = [&] () {
+        std::vector<std::vector<long int>> groups;
+        for (auto &rotation : by_rotation) groups.push_back(rotation.second);
+        return groups;
+    }();
+
+    if (verb)
+        std::cout << " + Coarse search over " << groups.size() << " rotations with boxes of " << Nc << " pixels ..." << std::endl;
+
+    const long int P = 2 * Nc;
+    const RFLOAT nr_voxels = RFLOAT(P) * P * P;
+    // The transformers keep a pointer to their input, so it must outlive them
+    const MultidimArray<RFLOAT> ms_p = padded(ms), mask_p = padded(mask_c);
+    FourierTransformer transformer;
+    const MultidimArray<Complex> Fms   = transformer.FourierTransform(ms_p);
+    const MultidimArray<Complex> Fmask = transformer.FourierTransform(mask_p);
+
+    std::vector<RFLOAT> ccs (op_samplings.size(), 1e10);
+    #pragma omp parallel num_threads(nr_threads)
+    {
+        MultidimArray<RFLOAT> u_p, u2_p;
+        FourierTransformer my_transformer;
+
+        #pragma omp for schedule(dynamic)
+        for (long int igroup = 0; igroup < groups.size(); igroup++) {
+            const std::vector<long int> &group = groups[igroup];
+
+            Matrix<RFLOAT> rot_mat;
+            Localsym_angles2matrix(op_samplings[group[0]], rot_mat, LOCALSYM_OP_DO_INVERT);
+            MultidimArray<RFLOAT> u = applyGeometry(dest_c, rot_mat, IS_NOT_INV, DONT_WRAP), u2 = u;
+            for (long int n = 0; n < u2.size(); n++)
+                u2[n] *= u2[n];
+
+            u_p = padded(u);
+            u2_p = padded(u2);
+            MultidimArray<Complex> F = my_transformer.FourierTransform(u_p);
+            const MultidimArray<Complex> &Fu2 = my_transformer.FourierTransform(u2_p);
+            for (long int n = 0; n < F.size(); n++)
+                F[n] = conj(Fmask[n]) * Fu2[n] - conj(Fms[n]) * F[n] * (RFLOAT) 2.0;
+            const MultidimArray<RFLOAT> ssd = my_transformer.inverseFourierTransform(F);
+
+            // R^T t, in coarse pixels
+            const Matrix<RFLOAT> R = Euler::angles2matrix(
+                op_samplings[group[0]][AA_POS], op_samplings[group[0]][BB_POS], op_samplings[group[0]][GG_POS]);
+            for (long int n : group) {
+                const Vector<RFLOAT> &op = op_samplings[n];
+                RFLOAT shift [3];
+                bool is_inside = true;
+                for (int d = 0; d < 3; d++) {
+                    shift[d] = scale * (R(0, d) * op[DX_POS] + R(1, d) * op[DY_POS] + R(2, d) * op[DZ_POS]);
+                    is_inside = is_inside && std::abs(shift[d]) < Nc - 1;
+                }
+                if (!is_inside) continue;
+
+                // Trilinear interpolation (shifts are at (s + P) % P)
+                long int i0 [3];
+                RFLOAT f [3];
+                for (int d = 0; d < 3; d++) {
+                    const long int s0 = floor(shift[d]);
+                    f[d] = shift[d] - s0;
+                    i0[d] = s0 + P;
+                }
+                RFLOAT val = 0.0;
+                for (int dk = 0; dk <= 1; dk++)
+                for (int dj = 0; dj <= 1; dj++)
+                for (int di = 0; di <= 1; di++) {
+                    const RFLOAT w = (di ? f[0] : 1.0 - f[0]) * (dj ? f[1] : 1.0 - f[1]) * (dk ? f[2] : 1.0 - f[2]);
+                    val += w * direct::elem(ssd, (i0[0] + di) % P, (i0[1] + dj) % P, (i0[2] + dk) % P);
+                }
+                ccs[n] = sqrt(std::max(sum_ms2 + nr_voxels * val, (RFLOAT) 0.0) / mask_sum);
+            }
+        }
+    }
+    return ccs;
+}
+
+std::vector<long int> bestOperatorSamplings(
+    const MultidimArray<RFLOAT> &src, const MultidimArray<RFLOAT> &dest, const MultidimArray<RFLOAT> &mask,
+    const std::vector<Vector<RFLOAT>> &op_samplings, long int nr_refine, int nr_threads, bool verb
+) {
+    std::vector<long int> best (op_samplings.size());
+    std::iota(best.begin(), best.end(), 0);
+    if (nr_refine <= 0 || nr_refine >= op_samplings.size())
+        return best;
+
+    const std::vector<RFLOAT> coarse_ccs = coarseOperatorCCs(src, dest, mask, op_samplings, nr_threads, verb);
+    std::stable_sort(best.begin(), best.end(),
+        [&] (long int a, long int b) { return coarse_ccs[a] < coarse_ccs[b]; });
+    best.resize(nr_refine);
+    return best;
+}
+
 void calculateOperatorCC(
     const MultidimArray<RFLOAT> &src, const MultidimArray<RFLOAT> &dest, const MultidimArray<RFLOAT> &mask,
     std::vector<Vector<RFLOAT>>& op_samplings,
-    bool do_sort, bool verb
+    bool do_sort, bool verb, int nr_threads, long int nr_refine
 ) {
-    RFLOAT val = 0.0, mask_val = 0.0, mask_val_sum = 0.0, mask_val_ctr = 0.0, cc = 0.0;
-    int barstep = 0, updatebar = 0, totalbar = 0;
-    Matrix<RFLOAT> op_mat;
-    MultidimArray<RFLOAT> vol;
+    RFLOAT mask_val_sum = 0.0, mask_val_ctr = 0.0;
 
     if (op_samplings.size() < 1)
         REPORT_ERROR("ERROR: No sampling points!");
@@ -1596,47 +1766,40 @@ void calculateOperatorCC(
     if (!src.sameShape(dest) || !src.sameShape(mask))
         REPORT_ERROR("ERROR: MultidimArray src, dest, mask should have the same sizes!");
 
+    for (const auto &op : op_samplings) {
+        if (op.size() != NR_LOCALSYM_PARAMETERS)
+            REPORT_ERROR("ERROR: op is not a local symmetry operator!");
+    }
+
     // Check the mask, calculate the sum of mask values
     sum3DCubicMask(mask, mask_val_sum, mask_val_ctr);
     if (mask_val_sum < 1.0)
         std::cout << " + WARNING: sum of mask values is smaller than 1! Please check whether it is a correct mask!" << std::endl;
 
-    // Calculate all CCs
-    if (verb) {
-        // std::cout << " + Calculate CCs for all sampling points ..." << std::endl;
-        init_progress_bar(op_samplings.size());
-        barstep = op_samplings.size() / 100;
-        updatebar = totalbar = 0;
+    // Only calculate the CCs of the best sampling points of a coarse search (the others stay at 1e10)
+    const std::vector<long int> to_calculate = bestOperatorSamplings(src, dest, mask, op_samplings, nr_refine, nr_threads, verb);
+    if (to_calculate.size() < op_samplings.size()) {
+        for (auto &op : op_samplings)
+            op[CC_POS] = 1e10;
+        if (verb)
+            std::cout << " + Calculating CCs of the best " << nr_refine << " sampling points ..." << std::endl;
     }
-    for (auto &op : op_samplings) {
-        Localsym_operator2matrix(op, op_mat, LOCALSYM_OP_DO_INVERT);
-        vol = applyGeometry(dest, op_mat, IS_NOT_INV, DONT_WRAP);
-
-        cc = 0.0;
-        for (long int k = 0; k < Zsize(vol); k++)
-        for (long int j = 0; j < Ysize(vol); j++)
-        for (long int i = 0; i < Xsize(vol); i++) {
-            mask_val = direct::elem(mask, i, j, k);
-            if (mask_val < Xmipp::epsilon<RFLOAT>())
-                continue;
 
-            val = direct::elem(vol, i, j, k) - direct::elem(src, i, j, k);
-            //cc += val * val;
-            cc += mask_val * val * val; // weighted by mask value ?
-        }
-        op[CC_POS] = sqrt(cc / mask_val_sum);
-
-        if (verb) {
-            if (updatebar > barstep) {
-                updatebar = 0;
-                progress_bar(totalbar);
-            }
-            updatebar++;
-            totalbar++;
-        }
+    // Calculate all CCs
+    std::atomic<long int> nr_done (0);
+    if (verb)
+        init_progress_bar(to_calculate.size());
+    #pragma omp parallel for num_threads(nr_threads) schedule(dynamic)
+    for (long int n = 0; n < to_calculate.size(); n++) {
+        Vector<RFLOAT> &op = op_samplings[to_calculate[n]];
+        op[CC_POS] = operatorCC(src, dest, mask, op, mask_val_sum);
+
+        nr_done++;
+        if (verb && omp_get_thread_num() == 0)
+            progress_bar(nr_done);
     }
     if (verb)
-        progress_bar(op_samplings.size());
+        progress_bar(to_calculate.size());
 
     // Sort cc, in descending order
     if (do_sort)
@@ -2059,6 +2222,8 @@ void local_symmetry_parameters::read(int argc, char **argv) {
     fn_info_in_parsed_ext = parser.getOption("--i_mask_info_parsed_ext", "Extension of parsed input file with mask filenames and rotational / translational operators", "parsed");
     use_healpix_sampling = parser.checkOption("--use_healpix", "Use Healpix for angular samplings?");
     width_edge_pix = textToFloat(parser.getOption("--width", "Width of cosine soft edge (in pixels)", "5."));
+    nr_threads = textToInteger(parser.getOption("--j", "Number of threads for local searches", "1"));
+    nr_refine = textToInteger(parser.getOption("--nr_refine", "Only calculate CCs for this number of the best sampling points of a coarse (FFT) local search on downsampled maps (<= 0: calculate CCs for all sampling points)", "100"));
 
        // Check for errors in the command-line option
     if (parser.checkForErrors())
@@ -2426,7 +2591,7 @@ void local_symmetry_parameters::run() {
                     REPORT_ERROR("ERROR: No sampling points!");
 
                 // Calculate all CCs for the sampling points
-                calculateOperatorCC(src_cropped, dest_cropped, mask_cropped, op_samplings, false, do_verb);
+                calculateOperatorCC(src_cropped, dest_cropped, mask_cropped, op_samplings, false, do_verb, nr_threads, nr_refine);
 
                 // TODO: For rescaled maps
                 if (newdim != cropdim) {
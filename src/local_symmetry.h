@@ -232,12 +232,38 @@ void getLocalSearchOperatorSamplings(
     bool verb = true
 );
 
+// Calculate the CCs (the weighted rms differences under the mask) of sampled operators, on nr_threads threads.
+// If 0 < nr_refine < op_samplings.size(), the sampling points are first ranked by a coarse search on downsampled maps,
+// with one FFT cross-correlation for all translations of each rotation,
+// and only the best nr_refine of them get their CCs calculated (the others are left at 1e10).
+// relion_localsym_mpi does the coarse search on the leader (bestOperatorSamplings), so that it ranks all sampling points at once.
 void calculateOperatorCC(
     const MultidimArray<RFLOAT> &src,
     const MultidimArray<RFLOAT> &dest,
     const MultidimArray<RFLOAT> &mask,
     std::vector<Vector<RFLOAT>> &op_samplings,
-    bool do_sort = true, bool verb = true
+    bool do_sort = true, bool verb = true,
+    int nr_threads = 1, long int nr_refine = -1
+);
+
+// The approximate CCs of all op_samplings in the coarse search of calculateOperatorCC,
+// on maps downsampled to 32-63 pixels (1e10 for translations beyond the downsampled box)
+std::vector<RFLOAT> coarseOperatorCCs(
+    const MultidimArray<RFLOAT> &src,
+    const MultidimArray<RFLOAT> &dest,
+    const MultidimArray<RFLOAT> &mask,
+    const std::vector<Vector<RFLOAT>> &op_samplings,
+    int nr_threads = 1, bool verb = true
+);
+
+// The indices of the best nr_refine of op_samplings by the coarse search of calculateOperatorCC, best first
+// (or of all of them, in their order, unless 0 < nr_refine < op_samplings.size())
+std::vector<long int> bestOperatorSamplings(
+    const MultidimArray<RFLOAT> &src,
+    const MultidimArray<RFLOAT> &dest,
+    const MultidimArray<RFLOAT> &mask,
+    const std::vector<Vector<RFLOAT>> &op_samplings,
+    long int nr_refine, int nr_threads = 1, bool verb = true
 );
 
 void separateMasksBFS(
@@ -300,6 +326,10 @@ class local_symmetry_parameters {
 
     bool use_healpix_sampling;
 
+    // Threads, and the number of sampling points of a coarse search to calculate CCs for (all if <= 0)
+    int nr_threads;
+    long int nr_refine;
+
     // Verbose output?
     bool verb;
 
@@ -352,7 +352,28 @@ void local_symmetry_parameters_mpi::run() {
                 if (op_samplings.size() <= node->size)
                     REPORT_ERROR("ERROR: Too few sampling points! Use non-parallel version (without '_mpi') instead!");
 
-                nr_total_samplings = op_samplings.size();
+                // Rank all sampling points by the coarse search here, so that the same ones are refined for any number of ranks:
+                // only the best nr_refine (put first) are sent out, the others keep their CC of 1e10
+                const std::vector<long int> best = bestOperatorSamplings(src_cropped, dest_cropped, mask_cropped, op_samplings, nr_refine, nr_threads, true);
+                nr_total_samplings = best.size();
+                if (nr_total_samplings < op_samplings.size()) {
+                    if (nr_total_samplings <= node->size)
+                        REPORT_ERROR("ERROR: Too few sampling points to refine! Use a larger --nr_refine or the non-parallel version (without '_mpi') instead!");
+                    std::vector<bool> is_best (op_samplings.size(), false);
+                    std::vector<Vector<RFLOAT>> ranked;
+                    ranked.reserve(op_samplings.size());
+                    for (long int n : best) {
+                        ranked.push_back(op_samplings[n]);
+                        is_best[n] = true;
+                    }
+                    for (long int n = 0; n < op_samplings.size(); n++) {
+                        if (!is_best[n]) ranked.push_back(op_samplings[n]);
+                    }
+                    for (auto &sampling : ranked)
+                        sampling[CC_POS] = 1e10;
+                    op_samplings.swap(ranked);
+                    std::cout << " + Calculating CCs of the best " << nr_total_samplings << " sampling points ..." << std::endl;
+                }
             }
             MPI_Barrier(MPI_COMM_WORLD);
 
@@ -410,7 +431,7 @@ void local_symmetry_parameters_mpi::run() {
             MPI_Barrier(MPI_COMM_WORLD);
 
             // All nodes calculate CC, with leader profiling (DONT SORT!)
-            calculateOperatorCC(src_cropped, dest_cropped, mask_cropped, op_samplings_batch, false, node->isLeader());
+            calculateOperatorCC(src_cropped, dest_cropped, mask_cropped, op_samplings_batch, false, node->isLeader(), nr_threads);
             for (int op_id = 0; op_id < op_samplings_batch.size(); op_id++) {
                 direct::elem(op_samplings_batch_packed, op_id, CC_POS) = op_samplings_batch[op_id][CC_POS];
             }
@@ -423,7 +444,7 @@ void local_symmetry_parameters_mpi::run() {
                 MPI_Status status;
 
                 for (int id_rank = 0; id_rank < node->size; id_rank++) {
-                    divide_equally(op_samplings.size(), node->size, id_rank, first, last);
+                    divide_equally(nr_total_samplings, node->size, id_rank, first, last);
 
                     // Leader receives op_samplings_batch_packed from followers
                     if (id_rank > 0)
@@ -0,0 +1,68 @@
+/***************************************************************************
+ *
+ * Author: "agent"
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This complete copyright notice must be included in any revised version of the
+ * source code. Additional authorship citations may be added, but existing
+ * author citations must be preserved.
+ ***************************************************************************/
+
+#ifndef MAPPED_FILE_H_
+#define MAPPED_FILE_H_
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <string>
+
+/** Read-only memory map of a whole file.
+ *
+ * Pages are shared with the page cache, so several readers of the same file
+ * (other threads or other ranks on the same host) do not duplicate it in memory.
+ * If the file cannot be mapped (it does not exist, or it is empty), data() is nullptr.
+ */
+class MappedFile {
+
+    int fd;
+    size_t len;
+    void *ptr;
+
+    public:
+
+    MappedFile(const std::string &filename): fd(-1), len(0), ptr(nullptr) {
+        fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0) return;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size <= 0) return;
+        len = st.st_size;
+        void *p = mmap(nullptr, len, PROT_READ, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED) return;
+        ptr = p;
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator = (const MappedFile&) = delete;
+
+    ~MappedFile() {
+        if (ptr) munmap(ptr, len);
+        if (fd >= 0) close(fd);
+    }
+
+    const char* data() const { return static_cast<const char*>(ptr); }
+
+    size_t size() const { return ptr ? len : 0; }
+
+};
+
+#endif
@@ -18,6 +18,9 @@
  * author citations must be preserved.
  ***************************************************************************/
 #include <omp.h>
+#include <algorithm>
+#include <limits>
+#include <vector>
 #include "src/mask.h"
 #include "src/multidim_array_statistics.h"
 
@@ -247,6 +250,88 @@ void softMaskOutsideMap(MultidimArray<RFLOAT> &vol, MultidimArray<RFLOAT> &msk,
 
 }
 
+namespace {
+
+    // Lower envelope of parabolas (Felzenszwalb & Huttenlocher, 2012):
+    // d[q] = min_p (q - p)^2 + f[p] over all p with a finite f[p] (is_set[p]), or infinite if there are none
+    void distanceTransform1D(
+        const std::vector<double> &f, const std::vector<char> &is_set, std::vector<double> &d,
+        std::vector<long int> &v, std::vector<double> &z
+    ) {
+        const long int n = f.size();
+        long int k = -1;
+        for (long int q = 0; q < n; q++) {
+            if (!is_set[q]) continue;
+            double s = -std::numeric_limits<double>::infinity();
+            while (k >= 0) {
+                s = (f[q] + q * q - f[v[k]] - v[k] * v[k]) / (2.0 * (q - v[k]));
+                if (s > z[k]) break;
+                k--;
+            }
+            if (k < 0) s = -std::numeric_limits<double>::infinity();
+            k++;
+            v[k] = q;
+            z[k] = s;
+        }
+
+        if (k < 0) {
+            std::fill(d.begin(), d.end(), std::numeric_limits<double>::infinity());
+            return;
+        }
+        z[k + 1] = std::numeric_limits<double>::infinity();
+        for (long int q = 0, j = 0; q < n; q++) {
+            while (z[j + 1] < q) j++;
+            d[q] = (q - v[j]) * (q - v[j]) + f[v[j]];
+        }
+    }
+
+}
+
+MultidimArray<RFLOAT> squaredDistanceTransform(const MultidimArray<RFLOAT> &msk, bool to_zeros, int n_threads) {
+    const long int xdim = Xsize(msk), ydim = Ysize(msk), zdim = Zsize(msk);
+    const double inf = std::numeric_limits<double>::infinity();
+
+    std::vector<double> dist2 (msk.size());
+    for (long int n = 0; n < msk.size(); n++) {
+        const bool is_feature = to_zeros ? msk[n] < 0.001 : msk[n] > 0.999;
+        dist2[n] = is_feature ? 0.0 : inf;
+    }
+
+    // One pass along x, y and z in turn, each over all lines in that direction
+    const long int dims    [3] {xdim, ydim, zdim};
+    const long int strides [3] {1, xdim, xdim * ydim};
+    for (int axis = 0; axis < 3; axis++) {
+        const long int n = dims[axis], stride = strides[axis];
+        if (n <= 1) continue;
+        const long int nr_lines = dist2.size() / n;
+
+        #pragma omp parallel num_threads(n_threads)
+        {
+            std::vector<double> f (n), d (n), z (n + 1);
+            std::vector<long int> v (n);
+            std::vector<char> is_set (n);
+
+            #pragma omp for
+            for (long int u = 0; u < nr_lines; u++) {
+                const long int start = u % stride + (u / stride) * stride * n;  // u * n along x
+                for (long int q = 0; q < n; q++) {
+                    f[q] = dist2[start + q * stride];
+                    is_set[q] = f[q] < inf;
+                }
+                distanceTransform1D(f, is_set, d, v, z);
+                for (long int q = 0; q < n; q++)
+                    dist2[start + q * stride] = d[q];
+            }
+        }
+    }
+
+    MultidimArray<RFLOAT> result;
+    result.resize(msk);
+    for (long int n = 0; n < result.size(); n++)
+        result[n] = std::min(dist2[n], (double) std::numeric_limits<RFLOAT>::max());
+    return result;
+}
+
 void autoMask(
     const MultidimArray<RFLOAT> &img_in, MultidimArray<RFLOAT> &msk_out,
     RFLOAT ini_mask_density_threshold, RFLOAT extend_ini_mask, RFLOAT width_soft_mask_edge, 
@@ -262,151 +347,41 @@ void autoMask(
         msk_out[n] = img_in[n] >= ini_mask_density_threshold;
     }
 
-    MultidimArray<RFLOAT> msk_cp;
-
-    // B. extend/shrink initial binary mask. To save memory store a temporary copy of Im in I1
-    int barstep, update_bar, totalbar;
+    // B. extend/shrink initial binary mask:
+    // set zeros (ones) to one (zero) if there is a one (zero) closer than extend_ini_mask
     if (extend_ini_mask > 0.0 || extend_ini_mask < 0.0) {
+        const bool do_extend = extend_ini_mask > 0.0;
         if (verb) {
-            std::cout << (extend_ini_mask > 0.0 ? 
+            std::cout << (do_extend ? 
             "== Extending initial binary mask ..." : 
             "== Shrinking initial binary mask ...") << std::endl;
-            init_progress_bar(img_in.size() / n_threads);
-            barstep = img_in.size() / 120 / n_threads;
-            update_bar = 0;
-            totalbar = 0;
         }
 
-        int extend_size = abs(ceil(extend_ini_mask));
-        RFLOAT extend_ini_mask2 = extend_ini_mask * extend_ini_mask;
-        msk_cp = msk_out;
-        if (extend_ini_mask > 0.0) {
-            #pragma omp parallel for num_threads(n_threads)
-            FOR_ALL_ELEMENTS_IN_ARRAY3D(msk_cp, i, j, k) {
-                // only extend zero values to 1.
-                if (msk_cp.elem(i, j, k) < 0.001) {
-                    bool already_done = false;
-                    for (long int kp = k - extend_size; kp <= k + extend_size; kp++) {
-                    for (long int jp = j - extend_size; jp <= j + extend_size; jp++) {
-                    for (long int ip = i - extend_size; ip <= i + extend_size; ip++) {
-                        if (
-                            ip >= Xinit(msk_cp) && ip <= Xlast(msk_cp) &&
-                            jp >= Yinit(msk_cp) && jp <= Ylast(msk_cp) &&
-                            kp >= Zinit(msk_cp) && kp <= Zlast(msk_cp)
-                        ) {
-                            // only check distance if neighbouring Im() is one
-                            if (msk_cp.elem(ip, jp, kp) > 0.999) {
-                                RFLOAT r2 = hypot2(ip - i, jp - j, kp - k);
-                                // Set original voxel to 1 if a neghouring with Im()=1 is within distance extend_ini_mask
-                                if (r2 < extend_ini_mask2) {
-                                    msk_out.elem(i, j, k) = 1.0;
-                                    already_done = true;
-                                }
-                            }
-                        }
-                    if (already_done) break; }
-                    if (already_done) break; }
-                    if (already_done) break; }
-                }
-                if (verb && omp_get_thread_num() == 0) {
-                    if (update_bar > barstep) {
-                        update_bar = 0;
-                        progress_bar(totalbar);
-                    }
-                    update_bar++;
-                    totalbar++;
-                }
-            }
-        } else {
-            #pragma omp parallel for num_threads(n_threads)
-            FOR_ALL_ELEMENTS_IN_ARRAY3D(msk_cp, i, j, k) {
-                // only extend one values to zero.
-                if (msk_cp.elem(i, j, k) > 0.999) {
-                    bool already_done = false;
-                    for (long int kp = k - extend_size; kp <= k + extend_size; kp++) {
-                    for (long int jp = j - extend_size; jp <= j + extend_size; jp++) {
-                    for (long int ip = i - extend_size; ip <= i + extend_size; ip++) {
-                        if (
-                            kp >= Zinit(msk_cp) && kp <= Zlast(msk_cp) &&
-                            jp >= Yinit(msk_cp) && jp <= Ylast(msk_cp) &&
-                            ip >= Xinit(msk_cp) && ip <= Xlast(msk_cp)
-                        ) {
-                            // only check distance if neighbouring Im() is one
-                            if (msk_cp.elem(ip, jp, kp) < 0.001) {
-                                RFLOAT r2 = (RFLOAT) hypot2(ip - i, jp - j, kp - k);
-                                // Set original voxel to 1 if a neghouring with Im()=1 is within distance extend_ini_mask
-                                if (r2 < extend_ini_mask2) {
-                                    msk_out.elem(i, j, k) = 0.0;
-                                    already_done = true;
-                                }
-                            }
-                        }
-                    if (already_done) break; }
-                    if (already_done) break; }
-                    if (already_done) break; }
-                }
-                if (verb && omp_get_thread_num() == 0) {
-                    if (update_bar > barstep) {
-                        update_bar = 0;
-                        progress_bar(totalbar);
-                    }
-                    update_bar++;
-                    totalbar++;
-                }
+        const RFLOAT extend_ini_mask2 = extend_ini_mask * extend_ini_mask;
+        const MultidimArray<RFLOAT> dist2 = squaredDistanceTransform(msk_out, !do_extend, n_threads);
+        #pragma omp parallel for num_threads(n_threads)
+        for (long int n = 0; n < msk_out.size(); n++) {
+            if (do_extend ? msk_out[n] < 0.001 : msk_out[n] > 0.999) {
+                if (dist2[n] < extend_ini_mask2)
+                    msk_out[n] = do_extend;
             }
         }
-        if (verb) progress_bar(msk_out.size() / n_threads);
     }
 
+    // C. Make a soft edge to the mask:
+    // a raised cosine of the distance to the nearest one, for zeros closer than width_soft_mask_edge
     if (width_soft_mask_edge > 0.0) {
         if (verb) {
             std::cout << "== Making a soft edge on the extended mask ..." << std::endl;
-            init_progress_bar(msk_out.size() / n_threads);
-            barstep = msk_out.size() / 120 / n_threads;
-            update_bar = 0;
-            totalbar = 0;
         }
-        // C. Make a soft edge to the mask
-        // Note that the extended mask is now in I1, and we'll put the soft-edge mask again into Im
 
-        msk_cp = msk_out;
-        int extend_size = ceil(width_soft_mask_edge);
-        RFLOAT width_soft_mask_edge2 = width_soft_mask_edge * width_soft_mask_edge;
+        const RFLOAT width_soft_mask_edge2 = width_soft_mask_edge * width_soft_mask_edge;
+        const MultidimArray<RFLOAT> dist2 = squaredDistanceTransform(msk_out, false, n_threads);
         #pragma omp parallel for num_threads(n_threads)
-        FOR_ALL_ELEMENTS_IN_ARRAY3D(msk_cp, i, j, k) {
-            // only extend zero values to values between 0 and 1.
-            if (msk_cp.elem(i, j, k) < 0.001) {
-                RFLOAT min_r2 = 9999.0;
-                for (long int kp = k - extend_size; kp <= k + extend_size; kp++) {
-                for (long int jp = j - extend_size; jp <= j + extend_size; jp++) {
-                for (long int ip = i - extend_size; ip <= i + extend_size; ip++) {
-                    if (
-                        kp >= Zinit(msk_cp) && kp <= Zlast(msk_cp) &&
-                        jp >= Yinit(msk_cp) && jp <= Ylast(msk_cp) &&
-                        ip >= Xinit(msk_cp) && ip <= Xlast(msk_cp)
-                    ) {
-                        // only update distance to a neighbouring msk_cp is one
-                        if (msk_cp.elem(ip, jp, kp) > 0.999) {
-                            RFLOAT r2 = hypot2(ip - i, jp - j, kp - k);
-                            // Set original voxel to 1 if a neghouring with Im()=1 is within distance extend_ini_mask
-                            if (r2 < min_r2) { min_r2 = r2; }
-                        }
-                    }
-                }}}
-                if (min_r2 < width_soft_mask_edge2) {
-                    msk_out.elem(i, j, k) = raised_cos(sqrt(min_r2) * PI / width_soft_mask_edge);
-                }
-            }
-            if (verb && omp_get_thread_num() == 0) {
-                if (update_bar > barstep) {
-                    update_bar = 0;
-                    progress_bar(totalbar);
-                }
-                update_bar++;
-                totalbar++;
-            }
+        for (long int n = 0; n < msk_out.size(); n++) {
+            if (msk_out[n] < 0.001 && dist2[n] < width_soft_mask_edge2)
+                msk_out[n] = raised_cos(sqrt(dist2[n]) * PI / width_soft_mask_edge);
         }
-        if (verb) progress_bar(msk_cp.size() / n_threads);
     }
 
 }
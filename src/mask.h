@@ -48,6 +48,11 @@ void softMaskOutsideMapForHelix(
 // Apply a soft mask and set density outside the mask at the average value of those pixels in the original map
 void softMaskOutsideMap(MultidimArray<RFLOAT> &vol, MultidimArray<RFLOAT> &msk, bool invert_mask = false);
 
+// Squared distance (in pixels) from every pixel to the nearest one (> 0.999) in msk, or to the nearest zero (< 0.001) if to_zeros.
+// Exact, in linear time (separable passes along x, y and z, over n_threads threads).
+// Pixels are at the largest RFLOAT if there are no ones (zeros) at all.
+MultidimArray<RFLOAT> squaredDistanceTransform(const MultidimArray<RFLOAT> &msk, bool to_zeros = false, int n_threads = 1);
+
 // Make an automated mask, based on:
 // 1. initial binarization (based on ini_mask_density_threshold)
 // 2. Growing extend_ini_mask in all directions
@@ -309,7 +309,7 @@ class Vector {
 
     /// Sum of squared vector values
     T sum2() const {
-        return std::accumulate(begin(), end(), 0,
+        return std::accumulate(begin(), end(), T(0),
             [] (const T& running_total, const T& x) { return running_total + x * x; });
     }
 
@@ -49,7 +49,7 @@ void svdcmp(
     w.resize(u.ncols());
     std::fill(w.begin(), w.end(), 0);
     v.resize(u.ncols(), u.ncols());
-    std::fill(u.begin(), u.end(), 0);
+    std::fill(v.begin(), v.end(), 0);
     // Call the numerical recipes routine
     svdcmp(u.data(), a.nrows(), a.ncols(), w.data(), v.data());
 }
@@ -67,8 +67,8 @@ Matrix<T> Matrix<T>::inv() const {
         int a, b, c, d;
         for (int i = 0; i <= 2; i++)
         for (int j = 0; j <= 2; j++) {
-            a = (j - 1) % 3;
-            b = (i - 1) % 3;
+            a = (j + 2) % 3;
+            b = (i + 2) % 3;
             c = (j + 1) % 3;
             d = (i + 1) % 3;
             inverse.at(i, j) = at(a, b) * at(c, d) - at(a, d) * at(c, b);
@@ -21,40 +21,169 @@
 #ifndef METADATA_CONTAINER_H
 #define METADATA_CONTAINER_H
 
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "src/mapped_file.h"
 #include "src/funcs.h"
 #include "src/metadata_label.h"
 
 class MetaDataTable;
 
+/* A reference to one object (row) of a MetaDataTable.
+ *
+ * The values themselves are stored column-wise inside the table,
+ * so a MetaDataContainer is only valid for as long as its table is.
+ */
 struct MetaDataContainer {
 
-    MetaDataTable* table;
-
-    std::vector<double> doubles;  // Extended precision
-    std::vector<long> ints;       // Extended precision
-    std::vector<bool> bools;
-    std::vector<std::string> strings;
-    std::vector<std::vector<double>> doubleVectors;
-    std::vector<std::string> unknowns;
-
-    MetaDataContainer();
-    MetaDataContainer(
-        MetaDataTable* table, long doubleCount, long intCount, long boolCount,
-        long stringCount, long doubleVectorCount, long unknownCount
-    );
-    MetaDataContainer(MetaDataTable* table, MetaDataContainer* mdc);
-
-    template <typename T>
-    T getValue(long i) const;
-
-    void setValue(long i, double src);
-    void setValue(long i, float src);
-    void setValue(long i, int src);
-    void setValue(long i, long src);
-    void setValue(long i, bool src);
-    void setValue(long i, const std::string &src);
-    void setValue(long i, const std::vector<double> &src);
-    void setValue(long i, const std::vector<float> &src);
+    const MetaDataTable* table;
+
+    long row;
+
+    MetaDataContainer(const MetaDataTable* table, long row): table(table), row(row) {}
+
+};
+
+/* Interned strings for the string-valued columns of a MetaDataTable.
+ *
+ * Micrograph names, optics group names, etc. repeat over millions of particles.
+ * Each distinct string is stored once and cells only hold its 32-bit id.
+ */
+class StringPool {
+
+    std::unordered_map<std::string, unsigned int> ids;
+
+    // Points into the keys of ids (which do not move on rehashing)
+    std::vector<const std::string*> strings;
+
+    public:
+
+    typedef unsigned int id_t;
+
+    StringPool() {}
+
+    StringPool(const StringPool &other) { *this = other; }
+
+    // Moving the map moves its nodes, so the pointers in strings stay valid
+    StringPool(StringPool &&other) = default;
+
+    StringPool& operator = (StringPool &&other) = default;
+
+    StringPool& operator = (const StringPool &other) {
+        if (this == &other) return *this;
+        clear();
+        ids.reserve(other.size());
+        strings.reserve(other.strings.capacity());
+        for (const std::string *s : other.strings) intern(*s);
+        return *this;
+    }
+
+    id_t intern(const std::string &s) {
+        const auto search = ids.find(s);
+        if (search != ids.end()) return search->second;
+        const auto inserted = ids.emplace(s, (id_t) strings.size());
+        strings.push_back(&inserted.first->first);
+        return inserted.first->second;
+    }
+
+    const std::string& operator [] (id_t id) const { return *strings[id]; }
+
+    size_t size() const { return strings.size(); }
+
+    // While no more than n strings are interned, ids can be looked up
+    // by other threads during intern()
+    void reserve(size_t n) {
+        ids.reserve(n);
+        strings.reserve(n);
+    }
+
+    void clear() {
+        ids.clear();
+        strings.clear();
+    }
+
+};
+
+/* Columns of a MetaDataTable that are still encoded in the binary file they were read from.
+ *
+ * A column is identified by its kind (which list of columns it is in) and its offset in that list,
+ * as they were when the file was read. Columns added later are never lazy.
+ * Each column is decoded at most once, under the lock, and is then marked as decoded.
+ * Copies share the (read-only) file but keep their own record of what has been decoded.
+ */
+class LazyColumns {
+
+    public:
+
+    enum Kind { DOUBLES, INTS, BOOLS, STRINGS, VECTORS, UNKNOWNS, NR_KINDS };
+
+    // Where the encoded column is in the file
+    struct Extent {
+        const char *data;
+        size_t size;
+    };
+
+    private:
+
+    std::shared_ptr<const MappedFile> file;
+
+    std::vector<Extent> extents[NR_KINDS];
+
+    std::unique_ptr<std::atomic<bool>[]> decoded[NR_KINDS];
+
+    std::unique_ptr<std::mutex> lock;
+
+    public:
+
+    LazyColumns() {}
+
+    // columns[kind][off]
+    LazyColumns(std::shared_ptr<const MappedFile> file, std::vector<std::vector<Extent>> columns):
+    file(std::move(file)), lock(new std::mutex) {
+        for (int k = 0; k < NR_KINDS; k++) {
+            extents[k] = std::move(columns[k]);
+            decoded[k].reset(new std::atomic<bool>[extents[k].size()]);
+            for (size_t i = 0; i < extents[k].size(); i++) decoded[k][i] = false;
+        }
+    }
+
+    LazyColumns(const LazyColumns &other) { *this = other; }
+
+    LazyColumns(LazyColumns &&other) = default;
+
+    LazyColumns& operator = (LazyColumns &&other) = default;
+
+    LazyColumns& operator = (const LazyColumns &other) {
+        if (this == &other) return *this;
+        file = other.file;
+        lock.reset(file ? new std::mutex : nullptr);
+        for (int k = 0; k < NR_KINDS; k++) {
+            extents[k] = other.extents[k];
+            decoded[k].reset(file ? new std::atomic<bool>[extents[k].size()] : nullptr);
+            for (size_t i = 0; file && i < extents[k].size(); i++)
+                decoded[k][i] = other.decoded[k][i].load();
+        }
+        return *this;
+    }
+
+    bool empty() const { return !file; }
+
+    bool pending(Kind kind, long off) const {
+        return off < (long) extents[kind].size() && !decoded[kind][off].load(std::memory_order_acquire);
+    }
+
+    const Extent& extent(Kind kind, long off) const { return extents[kind][off]; }
+
+    void setDecoded(Kind kind, long off) const {
+        decoded[kind][off].store(true, std::memory_order_release);
+    }
+
+    std::mutex& mutex() const { return *lock; }
+
 };
 
 #endif
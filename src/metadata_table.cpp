@@ -44,9 +44,16 @@
 
 #include "src/metadata_table.h"
 #include "src/metadata_label.h"
+#include "src/mapped_file.h"
+#include <omp.h>
+#include <sys/stat.h>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <memory>
 
 MetaDataTable::MetaDataTable():
-    objects(0),
+    nr_objects(0),
     label_indices(EMDL::LAST_LABEL, -1),
     isList(false),
     name(""),
@@ -55,65 +62,160 @@ MetaDataTable::MetaDataTable():
     activeLabels(0)
 {}
 
-MetaDataTable::MetaDataTable(const MetaDataTable &MD):
-    objects(MD.size()),
-    label_indices(MD.label_indices),
-    unknown_label_indices(MD.unknown_label_indices),
-    unknownLabelNames(MD.unknownLabelNames),
-    isList(MD.isList),
-    name(MD.name),
-    comment(MD.comment),
-    version(MD.version),
-    activeLabels(MD.activeLabels)
-{
-    for (size_t idx = 0; idx < MD.size(); idx++) {
-        objects[idx] = new MetaDataContainer(this, MD.objects[idx]);
-    }
+void MetaDataTable::clear() {
+    nr_objects = 0;
+    doubles.clear();
+    ints.clear();
+    bools.clear();
+    strings.clear();
+    doubleVectors.clear();
+    unknowns.clear();
+    string_pool.clear();
+    lazy = LazyColumns();
+
+    label_indices = std::vector<long>(EMDL::LAST_LABEL, -1);
+    unknown_label_indices.clear();
+    unknownLabelNames.clear();
+
+    isList = false;
+    name = "";
+    comment = "";
+    version = CurrentVersion;
+
+    activeLabels.clear();
 }
 
-// Copy assignment
-MetaDataTable& MetaDataTable::operator = (const MetaDataTable &MD) {
-    if (this == &MD) return *this;
+void MetaDataTable::reserve(size_t capacity) {
+    for (auto &column : doubles)       column.reserve(capacity);
+    for (auto &column : ints)          column.reserve(capacity);
+    for (auto &column : bools)         column.reserve(capacity);
+    for (auto &column : strings)       column.reserve(capacity);
+    for (auto &column : doubleVectors) column.reserve(capacity);
+    for (auto &column : unknowns)      column.reserve(capacity);
+}
 
-    clear();
+void MetaDataTable::resizeObjects(long n) {
+    materialise();
+    const StringPool::id_t empty_id = string_pool.intern("\"\"");
+    for (auto &column : doubles)       column.resize(n, 0.0);
+    for (auto &column : ints)          column.resize(n, 0);
+    for (auto &column : bools)         column.resize(n, false);
+    for (auto &column : strings)       column.resize(n, empty_id);
+    for (auto &column : doubleVectors) column.resize(n);
+    for (auto &column : unknowns)      column.resize(n);
+    nr_objects = n;
+}
 
-    objects.resize(MD.size());
-    label_indices = MD.label_indices;
-    unknown_label_indices = MD.unknown_label_indices;
-    unknownLabelNames = MD.unknownLabelNames;
+template <typename T>
+static void permute_column(std::vector<T> &column, const std::vector<long> &order) {
+    std::vector<T> permuted;
+    permuted.reserve(order.size());
+    for (long i : order) permuted.push_back(std::move(column[i]));
+    column.swap(permuted);
+}
 
-    isList = MD.isList;
-    name = MD.name;
-    comment = MD.comment;
-    version = MD.version;
+void MetaDataTable::permute(const std::vector<long> &order) {
+    if (order.size() != size())
+        REPORT_ERROR("MetaDataTable::permute BUG: order does not have one entry per object");
+    materialise();
+    for (auto &column : doubles)       permute_column(column, order);
+    for (auto &column : ints)          permute_column(column, order);
+    for (auto &column : bools)         permute_column(column, order);
+    for (auto &column : strings)       permute_column(column, order);
+    for (auto &column : doubleVectors) permute_column(column, order);
+    for (auto &column : unknowns)      permute_column(column, order);
+}
 
-    activeLabels = MD.activeLabels;
+template <>
+double MetaDataTable::getValueAt(long off, long i) const {
+    materialise(LazyColumns::DOUBLES, off);
+    return doubles[off][i];
+}
 
-    for (long int idx = 0; idx < MD.size(); idx++) {
-        objects[idx] = new MetaDataContainer(this, MD.objects[idx]);
-    }
+template <>
+float MetaDataTable::getValueAt(long off, long i) const {
+    materialise(LazyColumns::DOUBLES, off);
+    return (float) doubles[off][i];
+}
 
-    return *this;
+template <>
+int MetaDataTable::getValueAt(long off, long i) const {
+    materialise(LazyColumns::INTS, off);
+    return (int) ints[off][i];
 }
 
-MetaDataTable::~MetaDataTable() {
-    for (const auto &object : objects) delete object;
+template <>
+long MetaDataTable::getValueAt(long off, long i) const {
+    materialise(LazyColumns::INTS, off);
+    return ints[off][i];
 }
 
-void MetaDataTable::clear() {
-    for (const auto &object : objects) delete object;
-    objects.clear();
+template <>
+bool MetaDataTable::getValueAt(long off, long i) const {
+    materialise(LazyColumns::BOOLS, off);
+    return bools[off][i];
+}
 
-    label_indices = std::vector<long>(EMDL::LAST_LABEL, -1);
-    unknown_label_indices.clear();
-    unknownLabelNames.clear();
+template <>
+std::vector<double> MetaDataTable::getValueAt(long off, long i) const {
+    materialise(LazyColumns::VECTORS, off);
+    return doubleVectors[off][i];
+}
 
-    isList = false;
-    name = "";
-    comment = "";
-    version = CurrentVersion;
+template <>
+std::vector<float> MetaDataTable::getValueAt(long off, long i) const {
+    materialise(LazyColumns::VECTORS, off);
+    const auto &v = doubleVectors[off][i];
+    return std::vector<float>(v.begin(), v.end());
+}
 
-    activeLabels.clear();
+template <>
+std::string MetaDataTable::getValueAt(long off, long i) const {
+    materialise(LazyColumns::STRINGS, off);
+    const auto &s = string_pool[strings[off][i]];
+    return s == "\"\"" ? "" : s;
+}
+
+void MetaDataTable::setValueAt(long off, long i, double src) {
+    materialise(LazyColumns::DOUBLES, off);
+    doubles[off][i] = src;
+}
+
+void MetaDataTable::setValueAt(long off, long i, float src) {
+    materialise(LazyColumns::DOUBLES, off);
+    doubles[off][i] = src;
+}
+
+void MetaDataTable::setValueAt(long off, long i, int src) {
+    materialise(LazyColumns::INTS, off);
+    ints[off][i] = src;
+}
+
+void MetaDataTable::setValueAt(long off, long i, long src) {
+    materialise(LazyColumns::INTS, off);
+    ints[off][i] = src;
+}
+
+void MetaDataTable::setValueAt(long off, long i, bool src) {
+    materialise(LazyColumns::BOOLS, off);
+    bools[off][i] = src;
+}
+
+void MetaDataTable::setValueAt(long off, long i, const std::string &src) {
+    // Interning may grow the pool beyond what was reserved for decoding, so decode every string column now
+    for (long k = 0; k < strings.size(); k++) materialise(LazyColumns::STRINGS, k);
+    strings[off][i] = string_pool.intern(src.empty() ? "\"\"" : src);
+    compactStringsIfSparse();
+}
+
+void MetaDataTable::setValueAt(long off, long i, const std::vector<double> &src) {
+    materialise(LazyColumns::VECTORS, off);
+    doubleVectors[off][i] = src;
+}
+
+void MetaDataTable::setValueAt(long off, long i, const std::vector<float> &src) {
+    materialise(LazyColumns::VECTORS, off);
+    doubleVectors[off][i].assign(src.begin(), src.end());
 }
 
 std::pair<EMDL::EMDLabel, std::string> label_and_unknown(const MetaDataTable &mdt, int i) {
@@ -129,11 +231,13 @@ std::map<EMDL::EMDLabel, std::string> labels_and_unknowns(const MetaDataTable& m
     return map;
 }
 
-std::vector<std::string> data_names(MetaDataTable mtd) {
+// In the order of the active labels (which is the order in which the values are written)
+std::vector<std::string> data_names(const MetaDataTable &mdt) {
     std::vector<std::string> names;
-    const auto lus = labels_and_unknowns(mtd);
-    names.reserve(lus.size());
-    for (const auto &lu : lus) {
+    const auto n = mdt.getActiveLabels().size();
+    names.reserve(n);
+    for (int i = 0; i < n; i++) {
+        const auto lu = label_and_unknown(mdt, i);
         if (lu.first == EMDL::SORTED_IDX) continue;  // Don't expose (ugly) implementation details!
         names.push_back(lu.first == EMDL::UNKNOWN_LABEL ? lu.second : EMDL::label2Str(lu.first));
     }
@@ -202,7 +306,96 @@ std::string MetaDataTable::getValueToString(EMDL::EMDLabel label, long i) const
 void MetaDataTable::setUnknownValue(int i, const std::string &value) {
     long j = unknown_label_indices[i];
     if (j < 0) REPORT_ERROR("MetaDataTable::setUnknownValue BUG: j should not be negative here....");
-    objects.back()->unknowns[j] = value;
+    materialise(LazyColumns::UNKNOWNS, j);
+    unknowns[j][nr_objects - 1] = value;
+}
+
+// Which list of columns holds the values of a label
+static LazyColumns::Kind kindOf(EMDL::EMDLabel label) {
+    return
+        label == EMDL::UNKNOWN_LABEL         ? LazyColumns::UNKNOWNS :
+        EMDL::is<double>(label)              ? LazyColumns::DOUBLES  :
+        EMDL::is<int>(label)                 ? LazyColumns::INTS     :
+        EMDL::is<bool>(label)                ? LazyColumns::BOOLS    :
+        EMDL::is<std::string>(label)         ? LazyColumns::STRINGS  :
+        EMDL::is<std::vector<double>>(label) ? LazyColumns::VECTORS  : LazyColumns::UNKNOWNS;
+}
+
+// Convert the characters b ... e - 1 with strtod or strtol, which need a terminated string.
+// The characters are copied to the stack, so that cells can be parsed in place.
+template <typename T, typename Convert>
+static T convertTerminated(const char *b, const char *e, Convert convert) {
+    char buffer[64];
+    if (e - b >= (long) sizeof(buffer)) return convert(std::string(b, e).c_str());
+    std::copy(b, e, buffer);
+    buffer[e - b] = '\0';
+    return convert(buffer);
+}
+
+// Parse a number in b ... e - 1 the way "std::istringstream(value) >> v" does,
+// so that loops read in place and through a stream give the same table:
+// the longest prefix of the form [+-]digits[.digits][(e|E)[+-]digits] is converted,
+// anything after it is ignored, and values with no such prefix (including "nan" and "inf") give 0.
+// Out-of-range values are clamped to the largest finite double.
+static double parseDouble(const char *b, const char *e) {
+    while (b < e && isspace(*b)) b++;
+    const char *p = b + (b < e && (*b == '+' || *b == '-'));
+    bool mantissa = false;
+    for (; p < e && isdigit(*p); p++) mantissa = true;
+    if (p < e && *p == '.')
+        for (p++; p < e && isdigit(*p); p++) mantissa = true;
+    if (!mantissa) return 0.0;
+    if (p < e && (*p == 'e' || *p == 'E')) {
+        const char *q = p + 1;
+        q += q < e && (*q == '+' || *q == '-');
+        if (q == e || !isdigit(*q)) return 0.0;  // The stream rejects a dangling exponent
+        for (p = q; p < e && isdigit(*p); p++);
+    }
+    // Only the prefix is converted (strtod would go further on "0x1p3")
+    double v = convertTerminated<double>(b, p, [] (const char *s) { return strtod(s, nullptr); });
+    if (std::isinf(v)) v = std::copysign(std::numeric_limits<double>::max(), v);
+    return v;
+}
+
+static double parseDouble(const std::string &value) {
+    return parseDouble(value.data(), value.data() + value.size());
+}
+
+// Parse an integer in b ... e - 1 the way "std::istringstream(value) >> v" does
+// (trailing characters are ignored, no digits give 0, out-of-range values saturate)
+static long parseInteger(const char *b, const char *e) {
+    while (b < e && isspace(*b)) b++;
+    const char *p = b + (b < e && (*b == '+' || *b == '-'));
+    while (p < e && isdigit(*p)) p++;
+    return convertTerminated<long>(b, p, [] (const char *s) { return strtol(s, nullptr, 10); });
+}
+
+static long parseInteger(const std::string &value) {
+    return parseInteger(value.data(), value.data() + value.size());
+}
+
+// Parse a vector written as "[a,b,c]"
+static std::vector<double> parseDoubleVector(const std::string &value) {
+    std::vector<double> v;
+    v.reserve(32);
+
+    char* temp = new char[value.size() + 1];
+    strcpy(temp, value.c_str());
+
+    char* token;
+    char* rest = temp;
+
+    while ((token = strtok_r(rest, "[,]", &rest)) != 0) {
+        double d;
+        std::stringstream sts(token);
+        sts >> d;
+
+        v.push_back(d);
+    }
+
+    delete[] temp;
+
+    return v;
 }
 
 void MetaDataTable::setValueFromString(
@@ -212,44 +405,18 @@ void MetaDataTable::setValueFromString(
         setValue(label, value, i);
         return;
     } else {
-        std::istringstream is (value);
-
+        // Same conversions as readStarLoop(const char *, const char *, bool)
         if (EMDL::is<double>(label)) {
-            double v;
-            is >> v;
-            setValue(label, v, i);
+            setValue(label, parseDouble(value), i);
             return;
         } else if (EMDL::is<int>(label)) {
-            long v;
-            is >> v;
-            setValue(label, v, i);
+            setValue(label, parseInteger(value), i);
             return;
         } else if (EMDL::is<bool>(label)) {
-            bool v;
-            is >> v;
-            setValue(label, v, i);
+            setValue(label, parseInteger(value) != 0, i);
             return;
         } else if (EMDL::is<std::vector<double>>(label)) {
-            std::vector<double> v;
-            v.reserve(32);
-
-            char* temp = new char[value.size() + 1];
-            strcpy(temp, value.c_str());
-
-            char* token;
-            char* rest = temp;
-
-            while ((token = strtok_r(rest, "[,]", &rest)) != 0) {
-                double d;
-                std::stringstream sts(token);
-                sts >> d;
-
-                v.push_back(d);
-            }
-
-            delete[] temp;
-
-            setValue(label, v, i);
+            setValue(label, parseDoubleVector(value), i);
             return;
         }
     }
@@ -291,14 +458,12 @@ void MetaDataTable::sort(
         }
     } else {
         // Change the actual order in the MetaDataTable
-        std::vector<MetaDataContainer*> objs;
-        objs.reserve(N);
-
+        std::vector<long> order;
+        order.reserve(N);
         for (const auto &x : vp) {
-            objs.push_back(objects[x.second]);
+            order.push_back(x.second);
         }
-
-        objects = objs;
+        permute(order);
     }
 }
 
@@ -341,36 +506,24 @@ void MetaDataTable::addLabel(EMDL::EMDLabel label, const std::string &unknownLab
     long i;
 
     if (EMDL::is<double>(label)) {
-        for (const auto &object : objects) {
-            object->doubles.push_back(0);
-        }
-        i = objects.front()->doubles.size();
+        i = doubles.size();
+        doubles.emplace_back(nr_objects, 0.0);
     } else if (EMDL::is<int>(label)) {
-        for (const auto &object : objects) {
-            object->ints.push_back(0);
-        }
-        i = objects.front()->ints.size();
+        i = ints.size();
+        ints.emplace_back(nr_objects, 0);
     } else if (EMDL::is<bool>(label)) {
-        for (const auto &object : objects) {
-            object->bools.push_back(false);
-        }
-        i = objects.front()->bools.size();
+        i = bools.size();
+        bools.emplace_back(nr_objects, false);
     } else if (EMDL::is<std::string>(label)) {
-        for (const auto &object : objects) {
-            object->strings.emplace_back("empty");
-        }
-        i = objects.front()->strings.size();
+        i = strings.size();
+        strings.emplace_back(nr_objects, string_pool.intern("empty"));
     } else if (EMDL::is<std::vector<double>>(label)) {
-        for (const auto &object : objects) {
-            object->doubleVectors.emplace_back();
-        }
-        i = objects.front()->doubleVectors.size();
+        i = doubleVectors.size();
+        doubleVectors.emplace_back(nr_objects);
     } else if (EMDL::is<void>(label)) {
-        for (const auto &object : objects) {
-            object->unknowns.emplace_back("empty");
-        }
+        i = unknowns.size();
+        unknowns.emplace_back(nr_objects, "empty");
         unknownLabelNames.push_back(unknownLabel);
-        i = objects.front()->unknowns.size();
     }
 
     activeLabels.push_back(label);
@@ -380,9 +533,11 @@ void MetaDataTable::addLabel(EMDL::EMDLabel label, const std::string &unknownLab
 }
 
 void MetaDataTable::addMissingLabels(const MetaDataTable &mdt) {
-    for (const auto &lu : labels_and_unknowns(mdt)) {
-        if (lu.first == EMDL::UNKNOWN_LABEL && !containsLabel(lu.first, lu.second) ||
-            label_indices[lu.first] < 0) {
+    if (&mdt == this) return;
+    for (int i = 0; i < mdt.activeLabels.size(); i++) {
+        const auto lu = label_and_unknown(mdt, i);
+        if (lu.first == EMDL::UNKNOWN_LABEL ?
+            !containsLabel(lu.first, lu.second) : label_indices[lu.first] < 0) {
             addLabel(lu.first, lu.second);
         }
     }
@@ -399,140 +554,166 @@ void MetaDataTable::append(const MetaDataTable &mdt) {
     }
 
     // Now append
-    objects.reserve(size() + mdt.size());
-    for (long i = 0; i < mdt.size(); i++) {
-        if (objects.empty()) {
-            objects.push_back(new MetaDataContainer(this, 0, 0, 0, 0, 0, 0));
-        } else {
-            const auto &object1 = objects.front();
-            objects.push_back(new MetaDataContainer(
-                this,
-                object1->doubles.size(), object1->ints.size(),
-                object1->bools.size(), object1->strings.size(),
-                object1->doubleVectors.size(), object1->unknowns.size()
-            ));
-        }
-
-        setObjectUnsafe(mdt.getObject(i), size() - 1);
-    }
+    const long n = mdt.size(), dest = size();
+    resizeObjects(dest + n);
+    copyObjects(mdt, n, [] (long k) { return k; }, dest);
 }
 
-
-MetaDataContainer* MetaDataTable::getObject(long int i) const {
-    if (i < 0) { i = size() - 1; }
-    if (!checkBounds(i))
-        REPORT_ERROR((std::string) __func__ + ": Out of bounds!"
-            "(no " + std::to_string(i) + "th object in collection of " + std::to_string(size()) + " objects)");
-    return objects[i];
+void MetaDataTable::appendRows(const MetaDataTable &src, const std::vector<long> &rows) {
+    addMissingLabels(src);
+    const long dest = size();
+    resizeObjects(dest + rows.size());
+    copyObjects(src, rows.size(), [&rows] (long k) { return rows[k]; }, dest);
 }
 
-void MetaDataTable::setObject(MetaDataContainer* data, long int i) {
-    if (i < 0) { i = size() - 1; }
-    if (!checkBounds(i))
-        REPORT_ERROR((std::string) __func__ + ": Out of bounds!"
-            "(no " + std::to_string(i) + "th object in collection of " + std::to_string(size()) + " objects)");
-    addMissingLabels(*data->table);
-    setObjectUnsafe(data, i);
+template <typename T, typename RowIndex>
+static void copy_column(
+    const std::vector<T> &from, std::vector<T> &to, long n, RowIndex src_row, long dest
+) {
+    for (long k = 0; k < n; k++) to[dest + k] = from[src_row(k)];
 }
 
-void MetaDataTable::setValuesOfDefinedLabels(MetaDataContainer* data, long i) {
-    if (i < 0) { i = size() - 1; }
-    if (!checkBounds(i))
-        REPORT_ERROR((std::string) __func__ + ": Out of bounds!"
-            "(no " + std::to_string(i) + "th object in collection of " + std::to_string(size()) + " objects)");
-    setObjectUnsafe(data, i);
-}
+template <typename RowIndex>
+void MetaDataTable::copyObjects(const MetaDataTable &src, long n, RowIndex src_row, long dest) {
+    src.materialise();
+    materialise();
 
-void MetaDataTable::setObjectUnsafe(MetaDataContainer* data, long i) {
-    MetaDataContainer* obj = objects[i];
+    // Strings are interned per table, so their ids have to be translated.
+    // Only the strings that are copied are looked up (once each), however large the pool of src.
+    std::unordered_map<StringPool::id_t, StringPool::id_t> string_ids;
 
-    for (long j = 0; j < data->table->activeLabels.size(); j++) {
-        EMDL::EMDLabel label = data->table->activeLabels[j];
+    for (long j = 0; j < src.activeLabels.size(); j++) {
+        EMDL::EMDLabel label = src.activeLabels[j];
 
         if (label != EMDL::UNKNOWN_LABEL) {
-            const long k =              label_indices[label];
-            const long l = data->table->label_indices[label];
+            const long k =     label_indices[label];
+            const long l = src.label_indices[label];
 
             if (k < 0) continue;
 
             if (EMDL::is<double>(label)) {
-                obj->doubles[k] = data->doubles[l];
+                copy_column(src.doubles[l], doubles[k], n, src_row, dest);
             } else if (EMDL::is<int>(label)) {
-                obj->ints[k] = data->ints[l];
+                copy_column(src.ints[l], ints[k], n, src_row, dest);
             } else if (EMDL::is<bool>(label)) {
-                obj->bools[k] = data->bools[l];
+                copy_column(src.bools[l], bools[k], n, src_row, dest);
             } else if (EMDL::is<std::string>(label)) {
-                obj->strings[k] = data->strings[l];
+                if (&src == this) {
+                    copy_column(src.strings[l], strings[k], n, src_row, dest);
+                    continue;
+                }
+                const auto &from = src.strings[l];
+                auto &to = strings[k];
+                if (n == 1) {
+                    to[dest] = string_pool.intern(src.string_pool[from[src_row(0)]]);
+                    continue;
+                }
+                for (long m = 0; m < n; m++) {
+                    const StringPool::id_t id = from[src_row(m)];
+                    auto search = string_ids.find(id);
+                    if (search == string_ids.end())
+                        search = string_ids.emplace(id, string_pool.intern(src.string_pool[id])).first;
+                    to[dest + m] = search->second;
+                }
             } else if (EMDL::is<std::vector<double>>(label)) {
-                obj->doubleVectors[k] = data->doubleVectors[l];
+                copy_column(src.doubleVectors[l], doubleVectors[k], n, src_row, dest);
             }
         } else {
-            const long l = data->table->unknown_label_indices[j];
-            const std::string unknownLabel = data->table->unknownLabelNames[l];
+            const long l = src.unknown_label_indices[j];
+            const std::string unknownLabel = src.unknownLabelNames[l];
             const auto search = std::find(unknownLabelNames.begin(), unknownLabelNames.end(), unknownLabel);
 
             if (search == unknownLabelNames.end())
-                REPORT_ERROR("MetaDataTable::setObjectUnsafe: logic error."
+                REPORT_ERROR("MetaDataTable::copyObjects: logic error."
                              "unknownLabel was not found.");
 
-            obj->unknowns[search - unknownLabelNames.begin()] = data->unknowns[l];
+            copy_column(src.unknowns[l], unknowns[search - unknownLabelNames.begin()], n, src_row, dest);
         }
     }
+
+    if (&src != this) compactStringsIfSparse();
 }
 
-long int MetaDataTable::addObject() {
-    if (objects.empty()) {
-        objects.push_back(new MetaDataContainer(this, 0, 0, 0, 0, 0, 0));
-    } else {
-        const auto &object1 = objects.front();
-        objects.push_back(new MetaDataContainer(
-            this,
-            object1->doubles.size(), object1->ints.size(),
-            object1->bools.size(), object1->strings.size(),
-            object1->doubleVectors.size(), object1->unknowns.size()
-        ));
+void MetaDataTable::compactStringsIfSparse() {
+    const size_t nr_cells = strings.size() * (size_t) nr_objects;
+    if (string_pool.size() <= std::max((size_t) 1024, 2 * nr_cells)) return;
+
+    materialise();
+    const StringPool::id_t unused = std::numeric_limits<StringPool::id_t>::max();
+    std::vector<StringPool::id_t> remap (string_pool.size(), unused);
+    StringPool compacted;
+    for (auto &column : strings)
+    for (auto &id : column) {
+        if (remap[id] == unused) remap[id] = compacted.intern(string_pool[id]);
+        id = remap[id];
     }
+    string_pool = std::move(compacted);
+}
+
+MetaDataContainer MetaDataTable::getObject(long int i) const {
+    if (i < 0) { i = size() - 1; }
+    if (!checkBounds(i))
+        REPORT_ERROR((std::string) __func__ + ": Out of bounds!"
+            "(no " + std::to_string(i) + "th object in collection of " + std::to_string(size()) + " objects)");
+    return MetaDataContainer(this, i);
+}
+
+void MetaDataTable::setObject(const MetaDataContainer &data, long int i) {
+    if (i < 0) { i = size() - 1; }
+    if (!checkBounds(i))
+        REPORT_ERROR((std::string) __func__ + ": Out of bounds!"
+            "(no " + std::to_string(i) + "th object in collection of " + std::to_string(size()) + " objects)");
+    addMissingLabels(*data.table);
+    setObjectUnsafe(data, i);
+}
+
+void MetaDataTable::setValuesOfDefinedLabels(const MetaDataContainer &data, long i) {
+    if (i < 0) { i = size() - 1; }
+    if (!checkBounds(i))
+        REPORT_ERROR((std::string) __func__ + ": Out of bounds!"
+            "(no " + std::to_string(i) + "th object in collection of " + std::to_string(size()) + " objects)");
+    setObjectUnsafe(data, i);
+}
+
+void MetaDataTable::setObjectUnsafe(const MetaDataContainer &data, long i) {
+    const long row = data.row;
+    copyObjects(*data.table, 1, [row] (long) { return row; }, i);
+}
+
+long int MetaDataTable::addObject() {
+    resizeObjects(size() + 1);
     return size() - 1;
 }
 
-long int MetaDataTable::addObject(MetaDataContainer* data) {
-    if (objects.empty()) {
-        objects.push_back(new MetaDataContainer(this, 0, 0, 0, 0, 0, 0));
-    } else {
-        const auto &object1 = objects.front();
-        objects.push_back(new MetaDataContainer(
-            this,
-            object1->doubles.size(), object1->ints.size(),
-            object1->bools.size(), object1->strings.size(),
-            object1->doubleVectors.size(), object1->unknowns.size()
-        ));
-    }
+long int MetaDataTable::addObject(const MetaDataContainer &data) {
+    resizeObjects(size() + 1);
     setObject(data, size() - 1);
     return size() - 1;
 }
 
-void MetaDataTable::addValuesOfDefinedLabels(MetaDataContainer* data) {
-    if (objects.empty()) {
-        objects.push_back(new MetaDataContainer(this, 0, 0, 0, 0, 0, 0));
-    } else {
-        const auto &object1 = objects.front();
-        objects.push_back(new MetaDataContainer(
-            this,
-            object1->doubles.size(), object1->ints.size(),
-            object1->bools.size(), object1->strings.size(),
-            object1->doubleVectors.size(), object1->unknowns.size()
-        ));
-    }
+void MetaDataTable::addValuesOfDefinedLabels(const MetaDataContainer &data) {
+    resizeObjects(size() + 1);
     setValuesOfDefinedLabels(data, size() - 1);
 }
 
+template <typename T>
+static void erase_from_column(std::vector<T> &column, long i) {
+    column.erase(column.begin() + i);
+}
+
 void MetaDataTable::removeObject(long i) {
     if (i < 0) { i = size() - 1; }
     if (!checkBounds(i))
         REPORT_ERROR((std::string) __func__ + ": Out of bounds!"
             "(no " + std::to_string(i) + "th object in collection of " + std::to_string(size()) + " objects)");
-    delete objects[i];
-    objects.erase(objects.begin() + i);
+    materialise();
+    for (auto &column : doubles)       erase_from_column(column, i);
+    for (auto &column : ints)          erase_from_column(column, i);
+    for (auto &column : bools)         erase_from_column(column, i);
+    for (auto &column : strings)       erase_from_column(column, i);
+    for (auto &column : doubleVectors) erase_from_column(column, i);
+    for (auto &column : unknowns)      erase_from_column(column, i);
+    nr_objects--;
 }
 
 void MetaDataTable::printLabels(std::ostream &ost) {
@@ -541,7 +722,10 @@ void MetaDataTable::printLabels(std::ostream &ost) {
 }
 
 void MetaDataTable::randomiseOrder() {
-    std::random_shuffle(objects.begin(), objects.end());
+    std::vector<long> order (size());
+    std::iota(order.begin(), order.end(), 0);
+    std::random_shuffle(order.begin(), order.end());
+    permute(order);
 }
 
 //FIXME: does not support unknownLabels but this function is only used by relion_star_handler
@@ -734,14 +918,16 @@ MetaDataTable subsetMetaDataTable(
     if (!MDin.containsLabel(label))
         REPORT_ERROR("subsetMetadataTable ERROR: input MetaDataTable does not contain label: " + EMDL::label2Str(label));
 
-    MetaDataTable MDout;
+    std::vector<long> rows;
     for (long int i : MDin) {
         RFLOAT x = EMDL::is<int>(label) ? MDin.getValue<long>(label, i) :
             MDin.getValue<RFLOAT>(label, i);
 
         if (x <= max_value && x >= min_value)
-            MDout.addObject(MDin.getObject(i));
+            rows.push_back(i);
     }
+    MetaDataTable MDout;
+    MDout.appendRows(MDin, rows);
     return MDout;
 }
 
@@ -756,12 +942,14 @@ MetaDataTable subsetMetaDataTable(
     if (!MDin.containsLabel(label))
         REPORT_ERROR("subsetMetadataTable ERROR: input MetaDataTable does not contain label: " + EMDL::label2Str(label));
 
-    MetaDataTable MDout;
+    std::vector<long> rows;
     for (long int i : MDin) {
         if (exclude == (
             MDin.getValue<std::string>(label, i).find(search_str) == std::string::npos
-        )) MDout.addObject(MDin.getObject(i));
+        )) rows.push_back(i);
     }
+    MetaDataTable MDout;
+    MDout.appendRows(MDin, rows);
     return MDout;
 }
 
@@ -861,11 +1049,14 @@ MetaDataTable removeDuplicatedParticles(
         }
     }
 
-    MetaDataTable MDout, MDremoved;
     // (Bookkeeping) Make a note of which particles were kept and which removed.
+    std::vector<long> kept, removed;
     for (long int i : MDin) {
-        (valid[i] ? MDout : MDremoved).addObject(MDin.getObject(i));
+        (valid[i] ? kept : removed).push_back(i);
     }
+    MetaDataTable MDout, MDremoved;
+    MDout.appendRows(MDin, kept);
+    MDremoved.appendRows(MDin, removed);
 
     if (!fn_removed.empty()) MDremoved.write(fn_removed);
 
@@ -878,6 +1069,144 @@ MetaDataTable removeDuplicatedParticles(
 
 // Reading
 
+namespace {
+
+const char binary_magic[8] = {'R', 'L', 'N', 'M', 'D', 'T', 'B', '2'};
+const uint32_t binary_byte_order = 0x01020304;
+
+// The size, modification time and inode of a STAR file, as recorded in a binary copy of it (all 0 if there is no such file).
+// Modification times are only updated every few milliseconds, but a STAR file that is written again within that time
+// will still have a new inode, since MetaDataTable::write renames a temporary file.
+struct SourceStamp {
+
+    uint64_t size, inode;
+    int64_t sec, nsec;
+
+    static SourceStamp of(const FileName &fn) {
+        struct stat st;
+        if (fn.empty() || stat(fn.c_str(), &st) != 0) return {0, 0, 0, 0};
+        return {(uint64_t) st.st_size, (uint64_t) st.st_ino, (int64_t) st.st_mtim.tv_sec, (int64_t) st.st_mtim.tv_nsec};
+    }
+
+    bool operator == (const SourceStamp &other) const {
+        return size == other.size && inode == other.inode && sec == other.sec && nsec == other.nsec;
+    }
+
+};
+
+template <typename T>
+inline T load(const char *p) {
+    T x;
+    memcpy(&x, p, sizeof(T));
+    return x;
+}
+
+// Sequential reads from [p, end), which fail on truncated files
+struct BinaryReader {
+
+    const char *p, *end;
+    const FileName &fn;
+
+    void need(size_t n) {
+        if (n > (size_t) (end - p))
+            REPORT_ERROR("MetaDataTable::readBinary: " + fn + " is truncated or corrupt");
+    }
+
+    template <typename T>
+    T get() {
+        need(sizeof(T));
+        const T x = load<T>(p);
+        p += sizeof(T);
+        return x;
+    }
+
+    std::string getString() {
+        const uint64_t n = get<uint64_t>();
+        need(n);
+        const std::string s (p, n);
+        p += n;
+        return s;
+    }
+
+};
+
+template <typename T>
+inline void put(std::ostream &out, const T &x) {
+    out.write((const char*) &x, sizeof(T));
+}
+
+inline void putString(std::ostream &out, const std::string &s) {
+    put<uint64_t>(out, s.size());
+    out.write(s.data(), s.size());
+}
+
+// Align the next write to 8 bytes, so that columns can be copied straight out of the map
+inline void pad(std::ostream &out) {
+    static const char zeros[8] = {};
+    out.write(zeros, (8 - (uint64_t) out.tellp() % 8) % 8);
+}
+
+// Does an encoded column of n objects fit in size bytes? (see writeBinary for the layout)
+bool columnFits(LazyColumns::Kind kind, const char *data, uint64_t size, uint64_t n) {
+    switch (kind) {
+        case LazyColumns::DOUBLES:
+        case LazyColumns::INTS:
+        return size >= 8 * n;
+        case LazyColumns::BOOLS:
+        return size >= n;
+        case LazyColumns::STRINGS: {
+            if (size < 8) return false;
+            const uint64_t count = load<uint64_t>(data);
+            if (count > size / 8 || size < 8 * (count + 2) + 4 * n) return false;
+            return size >= 8 * (count + 2) + 4 * n + load<uint64_t>(data + 8 * (count + 1));
+        }
+        case LazyColumns::VECTORS:
+        case LazyColumns::UNKNOWNS: {
+            if (n + 1 > size / 8) return false;
+            const uint64_t items = load<uint64_t>(data + 8 * n);
+            return (size - 8 * (n + 1)) / (kind == LazyColumns::VECTORS ? 8 : 1) >= items;
+        }
+        default:
+        return false;
+    }
+}
+
+// Position of the '\n' ending the line that starts at p (or e)
+inline const char* endOfLine(const char *p, const char *e) {
+    const char *eol = (const char*) memchr(p, '\n', e - p);
+    return eol ? eol : e;
+}
+
+// Start of the line after the one that starts at p (or e)
+inline const char* nextLine(const char *p, const char *e) {
+    const char *eol = endOfLine(p, e);
+    return eol == e ? e : eol + 1;
+}
+
+inline bool contains(const char *b, const char *e, const std::string &needle) {
+    return std::search(b, e, needle.begin(), needle.end()) != e;
+}
+
+// Whether simplify() would leave nothing of the line
+inline bool isBlank(const char *b, const char *e) {
+    for (; b != e; ++b) switch (*b) {
+        case ' ': case '\t': case '\r': case '\a': case '\v': case '\b': case '\f': continue;
+        default: return false;
+    }
+    return true;
+}
+
+// Whether the line has to go through simplify() and nextTokenInSTAR().
+// Quotes and control characters are rare, so other lines are split in place.
+inline bool needsSimplify(const char *b, const char *e) {
+    for (; b != e; ++b) switch (*b) {
+        case '"': case '\'': case '\r': case '\a': case '\v': case '\b': case '\f': return true;
+    }
+    return false;
+}
+
+}
+
 long int MetaDataTable::read(
     const FileName &filename, const std::string &name, bool do_only_count
 ) {
@@ -886,11 +1215,244 @@ long int MetaDataTable::read(
 
     const FileName fn_read = filename.removeFileFormat();  // Check for a :star extension
 
-    std::ifstream in (fn_read.data(), std::ios_base::in);
-    if (in.fail())
-        REPORT_ERROR((std::string) "MetaDataTable::read: File " + fn_read + " does not exist");
+    if (fn_read.getExtension() == "bin")
+        return readBinary(fn_read, name, do_only_count);
+
+    // Prefer a binary copy written alongside the STAR file, if it was written from the STAR file as it is now
+    // (same size and modification time, so not if the STAR file was edited, restored or copied since).
+    // If the binary file cannot be read (e.g. it is truncated or out of date), parse the STAR file instead.
+    const FileName fn_bin = fn_read + ".bin";
+    if (exists(fn_bin)) {
+        try {
+            const long int result = readBinary(fn_bin, name, do_only_count, fn_read);
+            if (result > 0) return result;
+        } catch (const RelionError &err) {
+            std::cerr << " + WARNING: ignoring " << fn_bin << ", reading " << fn_read << " instead: " << err.msg << std::endl;
+        }
+        clear();
+    }
+
+    // Map the file, so that a loop can be parsed in place by several threads
+    const MappedFile file (fn_read);
+    if (!file.data()) {
+        // Missing or empty file
+        std::ifstream in (fn_read.data(), std::ios_base::in);
+        if (in.fail())
+            REPORT_ERROR((std::string) "MetaDataTable::read: File " + fn_read + " does not exist");
+        return readStar(in, name, do_only_count);
+    }
+
+    // Same search as readStar, without copying lines that cannot matter
+    version = 30000;
+    const char *e = file.data() + file.size();
+    for (const char *p = file.data(); p < e; p = nextLine(p, e)) {
+        const char *eol = endOfLine(p, e);
+
+        if (contains(p, eol, "# version ")) {
+            const std::string line (p, eol);
+            const std::string token = line.substr(line.find("# version ") + std::string("# version ").length());
+            std::istringstream(token) >> version;
+        }
+
+        if (!contains(p, eol, "data_")) continue;
+        std::string line (p, eol);
+        trim(line);
+        const std::string token = line.substr(line.find("data_") + 5);
+        if (!name.empty() && name != token) continue;
+
+        this->name = token;
+        // Get the next item that starts with "_somelabel" or with "loop_"
+        for (p = nextLine(p, e); p < e; p = nextLine(p, e)) {
+            if (contains(p, endOfLine(p, e), "loop_")) {
+                return readStarLoop(nextLine(p, e), e, do_only_count);
+            } else if (*p == '_') {
+                // Lists are short, so the stream parser will do
+                std::ifstream in (fn_read.data(), std::ios_base::in);
+                return readStar(in, name, do_only_count);
+            }
+        }
+        return 0;
+    }
+
+    return 0;
+}
+
+void MetaDataTable::addLabelFromStar(const std::string &line) {
+    // label definition line
+    // Take string from "_" until "#"
+    size_t start = line.find("_");
+    size_t end   = line.find("#");
+
+    const std::string token = line.substr(start + 1, end - start - 2);
+
+    auto label = EMDL::str2Label(token);
+    if (label == EMDL::UNDEFINED) {
+        std::cerr << " + WARNING: will ignore (but maintain) values for the unknown label: " << token << std::endl;
+        label = EMDL::UNKNOWN_LABEL;
+    }
+
+    addLabel(label, token);
+}
+
+long int MetaDataTable::readStarLoop(const char *p, const char *e, bool do_only_count) {
+    isList = false;
+
+    // First read all the column labels
+    for (; p < e; p = nextLine(p, e)) {
+        const std::string line = simplify(std::string(p, endOfLine(p, e)));
+        if (line[0] == '#' || line[0] == '\0' || line[0] == ';')
+            continue;
+
+        if (line[0] != '_') break;  // found first data line
+
+        addLabelFromStar(line);
+    }
+
+    // The loop ends at the first blank line.
+    // Split the rest of the file into chunks of whole lines, one per thread.
+    const size_t bytes = e - p;
+    const int n_chunks = std::max(1, (int) std::min<size_t>(omp_get_max_threads(), bytes >> 20));
+    std::vector<const char*> chunk_begin (n_chunks + 1, e);
+    for (int t = 0; t < n_chunks; t++) {
+        const char *q = p + bytes * t / n_chunks;
+        chunk_begin[t] = t == 0 || q[-1] == '\n' ? q : nextLine(q, e);
+    }
+
+    // Count the rows in each chunk
+    std::vector<long> chunk_rows (n_chunks, 0);
+    std::vector<unsigned char> chunk_ends_loop (n_chunks, false);
+    #pragma omp parallel for num_threads(n_chunks)
+    for (int t = 0; t < n_chunks; t++) {
+        for (const char *q = chunk_begin[t]; q < chunk_begin[t + 1]; q = nextLine(q, e)) {
+            if (isBlank(q, endOfLine(q, e))) {
+                chunk_ends_loop[t] = true;
+                break;
+            }
+            chunk_rows[t]++;
+        }
+    }
+
+    int n_used = n_chunks;
+    for (int t = 0; t < n_chunks; t++) {
+        if (chunk_ends_loop[t]) { n_used = t + 1; break; }
+    }
+    std::vector<long> first_row (n_used + 1, 0);
+    for (int t = 0; t < n_used; t++)
+        first_row[t + 1] = first_row[t] + chunk_rows[t];
+
+    const long int nr_rows = first_row[n_used];
+    if (do_only_count) return nr_rows;
+
+    resizeObjects(nr_rows);
+
+    // Where the value in each position of a row goes
+    const int num_labels = activeLabels.size();
+    std::vector<LazyColumns::Kind> types (num_labels);
+    std::vector<long> offsets (num_labels);
+    for (int pos = 0; pos < num_labels; pos++) {
+        const EMDL::EMDLabel label = activeLabels[pos];
+        offsets[pos] = label == EMDL::UNKNOWN_LABEL ? unknown_label_indices[pos] : label_indices[label];
+        types[pos] = kindOf(label);
+    }
+
+    // Fill the rows of each chunk in parallel.
+    // Strings are interned into one pool per chunk and merged afterwards.
+    std::vector<StringPool> pools (n_used);
+    std::vector<std::pair<std::string, std::string>> errors (n_used);  // (line, message)
+    #pragma omp parallel for num_threads(n_used)
+    for (int t = 0; t < n_used; t++) {
+        StringPool &pool = pools[t];
+        const StringPool::id_t empty_id = pool.intern("\"\"");
+        std::string value, token, line;
+        long int i = first_row[t];
+
+        // Numbers are parsed in place; only the other columns need the value as a string
+        const auto store = [&] (int pos, const char *vb, const char *ve) {
+            const long off = offsets[pos];
+            switch (types[pos]) {
+                case LazyColumns::DOUBLES:  doubles[off][i] = parseDouble(vb, ve); return;
+                case LazyColumns::INTS:     ints[off][i] = parseInteger(vb, ve); return;
+                case LazyColumns::BOOLS:    bools[off][i] = parseInteger(vb, ve) != 0; return;
+                default: break;
+            }
+            if (vb == ve && types[pos] == LazyColumns::STRINGS) {
+                strings[off][i] = empty_id;
+                return;
+            }
+            value.assign(vb, ve);
+            switch (types[pos]) {
+                case LazyColumns::STRINGS:  strings[off][i] = pool.intern(value); break;
+                case LazyColumns::VECTORS:  doubleVectors[off][i] = parseDoubleVector(value); break;
+                case LazyColumns::UNKNOWNS: unknowns[off][i] = value; break;
+                default: break;
+            }
+        };
+
+        for (const char *q = chunk_begin[t]; i < first_row[t + 1]; i++, q = nextLine(q, e)) {
+            const char *eol = endOfLine(q, e);
+            int labelPosition = 0;
+            bool too_many = false;
+
+            try {
+                if (needsSimplify(q, eol)) {
+                    line = simplify(std::string(q, eol));
+                    for (int pos = 0; nextTokenInSTAR(line, pos, token); labelPosition++) {
+                        if (labelPosition >= num_labels) { too_many = true; break; }
+                        store(labelPosition, token.data(), token.data() + token.size());
+                    }
+                } else {
+                    for (const char *tb = q;; labelPosition++) {
+                        while (tb < eol && (*tb == ' ' || *tb == '\t')) tb++;
+                        if (tb == eol || *tb == '#') break;
+                        const char *te = tb;
+                        while (te < eol && *te != ' ' && *te != '\t') te++;
+                        if (labelPosition >= num_labels) { too_many = true; break; }
+                        store(labelPosition, tb, te);
+                        tb = te;
+                    }
+                }
+            } catch (const RelionError &err) {
+                errors[t] = {std::string(q, eol), err.msg};
+                break;
+            }
+
+            if (too_many) {
+                errors[t] = {std::string(q, eol), "A line in the STAR file contains more columns than the number of labels."};
+                break;
+            }
+            if (labelPosition < num_labels && num_labels > 2) {
+                // For backward-compatibility for cases like "fn_mtf <empty>", don't die if num_labels == 2.
+                errors[t] = {std::string(q, eol), "A line in the STAR file contains fewer columns than the number of labels. Expected = " + integerToString(num_labels) + " Found = " +  integerToString(labelPosition)};
+                break;
+            }
+            for (int pos = labelPosition; pos < num_labels; pos++) {
+                if (types[pos] == LazyColumns::STRINGS) strings[offsets[pos]][i] = empty_id;
+            }
+        }
+    }
+
+    for (const auto &error : errors) {
+        if (error.second.empty()) continue;
+        std::cerr << "Error in line: " << error.first << std::endl;
+        REPORT_ERROR(error.second);
+    }
+
+    // Translate the per-chunk string ids
+    std::vector<std::vector<StringPool::id_t>> remaps (n_used);
+    for (int t = 0; t < n_used; t++) {
+        remaps[t].resize(pools[t].size());
+        for (StringPool::id_t id = 0; id < pools[t].size(); id++)
+            remaps[t][id] = string_pool.intern(pools[t][id]);
+    }
+    #pragma omp parallel for num_threads(n_used)
+    for (int t = 0; t < n_used; t++) {
+        for (auto &column : strings) {
+            for (long int i = first_row[t]; i < first_row[t + 1]; i++)
+                column[i] = remaps[t][column[i]];
+        }
+    }
 
-    return readStar(in, name, do_only_count);
+    return nr_rows;
 }
 
 long int MetaDataTable::readStarLoop(std::ifstream &in, bool do_only_count) {
@@ -909,20 +1471,7 @@ long int MetaDataTable::readStarLoop(std::ifstream &in, bool do_only_count) {
 
         if (line[0] != '_') break;  // found first data line
 
-        // label definition line
-        // Take string from "_" until "#"
-        size_t start = line.find("_");
-        size_t end   = line.find("#");
-
-        const std::string token = line.substr(start + 1, end - start - 2);
-
-        auto label = EMDL::str2Label(token);
-        if (label == EMDL::UNDEFINED) {
-            std::cerr << " + WARNING: will ignore (but maintain) values for the unknown label: " << token << std::endl;
-            label = EMDL::UNKNOWN_LABEL;
-        }
-
-        addLabel(label, token);
+        addLabelFromStar(line);
 
         labelPosition++;
     }
@@ -1066,12 +1615,199 @@ long int MetaDataTable::readStar(
     return 0;
 }
 
+// Binary metadata files
+
+long int MetaDataTable::readBinary(
+    const FileName &filename, const std::string &name, bool do_only_count, const FileName &fn_source
+) {
+    clear();
+
+    const FileName fn_read = filename.removeFileFormat();
+    const SourceStamp source = SourceStamp::of(fn_source);
+    const auto file = std::make_shared<const MappedFile>(fn_read);
+    if (!file->data())
+        REPORT_ERROR((std::string) "MetaDataTable::readBinary: File " + fn_read + " does not exist or is empty");
+
+    const char *end = file->data() + file->size();
+    for (const char *table = file->data(); table < end;) {
+
+        BinaryReader in {table, end, fn_read};
+        in.need(sizeof(binary_magic));
+        if (memcmp(in.p, binary_magic, sizeof(binary_magic)) != 0)
+            REPORT_ERROR("MetaDataTable::readBinary: " + fn_read + " is not a binary metadata file");
+        in.p += sizeof(binary_magic);
+        if (in.get<uint32_t>() != binary_byte_order)
+            REPORT_ERROR("MetaDataTable::readBinary: " + fn_read + " was written on a machine with a different byte order");
+
+        const int table_version = in.get<int32_t>();
+        const uint64_t table_bytes = in.get<uint64_t>();
+        if (table_bytes < sizeof(binary_magic) || table_bytes > (uint64_t) (end - table))
+            REPORT_ERROR("MetaDataTable::readBinary: " + fn_read + " is truncated or corrupt");
+        in.end = table + table_bytes;
+
+        const uint64_t n = in.get<uint64_t>();
+        const bool table_is_list = in.get<int32_t>();
+        in.get<int32_t>();
+        SourceStamp table_source;
+        table_source.size = in.get<uint64_t>();
+        table_source.inode = in.get<uint64_t>();
+        table_source.sec  = in.get<int64_t>();
+        table_source.nsec = in.get<int64_t>();
+        const std::string table_name = in.getString();
+
+        // If a name has been given, only read that table
+        // Otherwise, just read the first one
+        if (!name.empty() && name != table_name) {
+            table += table_bytes;
+            continue;
+        }
+
+        if (!fn_source.empty() && (source.size == 0 || !(table_source == source)))
+            REPORT_ERROR("MetaDataTable::readBinary: " + fn_read + " was not written from the current " + fn_source);
+
+        version = table_version;
+        isList = table_is_list;
+        this->name = table_name;
+        comment = in.getString();
+
+        if (do_only_count) return isList ? 1 : n;
+
+        // Add the labels without allocating their columns
+        std::vector<std::vector<LazyColumns::Extent>> extents (LazyColumns::NR_KINDS);
+        size_t nr_strings = 0;
+        const uint64_t num_columns = in.get<uint64_t>();
+        for (uint64_t c = 0; c < num_columns; c++) {
+            const std::string token = in.getString();
+            const auto kind = (LazyColumns::Kind) in.get<int32_t>();
+            in.get<int32_t>();
+            const uint64_t offset = in.get<uint64_t>();
+            const uint64_t size   = in.get<uint64_t>();
+
+            auto label = EMDL::str2Label(token);
+            if (label == EMDL::UNDEFINED) {
+                std::cerr << " + WARNING: will ignore (but maintain) values for the unknown label: " << token << std::endl;
+                label = EMDL::UNKNOWN_LABEL;
+            }
+            if (kindOf(label) != kind)
+                REPORT_ERROR("MetaDataTable::readBinary: " + token + " in " + fn_read + " does not have the expected type");
+
+            addLabel(label, token);
+            const long off = label == EMDL::UNKNOWN_LABEL ? unknown_label_indices.back() : label_indices[label];
+            if (
+                off != (long) extents[kind].size() || offset > table_bytes || size > table_bytes - offset ||
+                !columnFits(kind, table + offset, size, n)
+            ) REPORT_ERROR("MetaDataTable::readBinary: " + fn_read + " is truncated or corrupt");
+
+            extents[kind].push_back({table + offset, size});
+            if (kind == LazyColumns::STRINGS) nr_strings += load<uint64_t>(table + offset);
+        }
+
+        nr_objects = n;
+        // Decoding a column must not move the strings of the pool, since other threads may be reading them
+        string_pool.intern("\"\"");
+        string_pool.reserve(string_pool.size() + nr_strings);
+        lazy = LazyColumns(file, std::move(extents));
+
+        return isList ? 1 : nr_objects;
+    }
+
+    return 0;
+}
+
+void MetaDataTable::decodeColumn(LazyColumns::Kind kind, long off) const {
+    std::lock_guard<std::mutex> guard (lazy.mutex());
+    if (!lazy.pending(kind, off)) return;  // Another thread got here first
+
+    const char *p = lazy.extent(kind, off).data;
+    const long n = nr_objects;
+
+    switch (kind) {
+
+        case LazyColumns::DOUBLES: {
+            auto &column = doubles[off];
+            column.resize(n);
+            memcpy(column.data(), p, n * sizeof(double));
+            break;
+        }
+
+        case LazyColumns::INTS: {
+            auto &column = ints[off];
+            column.resize(n);
+            for (long i = 0; i < n; i++) column[i] = load<int64_t>(p + 8 * i);
+            break;
+        }
+
+        case LazyColumns::BOOLS:
+        bools[off].assign(p, p + n);
+        break;
+
+        case LazyColumns::STRINGS: {
+            // count, offsets into chars (count + 1), ids (n), chars
+            const uint64_t count = load<uint64_t>(p);
+            const char *offsets = p + 8;
+            const char *ids = offsets + 8 * (count + 1);
+            const char *chars = ids + 4 * n;
+            std::vector<StringPool::id_t> remap (count);
+            for (uint64_t k = 0; k < count; k++) {
+                const uint64_t b = load<uint64_t>(offsets + 8 * k), e = load<uint64_t>(offsets + 8 * (k + 1));
+                remap[k] = string_pool.intern(std::string(chars + b, chars + e));
+            }
+            auto &column = strings[off];
+            column.resize(n);
+            for (long i = 0; i < n; i++) column[i] = remap[load<uint32_t>(ids + 4 * i)];
+            break;
+        }
+
+        case LazyColumns::VECTORS: {
+            // offsets into values (n + 1), values
+            const char *values = p + 8 * (n + 1);
+            auto &column = doubleVectors[off];
+            column.resize(n);
+            for (long i = 0; i < n; i++) {
+                const uint64_t b = load<uint64_t>(p + 8 * i), e = load<uint64_t>(p + 8 * (i + 1));
+                column[i].resize(e - b);
+                memcpy(column[i].data(), values + 8 * b, 8 * (e - b));
+            }
+            break;
+        }
+
+        case LazyColumns::UNKNOWNS: {
+            // offsets into chars (n + 1), chars
+            const char *chars = p + 8 * (n + 1);
+            auto &column = unknowns[off];
+            column.resize(n);
+            for (long i = 0; i < n; i++) {
+                const uint64_t b = load<uint64_t>(p + 8 * i), e = load<uint64_t>(p + 8 * (i + 1));
+                column[i].assign(chars + b, chars + e);
+            }
+            break;
+        }
+
+        default:
+        break;
+    }
+
+    lazy.setDecoded(kind, off);
+}
+
+void MetaDataTable::materialise() const {
+    if (lazy.empty()) return;
+    for (long off = 0; off < doubles.size();       off++) materialise(LazyColumns::DOUBLES,  off);
+    for (long off = 0; off < ints.size();          off++) materialise(LazyColumns::INTS,     off);
+    for (long off = 0; off < bools.size();         off++) materialise(LazyColumns::BOOLS,    off);
+    for (long off = 0; off < strings.size();       off++) materialise(LazyColumns::STRINGS,  off);
+    for (long off = 0; off < doubleVectors.size(); off++) materialise(LazyColumns::VECTORS,  off);
+    for (long off = 0; off < unknowns.size();      off++) materialise(LazyColumns::UNKNOWNS, off);
+}
+
 // Writing
 
 void MetaDataTable::write(std::ostream& out) {
 
     if (empty()) return;  // Only write tables that have something in them
 
+    materialise();
+
     if (version >= 30000) {
         out << "\n"
             << "# version " << CurrentVersion << "\n";
@@ -1105,7 +1841,7 @@ void MetaDataTable::write(std::ostream& out) {
                 if (l == EMDL::SORTED_IDX) continue;
                 out.width(10);
                 out << (l == EMDL::UNKNOWN_LABEL ?
-                    escapeStringForSTAR(objects[j]->unknowns[unknown_label_indices[i]]) :
+                    escapeStringForSTAR(unknowns[unknown_label_indices[i]][j]) :
                     getValueToString(l, j))
                     << " ";
             }
@@ -1126,11 +1862,11 @@ void MetaDataTable::write(std::ostream& out) {
 
         for (long i = 0; i < activeLabels.size(); i++) {
             const auto lu = label_and_unknown(*this, i);
-            const bool is_known = lu.first == EMDL::UNKNOWN_LABEL;
+            const bool is_known = lu.first != EMDL::UNKNOWN_LABEL;
             const std::string name = is_known ? EMDL::label2Str(lu.first) : lu.second;
             const std::string item = is_known ?
                 getValueToString(lu.first, 0) :
-                escapeStringForSTAR(objects[0]->unknowns[unknown_label_indices[i]]);
+                escapeStringForSTAR(unknowns[unknown_label_indices[i]][0]);
             out << "_" << name << std::setw(12 + maxWidth - name.length()) << " " << item << "\n";
         }
         out << "\n";
@@ -1140,12 +1876,143 @@ void MetaDataTable::write(std::ostream& out) {
 }
 
 void MetaDataTable::write(const FileName &fn_out) {
+    const bool is_binary = fn_out.getExtension() == "bin";
     const FileName fn_tmp = fn_out + ".tmp";
-    std::ofstream fh (fn_tmp.c_str(), std::ios::out);
+    std::ofstream fh (fn_tmp.c_str(), is_binary ? std::ios::out | std::ios::binary : std::ios::out);
     if (!fh)
         REPORT_ERROR((std::string) "MetaDataTable::write: cannot write to file: " + fn_out);
         // fh << "# RELION; version " << g_RELION_VERSION << std::endl;
-    write(fh);
+    if (is_binary) {
+        writeBinary(fh);
+    } else {
+        write(fh);
+    }
+    fh.close();
+    if (!fh)
+        REPORT_ERROR((std::string) "MetaDataTable::write: cannot write to file: " + fn_tmp);
     // Rename to prevent errors with programs in pipeliner reading in incomplete STAR files
     std::rename(fn_tmp.c_str(), fn_out.c_str());
 }
+
+void MetaDataTable::writeBinary(std::ostream &out, const FileName &fn_source) {
+
+    if (empty()) return;  // Only write tables that have something in them
+
+    const SourceStamp source = SourceStamp::of(fn_source);
+
+    materialise();
+
+    std::vector<long> columns;  // positions in activeLabels
+    for (long i = 0; i < activeLabels.size(); i++) {
+        if (activeLabels[i] != EMDL::SORTED_IDX) columns.push_back(i);
+    }
+
+    const std::streamoff start = out.tellp();
+    std::vector<uint64_t> offsets (columns.size(), 0), sizes (columns.size(), 0);
+
+    // The header has a fixed size: write it once to make room and again when the columns are in place
+    const auto write_header = [&] (uint64_t table_bytes) {
+        out.write(binary_magic, sizeof(binary_magic));
+        put<uint32_t>(out, binary_byte_order);
+        put<int32_t>(out, CurrentVersion);
+        put<uint64_t>(out, table_bytes);
+        put<uint64_t>(out, nr_objects);
+        put<int32_t>(out, isList);
+        put<int32_t>(out, 0);
+        put<uint64_t>(out, source.size);
+        put<uint64_t>(out, source.inode);
+        put<int64_t>(out, source.sec);
+        put<int64_t>(out, source.nsec);
+        putString(out, name);
+        putString(out, comment);
+        put<uint64_t>(out, columns.size());
+        for (long c = 0; c < columns.size(); c++) {
+            const auto lu = label_and_unknown(*this, columns[c]);
+            putString(out, lu.first == EMDL::UNKNOWN_LABEL ? lu.second : EMDL::label2Str(lu.first));
+            put<int32_t>(out, kindOf(lu.first));
+            put<int32_t>(out, 0);
+            put<uint64_t>(out, offsets[c]);
+            put<uint64_t>(out, sizes[c]);
+        }
+    };
+    write_header(0);
+
+    const long n = nr_objects;
+    for (long c = 0; c < columns.size(); c++) {
+        pad(out);
+        offsets[c] = (std::streamoff) out.tellp() - start;
+
+        const EMDL::EMDLabel label = activeLabels[columns[c]];
+        const long off = label == EMDL::UNKNOWN_LABEL ? unknown_label_indices[columns[c]] : label_indices[label];
+        switch (kindOf(label)) {
+
+            case LazyColumns::DOUBLES:
+            out.write((const char*) doubles[off].data(), n * sizeof(double));
+            break;
+
+            case LazyColumns::INTS: {
+                const std::vector<int64_t> values (ints[off].begin(), ints[off].end());
+                out.write((const char*) values.data(), n * sizeof(int64_t));
+                break;
+            }
+
+            case LazyColumns::BOOLS:
+            out.write((const char*) bools[off].data(), n);
+            break;
+
+            case LazyColumns::STRINGS: {
+                // Only the strings used by this column, numbered in order of appearance
+                std::vector<long> local (string_pool.size(), -1);
+                std::vector<StringPool::id_t> used;
+                std::vector<uint32_t> ids (n);
+                for (long i = 0; i < n; i++) {
+                    const StringPool::id_t id = strings[off][i];
+                    if (local[id] < 0) {
+                        local[id] = used.size();
+                        used.push_back(id);
+                    }
+                    ids[i] = local[id];
+                }
+                std::vector<uint64_t> char_offsets (1, 0);
+                for (StringPool::id_t id : used)
+                    char_offsets.push_back(char_offsets.back() + string_pool[id].size());
+                put<uint64_t>(out, used.size());
+                out.write((const char*) char_offsets.data(), char_offsets.size() * sizeof(uint64_t));
+                out.write((const char*) ids.data(), n * sizeof(uint32_t));
+                for (StringPool::id_t id : used) out.write(string_pool[id].data(), string_pool[id].size());
+                break;
+            }
+
+            case LazyColumns::VECTORS: {
+                std::vector<uint64_t> value_offsets (1, 0);
+                for (const auto &v : doubleVectors[off])
+                    value_offsets.push_back(value_offsets.back() + v.size());
+                out.write((const char*) value_offsets.data(), value_offsets.size() * sizeof(uint64_t));
+                for (const auto &v : doubleVectors[off]) out.write((const char*) v.data(), v.size() * sizeof(double));
+                break;
+            }
+
+            case LazyColumns::UNKNOWNS: {
+                std::vector<uint64_t> char_offsets (1, 0);
+                for (const auto &s : unknowns[off])
+                    char_offsets.push_back(char_offsets.back() + s.size());
+                out.write((const char*) char_offsets.data(), char_offsets.size() * sizeof(uint64_t));
+                for (const auto &s : unknowns[off]) out.write(s.data(), s.size());
+                break;
+            }
+
+            default:
+            break;
+        }
+
+        sizes[c] = (std::streamoff) out.tellp() - start - offsets[c];
+    }
+    pad(out);
+
+    const std::streamoff table_end = out.tellp();
+    out.seekp(start);
+    write_header(table_end - start);
+    out.seekp(table_end);
+
+    if (!out) REPORT_ERROR("MetaDataTable::writeBinary: cannot write table " + name);
+}
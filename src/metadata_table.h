@@ -30,6 +30,8 @@
 #define METADATA_TABLE_H
 
 #include <vector>
+#include <numeric>
+#include <algorithm>
 #include <iostream>
 #include <stdio.h>
 #include "src/filename.h"
@@ -40,6 +42,8 @@
 
 namespace MD {
 
+struct CompareAt;
+
 struct CompareDoublesAt;
 
 struct CompareIntsAt;
@@ -57,17 +61,15 @@ struct CompareStringsBeforeAtAt;
  *	- stores a table of values for an arbitrary subset of predefined EMDLabels
  *	- each column corresponds to a label
  *	- each row represents a data point
- *	- the rows are stored in per-type contiguous blocks of memory
+ *	- the values of each column are stored in one contiguous array
  *
  *	2020/Nov/12:
- *	  This class is organized as an array (`objects`) of structures (`MetaDataContainer`).
- *
  *        `activeLabels` contains all valid labels.
- *        Even when a label is `deactivateLabel`-ed, the values remain in `MetaDataContainer`s.
+ *        Even when a label is `deactivateLabel`-ed, its column remains in storage.
  *        The label is only removed from `activeLabels`.
  *
- *        Each data type (int, double, etc) contains its own storage array inside `MetaDataContainer`.
- *        Thus, values in `label_indicess` are NOT unique. Accessing columns via a wrong type is
+ *        Each data type (int, double, etc) has its own list of columns.
+ *        Thus, values in `label_indices` are NOT unique. Accessing columns via a wrong type is
  *        very DANGEROUS. Use `cmake -DMDT_TYPE_CHECK=ON` to enable runtime checks.
  *
  *        Handling of labels unknown to RELION needs care.
@@ -78,21 +80,42 @@ struct CompareStringsBeforeAtAt;
  *
  *        Whenever `activeLabels` is modified, `unknown_label_indices` MUST be updated accordingly.
  *        When the label for a column is EMD_UNKNOWN_LABEL, the corresponding element in
- *        `unknown_label_indices` must store the offset in `unknownLabelNames` and
- *        `MetaDataContainer->unknowns`. Otherwise, the value does not matter.
+ *        `unknown_label_indices` must store the offset in `unknownLabelNames` and `unknowns`.
+ *        Otherwise, the value does not matter.
+ *
+ *        String values are interned in `string_pool`.
+ *        A MetaDataContainer is only a (table, row) reference, not a copy of the row.
+ *
+ *        Tables read from a binary file (readBinary) decode their columns on first use.
+ *        Anything that accesses column storage directly must call `materialise` first
+ *        (`getValueAt` and `setValueAt` do so for their own column).
  */
 class MetaDataTable {
 
-    // Effectively stores all metadata
-    std::vector<MetaDataContainer*> objects;
+    // Number of objects (rows)
+    long nr_objects;
 
-    // Maps labels to corresponding indices in the vectors in MetaDataContainer.
+    // Column storage, one vector per label, indexed by object.
+    // Maps labels to corresponding indices in the column lists.
     // The length of label_indices is always equal to the number of defined labels (~320)
     // e.g.:
     // the value of "defocus-U" for row r is stored in:
-    //	 objects[r]->doubles[label_indices[EMDL::CTF_DEFOCUSU]]
-    // the value of "image name" is stored in:
-    //	 objects[r]->strings[label_indices[EMDL::IMAGE_NAME]]
+    //	 doubles[label_indices[EMDL::CTF_DEFOCUSU]][r]
+    // the value of "image name" for row r is:
+    //	 string_pool[strings[label_indices[EMDL::IMAGE_NAME]][r]]
+    // (mutable, because columns read from a binary file are decoded on first use, see `lazy`)
+    mutable std::vector<std::vector<double>> doubles;  // Extended precision
+    mutable std::vector<std::vector<long>> ints;       // Extended precision
+    mutable std::vector<std::vector<unsigned char>> bools;  // Not vector<bool>, so rows can be written concurrently
+    mutable std::vector<std::vector<StringPool::id_t>> strings;
+    mutable std::vector<std::vector<std::vector<double>>> doubleVectors;
+    mutable std::vector<std::vector<std::string>> unknowns;
+
+    mutable StringPool string_pool;
+
+    // Columns that are still in the binary file this table was read from (empty until decoded)
+    LazyColumns lazy;
+
     std::vector<long> label_indices;
 
     /** What labels have been read from a docfile/metadata file
@@ -119,10 +142,6 @@ class MetaDataTable {
 
     MetaDataTable();
 
-    // Copy constructor
-    // Fill the new table with *copies* of all objects
-    MetaDataTable(const MetaDataTable &c);
-
     static MetaDataTable from_filename(
         const FileName &filename, const std::string &name = "", bool do_only_count = false
     ) {
@@ -131,18 +150,14 @@ class MetaDataTable {
         return mdt;
     }
 
-    MetaDataTable& operator = (const MetaDataTable &MD);
-
-    ~MetaDataTable();
-
     // Is this a 1D list (as opposed to a 2D table)?
     bool isList;
 
-    inline bool empty() const { return objects.empty(); }
+    inline bool empty() const { return nr_objects == 0; }
 
-    inline size_t size() const { return objects.size(); }
+    inline size_t size() const { return nr_objects; }
 
-    inline void reserve(size_t capacity) { objects.reserve(capacity); }
+    void reserve(size_t capacity);
 
     void clear();
 
@@ -166,9 +181,16 @@ class MetaDataTable {
 
     template <typename Comparison>
     void newSort(EMDL::EMDLabel label) {
-        std::stable_sort(objects.begin(), objects.end(), Comparison(label_indices[label]));
+        materialise();
+        std::vector<long> order (size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), Comparison(*this, label_indices[label]));
+        permute(order);
     }
 
+    // Reorder the objects, such that object i becomes the old object order[i]
+    void permute(const std::vector<long> &order);
+
     // Does 'activeLabels' contain 'label'?
     bool containsLabel(EMDL::EMDLabel label, const std::string &unknownLabel="") const;
 
@@ -186,8 +208,11 @@ class MetaDataTable {
     // Append all rows from 'app' to the end of the table and insert all missing labels.
     void append(const MetaDataTable &app);
 
-    // Get metadata container at index i
-    MetaDataContainer* getObject(long int i) const;
+    // Append the given rows of 'src' to the end of the table and insert all missing labels.
+    void appendRows(const MetaDataTable &src, const std::vector<long> &rows);
+
+    // Get a reference to object i
+    MetaDataContainer getObject(long int i) const;
 
     /* setObject(data, i)
      *  copies values from 'data' to object 'i'.
@@ -196,7 +221,7 @@ class MetaDataTable {
      *  Undefined labels are inserted.
      *
      *  Use addObject() to set an object that does not yet exist */
-    void setObject(MetaDataContainer* data, long int i);
+    void setObject(const MetaDataContainer &data, long int i);
 
     /* setValuesOfDefinedLabels(data, i)
      * copies values from 'data' to object 'i'.
@@ -205,7 +230,7 @@ class MetaDataTable {
      * Only already defined labels are considered.
      *
      * Use addValuesOfDefinedLabels() to add an object that does not yet exist */
-    void setValuesOfDefinedLabels(MetaDataContainer* data, long i);
+    void setValuesOfDefinedLabels(const MetaDataContainer &data, long i);
 
     /* addObject()
      *  Adds a new object and initializes the defined labels with default values.
@@ -216,13 +241,13 @@ class MetaDataTable {
      *  Adds a new object and sets its values to those from 'data'.
      *  The set of labels for the table is extended as necessary.
      */
-    long int addObject(MetaDataContainer* data);
+    long int addObject(const MetaDataContainer &data);
 
     /* addValuesOfDefinedLabels(data)
      *  Adds a new object and sets the already defined values to those from 'data'.
      *  Labels from 'data' that are not already defined are ignored.
      */
-    void addValuesOfDefinedLabels(MetaDataContainer* data);
+    void addValuesOfDefinedLabels(const MetaDataContainer &data);
 
     void removeObject(long i);
 
@@ -279,12 +304,36 @@ class MetaDataTable {
     // Read a MetaDataTable (get file format from extension)
     long int read(const FileName &filename, const std::string &name = "", bool do_only_count = false);
 
+    /* Read a MetaDataTable from a binary metadata file (see writeBinary)
+     *
+     * The file is memory-mapped and each column is only decoded when it is first used,
+     * so reading a few columns of a large table costs little more than their size.
+     * If fn_source is given, the table must have been written as a copy of that STAR file as it is now
+     * (see writeBinary), or an error is reported.
+     * Returns like readStar.
+     */
+    long int readBinary(
+        const FileName &filename, const std::string &name = "", bool do_only_count = false,
+        const FileName &fn_source = ""
+    );
+
     // Write a MetaDataTable in STAR format
     void write(std::ostream &out = std::cout);
 
-    // Write to a single file
+    // Write to a single file (in binary format if the extension is .bin)
     void write(const FileName &fn_out);
 
+    /* Append a MetaDataTable to a binary metadata file
+     *
+     * Each table is a header (name, labels and where their columns are)
+     * followed by its columns, stored one after the other.
+     * Several tables can be written to one file, like data blocks in a STAR file.
+     * If the table is a copy of the STAR file fn_source (which has to be written first),
+     * its size, modification time and inode are recorded, so that read() only uses the copy while they match.
+     * The stream must be seekable and opened in binary mode.
+     */
+    void writeBinary(std::ostream &out, const FileName &fn_source = "");
+
     void printLabels(std::ostream &ost);
 
     // Randomise the order inside the STAR file
@@ -304,11 +353,61 @@ class MetaDataTable {
 
     inline bool checkBounds(long int i) const { return 0 <= i && i < size(); }
 
+    // Grow or shrink all columns to n objects (new objects get default values)
+    void resizeObjects(long n);
+
+    // Decode column off of the given kind if it is still lazy
+    inline void materialise(LazyColumns::Kind kind, long off) const {
+        if (!lazy.empty() && lazy.pending(kind, off)) decodeColumn(kind, off);
+    }
+
+    // Decode all lazy columns (before operations on whole objects)
+    void materialise() const;
+
+    void decodeColumn(LazyColumns::Kind kind, long off) const;
+
+    // Drop the strings that are no longer in any cell from the pool (renumbering the others),
+    // once they could outnumber the cells. Call after interning new strings.
+    void compactStringsIfSparse();
+
+    // Add the label named on a "_rlnSomeLabel #1" line of a STAR loop header
+    void addLabelFromStar(const std::string &line);
+
+    /* Read a STAR loop structure from memory, starting after the "loop_" line.
+     *  The header is read serially and the rows by several threads in parallel.
+     */
+    long int readStarLoop(const char *begin, const char *end, bool do_only_count = false);
+
+    template <typename T>
+    T getValueAt(long off, long i) const;
+
+    void setValueAt(long off, long i, double src);
+    void setValueAt(long off, long i, float src);
+    void setValueAt(long off, long i, int src);
+    void setValueAt(long off, long i, long src);
+    void setValueAt(long off, long i, bool src);
+    void setValueAt(long off, long i, const std::string &src);
+    void setValueAt(long off, long i, const std::vector<double> &src);
+    void setValueAt(long off, long i, const std::vector<float> &src);
+
+    /* copyObjects(src, n, src_row, dest)
+     *  Copy n objects from src (object src_row(k) for k = 0 ... n - 1)
+     *  into this table (objects dest ... dest + n - 1).
+     *  Only labels present in both tables are copied. */
+    template <typename RowIndex>
+    void copyObjects(const MetaDataTable &src, long n, RowIndex src_row, long dest);
+
     /* setObjectUnsafe(data)
      *  Same as setObject, but assumes that all labels are present. */
-    void setObjectUnsafe(MetaDataContainer *data, long objId);
+    void setObjectUnsafe(const MetaDataContainer &data, long objId);
 
     friend struct PlotMetaData;
+    friend struct MD::CompareAt;
+    friend struct MD::CompareDoublesAt;
+    friend struct MD::CompareIntsAt;
+    friend struct MD::CompareStringsAt;
+    friend struct MD::CompareStringsAfterAtAt;
+    friend struct MD::CompareStringsBeforeAtAt;
 
 };
 
@@ -395,7 +494,7 @@ T MetaDataTable::getValue(EMDL::EMDLabel label, long i) const {
         REPORT_ERROR((std::string) __func__ + ": Out of bounds!"
             "(no " + std::to_string(i) + "th object in collection of " + std::to_string(size()) + " objects)");
 
-    return objects[i]->getValue<T>(off);
+    return getValueAt<T>(off, i);
 }
 
 
@@ -424,20 +523,22 @@ void MetaDataTable::setValue(EMDL::EMDLabel label, const T &value, long int i) {
 
     if (off < 0) throw "Negative offset";
 
-    objects[i]->setValue(off, value);
+    setValueAt(off, i, value);
 }
 
 // Comparators used for sorting (essentially lambdas)
+// They compare two object indices by the values in column i
 namespace MD {
 
 struct CompareAt {
 
+    const MetaDataTable &mdt;
     long i;
 
-    CompareAt(long i): i(i) {}
+    CompareAt(const MetaDataTable &mdt, long i): mdt(mdt), i(i) {}
 
     // Dummy implementation
-    bool operator()(MetaDataContainer *lh, MetaDataContainer *rh) const { return true; }
+    bool operator()(long lh, long rh) const { return true; }
 
 };
 
@@ -445,8 +546,8 @@ struct CompareDoublesAt: public CompareAt {
 
     using CompareAt::CompareAt;
 
-    bool operator()(MetaDataContainer *lh, MetaDataContainer *rh) const {
-        return lh->doubles[i] < rh->doubles[i];
+    bool operator()(long lh, long rh) const {
+        return mdt.doubles[i][lh] < mdt.doubles[i][rh];
     }
 
 };
@@ -455,8 +556,8 @@ struct CompareIntsAt: public CompareAt {
 
     using CompareAt::CompareAt;
 
-    bool operator()(MetaDataContainer *lh, MetaDataContainer *rh) const {
-        return lh->ints[i] < rh->ints[i];
+    bool operator()(long lh, long rh) const {
+        return mdt.ints[i][lh] < mdt.ints[i][rh];
     }
 
 };
@@ -465,8 +566,8 @@ struct CompareStringsAt: public CompareAt {
 
     using CompareAt::CompareAt;
 
-    bool operator()(MetaDataContainer *lh, MetaDataContainer *rh) const {
-        return lh->strings[i] < rh->strings[i];
+    bool operator()(long lh, long rh) const {
+        return mdt.string_pool[mdt.strings[i][lh]] < mdt.string_pool[mdt.strings[i][rh]];
     }
 
 };
@@ -475,9 +576,9 @@ struct CompareStringsAfterAtAt: public CompareAt {
 
     using CompareAt::CompareAt;
 
-    bool operator()(MetaDataContainer *lh, MetaDataContainer *rh) const {
-        std::string slh = lh->strings[i];
-        std::string srh = rh->strings[i];
+    bool operator()(long lh, long rh) const {
+        const std::string &slh = mdt.string_pool[mdt.strings[i][lh]];
+        const std::string &srh = mdt.string_pool[mdt.strings[i][rh]];
         return slh.substr(slh.find("@") + 1) < srh.substr(srh.find("@") + 1);
     }
 
@@ -487,9 +588,9 @@ struct CompareStringsBeforeAtAt: public CompareAt {
 
     using CompareAt::CompareAt;
 
-    bool operator()(MetaDataContainer *lh, MetaDataContainer *rh) const {
-        std::string slh = lh->strings[i];
-        std::string srh = rh->strings[i];
+    bool operator()(long lh, long rh) const {
+        const std::string &slh = mdt.string_pool[mdt.strings[i][lh]];
+        const std::string &srh = mdt.string_pool[mdt.strings[i][rh]];
         std::stringstream stslh, stsrh;
         stslh << slh.substr(0, slh.find("@"));
         stsrh << srh.substr(0, srh.find("@"));
@@ -1312,9 +1312,45 @@ void MlWsumModel::initZeros() {
 #define MAX_PACK_SIZE 671010000
 #endif
 
-void MlWsumModel::pack(MultidimArray<RFLOAT> &packed) {
+namespace {
+
+    // Call f(offset, length) for the runs of consecutive elements of bp.data (and of bp.weight, which has the same shape) that are packed.
+    // With within_rmax, these are only the elements within r_max (in the padded grid) plus the reach of the interpolation kernel,
+    // because backprojection leaves everything beyond that zero.
+    template <typename F>
+    void forEachPackedRun(const BackProjector &bp, bool within_rmax, F f) {
+        const MultidimArray<Complex> &data = bp.data;
+        if (!within_rmax) {
+            f(0, (long int) data.size());
+            return;
+        }
+        const long int r = round(bp.r_max * bp.padding_factor) + 2;
+        const long int r2 = r * r;
+        for (long int k = 0; k < data.zdim; k++)
+        for (long int i = 0; i < data.ydim; i++) {
+            const long int z = k + data.zinit, y = i + data.yinit;
+            const long int yz2 = y * y + z * z;
+            if (yz2 > r2) continue;
+            const long int s = floor(sqrt((RFLOAT) (r2 - yz2)));
+            const long int jmin = std::max(-s - (long int) data.xinit, 0L);
+            const long int jmax = std::min( s - (long int) data.xinit, (long int) data.xdim - 1);
+            if (jmin <= jmax)
+                f((k * data.ydim + i) * data.xdim + jmin, jmax - jmin + 1);
+        }
+    }
+
+    unsigned long long packedBPrefSize(const BackProjector &bp, bool within_rmax) {
+        unsigned long long size = 0;
+        forEachPackedRun(bp, within_rmax, [&size] (long int offset, long int length) { size += length; });
+        return size;
+    }
+
+}
+
+void MlWsumModel::pack(MultidimArray<RFLOAT> &packed, bool within_rmax) {
     unsigned long long packed_size = 0;
     int spectral_size = ori_size / 2 + 1;
+    const unsigned long long bpref_size = packedBPrefSize(BPref[0], within_rmax);
 
     // for LL & avePmax & sigma2_offset & avg_norm_correction & sigma2_rot & sigma2_tilt & sigma2_psi
     packed_size += 7 ;
@@ -1324,8 +1360,8 @@ void MlWsumModel::pack(MultidimArray<RFLOAT> &packed) {
     packed_size += 3 * nr_groups;
     // for all class-related stuff
     // data is complex: multiply by two!
-    packed_size += nr_classes * nr_bodies * 2 * (unsigned long long) BPref[0].getSize();
-    packed_size += nr_classes * nr_bodies *     (unsigned long long) BPref[0].getSize();
+    packed_size += nr_classes * nr_bodies * 2 * bpref_size;
+    packed_size += nr_classes * nr_bodies *     bpref_size;
     packed_size += nr_classes * nr_bodies *     (unsigned long long) nr_directions;
     // for pdf_class
     packed_size += nr_classes;
@@ -1358,17 +1394,21 @@ void MlWsumModel::pack(MultidimArray<RFLOAT> &packed) {
 
     }
     for (int iclass = 0; iclass < nr_classes * nr_bodies; iclass++) {
+        BackProjector &bp = BPref[iclass];
 
-        for (auto &x : BPref[iclass].data) {
-            packed[idx++] = x.real;
-            packed[idx++] = x.imag;
-        }
-        BPref[iclass].data.clear();
+        forEachPackedRun(bp, within_rmax, [&] (long int offset, long int length) {
+            for (long int n = offset; n < offset + length; n++) {
+                packed[idx++] = bp.data[n].real;
+                packed[idx++] = bp.data[n].imag;
+            }
+        });
+        forEachPackedRun(bp, within_rmax, [&] (long int offset, long int length) {
+            for (long int n = offset; n < offset + length; n++)
+                packed[idx++] = bp.weight[n];
+        });
+        bp.data.clear();
+        bp.weight.clear();
 
-        for (auto &x : BPref[iclass].weight) {
-            packed[idx++] = x;
-        }
-        BPref[iclass].weight.clear();
         for (auto &x : pdf_direction[iclass]) {
             packed[idx++] = x;
         }
@@ -1394,7 +1434,7 @@ void MlWsumModel::pack(MultidimArray<RFLOAT> &packed) {
     }
 
 }
-void MlWsumModel::unpack(MultidimArray<RFLOAT> &packed) {
+void MlWsumModel::unpack(MultidimArray<RFLOAT> &packed, bool within_rmax) {
 
     unsigned long long idx = 0;
     int spectral_size = ori_size / 2 + 1;
@@ -1418,14 +1458,23 @@ void MlWsumModel::unpack(MultidimArray<RFLOAT> &packed) {
     }
 
     for (int iclass = 0; iclass < nr_classes * nr_bodies; iclass++) {
-        BPref[iclass].initialiseDataAndWeight(current_size);
-        for (auto &x : BPref[iclass].data) {
-            x.real = packed[idx++];
-            x.imag = packed[idx++];
-        }
-        for (auto &x : BPref[iclass].weight) {
-            x = packed[idx++];
+        BackProjector &bp = BPref[iclass];
+        // Whatever is not in packed is zero
+        if (within_rmax) {
+            bp.initZeros(current_size);
+        } else {
+            bp.initialiseDataAndWeight(current_size);
         }
+        forEachPackedRun(bp, within_rmax, [&] (long int offset, long int length) {
+            for (long int n = offset; n < offset + length; n++) {
+                bp.data[n].real = packed[idx++];
+                bp.data[n].imag = packed[idx++];
+            }
+        });
+        forEachPackedRun(bp, within_rmax, [&] (long int offset, long int length) {
+            for (long int n = offset; n < offset + length; n++)
+                bp.weight[n] = packed[idx++];
+        });
         pdf_direction[iclass].resize(nr_directions);
         for (auto &x : pdf_direction[iclass]) {
             x = packed[idx++];
@@ -1452,7 +1501,7 @@ void MlWsumModel::unpack(MultidimArray<RFLOAT> &packed) {
 }
 
 
-void MlWsumModel::pack(MultidimArray<RFLOAT> &packed, int &piece, int &nr_pieces, bool do_clear) {
+void MlWsumModel::pack(MultidimArray<RFLOAT> &packed, int &piece, int &nr_pieces, bool do_clear, bool within_rmax) {
 
 
     // Determine size of the packed array
@@ -1462,6 +1511,7 @@ void MlWsumModel::pack(MultidimArray<RFLOAT> &packed, int &piece, int &nr_pieces
     unsigned long long spectral_size = ori_size / 2 + 1;
     unsigned long long packed_size = 0;
     unsigned long long idx_start, idx_stop;
+    const unsigned long long bpref_size = packedBPrefSize(BPref[0], within_rmax);
 
     // for LL & avePmax & sigma2_offset & avg_norm_correction & sigma2_rot & sigma2_tilt & sigma2_psi
     packed_size += 7;
@@ -1471,8 +1521,8 @@ void MlWsumModel::pack(MultidimArray<RFLOAT> &packed, int &piece, int &nr_pieces
     packed_size += 3 * nr_groups; // wsum_signal_product, wsum_reference_power, sumw_group
     // for all class-related stuff
     // data is complex: multiply by two!
-    packed_size += nr_classes_bodies * 2 * (unsigned long long) BPref[0].getSize(); // BPref.data
-    packed_size += nr_classes_bodies *     (unsigned long long) BPref[0].getSize(); // BPref.weight
+    packed_size += nr_classes_bodies * 2 * bpref_size; // BPref.data
+    packed_size += nr_classes_bodies *     bpref_size; // BPref.weight
     packed_size += nr_classes_bodies *     (unsigned long long) nr_directions; // pdf_directions
     // for pdf_class
     packed_size += nr_classes;
@@ -1544,22 +1594,26 @@ void MlWsumModel::pack(MultidimArray<RFLOAT> &packed, int &piece, int &nr_pieces
 
     }
     for (int iclass = 0; iclass < nr_classes_bodies; iclass++) {
-        for (auto &x : BPref[iclass].data) {
-            if (ori_idx >= idx_start && ori_idx < idx_stop) { packed[idx++] = x.real; }
-            ori_idx++;
-            if (ori_idx >= idx_start && ori_idx < idx_stop) { packed[idx++] = x.imag; }
-            ori_idx++;
-        }
-        // Only clear after the whole array has been packed... i.e. not when we reached the pack_size halfway through
-        if (idx == ori_idx && do_clear)
-            BPref[iclass].data.clear();
-
-        for (auto &x : BPref[iclass].weight) {
-            if (ori_idx >= idx_start && ori_idx < idx_stop) { packed[idx++] = x; }
-            ori_idx++;
+        BackProjector &bp = BPref[iclass];
+        forEachPackedRun(bp, within_rmax, [&] (long int offset, long int length) {
+            for (long int n = offset; n < offset + length; n++) {
+                if (ori_idx >= idx_start && ori_idx < idx_stop) { packed[idx++] = bp.data[n].real; }
+                ori_idx++;
+                if (ori_idx >= idx_start && ori_idx < idx_stop) { packed[idx++] = bp.data[n].imag; }
+                ori_idx++;
+            }
+        });
+        forEachPackedRun(bp, within_rmax, [&] (long int offset, long int length) {
+            for (long int n = offset; n < offset + length; n++) {
+                if (ori_idx >= idx_start && ori_idx < idx_stop) { packed[idx++] = bp.weight[n]; }
+                ori_idx++;
+            }
+        });
+        // Only clear after the whole arrays have been packed... i.e. not when we reached the pack_size halfway through
+        if (idx == ori_idx && do_clear) {
+            bp.data.clear();
+            bp.weight.clear();
         }
-        if (idx == ori_idx && do_clear)
-            BPref[iclass].weight.clear();
 
         for (auto &x : pdf_direction[iclass]) {
             if (ori_idx >= idx_start && ori_idx < idx_stop) { packed[idx++] = x; }
@@ -1598,7 +1652,7 @@ void MlWsumModel::pack(MultidimArray<RFLOAT> &packed, int &piece, int &nr_pieces
 
 }
 
-void MlWsumModel::unpack(MultidimArray<RFLOAT> &packed, int piece, bool do_clear) {
+void MlWsumModel::unpack(MultidimArray<RFLOAT> &packed, int piece, bool do_clear, bool within_rmax) {
 
     int nr_groups = sigma2_noise.size();
     int nr_classes_bodies = BPref.size();
@@ -1655,24 +1709,34 @@ void MlWsumModel::unpack(MultidimArray<RFLOAT> &packed, int piece, bool do_clear
     }
 
     for (int iclass = 0; iclass < nr_classes_bodies; iclass++) {
-        if (idx == ori_idx)
-            BPref[iclass].initialiseDataAndWeight(current_size);
-        for (auto &x : BPref[iclass].data) {
-            if (ori_idx >= idx_start && ori_idx < idx_stop)
-                x.real = packed[idx++];
-            ori_idx++;
-
-            if (ori_idx >= idx_start && ori_idx < idx_stop)
-                x.imag = packed[idx++];
-            ori_idx++;
-            // x = Complex(re, im);
+        BackProjector &bp = BPref[iclass];
+        if (idx == ori_idx) {
+            // Whatever is not in packed is zero
+            if (within_rmax) {
+                bp.initZeros(current_size);
+            } else {
+                bp.initialiseDataAndWeight(current_size);
+            }
         }
+        forEachPackedRun(bp, within_rmax, [&] (long int offset, long int length) {
+            for (long int n = offset; n < offset + length; n++) {
+                if (ori_idx >= idx_start && ori_idx < idx_stop)
+                    bp.data[n].real = packed[idx++];
+                ori_idx++;
+
+                if (ori_idx >= idx_start && ori_idx < idx_stop)
+                    bp.data[n].imag = packed[idx++];
+                ori_idx++;
+            }
+        });
 
-        for (auto &x : BPref[iclass].weight) {
-            if (ori_idx >= idx_start && ori_idx < idx_stop)
-                x = packed[idx++];
-            ori_idx++;
-        }
+        forEachPackedRun(bp, within_rmax, [&] (long int offset, long int length) {
+            for (long int n = offset; n < offset + length; n++) {
+                if (ori_idx >= idx_start && ori_idx < idx_stop)
+                    bp.weight[n] = packed[idx++];
+                ori_idx++;
+            }
+        });
 
         if (idx == ori_idx)
             pdf_direction[iclass].resize(nr_directions);
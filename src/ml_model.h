@@ -481,19 +481,21 @@ class MlWsumModel: public MlModel {
 
     // Pack entire structure into one large MultidimArray<RFLOAT> for reading/writing to disc
     // To save memory, the model itself will be cleared after packing.
-    void pack(MultidimArray<RFLOAT> &packed);
+    // With within_rmax, only the parts of the BPref arrays that backprojection can reach (within their r_max) are packed,
+    // which unpack (also with within_rmax) then fills in, zeroing the rest.
+    void pack(MultidimArray<RFLOAT> &packed, bool within_rmax=false);
 
     // Fill the model again using unpack (this is the inverse operation from pack)
-    void unpack(MultidimArray<RFLOAT> &packed);
+    void unpack(MultidimArray<RFLOAT> &packed, bool within_rmax=false);
 
     // Pack entire structure into one large MultidimArray<RFLOAT> for shipping over with MPI
     // To save memory, the model itself will be cleared after packing.
     // If the whole thing becomes bigger than 1Gb (see MAX_PACK_SIZE in ml_model.cpp), then break it up into pieces because MPI cannot handle very large messages
     // When broken up: nr_pieces > 1
-    void pack(MultidimArray<RFLOAT> &packed, int &piece, int &nr_pieces, bool do_clear=true);
+    void pack(MultidimArray<RFLOAT> &packed, int &piece, int &nr_pieces, bool do_clear=true, bool within_rmax=false);
 
     // Fill the model again using unpack (this is the inverse operation from pack)
-    void unpack(MultidimArray<RFLOAT> &packed, int piece, bool do_clear=true);
+    void unpack(MultidimArray<RFLOAT> &packed, int piece, bool do_clear=true, bool within_rmax=false);
 
 };
 
@@ -35,6 +35,7 @@
 #include "src/error.h"
 #include "src/ml_optimiser.h"
 #include "src/jaz/ctf_helper.h"
+#include "src/fftw_plans.h"
 #ifdef CUDA
     #include "src/acc/cuda/cuda_ml_optimiser.h"
     #include <nvToolsExt.h>
@@ -226,6 +227,7 @@ void MlOptimiser::read(int argc, char **argv, int rank) {
         // Do this before reading in the data.star file below!
         do_preread_images   = checkParameter(argc, argv, "--preread_images");
         do_parallel_disc_io = !checkParameter(argc, argv, "--no_parallel_disc_io");
+        mydata.compressed_images.format = ParticleImageCache::formatFromString(getParameter(argc, argv, "--preread_compress", ""));
 
         parser.addSection("Continue options");
         FileName fn_in = parser.getOption("--continue", "_optimiser.star file of the iteration after which to continue");
@@ -484,18 +486,25 @@ void MlOptimiser::parseContinue(int argc, char **argv) {
     x_pool = textToInteger(parser.getOption("--pool", "Number of images to pool for each thread task", "1"));
     nr_threads = textToInteger(parser.getOption("--j", "Number of threads to run in parallel (only useful on multi-core machines)", "1"));
     do_parallel_disc_io = !parser.checkOption("--no_parallel_disc_io", "Do NOT let parallel (MPI) processes access the disc simultaneously (use this option with NFS)");
+    do_write_binary_data = parser.checkOption("--binary_data", "Also write each _data.star as a binary copy (_data.star.bin), which is faster to read for subsequent jobs");
+    prefetch_depth = textToInteger(parser.getOption("--prefetch", "Number of batches of particle image files to read ahead on an I/O thread (0: no read-ahead). Only the reads are overlapped (not the FFTs or CTFs); 2D images only, and not with MPI, --preread_images or --no_parallel_disc_io", "0"));
     combine_weights_thru_disc = !parser.checkOption("--dont_combine_weights_via_disc", "Send the large arrays of summed weights through the MPI network, instead of writing large files to disc");
     do_shifts_onthefly = parser.checkOption("--onthefly_shifts", "Calculate shifted images on-the-fly, do not store precalculated ones in memory");
     do_preread_images  = parser.checkOption("--preread_images", "Use this to let the leader process read all particles into memory. Be careful you have enough RAM for large data sets!");
+    mydata.compressed_images.format = ParticleImageCache::formatFromString(parser.getOption("--preread_compress", "Keep pre-read particles in RAM as float16 or lossless (zlib) compressed images; with MPI, one copy per host is shared by its ranks", ""));
     fn_scratch = parser.getOption("--scratch_dir", "If provided, particle stacks will be copied to this local scratch disk prior to refinement.", "");
     keep_free_scratch_Gb = textToFloat(parser.getOption("--keep_free_scratch", "Space available for copying particle stacks (in Gb)", "10"));
     do_reuse_scratch = parser.checkOption("--reuse_scratch", "Re-use data on scratchdir, instead of wiping it and re-copying all data. This works only when ALL particles have already been cached.");
     keep_scratch = parser.checkOption("--keep_scratch", "Don't remove scratch after convergence. Following jobs that use EXACTLY the same particles should use --reuse_scratch.");
+    do_resume_scratch = parser.checkOption("--resume_scratch", "Resume an interrupted copy of the same particles to the scratch dir, instead of wiping it and re-copying all data");
+    do_background_scratch = parser.checkOption("--background_scratch", "Copy the particles to the scratch dir in the background, and start refining on the optics groups that have been copied");
 
     #ifdef ALTCPU
     do_cpu = parser.checkOption("--cpu", "Use intel vectorisation implementation for CPU");
+    cpu_bp_buffer_mb = textToInteger(parser.getOption("--cpu_bp_buffer", "Size of the backprojection buffer of each CPU thread (in MB); the default of 0 shares the reconstruction between threads with locks", "0"));
     #else
     do_cpu = false;
+    cpu_bp_buffer_mb = 0;
     #endif
 
     failsafe_threshold = textToInteger(parser.getOption("--failsafe_threshold", "Maximum number of particles permitted to be drop, due to zero sum of weights, before exiting with an error (GPU only).", "40"));
@@ -755,16 +764,23 @@ void MlOptimiser::parseInitial(int argc, char **argv) {
     combine_weights_thru_disc = !parser.checkOption("--dont_combine_weights_via_disc", "Send the large arrays of summed weights through the MPI network, instead of writing large files to disc");
     do_shifts_onthefly = parser.checkOption("--onthefly_shifts", "Calculate shifted images on-the-fly, do not store precalculated ones in memory");
     do_parallel_disc_io = !parser.checkOption("--no_parallel_disc_io", "Do NOT let parallel (MPI) processes access the disc simultaneously (use this option with NFS)");
+    do_write_binary_data = parser.checkOption("--binary_data", "Also write each _data.star as a binary copy (_data.star.bin), which is faster to read for subsequent jobs");
+    prefetch_depth = textToInteger(parser.getOption("--prefetch", "Number of batches of particle image files to read ahead on an I/O thread (0: no read-ahead). Only the reads are overlapped (not the FFTs or CTFs); 2D images only, and not with MPI, --preread_images or --no_parallel_disc_io", "0"));
     do_preread_images  = parser.checkOption("--preread_images", "Use this to let the leader process read all particles into memory. Be careful you have enough RAM for large data sets!");
+    mydata.compressed_images.format = ParticleImageCache::formatFromString(parser.getOption("--preread_compress", "Keep pre-read particles in RAM as float16 or lossless (zlib) compressed images; with MPI, one copy per host is shared by its ranks", ""));
     fn_scratch = parser.getOption("--scratch_dir", "If provided, particle stacks will be copied to this local scratch disk prior to refinement.", "");
     keep_free_scratch_Gb = textToFloat(parser.getOption("--keep_free_scratch", "Space available for copying particle stacks (in Gb)", "10"));
     do_reuse_scratch = parser.checkOption("--reuse_scratch", "Re-use data on scratchdir, instead of wiping it and re-copying all data.");
     keep_scratch = parser.checkOption("--keep_scratch", "Don't remove scratch after convergence. Following jobs that use EXACTLY the same particles should use --reuse_scratch.");
+    do_resume_scratch = parser.checkOption("--resume_scratch", "Resume an interrupted copy of the same particles to the scratch dir, instead of wiping it and re-copying all data");
+    do_background_scratch = parser.checkOption("--background_scratch", "Copy the particles to the scratch dir in the background, and start refining on the optics groups that have been copied");
     do_fast_subsets = parser.checkOption("--fast_subsets", "Use faster optimisation by using subsets of the data in the first 15 iterations");
     #ifdef ALTCPU
     do_cpu = parser.checkOption("--cpu", "Use intel vectorisation implementation for CPU");
+    cpu_bp_buffer_mb = textToInteger(parser.getOption("--cpu_bp_buffer", "Size of the backprojection buffer of each CPU thread (in MB); the default of 0 shares the reconstruction between threads with locks", "0"));
     #else
     do_cpu = false;
+    cpu_bp_buffer_mb = 0;
     #endif
 
     do_gpu = parser.checkOption("--gpu", "Use available gpu resources for some calculations");
@@ -1037,9 +1053,10 @@ void MlOptimiser::read(FileName fn_in, int rank, bool do_prevent_preread) {
     #ifdef DEBUG_READ
     std::cerr<<"MlOptimiser::readStar before data."<<std::endl;
     #endif
-    bool do_preread = do_preread_images && !do_prevent_preread && (do_parallel_disc_io || rank == 0);
+    bool do_preread = !do_prevent_preread && doPrereadImagesOnRank(rank);
     bool is_helical_segment = do_helical_refine || mymodel.ref_dim == 2 && helical_tube_outer_diameter > 0.0;
     mydata.read(fn_data, false, false, do_preread, is_helical_segment);
+    if (verb > 0) printPrereadImagesSize();
 
     #ifdef DEBUG_READ
     std::cerr << "MlOptimiser::readStar before model." << std::endl;
@@ -1215,7 +1232,7 @@ void MlOptimiser::write(bool do_write_sampling, bool do_write_data, bool do_writ
 
     // And write the mydata to file
     if (do_write_data)
-        mydata.write(fn_root);
+        mydata.write(fn_root, do_write_binary_data);
 
     // And write the sampling object
     if (do_write_sampling)
@@ -1322,7 +1339,7 @@ void MlOptimiser::initialise() {
 
     // And allow plans before expectation to run using allowed
     // number of threads
-    fftw_plan_with_nthreads(nr_threads);
+    FftwPlans::setThreads(nr_threads);
     #endif
 
     if (!fn_sigma.empty()) {
@@ -1602,10 +1619,11 @@ void MlOptimiser::initialiseGeneral(int rank) {
     if (iter == 0) {
         // Read in the experimental image metadata
         // If do_preread_images: only the leader reads all images into RAM
-        bool do_preread = do_preread_images ? do_parallel_disc_io || rank == 0 : false;
+        bool do_preread = doPrereadImagesOnRank(rank);
         bool is_helical_segment = do_helical_refine || mymodel.ref_dim == 2 && helical_tube_outer_diameter > 0.0;
         int myverb = rank == 0;
         mydata.read(fn_data, true, false, do_preread, is_helical_segment, myverb); // true means ignore original particle name
+        if (myverb > 0) printPrereadImagesSize();
 
         // Read in the reference(s) and initialise mymodel
         int refdim = fn_ref == "denovo" ? 3 : 2;
@@ -2003,9 +2021,9 @@ void MlOptimiser::initialiseWorkLoad() {
         mydata.setScratchDirectory(fn_scratch, do_reuse_scratch, 1);
 
         if (!do_reuse_scratch) {
-            mydata.prepareScratchDirectory(fn_scratch);
+            mydata.prepareScratchDirectory(fn_scratch, "", do_resume_scratch);
             bool also_do_ctfimage = (mymodel.data_dim == 3 && do_ctf_correction);
-            mydata.copyParticlesToScratch(1, true, also_do_ctfimage, keep_free_scratch_Gb);
+            mydata.copyParticlesToScratch(1, true, also_do_ctfimage, keep_free_scratch_Gb, nr_threads, do_resume_scratch, do_background_scratch);
         }
     }
 }
@@ -2038,9 +2056,6 @@ void MlOptimiser::calculateSumOfPowerSpectraAndAverageImage(MultidimArray<RFLOAT
         barstep = std::max(1, my_nr_particles / 60);
     }
 
-    // Only open stacks once and then read multiple images
-    fImageHandler hFile;
-
     // Note the loop over the particles (part_id) is MPI-parallelized
     int nr_particles_done = 0;
     FileName fn_img;
@@ -2068,7 +2083,7 @@ void MlOptimiser::calculateSumOfPowerSpectraAndAverageImage(MultidimArray<RFLOAT
             // Read image from disc
             Image<RFLOAT> img;
             if (do_preread_images && do_parallel_disc_io) {
-                img() = mydata.particles[part_id].images[img_id].img;
+                mydata.getPrereadImage(part_id, img_id, img());
             } else {
                 try {
                     fn_img = mydata.getImageNameOnScratch(part_id, img_id);
@@ -2085,15 +2100,8 @@ void MlOptimiser::calculateSumOfPowerSpectraAndAverageImage(MultidimArray<RFLOAT
                     fn_img = MDimg.getValue<std::string>(EMDL::IMAGE_NAME, MDimg.size() - 1);
                 }
 
-                FileName fn_stack;
-                long int dump;
-                fn_img.decompose(dump, fn_stack);
-                FileName fn_open_stack = "";
-                if (fn_stack != fn_open_stack) {
-                    hFile.openFile(fn_stack, WRITE_READONLY);
-                    fn_open_stack = fn_stack;
-                }
-                img.readFromOpenFile(fn_img, hFile, -1, false);
+                // Images in MRC stacks are read through a mapping of the stack shared by all threads
+                img.readMapped(fn_img);
                 img().setXmippOrigin();
             }
 
@@ -2304,7 +2312,9 @@ void MlOptimiser::setSigmaNoiseEstimatesAndSetAverageImage(MultidimArray<RFLOAT>
         for (int iclass = 0; iclass < mymodel.nr_classes * mymodel.nr_bodies; iclass++) {
 
             MultidimArray<RFLOAT> tau2;
-            mymodel.Iref[iclass] = wsum_model.BPref[iclass].reconstruct(gridding_nr_iter, false, tau2);
+            mymodel.Iref[iclass] = wsum_model.BPref[iclass].reconstruct(
+                gridding_nr_iter, false, tau2, 1.0, 1.0, -1, false, nullptr, nr_threads
+            );
             // 2D projection data were CTF-corrected, subtomograms were not
             refs_are_ctf_corrected = mymodel.data_dim != 3;
         }
@@ -2583,7 +2593,7 @@ void MlOptimiser::expectation() {
 
     #ifdef MKLFFT
     // Allow parallel FFTW execution
-    fftw_plan_with_nthreads(nr_threads);
+    FftwPlans::setThreads(nr_threads);
     #endif
 
     // Initialise some stuff
@@ -2729,7 +2739,7 @@ void MlOptimiser::expectation() {
 
     #ifdef MKLFFT
     // Single-threaded FFTW execution for code inside parallel processing loop
-    fftw_plan_with_nthreads(1);
+    FftwPlans::setThreads(1);
     #endif
 
     // Now perform real expectation over all particles
@@ -2755,11 +2765,35 @@ void MlOptimiser::expectation() {
         init_progress_bar(my_nr_particles);
     }
 
+    // The image files of the next batches can be read in the background (expectationSomeParticles reads them otherwise)
+    if (prefetch_depth > 0 && (!do_parallel_disc_io || do_preread_images || mymodel.data_dim == 3)) {
+        if (verb > 0)
+            std::cerr << " WARNING: --prefetch is ignored with --preread_images, --no_parallel_disc_io or 3D data" << std::endl;
+        prefetch_depth = 0;
+    }
+    const bool do_prefetch = prefetch_depth > 0;
+    long int nr_particles_scheduled = 0;
+    if (do_prefetch) exp_prefetcher.start(prefetch_depth);
+
     while (nr_particles_done < my_nr_particles) {
 
         long int my_pool_first_part_id = my_first_part_id + nr_particles_done;
         long int my_pool_last_part_id = std::min(my_last_part_id, my_pool_first_part_id + nr_pool - 1);
 
+        // Keep this batch and the next prefetch_depth batches scheduled
+        while (do_prefetch && nr_particles_scheduled < my_nr_particles && nr_particles_scheduled < nr_particles_done + (prefetch_depth + 1) * nr_pool) {
+            const long int first = my_first_part_id + nr_particles_scheduled;
+            const long int last = std::min(my_last_part_id, first + nr_pool - 1);
+            std::vector<FileName> fn_imgs;
+            for (long int part_id_sorted = first; part_id_sorted <= last; part_id_sorted++) {
+                const long int part_id = mydata.sorted_idx[part_id_sorted];
+                for (int img_id = 0; img_id < mydata.numberOfImagesInParticle(part_id); img_id++)
+                    fn_imgs.push_back(getParticleImageName(part_id, img_id));
+            }
+            exp_prefetcher.schedule(first, fn_imgs);
+            nr_particles_scheduled += last - first + 1;
+        }
+
         {
         ifdefTIMING(TicToc tt (timer, TIMING_EXP_METADATA);)
         // Get the metadata for these particles
@@ -2796,6 +2830,16 @@ void MlOptimiser::expectation() {
     if (verb > 0)
         progress_bar(my_nr_particles);
 
+    if (do_prefetch) {
+        exp_prefetcher.finish();
+        if (verb > 0) {
+            std::cout << " Prefetched images: waited " << exp_prefetcher.stall_time << " sec for " << exp_prefetcher.nr_stalls
+                      << " of " << exp_prefetcher.nr_batches << " batches, computed for " << exp_prefetcher.compute_time << " sec" << std::endl;
+        }
+        exp_prefetcher.stall_time = exp_prefetcher.compute_time = 0;
+        exp_prefetcher.nr_batches = exp_prefetcher.nr_stalls = 0;
+    }
+
     #ifdef CUDA
     if (do_gpu) {
         for (int i = 0; i < accDataBundles.size(); i++) {
@@ -2826,6 +2870,9 @@ void MlOptimiser::expectation() {
 
             for (int j = 0; j < b->coarseProjectionPlans.size(); j++)
                 b->coarseProjectionPlans[j].clear();
+
+            if (verb > 0 && i == 0)
+                b->projectionPlanCache.printStatistics(std::cout);
         }
 
         for (int i = 0; i < cudaOptimisers.size(); i++)
@@ -2880,6 +2927,9 @@ void MlOptimiser::expectation() {
         for (int j = 0; j < b->coarseProjectionPlans.size(); j++)
             b->coarseProjectionPlans[j].clear();
 
+        if (verb > 0)
+            b->projectionPlanCache.printStatistics(std::cout);
+
         delete b;
         accDataBundles.clear();
 
@@ -2896,7 +2946,7 @@ void MlOptimiser::expectation() {
     #ifdef  MKLFFT
     // Allow parallel FFTW execution to continue now that we are outside the parallel
     // portion of expectation
-    fftw_plan_with_nthreads(nr_threads);
+    FftwPlans::setThreads(nr_threads);
     #endif
 
     // Clean up some memory
@@ -3039,10 +3089,10 @@ void MlOptimiser::expectationSetupCheckMemory(int myverb) {
         }
 
         RFLOAT total_mem_Gb_exp = mem_references + nr_pool * mem_pool + mem_rest;
-        // Each reconstruction has to store 1 extra complex array (Fconv) and 4 extra RFLOAT arrays (Fweight, Fnewweight. vol_out and Mconv in convoluteBlobRealSpace),
+        // Each reconstruction has to store 1 extra complex array (Fconv, which is transformed in place) and 2 extra RFLOAT arrays (Fweight and Fnewweight),
         // in adddition to the RFLOAT weight-array and the complex data-array of the BPref
-        // That makes a total of 2*2 + 5 = 9 * a RFLOAT array of size BPref
-        RFLOAT total_mem_Gb_max = Gb * 9 * wsum_model.BPref[0].data.size();
+        // That makes a total of 2*2 + 3 = 7 * a RFLOAT array of size BPref
+        RFLOAT total_mem_Gb_max = Gb * 7 * wsum_model.BPref[0].data.size();
 
         std::cout << " Estimated memory for expectation  step > " << total_mem_Gb_exp << " Gb."<<std::endl;
         std::cout << " Estimated memory for maximization step > " << total_mem_Gb_max << " Gb."<<std::endl;
@@ -3172,12 +3222,11 @@ void MlOptimiser::expectationSomeParticles(
         }
     }
 
-    // Only open/close stacks once
-    fImageHandler hFile;
-
     // Store total number of particle images in this bunch of SomeParticles, and set translations and orientations for skip_align/rotate
     long int my_metadata_offset = 0;
     exp_imgs.clear();
+    const bool is_prefetched = exp_prefetcher.isRunning() && exp_prefetcher.isNext(my_first_part_id);
+    std::vector<FileName> fn_imgs;
     int metadata_offset = 0;
     for (long int part_id_sorted = my_first_part_id; part_id_sorted <= my_last_part_id; part_id_sorted++) {
 
@@ -3229,12 +3278,9 @@ void MlOptimiser::expectationSomeParticles(
 
         // Sjors 7 March 2016 to prevent too high disk access... Read in all pooled images simultaneously
         // Don't do this for sub-tomograms to save RAM!
-        if (do_parallel_disc_io && !do_preread_images && mymodel.data_dim != 3) {
-            // Read in the actual image from disc, only open/close common stacks once
-            // Read in all images, only open/close common stacks once
+        if (do_parallel_disc_io && !do_preread_images && mymodel.data_dim != 3 && !is_prefetched) {
+            // Get the filenames, and read all images below, only opening/closing common stacks once
             for (int img_id = 0; img_id < mydata.numberOfImagesInParticle(part_id); img_id++, my_metadata_offset++) {
-
-                // Get the filename
                 FileName fn_img;
                 try {
                     fn_img = mydata.getImageNameOnScratch(part_id, img_id);
@@ -3243,27 +3289,21 @@ void MlOptimiser::expectationSomeParticles(
                     for (int i = 0; i <= my_metadata_offset; i++)
                         getline(split, fn_img);
                 }
-
-                // Only open again a new stackname
-                FileName fn_stack;
-                long int dump;
-                fn_img.decompose(dump, fn_stack);
-                FileName fn_open_stack = "";
-                if (fn_stack != fn_open_stack) {
-                    hFile.openFile(fn_stack, WRITE_READONLY);
-                    fn_open_stack = fn_stack;
-                }
-                Image<RFLOAT> img;
                 #ifdef DEBUG_BODIES
                 std::cerr << " fn_img= " << fn_img << " part_id= " << part_id << std::endl;
                 #endif
-                img.readFromOpenFile(fn_img, hFile, -1, false);
-                img().setXmippOrigin();
-                exp_imgs.push_back(img());
+                fn_imgs.push_back(fn_img);
             }
         }
     }
 
+    if (is_prefetched) {
+        // Read on the prefetch thread while the previous particles were processed
+        exp_imgs = exp_prefetcher.take(my_first_part_id);
+    } else if (!fn_imgs.empty()) {
+        exp_imgs = readParticleImages(fn_imgs);
+    }
+
 
     #ifdef DEBUG_EXPSOME
     std::cerr << " exp_my_first_part_id= " << exp_my_first_part_id << " exp_my_last_part_id= " << exp_my_last_part_id << std::endl;
@@ -3300,6 +3340,10 @@ void MlOptimiser::expectationSomeParticles(
             cpuOptimiser->expectationOneParticle(i, cpuOptimiser->thread_id);
         });
         //}
+
+        // Add the backprojection buffers of all threads into the reconstructions
+        for (AccBackprojector &backprojector : ((MlDataBundle*) accDataBundles[0])->backprojectors)
+            backprojector.mergeBuffers();
     }
     #endif
 
@@ -3844,7 +3888,9 @@ void MlOptimiser::maximization() {
                         mymodel.tau2_fudge_factor,
                         wsum_model.pdf_class[iclass],
                         minres_map,
-                        iclass == 0
+                        iclass == 0 && verb > 1,
+                        nullptr,
+                        nr_threads
                     );
                 }
 
@@ -4458,6 +4504,7 @@ void MlOptimiser::getFourierTransformsAndCtfs(
 ) {
 
     FourierTransformer transformer;
+    BatchFourierTransformer batch;
     for (int img_id = 0; img_id < mydata.numberOfImagesInParticle(part_id); img_id++) {
         Image<RFLOAT> img, rec_img;
         MultidimArray<RFLOAT> Fctf;
@@ -4625,7 +4672,7 @@ void MlOptimiser::getFourierTransformsAndCtfs(
             // If all followers had preread images into RAM: get those now
             if (do_preread_images) {
 
-                img() = mydata.particles[part_id].images[img_id].img;
+                mydata.getPrereadImage(part_id, img_id, img());
 
             } else {
 
@@ -4840,16 +4887,11 @@ void MlOptimiser::getFourierTransformsAndCtfs(
 		// std::cin >> c;
         #endif
 
-        // Always store FT of image without mask (to be used for the reconstruction)
-        MultidimArray<RFLOAT> img_aux = has_converged && do_use_reconstruct_images ? rec_img() : img();
-        MultidimArray<Complex> Faux = transformer.FourierTransform(img_aux);
-        MultidimArray<Complex> Fimg = windowFourierTransform(Faux, image_current_size[optics_group]);
-        CenterFFTbySign(Fimg);
+        // The images without and with the mask are Fourier-transformed together
+        batch.resize(2, Xsize(img()), Ysize(img()), Zsize(img()));
 
-        // Here apply the aberration corrections if necessary
-        mydata.obsModel.demodulatePhase(optics_group, Fimg);
-        mydata.obsModel.divideByMtf(optics_group, Fimg);
-        exp_Fimg_nomask[img_id] = Fimg;
+        // Always store FT of image without mask (to be used for the reconstruction)
+        batch.setReal(0, has_converged && do_use_reconstruct_images ? rec_img() : img());
 
         MultidimArray<RFLOAT> Mnoise;
         bool is_helical_segment = do_helical_refine || mymodel.ref_dim == 2 && helical_tube_outer_diameter > 0.0;
@@ -4920,8 +4962,21 @@ void MlOptimiser::getFourierTransformsAndCtfs(
 		// exit(0);
         #endif
 
+        batch.setReal(1, img());
+        batch.FourierTransform();
+
+        MultidimArray<Complex> Faux;
+        batch.getFourier(0, Faux);
+        MultidimArray<Complex> Fimg = windowFourierTransform(Faux, image_current_size[optics_group]);
+        CenterFFTbySign(Fimg);
+
+        // Here apply the aberration corrections if necessary
+        mydata.obsModel.demodulatePhase(optics_group, Fimg);
+        mydata.obsModel.divideByMtf(optics_group, Fimg);
+        exp_Fimg_nomask[img_id] = Fimg;
+
         // Store the Fourier Transform of the image Fimg
-        Faux = transformer.FourierTransform(img());
+        batch.getFourier(1, Faux);
 
         // Store the power_class spectrum of the whole image (to fill sigma2_noise between current_size and ori_size
         if (image_current_size[optics_group] < image_full_size[optics_group]) {
@@ -8163,10 +8218,29 @@ void MlOptimiser::setMetaDataSubset(long int first_part_id, long int last_part_i
     }
 }
 
-void MlOptimiser::getMetaAndImageDataSubset(long int first_part_id, long int last_part_id, bool do_also_imagedata) {
+bool MlOptimiser::doPrereadImagesOnRank(int rank) {
+    if (!do_preread_images) return false;
+    // Without parallel disc I/O, only the leader reads (and sends images to the followers)
+    if (!do_parallel_disc_io) return rank == 0;
+    // Compressed images are read by one rank per host, and then shared with the others
+    return !mydata.compressed_images.isEnabled() || node_rank == 0;
+}
+
+void MlOptimiser::printPrereadImagesSize() const {
+    if (!do_preread_images || mydata.compressed_images.bytes() == 0) return;
+    std::cout << " Pre-read particles take " << mydata.compressed_images.bytes() / (1024. * 1024. * 1024.) << " Gb ("
+              << mydata.compressed_images.uncompressedBytes() / (1024. * 1024. * 1024.) << " Gb uncompressed)" << std::endl;
+}
 
-    // In case we're reading images here, only open stacks once and then read multiple images
-    fImageHandler hFile;
+FileName MlOptimiser::getParticleImageName(long int part_id, int img_id) {
+    try {
+        return mydata.getImageNameOnScratch(part_id, img_id);
+    } catch (const char *errmsg) {
+        return (FileName) mydata.MDimg.getValue<std::string>(EMDL::IMAGE_NAME, mydata.particles[part_id].images[img_id].id);
+    }
+}
+
+void MlOptimiser::getMetaAndImageDataSubset(long int first_part_id, long int last_part_id, bool do_also_imagedata) {
 
     // Initialise filename strings if not reading imagedata here
     if (!do_also_imagedata) {
@@ -8206,13 +8280,7 @@ void MlOptimiser::getMetaAndImageDataSubset(long int first_part_id, long int las
             int my_image_size = mydata.getOpticsImageSize(mydata.getOpticsGroup(part_id, img_id));
 
             // Get the image names from the MDimg table
-            FileName fn_img = [&] () {
-                try {
-                    return mydata.getImageNameOnScratch(part_id, img_id);
-                } catch (const char *errmsg) {
-                    return (FileName) mydata.MDimg.getValue<std::string>(EMDL::IMAGE_NAME, ori_img_id);
-                }
-            }();
+            FileName fn_img = getParticleImageName(part_id, img_id);
 
             FileName fn_ctf = "";
             if (mymodel.data_dim == 3 && do_ctf_correction) {
@@ -8238,17 +8306,10 @@ void MlOptimiser::getMetaAndImageDataSubset(long int first_part_id, long int las
                 // First read the image from disc or get it from the preread images in the mydata structure
                 Image<RFLOAT> img, rec_img;
                 if (do_preread_images) {
-                    img() = mydata.particles[part_id].images[img_id].img;
+                    mydata.getPrereadImage(part_id, img_id, img());
                 } else {
-                    // only open new stacks
-                    FileName fn_stack, fn_open_stack = "";
-                    long int dump;
-                    fn_img.decompose(dump, fn_stack);
-                    if (fn_stack != fn_open_stack) {
-                        hFile.openFile(fn_stack, WRITE_READONLY);
-                        fn_open_stack = fn_stack;
-                    }
-                    img.readFromOpenFile(fn_img, hFile, -1, false);
+                    // Images in MRC stacks are read through a mapping of the stack shared by all threads
+                    img.readMapped(fn_img);
                     img().setXmippOrigin();
                 }
                 if (Xsize(img()) != Xsize(exp_imagedata) || Ysize(img()) != Ysize(exp_imagedata)) {
@@ -42,6 +42,7 @@
 #include "src/helix.h"
 #include "src/local_symmetry.h"
 #include "src/acc/settings.h"
+#include "src/particle_prefetcher.h"
 
 #define ML_SIGNIFICANT_WEIGHT 1.e-8
 #define METADATA_LINE_LENGTH METADATA_LINE_LENGTH_ALL
@@ -397,6 +398,16 @@ class MlOptimiser {
     // Use parallel access to disc?
     bool do_parallel_disc_io;
 
+    // Also write the _data.star file as a binary copy (_data.star.bin) that is faster to read?
+    bool do_write_binary_data;
+
+    // Number of batches of 2D particle image files to read ahead on an I/O thread (0: read them when needed).
+    // Sequential relion_refine only; the FFTs and CTFs are still computed with each batch.
+    int prefetch_depth;
+
+    // Index of this MPI rank among the ranks on its host (0 without MPI)
+    int node_rank;
+
     // Use gpu resources?
     bool do_gpu;
     bool anticipate_oom;
@@ -404,6 +415,9 @@ class MlOptimiser {
     // Use alternate cpu implementation
     bool do_cpu;
 
+    // Size of the per-thread backprojection buffers of the alternate cpu implementation (in MB, 0 to lock the model instead)
+    int cpu_bp_buffer_mb;
+
     // Which GPU devices to use?
     std::string gpu_ids;
 
@@ -422,6 +436,12 @@ class MlOptimiser {
     // Don't delete scratch after finishing
     bool keep_scratch;
 
+    // Resume an interrupted copy of the particles to the scratch dir
+    bool do_resume_scratch;
+
+    // Copy the particles to the scratch dir while refining (reading those of optics groups that were not copied yet from where they are)
+    bool do_background_scratch;
+
     // Print the symmetry transformation matrices
     bool do_print_symmetry_ops;
 
@@ -607,6 +627,9 @@ class MlOptimiser {
     MultidimArray<RFLOAT> exp_metadata, exp_imagedata;
     std::string exp_fn_img, exp_fn_ctf, exp_fn_recimg;
     std::vector<MultidimArray<RFLOAT> > exp_imgs;
+
+    // Reads exp_imgs for the next batches while the current one is processed
+    ParticlePrefetcher exp_prefetcher;
     std::vector<int> exp_random_class_some_particles;
 
     // Calculate translated images on-the-fly
@@ -706,6 +729,9 @@ class MlOptimiser {
         do_shifts_onthefly(0),
         exp_ipart_ThreadTaskDistributor(0),
         do_parallel_disc_io(0),
+        do_write_binary_data(0),
+        prefetch_depth(0),
+        node_rank(0),
         sum_changes_optimal_orientations(0),
         do_solvent(0),
         strict_highres_exp(0),
@@ -1028,6 +1054,15 @@ class MlOptimiser {
     // Get metadata array of a subset of particles from the experimental model
     void getMetaAndImageDataSubset(long int my_first_part_id, long int my_last_part_id, bool do_also_imagedata = true);
 
+    // Does this rank read all particles into RAM (--preread_images)?
+    bool doPrereadImagesOnRank(int rank);
+
+    // Report how much RAM the compressed pre-read particles take (if they were read)
+    void printPrereadImagesSize() const;
+
+    // Name of an image of a particle (on scratch if it has been copied there)
+    FileName getParticleImageName(long int part_id, int img_id);
+
 };
 
 // Global call to threaded core of doThreadExpectationSomeParticles
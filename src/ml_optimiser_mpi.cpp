@@ -20,6 +20,8 @@
 #include "src/ml_optimiser_mpi.h"
 #include "src/ml_optimiser.h"
 #include "src/postprocessing.h"
+#include "src/fftw_plans.h"
+#include "src/backprojector_mpi.h"
 #ifdef CUDA
 #include "src/acc/cuda/cuda_ml_optimiser.h"
 #endif
@@ -122,15 +124,27 @@ void MlOptimiserMpi::read(int argc, char **argv) {
 
     // Define a new MpiNode
     node = new MpiNode(argc, argv);  // Where is the delete?
+    node_rank = node->nodeRank;
 
     if (node->isLeader()) PRINT_VERSION_INFO();
 
     // First read in non-parallelisation-dependent variables
     MlOptimiser::read(argc, argv, node->rank);
 
+    // The leader hands out one batch of particles at a time, so followers cannot know which images to read ahead
+    if (prefetch_depth > 0) {
+        if (node->isLeader())
+            std::cerr << " WARNING: --prefetch is ignored by the MPI version of relion_refine" << std::endl;
+        prefetch_depth = 0;
+    }
+
     int mpi_section = parser.addSection("MPI options");
     halt_all_followers_except_this = textToInteger(parser.getOption("--halt_all_followers_except", "For debugging: keep all followers except this one waiting", "-1"));
     do_keep_debug_reconstruct_files = parser.checkOption("--keep_debug_reconstruct_files", "For debugging: keep temporary data and weight files for debug-reconstructions.");
+    do_share_references_on_node = parser.checkOption("--share_refs_on_node", "Let all followers on a host use one copy of the references in shared memory (not for --split_random_halves)");
+    do_parallel_reconstruct = parser.checkOption("--parallel_recons", "Reconstruct each 3D map with all followers of its random half (or all followers, once the halves are joined), which share the gridding iterations and FFTs. This saves time, and the padded working arrays of the reconstruction are divided over the followers, but every follower still holds the full data and weight arrays, so it does not make larger boxes fit in memory");
+    do_pack_rmax_only = parser.checkOption("--pack_rmax_only", "Only combine the weighted sums of the references up to the current resolution (r_max), not their whole (padded) arrays");
+    do_pack_float = parser.checkOption("--pack_float", "Send the weighted sums between followers in single precision (they are still summed in double precision)");
 
     // Don't put any output to screen for mpi followers
     ori_verb = verb;
@@ -462,6 +476,8 @@ void MlOptimiserMpi::initialise() {
 
     MlOptimiser::initialiseGeneral(node->rank);
 
+    sharePrereadImagesOnNode();
+
     initialiseWorkLoad();
 
     #ifdef MKLFFT
@@ -472,7 +488,7 @@ void MlOptimiserMpi::initialise() {
 
     // And allow plans before expectation to run using allowed
     // number of threads
-    fftw_plan_with_nthreads(nr_threads);
+    FftwPlans::setThreads(nr_threads);
     #endif
 
     if (!fn_sigma.empty()) {
@@ -554,6 +570,82 @@ void MlOptimiserMpi::initialise() {
     #endif
 }
 
+void MlOptimiserMpi::allocateSharedReferences() {
+    // Free the previous segment before allocating the next one
+    for (Projector &projector : mymodel.PPref)
+        projector.releaseSharedData();
+
+    // One block per reference (aligned to 64 bytes), sized as in computeFourierTransformMap
+    std::vector<size_t> offsets;
+    size_t bytes = 0;
+    for (Projector &projector : mymodel.PPref) {
+        if (projector.ref_dim == 0) projector.ref_dim = mymodel.ref_dim;
+        offsets.push_back(bytes);
+        bytes += (projector.getSize(mymodel.current_size) * sizeof(Complex) + 63) / 64 * 64;
+    }
+
+    shared_references = node->allocateOnNode(bytes, node->followerNodeC);
+    for (int i = 0; i < mymodel.PPref.size(); i++) {
+        Complex *ptr = reinterpret_cast<Complex*>(shared_references->data() + offsets[i]);
+        mymodel.PPref[i].shareData(mymodel.current_size, ptr, shared_references);
+    }
+}
+
+void MlOptimiserMpi::broadcastSharedReferences() {
+    for (const Projector &projector : mymodel.PPref) {
+        if (!projector.isShared())
+            REPORT_ERROR("MlOptimiserMpi::broadcastSharedReferences BUG: a reference was not computed in shared memory");
+    }
+
+    // Which host computed which reference (the owner of reference i is follower i % nr_followers, see initialiseWorkLoad)
+    const int nr_followers = node->size - 1;
+    std::vector<int> host_of_follower (nr_followers);
+    MPI_Allgather(&node->followerHost, 1, MPI_INT, host_of_follower.data(), 1, MPI_INT, node->followerC);
+
+    // Wait until all references of this host have been computed, then exchange them between hosts
+    MPI_Barrier(node->followerNodeC);
+    if (node->followerHostsC != MPI_COMM_NULL) {
+        int nr_hosts;
+        MPI_Comm_size(node->followerHostsC, &nr_hosts);
+        for (int i = 0; nr_hosts > 1 && i < mymodel.PPref.size(); i++) {
+            node->relion_MPI_Bcast(
+                mymodel.PPref[i].data.data, mymodel.PPref[i].data.size(),
+                relion_MPI::COMPLEX, host_of_follower[i % nr_followers], node->followerHostsC
+            );
+        }
+    }
+    MPI_Barrier(node->followerNodeC);
+
+    // From here on, the references are only read
+    shared_references->makeReadOnly();
+    shared_references.reset();
+
+    // For multibody refinement with overlapping bodies, there may be more PPrefs than bodies!
+    for (int i = 0; i < mymodel.PPref.size() && i < mymodel.nr_classes * mymodel.nr_bodies; i++) {
+        node->relion_MPI_Bcast(
+            mymodel.tau2_class[i].data,
+            mymodel.tau2_class[0].size(), relion_MPI::DOUBLE, i % nr_followers, node->followerC
+        );
+    }
+}
+
+void MlOptimiserMpi::sharePrereadImagesOnNode() {
+    if (!do_preread_images || !do_parallel_disc_io || !mydata.compressed_images.isEnabled()) return;
+
+    // Only node rank 0 has read the images (see doPrereadImagesOnRank): copy them into shared memory
+    ParticleImageCache &cache = mydata.compressed_images;
+    std::vector<ParticleImageCache::Entry> &entries = cache.entries();
+    long int nr_entries = entries.size();
+    MPI_Bcast(&nr_entries, 1, MPI_LONG, 0, node->nodeC);
+    entries.resize(nr_entries);
+    node->relion_MPI_Bcast(entries.data(), nr_entries * sizeof(ParticleImageCache::Entry), MPI_BYTE, 0, node->nodeC);
+
+    std::shared_ptr<SharedMemorySegment> segment = node->shareOnNode(cache.data(), cache.bytes());
+    if (segment) {
+        cache.adopt(segment->data(), segment->size(), segment);
+    }
+}
+
 void MlOptimiserMpi::initialiseWorkLoad() {
     if (do_split_random_halves) {
         if (node->size <= 2)
@@ -609,6 +701,7 @@ void MlOptimiserMpi::initialiseWorkLoad() {
     }
 
     // Now copy particle stacks to scratch if needed
+    do_follow_scratch = false;
     if (!fn_scratch.empty() && !do_preread_images) {
         mydata.setScratchDirectory(fn_scratch, do_reuse_scratch, verb);
 
@@ -624,27 +717,29 @@ void MlOptimiserMpi::initialiseWorkLoad() {
                     if (inode == 0) { need_to_copy = false; }
                     if (inode > 0 && inode == node->rank) {
                         // The leader removes the lock if it existed
-                        need_to_copy = mydata.prepareScratchDirectory(fn_scratch, fn_lock);
+                        need_to_copy = mydata.prepareScratchDirectory(fn_scratch, fn_lock, do_resume_scratch);
                     }
                     MPI_Barrier(MPI_COMM_WORLD);
                 }
 
                 int myverb = node->rank == 1 && ori_verb; // Only the first follower
                 if (need_to_copy)
-                mydata.copyParticlesToScratch(myverb, true, also_do_ctfimage, keep_free_scratch_Gb);
+                mydata.copyParticlesToScratch(myverb, true, also_do_ctfimage, keep_free_scratch_Gb, nr_threads, do_resume_scratch, do_background_scratch);
 
                 MPI_Barrier(MPI_COMM_WORLD);
                 if (!need_to_copy) {
                     // This initialises nr_parts_on_scratch on non-first ranks by pretending --reuse_scratch
                     mydata.setScratchDirectory(fn_scratch, true, verb);
                     keep_scratch = true; // Setting keep_scratch for non-first ranks, to ensure that only first rank on each node deletes scratch during cleanup
+                    // The first rank on this node may still be copying: follow its manifests
+                    do_follow_scratch = do_background_scratch;
                 }
             } else {
                 // Only the leader needs to copy the data,
                 // as only it will be reading in images.
                 if (node->isLeader()) {
-                    mydata.prepareScratchDirectory(fn_scratch);
-                    mydata.copyParticlesToScratch(1, true,  also_do_ctfimage, keep_free_scratch_Gb);
+                    mydata.prepareScratchDirectory(fn_scratch, "", do_resume_scratch);
+                    mydata.copyParticlesToScratch(1, true,  also_do_ctfimage, keep_free_scratch_Gb, nr_threads, do_resume_scratch, do_background_scratch);
                 } else {
                     mydata.copyParticlesToScratch(0, false, also_do_ctfimage, keep_free_scratch_Gb);
                 }
@@ -716,7 +811,7 @@ void MlOptimiserMpi::expectation() {
 
     #ifdef MKLFFT
     // Allow parallel FFTW execution
-    fftw_plan_with_nthreads(nr_threads);
+    FftwPlans::setThreads(nr_threads);
     #endif
 
     // Initialise some stuff
@@ -728,6 +823,9 @@ void MlOptimiserMpi::expectation() {
     {
     ifdefTIMING(TicToc tt (timer, TIMING_EXP_1a);)
     if (!node->isLeader()) {
+        if (do_share_references_on_node && !do_split_random_halves)
+            allocateSharedReferences();
+
         MlOptimiser::expectationSetup();
 
         mydata.MDimg.clear();
@@ -741,7 +839,9 @@ void MlOptimiserMpi::expectation() {
     }
 
     if (!do_split_random_halves) {
-        if (!node->isLeader()) {
+        if (!node->isLeader() && do_share_references_on_node) {
+            broadcastSharedReferences();
+        } else if (!node->isLeader()) {
             for (int i = 0; i < mymodel.PPref.size(); i++) {
                 /* NOTE: the first follower has rank 0 on the follower communicator node->followerC,
                  *       that's why we don't have to add 1, like this;
@@ -1035,7 +1135,7 @@ void MlOptimiserMpi::expectation() {
 
     #ifdef MKLFFT
     // Single-threaded FFTW execution for code inside parallel processing loop
-    fftw_plan_with_nthreads(1);
+    FftwPlans::setThreads(1);
     #endif
 
     }
@@ -1338,6 +1438,8 @@ void MlOptimiserMpi::expectation() {
 
                     for (auto &plan : b->coarseProjectionPlans) plan.clear();
 
+                    if (node->rank == 1 && bundle == accDataBundles.front())
+                        b->projectionPlanCache.printStatistics(std::cout);
                 }
 
                 {
@@ -1398,6 +1500,9 @@ void MlOptimiserMpi::expectation() {
 
                 for (auto &plan : b->coarseProjectionPlans) plan.clear();
 
+                if (node->rank == 1)
+                    b->projectionPlanCache.printStatistics(std::cout);
+
                 delete b;
                 accDataBundles.clear();
 
@@ -1420,7 +1525,7 @@ void MlOptimiserMpi::expectation() {
     #ifdef  MKLFFT
     // Allow parallel FFTW execution to continue now that we are outside the parallel
     // portion of expectation
-    fftw_plan_with_nthreads(nr_threads);
+    FftwPlans::setThreads(nr_threads);
     #endif
 
     // Just make sure the temporary arrays are empty...
@@ -1463,7 +1568,7 @@ void MlOptimiserMpi::combineAllWeightedSumsViaFile() {
     if ((node->size - 1) / nr_halfsets > 1) {
         // A. First all followers pack up their wsum_model (this is done simultaneously)
         if (!node->isLeader()) {
-            wsum_model.pack(Mpack); // use negative piece and nr_pieces to only make a single Mpack, i.e. do not split into multiple pieces
+            wsum_model.pack(Mpack, do_pack_rmax_only); // a single Mpack, i.e. do not split into multiple pieces
         }
 
         // B. All followers write their Mpack to disc. Do this SEQUENTIALLY to prevent heavy load on disc I/O
@@ -1528,7 +1633,7 @@ void MlOptimiserMpi::combineAllWeightedSumsViaFile() {
 
         // F. Finally all followers unpack Msum into their wsum_model (do this simultaneously)
         if (!node->isLeader())
-            wsum_model.unpack(Mpack);
+            wsum_model.unpack(Mpack, do_pack_rmax_only);
 
     } // end if ((node->size - 1)/nr_halfsets > 1)
     }
@@ -1539,18 +1644,19 @@ void MlOptimiserMpi::combineAllWeightedSums() {
     ifdefTIMING(TicToc tt (timer, TIMING_MPICOMBINENETW);)
 
     // Pack all weighted sums in Mpack
-    MultidimArray<RFLOAT> Mpack, Msum;
-    MPI_Status status;
+    MultidimArray<RFLOAT> Mpack;
 
-    // First follower manually sums over all other followers of it's subset
-    // And then sends results back to all those followers
-    // When splitting the data into two random halves, perform two passes: one for each subset
+    // All followers of a subset sum their Mpack in a ring allreduce.
+    // When splitting the data into two random halves, both subsets do this at the same time.
     int nr_halfsets = do_split_random_halves ? 2 : 1;
     #ifdef DEBUG
     std::cerr << " starting combineAllWeightedSums..." << std::endl;
     #endif
     // Only combine weighted sums if there are more than one followers per subset!
     if ((node->size - 1) / nr_halfsets > 1) {
+        const MPI_Comm comm = do_split_random_halves ? node->halfsetC : node->followerC;
+        RFLOAT combine_time = 0.0, combine_size = 0.0;
+
         // Loop over possibly multiple instances of Mpack of maximum size
         int piece = 0;
         int nr_pieces = 1;
@@ -1558,89 +1664,39 @@ void MlOptimiserMpi::combineAllWeightedSums() {
             // All nodes except those who will reset nr_pieces piece will pass while loop in next pass
             nr_pieces = 0;
 
-            // First all followers pack up their wsum_model
             if (!node->isLeader()) {
-                wsum_model.pack(Mpack, piece, nr_pieces);
-                // The first follower(s) set Msum equal to Mpack, the others initialise to zero
-                Msum = node->rank <= nr_halfsets ? Mpack :
-                    MultidimArray<RFLOAT>::zeros(Mpack.xdim, Mpack.ydim, Mpack.zdim, Mpack.ndim);
-            }
-
-            // Loop through all followers: each follower sends its Msum to the next follower for its subset.
-            // Each next follower sums its own Mpack to the received Msum and sends it on to the next follower
-            for (int this_follower = 1; this_follower < node->size; this_follower++) {
-
-                // Find out who is the first follower in this subset
-                int first_follower = do_split_random_halves ? modulo_alt(this_follower, 2) : 1;
-
-                // Find out who is the next follower in this subset
-                int other_follower = this_follower + nr_halfsets;
+                wsum_model.pack(Mpack, piece, nr_pieces, true, do_pack_rmax_only);
 
-                if (other_follower < node->size) {
-                    if (node->rank == this_follower) {
-                        #ifdef DEBUG
-                        std::cerr << " AA SEND node->rank= " << node->rank << " Msum.size()= " << Msum.size()
-                            << " this_follower= " << this_follower << " other_follower= " << other_follower << std::endl;
-                        #endif
-                        node->relion_MPI_Send(Msum.data, Msum.size(), relion_MPI::DOUBLE, other_follower, MPITag::PACK, MPI_COMM_WORLD);
-                    } else if (node->rank == other_follower) {
-                        node->relion_MPI_Recv(Msum.data, Msum.size(), relion_MPI::DOUBLE, this_follower, MPITag::PACK, MPI_COMM_WORLD, status);
-                        #ifdef DEBUG
-                        std::cerr << " AA RECV node->rank= " << node->rank << " Msum.size()= " << Msum.size()
-                            << " this_follower= " << this_follower << " other_follower= " << other_follower << std::endl;
-                        #endif
-                        // Add my own Mpack to send onwards in the next step
-                        Msum += Mpack;
-                    }
+                #ifdef DEBUG
+                std::cerr << " ALLREDUCE node->rank= " << node->rank << " Mpack.size()= " << Mpack.size() << std::endl;
+                #endif
+                const RFLOAT start_time = MPI_Wtime();
+                if (do_pack_float) {
+                    node->relion_MPI_Allreduce_sum_float(Mpack.data, Mpack.size(), comm);
                 } else {
-                    // Now this_follower has reached the last follower, which passes the final Msum to the first one (i.e. first_follower)
-                    if (node->rank == this_follower) {
-                        #ifdef DEBUG
-                        std::cerr << " BB SEND node->rank= " << node->rank << " Msum.size()= " << Msum.size()
-                            << " this_follower= " << this_follower << " first_follower= " << first_follower << std::endl;
-                        #endif
-                        node->relion_MPI_Send(Msum.data, Msum.size(), relion_MPI::DOUBLE, first_follower, MPITag::PACK, MPI_COMM_WORLD);
-                    } else if (node->rank == first_follower) {
-                        node->relion_MPI_Recv(Msum.data, Msum.size(), relion_MPI::DOUBLE, this_follower, MPITag::PACK, MPI_COMM_WORLD, status);
-                        #ifdef DEBUG
-                        std::cerr << " BB RECV node->rank= " << node->rank << " Msum.size()= " << Msum.size()
-                            << " this_follower= " << this_follower << " first_follower= " << first_follower << std::endl;
-                        #endif
-                    }
+                    node->relion_MPI_Allreduce_sum(Mpack.data, Mpack.size(), comm);
                 }
-            }
+                combine_time += MPI_Wtime() - start_time;
+                combine_size += Mpack.size() * (do_pack_float ? sizeof(float) : sizeof(RFLOAT));
 
-            // Now loop through all followers again to pass around the Msum
-            for (int this_follower = 1; this_follower < node->size; this_follower++) {
-                // Find out who is the next follower in this subset
-                int other_follower = this_follower + nr_halfsets;
-
-                // Do not send to the last follower, because it already had its Msum from the cycle above, therefore subtract nr_halfsets from node->size
-                if (other_follower < node->size - nr_halfsets) {
-                    if (node->rank == this_follower) {
-                        #ifdef DEBUG
-                        std::cerr << " CC SEND node->rank= " << node->rank << " Msum.size()= " << Msum.size()
-                            << " this_follower= " << this_follower << " other_follower= " << other_follower << std::endl;
-                        #endif
-                        node->relion_MPI_Send(Msum.data, Msum.size(), relion_MPI::DOUBLE, other_follower, MPITag::PACK, MPI_COMM_WORLD);
-                    } else if (node->rank == other_follower) {
-                        node->relion_MPI_Recv(Msum.data, Msum.size(), relion_MPI::DOUBLE, this_follower, MPITag::PACK, MPI_COMM_WORLD, status);
-                        #ifdef DEBUG
-                        std::cerr << " CC RECV node->rank= " << node->rank << " Msum.size()= " << Msum.size()
-                            << " this_follower= " << this_follower << " other_follower= " << other_follower << std::endl;
-                        #endif
-                    }
-                }
-            }
-
-            // Finally all followers unpack Msum into their wsum_model
-            if (!node->isLeader()) {
                 // Subtract 1 from piece because it was incremented already...
-                wsum_model.unpack(Msum, piece - 1);
+                wsum_model.unpack(Mpack, piece - 1, true, do_pack_rmax_only);
             }
 
         }
 
+        // Report the slowest follower, so the combine cost can be followed from iteration to iteration
+        RFLOAT max_time = 0.0, max_size = 0.0;
+        MPI_Reduce(&combine_time, &max_time, 1, relion_MPI::DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+        MPI_Reduce(&combine_size, &max_size, 1, relion_MPI::DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+        if (verb > 0) {
+            std::cout << " Combined " << max_size / (1024 * 1024) << " MB of weighted sums over "
+                << (node->size - 1) / nr_halfsets << " followers per subset in " << max_time << " sec";
+            if (max_time > 0.0)
+                std::cout << " (" << max_size / (1024 * 1024) / max_time << " MB/s)";
+            std::cout << std::endl;
+        }
+
         MPI_Barrier(MPI_COMM_WORLD);
     }
 
@@ -1658,7 +1714,7 @@ void MlOptimiserMpi::combineWeightedSumsTwoRandomHalvesViaFile() {
     // Everyone packs up his wsum_model (simultaneously)
     // The followers from 3 and onwards also need this in order to have the correct Mpack size to be able to read in the summed Mpack
     if (!node->isLeader())
-        wsum_model.pack(Mpack);
+        wsum_model.pack(Mpack, do_pack_rmax_only);
 
     // Rank 2 writes it Mpack to file
     if (node->rank == 2) {
@@ -1693,7 +1749,7 @@ void MlOptimiserMpi::combineWeightedSumsTwoRandomHalvesViaFile() {
 
     // Then everyone except the leader unpacks
     if (!node->isLeader())
-        wsum_model.unpack(Mpack);
+        wsum_model.unpack(Mpack, do_pack_rmax_only);
 }
 
 void MlOptimiserMpi::combineWeightedSumsTwoRandomHalves() {
@@ -1703,26 +1759,52 @@ void MlOptimiserMpi::combineWeightedSumsTwoRandomHalves() {
 
     MultidimArray<RFLOAT> Mpack;
     MPI_Status status;
+    RFLOAT combine_size = 0.0;
+    const RFLOAT start_time = MPI_Wtime();
+
+    // With do_pack_float, Mpack goes over in single precision
+    std::vector<float> Fpack;
+    const auto send = [&] (MultidimArray<RFLOAT> &from, int dest) {
+        if (do_pack_float) {
+            Fpack.assign(from.begin(), from.end());
+            node->relion_MPI_Send(Fpack.data(), Fpack.size(), MPI_FLOAT, dest, MPITag::PACK, MPI_COMM_WORLD);
+        } else {
+            node->relion_MPI_Send(from.data, from.size(), relion_MPI::DOUBLE, dest, MPITag::PACK, MPI_COMM_WORLD);
+        }
+        combine_size += from.size() * (do_pack_float ? sizeof(float) : sizeof(RFLOAT));
+    };
+    const auto receive = [&] (MultidimArray<RFLOAT> &into, int source) {
+        if (do_pack_float) {
+            Fpack.resize(into.size());
+            node->relion_MPI_Recv(Fpack.data(), Fpack.size(), MPI_FLOAT, source, MPITag::PACK, MPI_COMM_WORLD, status);
+            std::copy(Fpack.begin(), Fpack.end(), into.begin());
+        } else {
+            node->relion_MPI_Recv(into.data, into.size(), relion_MPI::DOUBLE, source, MPITag::PACK, MPI_COMM_WORLD, status);
+        }
+    };
 
     int piece = 0;
     int nr_pieces = 1;
-    long int pack_size;
     while (piece < nr_pieces) {
         // All nodes except those who will reset nr_pieces will pass while next time
         nr_pieces = 0;
 
         if (node->rank == 2) {
-            wsum_model.pack(Mpack, piece, nr_pieces, false); // do not clear the model!
-            node->relion_MPI_Send(Mpack.data, Mpack.size(), relion_MPI::DOUBLE, 1, MPITag::PACK, MPI_COMM_WORLD);
+            wsum_model.pack(Mpack, piece, nr_pieces, false, do_pack_rmax_only); // do not clear the model!
+            send(Mpack, 1);
             Mpack.clear();
         } else if (node->rank == 1) {
             if (verb > 0) std::cout << " Combining two random halves ..." << std::endl;
-            wsum_model.pack(Mpack, piece, nr_pieces);
+            wsum_model.pack(Mpack, piece, nr_pieces, true, do_pack_rmax_only);
             auto Msum = MultidimArray<RFLOAT>::zeros(Mpack.xdim, Mpack.ydim, Mpack.zdim, Mpack.ndim);
-            node->relion_MPI_Recv(Msum.data, Msum.size(), relion_MPI::DOUBLE, 2, MPITag::PACK, MPI_COMM_WORLD, status);
+            receive(Msum, 2);
             Msum += Mpack;
+            // Everyone else will receive the sum in single precision, so round it here too
+            if (do_pack_float) {
+                for (auto &x : Msum) x = (float) x;
+            }
             // Unpack the sum (subtract 1 from piece because it was incremented already...)
-            wsum_model.unpack(Msum, piece - 1);
+            wsum_model.unpack(Msum, piece - 1, true, do_pack_rmax_only);
             Mpack.clear();
         }
     }
@@ -1741,21 +1823,44 @@ void MlOptimiserMpi::combineWeightedSumsTwoRandomHalves() {
         // The leader does not have a wsum_model!
         if (!node->isLeader()) {
             // Let's have everyone repack their Mpack, so we know the size etc
-            wsum_model.pack(Mpack, piece, nr_pieces);
+            wsum_model.pack(Mpack, piece, nr_pieces, true, do_pack_rmax_only);
 
             // rank one sends Mpack to everyone else
             if (node->rank == 1) {
                 for (int other_follower = 2; other_follower < node->size; other_follower++)
-                    node->relion_MPI_Send(Mpack.data, Mpack.size(), relion_MPI::DOUBLE, other_follower, MPITag::PACK, MPI_COMM_WORLD);
+                    send(Mpack, other_follower);
             } else {
-                node->relion_MPI_Recv(Mpack.data, Mpack.size(), relion_MPI::DOUBLE, 1, MPITag::PACK, MPI_COMM_WORLD, status);
+                receive(Mpack, 1);
             }
 
             // Everyone unpacks the new Mpack
-            wsum_model.unpack(Mpack, piece - 1);
+            wsum_model.unpack(Mpack, piece - 1, true, do_pack_rmax_only);
             Mpack.clear();
         }
     }
+
+    // Only the leader has verb > 0, but follower 1 has sent the most
+    if (ori_verb > 0 && node->rank == 1) {
+        std::cout << " Combined the two random halves: sent " << combine_size / (1024 * 1024) << " MB in " << MPI_Wtime() - start_time << " sec" << std::endl;
+    }
+}
+
+void MlOptimiserMpi::helpReconstructDistributed(int ith_recons, int iclass, MPI_Comm comm) {
+    // All followers of a random half have the same data and weight, so they agree on whether there is anything to reconstruct
+    if (wsum_model.BPref[ith_recons].weight.sum() > Xmipp::epsilon<RFLOAT>()) {
+        reconstructDistributed(
+            wsum_model.BPref[ith_recons],
+            comm, false,
+            gridding_nr_iter,
+            do_map,
+            mymodel.tau2_class[ith_recons],
+            mymodel.tau2_fudge_factor,
+            wsum_model.pdf_class[iclass],
+            minres_map,
+            false,
+            nr_threads
+        );
+    }
 }
 
 void MlOptimiserMpi::maximization() {
@@ -1784,6 +1889,13 @@ void MlOptimiserMpi::maximization() {
     helical_twist_half1 = helical_twist_half2 = helical_twist_initial;
     helical_rise_half1  = helical_rise_half2  = helical_rise_initial;
 
+    // With --parallel_recons, the first follower of each pair reconstructs with the help of
+    // all other followers of its random half (or of all other followers, without random halves
+    // or once they have been joined, as then all followers have the same sums)
+    const bool distribute_recons = do_parallel_reconstruct && !do_external_reconstruct && mymodel.ref_dim == 3;
+    const bool split_recons = do_split_random_halves && !do_join_random_halves;
+    const MPI_Comm recons_comm = split_recons ? node->halfsetC : node->followerC;
+
     // First reconstruct all classes in parallel
     for (int ibody = 0; ibody < mymodel.nr_bodies; ibody++) {
 
@@ -1846,6 +1958,19 @@ void MlOptimiserMpi::maximization() {
                                 mymodel.tau2_fudge_factor,
                                 node->rank == 1  // only first follower is verbose
                             );
+                        } else if (distribute_recons) {
+                            reference = reconstructDistributed(
+                                wsum_model.BPref[ith_recons],
+                                recons_comm, true,
+                                gridding_nr_iter,
+                                do_map,
+                                mymodel.tau2_class[ith_recons],
+                                mymodel.tau2_fudge_factor,
+                                wsum_model.pdf_class[iclass],
+                                minres_map,
+                                ith_recons == 0 && node->rank == 1 && ori_verb > 1,
+                                nr_threads
+                            );
                         } else {
                             reference = wsum_model.BPref[ith_recons].reconstruct(
                                 gridding_nr_iter,
@@ -1854,7 +1979,9 @@ void MlOptimiserMpi::maximization() {
                                 mymodel.tau2_fudge_factor,
                                 wsum_model.pdf_class[iclass],
                                 minres_map,
-                                false
+                                ith_recons == 0 && node->rank == 1 && ori_verb > 1,
+                                nullptr,
+                                nr_threads
                             );
                         }
 
@@ -1948,10 +2075,22 @@ void MlOptimiserMpi::maximization() {
                     helical_rise_half1  = mymodel.helical_rise [ith_recons];
                     helical_twist_half1 = mymodel.helical_twist[ith_recons];
 
-                    // Also perform the unregularized reconstruction
-                    if (do_auto_refine && has_converged)
-                        readTemporaryDataAndWeightArraysAndReconstruct(ith_recons, 1);
+                }
 
+                // The other followers of the first random half (or all other followers) help with its reconstruction
+                if (
+                    distribute_recons && !node->isLeader() && node->rank != reconstruct_rank1 &&
+                    (!split_recons || node->myRandomSubset() == 1)
+                )
+                    helpReconstructDistributed(ith_recons, iclass, recons_comm);
+
+                // Also perform the unregularized reconstruction (of the first random half)
+                if (do_auto_refine && has_converged) {
+                    if (node->rank == reconstruct_rank1) {
+                        readTemporaryDataAndWeightArraysAndReconstruct(ith_recons, 1, distribute_recons && do_split_random_halves, true);
+                    } else if (distribute_recons && do_split_random_halves && node->myRandomSubset() == 1) {
+                        readTemporaryDataAndWeightArraysAndReconstruct(ith_recons, 1, true, false);
+                    }
                 }
 
                 // In some cases there is not enough memory to reconstruct two random halves in parallel
@@ -1998,6 +2137,19 @@ void MlOptimiserMpi::maximization() {
                                     mymodel.data_vs_prior_class[ith_recons],
                                     do_join_random_halves || do_always_join_random_halves,
                                     mymodel.tau2_fudge_factor);
+                            } else if (distribute_recons) {
+                                reference = reconstructDistributed(
+                                    wsum_model.BPref[ith_recons],
+                                    recons_comm, true,
+                                    gridding_nr_iter,
+                                    do_map,
+                                    mymodel.tau2_class[ith_recons],
+                                    mymodel.tau2_fudge_factor,
+                                    wsum_model.pdf_class[iclass],
+                                    minres_map,
+                                    ith_recons == 0 && node->rank == 1 && ori_verb > 1,
+                                    nr_threads
+                                );
                             } else {
                                 reference = wsum_model.BPref[ith_recons].reconstruct(
                                     gridding_nr_iter,
@@ -2006,7 +2158,9 @@ void MlOptimiserMpi::maximization() {
                                     mymodel.tau2_fudge_factor,
                                     wsum_model.pdf_class[iclass],
                                     minres_map,
-                                    false
+                                    ith_recons == 0 && node->rank == 1 && ori_verb > 1,
+                                    nullptr,
+                                    nr_threads
                                 );
                             }
 
@@ -2092,9 +2246,18 @@ void MlOptimiserMpi::maximization() {
                             helical_twist_half2 = mymodel.helical_twist[ith_recons];
                         }
 
-                        // But rank 2 always does the unfiltered reconstruction
-                        if (do_auto_refine && has_converged) {
-                            readTemporaryDataAndWeightArraysAndReconstruct(ith_recons, 2);
+                    }
+
+                    // And the other followers of the second random half help with its reconstruction
+                    if (distribute_recons && split_recons && node->myRandomSubset() == 2 && node->rank != reconstruct_rank2)
+                        helpReconstructDistributed(ith_recons, iclass, recons_comm);
+
+                    // But rank 2 always does the unfiltered reconstruction
+                    if (do_auto_refine && has_converged) {
+                        if (node->rank == reconstruct_rank2) {
+                            readTemporaryDataAndWeightArraysAndReconstruct(ith_recons, 2, distribute_recons, true);
+                        } else if (distribute_recons && node->myRandomSubset() == 2) {
+                            readTemporaryDataAndWeightArraysAndReconstruct(ith_recons, 2, true, false);
                         }
                     }
                 }
@@ -2558,7 +2721,7 @@ void MlOptimiserMpi::writeTemporaryDataAndWeightArrays() {
     MPI_Barrier(MPI_COMM_WORLD);
 }
 
-void MlOptimiserMpi::readTemporaryDataAndWeightArraysAndReconstruct(int iclass, int ihalf) {
+void MlOptimiserMpi::readTemporaryDataAndWeightArraysAndReconstruct(int iclass, int ihalf, bool distributed, bool is_root) {
 
     #ifdef DEBUG_RECONSTRUCTION
     FileName fn_root = fn_out + "_it" + integerToString(iter, 3) + "_half" + integerToString(node->rank);
@@ -2608,7 +2771,12 @@ void MlOptimiserMpi::readTemporaryDataAndWeightArraysAndReconstruct(int iclass,
 
     // Now perform the unregularized reconstruction
     MultidimArray<RFLOAT> tau2;
-    MultidimArray<RFLOAT> reconstruction = wsum_model.BPref[iclass].reconstruct(gridding_nr_iter, false, tau2);
+    MultidimArray<RFLOAT> reconstruction = distributed ?
+        reconstructDistributed(wsum_model.BPref[iclass], node->halfsetC, is_root, gridding_nr_iter, false, tau2, 1.0, 1.0, -1, false, nr_threads) :
+        wsum_model.BPref[iclass].reconstruct(gridding_nr_iter, false, tau2);
+
+    // Only the root of a distributed reconstruction has the map
+    if (!is_root) return;
 
     if (mymodel.nr_bodies > 1) {
         // 19may2015 translate the reconstruction back to its C.O.M.
@@ -2740,6 +2908,10 @@ void MlOptimiserMpi::iterate() {
         // Nobody can start the next iteration until everyone has finished
         MPI_Barrier(MPI_COMM_WORLD);
 
+        // Read the optics groups that have been copied to the scratch dir (by another rank) since the last iteration from there
+        if (do_follow_scratch)
+            mydata.setScratchDirectory(fn_scratch, true);
+
         // Only first follower checks for convergence and prints stats to the stdout
         if (do_auto_refine) { checkConvergence(node->rank == 1); }
 
@@ -46,6 +46,25 @@ class MlOptimiserMpi: public MlOptimiser {
     // Original verb
     int ori_verb;
 
+    // Do followers on the same host share one copy of the references (PPref)?
+    bool do_share_references_on_node;
+
+    // Reconstruct every class with all followers of its random half (or all followers), dividing the work of the reconstruction.
+    // Each follower holds slabs of the padded working arrays, but all of data and weight.
+    bool do_parallel_reconstruct;
+
+    // Re-read which particles are on the scratch dir every iteration, as another rank on this host copies them in the background
+    bool do_follow_scratch;
+
+    // Only combine the parts of the weighted sums of the references within their r_max (see MlWsumModel::pack)
+    bool do_pack_rmax_only;
+
+    // Send the weighted sums between followers in single precision
+    bool do_pack_float;
+
+    // The shared memory holding the references, while it is being filled
+    std::shared_ptr<SharedMemorySegment> shared_references;
+
     /** Destructor, calls MPI_Finalize */
     ~MlOptimiserMpi()
     {
@@ -64,6 +83,19 @@ class MlOptimiserMpi: public MlOptimiser {
 
     void initialise();
 
+    /** Let the references (PPref) of all followers on a host point into one segment of shared memory,
+     * which the followers fill in expectationSetup (each its own classes, see PPrefRank)
+     */
+    void allocateSharedReferences();
+
+    /** Copy the references that were computed on one host to the shared memory of the other hosts,
+     * and the tau2 spectra to all followers (instead of the broadcast of PPref to every follower)
+     */
+    void broadcastSharedReferences();
+
+    /** Move the compressed pre-read images (read by one rank per host) into memory shared by all ranks on the host */
+    void sharePrereadImagesOnNode();
+
     /** Initialise the work load: divide images equally over all nodes
      * Also initialise the same random seed for all nodes
      */
@@ -100,6 +132,11 @@ class MlOptimiserMpi: public MlOptimiser {
      */
     void maximization();
 
+    /** With --parallel_recons: take part in the reconstruction of ith_recons
+     * by another follower of comm (see reconstructDistributed)
+     */
+    void helpReconstructDistributed(int ith_recons, int iclass, MPI_Comm comm);
+
     /** Perform unregularized reconstruction
       * With the aim of performing solvent mask corrected FSC inside the auto-refine
       */
@@ -115,8 +152,10 @@ class MlOptimiserMpi: public MlOptimiser {
     /**
      *  Read temporary data and weight arrays from disc and perform unregularized reconstructions
      *  Also write the unregularized reconstructions to disc.
+     *  With distributed, all followers of random half ihalf call this together (see reconstructDistributed),
+     *  and only the one with is_root writes the reconstruction and removes the temporary arrays.
      */
-    void readTemporaryDataAndWeightArraysAndReconstruct(int iclass, int ihalf);
+    void readTemporaryDataAndWeightArraysAndReconstruct(int iclass, int ihalf, bool distributed = false, bool is_root = true);
 
     /**
      * Join two independent reconstructions ate the lowest frequencies to avoid convergence in distinct orientations
@@ -33,10 +33,14 @@
 
 // #define TIMING
 #ifdef TIMING
+    // The reading, aligning and summing of movies can run on different threads (see MoviePipeline),
+    // so each has its own timer
+    Timer MCreadTimer;
+    int TIMING_READ_GAIN = MCreadTimer.setNew("read gain");
+    int TIMING_READ_MOVIE = MCreadTimer.setNew("read movie");
+    int TIMING_APPLY_GAIN = MCreadTimer.setNew("apply gain");
+
     Timer MCtimer;
-    int TIMING_READ_GAIN = MCtimer.setNew("read gain");
-    int TIMING_READ_MOVIE = MCtimer.setNew("read movie");
-    int TIMING_APPLY_GAIN = MCtimer.setNew("apply gain");
     int TIMING_INITIAL_SUM = MCtimer.setNew("initial sum");
     int TIMING_DETECT_HOT = MCtimer.setNew("detect hot pixels");
     int TIMING_FIX_DEFECT = MCtimer.setNew("fix defects");
@@ -59,11 +63,13 @@
     int TIMING_CCF_FIND_MAX = MCtimer.setNew("align - argmax CCF (in thread)");
     int TIMING_FOURIER_SHIFT = MCtimer.setNew("align - shift in Fourier space");
     int TIMING_FIT_POLYNOMIAL = MCtimer.setNew("fit polynomial");
-    int TIMING_DOSE_WEIGHTING = MCtimer.setNew("dose weighting");
-    int TIMING_DW_WEIGHT = MCtimer.setNew("dw - calc weight");
-    int TIMING_DW_IFFT = MCtimer.setNew("dw - iFFT");
-    int TIMING_REAL_SPACE_INTERPOLATION = MCtimer.setNew("real space interpolation");
-    int TIMING_BINNING = MCtimer.setNew("binning");
+
+    Timer MCsumTimer;
+    int TIMING_DOSE_WEIGHTING = MCsumTimer.setNew("dose weighting");
+    int TIMING_DW_WEIGHT = MCsumTimer.setNew("dw - calc weight");
+    int TIMING_DW_IFFT = MCsumTimer.setNew("dw - iFFT");
+    int TIMING_REAL_SPACE_INTERPOLATION = MCsumTimer.setNew("real space interpolation");
+    int TIMING_BINNING = MCsumTimer.setNew("binning");
 	// int TIMING_ = MCtimer.setNew("");
 #endif
 
@@ -74,6 +80,7 @@ void MotioncorrRunner::read(int argc, char **argv, int rank) {
     fn_out = parser.getOption("--o", "Name for the output directory", "MotionCorr");
     n_threads = textToInteger(parser.getOption("--j", "Number of threads per movie (= process)", "1"));
     max_io_threads = textToInteger(parser.getOption("--max_io_threads", "Limit the number of IO threads.", "-1"));
+    pipeline_depth = textToInteger(parser.getOption("--pipeline_depth", "Number of movies to read ahead of (and to dose weight, sum and write behind) the one being aligned, in our own implementation (0: none)", "1"));
     continue_old = parser.checkOption("--only_do_unfinished", "Only run motion correction for those micrographs for which there is not yet an output micrograph.");
     do_at_most = textToInteger(parser.getOption("--do_at_most", "Only process at most this number of (unprocessed) micrographs.", "-1"));
     grouping_for_ps = textToInteger(parser.getOption("--grouping_for_ps", "Group this number of frames and write summed power spectrum. -1 == do not write", "-1"));
@@ -402,6 +409,8 @@ void MotioncorrRunner::run() {
         barstep = std::max(1ul, fn_micrographs.size() / 60);
     }
 
+    startPipeline(0, (long int) fn_micrographs.size() - 1);
+
     for (long int imic = 0; imic < fn_micrographs.size(); imic++) {
         if (verb > 0 && imic % barstep == 0)
             progress_bar(imic);
@@ -431,6 +440,9 @@ void MotioncorrRunner::run() {
         }
     }
 
+    // Wait for the last sums to be written
+    pipeline.finish();
+
     if (verb > 0)
         progress_bar(fn_micrographs.size());
 
@@ -438,7 +450,9 @@ void MotioncorrRunner::run() {
     generateLogFilePDFAndWriteStarFiles();
 
     #ifdef TIMING
+    MCreadTimer.printTimes(false);
     MCtimer.printTimes(false);
+    MCsumTimer.printTimes(false);
     #endif
     #ifdef TIMING_FFTW
     timer_fftw.printTimes(false);
@@ -851,18 +865,21 @@ void MotioncorrRunner::generateLogFilePDFAndWriteStarFiles() {
     }
 }
 
-bool MotioncorrRunner::executeOwnMotionCorrection(Micrograph &mic) {
-    FileName fn_mic = mic.getMovieFilename();
-    FileName fn_avg = getOutputFileNames(fn_mic);
-    FileName fn_avg_noDW = fn_avg.withoutExtension() + "_noDW.mrc";
-    FileName fn_log = fn_avg.withoutExtension() + ".log";
-    FileName fn_ps = fn_avg.withoutExtension() + "_PS.mrc";
-    std::ofstream logfile (fn_log);
+void MotioncorrRunner::startPipeline(long int first, long int last) {
+    if (!do_own || pipeline_depth <= 0 || first > last) return;
+
+    const std::vector<FileName> fn_movies (fn_micrographs.begin() + first, fn_micrographs.begin() + last + 1);
+    pipeline.start(pipeline_depth, fn_movies, [this] (MovieFrames &movie) { readMovieFrames(movie); });
+}
+
+void MotioncorrRunner::readMovieFrames(MovieFrames &movie) {
+    const FileName fn_mic = movie.fn_mic;
+    std::ostringstream logfile;
 
     // EER related things
     // TODO: will be refactored
     EERRenderer renderer;
-    const bool isEER = EERRenderer::isEER(mic.getMovieFilename());
+    movie.isEER = EERRenderer::isEER(fn_mic);
 
     int n_io_threads = n_threads;
     logfile << "Working on " << fn_mic << " with " << n_threads << " thread(s)." << std::endl << std::endl;
@@ -871,20 +888,11 @@ bool MotioncorrRunner::executeOwnMotionCorrection(Micrograph &mic) {
         logfile << "Limitted the number of IO threads per movie to " << n_io_threads << " thread(s)." << std::endl;
     }
 
-    Image<float> Ihead, Igain, Iref;
-    std::vector<MultidimArray<fComplex> > Fframes;
-    std::vector<Image<float> > Iframes;
-    std::vector<int> frames; // 0-indexed
-
-    RFLOAT output_angpix = angpix * bin_factor;
-    RFLOAT prescaling = 1;
-
-    const int hotpixel_sigma = 6;
-    const int fit_rmsd_threshold = 10; // px
-    int nx, ny, nn;
+    int &nx = movie.nx, &ny = movie.ny, &nn = movie.nn;
 
     // Check image size
-    if (!isEER) {
+    if (!movie.isEER) {
+        Image<float> Ihead;
         Ihead.read(fn_mic, false, -1, nullptr, true); // select_img -1, mmap false, is_2D true
         nx = Xsize(Ihead()); 
         ny = Ysize(Ihead()); 
@@ -897,6 +905,8 @@ bool MotioncorrRunner::executeOwnMotionCorrection(Micrograph &mic) {
     }
 
     // Which frame to use?
+    std::vector<int> &frames = movie.frames; // 0-indexed
+    frames.clear();
     logfile << "Movie size: X = " << nx << " Y = " << ny << " N = " << nn << std::endl;
     logfile << "Frames to be used:";
     for (int i = 0; i < nn; i++) {
@@ -909,9 +919,141 @@ bool MotioncorrRunner::executeOwnMotionCorrection(Micrograph &mic) {
     }
     logfile << std::endl;
 
+    // alignMovie skips movies with too few frames, so do not read them
+    if (frames.size() / group < 3) {
+        movie.log = logfile.str();
+        return;
+    }
+
+    // Only the frames in use need to be read from an EER movie
+    if (movie.isEER && !frames.empty())
+        renderer.setFramesOfInterest(frames.front() * eer_grouping + 1, (frames.back() + 1) * eer_grouping);
+
     const int n_frames = frames.size();
+    std::vector<Image<float> > &Iframes = movie.Iframes;
     Iframes.resize(n_frames);
-    Fframes.resize(n_frames);
+    movie.Fframes.resize(n_frames);
+
+    // Read gain reference (once, if the buffers of the movie are reused)
+    Image<float> &Igain = movie.Igain;
+    {
+    ifdefTIMING(TicToc tt (MCreadTimer, TIMING_READ_GAIN);)
+    if (!fn_gain_reference.empty() && (Xsize(Igain()) != nx || Ysize(Igain()) != ny)) {
+        if (movie.isEER) {
+            EERRenderer::loadEERGain(fn_gain_reference, Igain(), eer_upsampling);
+        } else {
+            Igain.read(fn_gain_reference);
+        }
+
+        if (Xsize(Igain()) != nx || Ysize(Igain()) != ny) {
+            std::cerr << "fn_mic: " << fn_mic << " nx = " << nx << " ny = " << ny << " gain nx = " << Xsize(Igain()) << " gain ny = " << Ysize(Igain()) <<  std::endl;
+            REPORT_ERROR("The size of the image and the size of the gain reference do not match. Make sure the gain reference has been rotated if necessary.");
+        }
+    }
+    }
+
+    // Read images
+    {
+    ifdefTIMING(TicToc tt (MCreadTimer, TIMING_READ_MOVIE);)
+    #pragma omp parallel for num_threads(n_io_threads)
+    for (int iframe = 0; iframe < n_frames; iframe++) {
+        if (!movie.isEER) {
+            Iframes[iframe].read(fn_mic, true, frames[iframe], nullptr, true); // mmap false, is_2D true
+        } else {
+            renderer.renderFrames(frames[iframe] * eer_grouping + 1, (frames[iframe] + 1) * eer_grouping, Iframes[iframe]());
+        }
+    }
+    }
+
+    // Apply gain
+    {
+    ifdefTIMING(TicToc tt (MCreadTimer, TIMING_APPLY_GAIN);)
+    if (!fn_gain_reference.empty()) {
+        #pragma omp parallel for num_threads(n_threads)
+        for (int iframe = 0; iframe < n_frames; iframe++) {
+            for (long int n = 0; n < Igain().size(); n++) {
+                Iframes[iframe]()[n] *= Igain()[n];
+            }
+        }
+    }
+    }
+
+    movie.log = logfile.str();
+}
+
+void MotioncorrRunner::writeImage(Image<float> &img, const FileName &fn) {
+    if (pipeline.isRunning()) {
+        pipeline.write(img, fn);
+    } else {
+        img.write(fn);
+    }
+}
+
+bool MotioncorrRunner::executeOwnMotionCorrection(Micrograph &mic) {
+    MovieFrames movie;
+    if (pipeline.isRunning()) {
+        movie = pipeline.take(mic.getMovieFilename());
+    } else {
+        movie.fn_mic = mic.getMovieFilename();
+        readMovieFrames(movie);
+    }
+
+    const FileName fn_log = getOutputFileNames(mic.getMovieFilename()).withoutExtension() + ".log";
+    const auto logfile = std::make_shared<std::ofstream>(fn_log);
+    *logfile << movie.log;
+
+    if (!alignMovie(mic, movie, *logfile)) {
+        if (pipeline.isRunning())
+            pipeline.recycle(std::move(movie));
+        return false;
+    }
+
+    if (do_dose_weighting && std::abs(voltage - 300) > 2 && std::abs(voltage - 200) > 2 && std::abs(voltage - 100) > 2) {
+        REPORT_ERROR("Sorry, dose weighting is supported only for 300, 200 or 100 kV");
+    }
+
+    if (!pipeline.isRunning()) {
+        sumMovie(movie, mic.model, angpix, voltage, *logfile);
+        return true;
+    }
+
+    // Dose weight, sum and write on the writer thread, while the next movie is aligned.
+    // mic (and angpix and voltage) will have moved on to the next movie by then.
+    const auto frames = std::make_shared<MovieFrames>(std::move(movie));
+    const std::shared_ptr<MotionModel> model (mic.model ? mic.model->clone() : nullptr);
+    const RFLOAT angpix = this->angpix, voltage = this->voltage;
+    pipeline.post([this, frames, model, angpix, voltage, logfile] {
+        try {
+            sumMovie(*frames, model.get(), angpix, voltage, *logfile);
+        } catch (...) {
+            pipeline.recycle(std::move(*frames));
+            throw;
+        }
+        pipeline.recycle(std::move(*frames));
+    });
+    return true;
+}
+
+bool MotioncorrRunner::alignMovie(Micrograph &mic, MovieFrames &movie, std::ostream &logfile) {
+    FileName fn_mic = mic.getMovieFilename();
+    FileName fn_avg = getOutputFileNames(fn_mic);
+    FileName fn_ps = fn_avg.withoutExtension() + "_PS.mrc";
+
+    const bool isEER = movie.isEER;
+    const Image<float> &Igain = movie.Igain;
+    std::vector<Image<float> > &Iframes = movie.Iframes;
+    std::vector<MultidimArray<fComplex> > &Fframes = movie.Fframes;
+    const std::vector<int> &frames = movie.frames; // 0-indexed
+    Image<float> Iref;
+
+    RFLOAT output_angpix = angpix * bin_factor;
+    RFLOAT prescaling = 1;
+
+    const int hotpixel_sigma = 6;
+    const int fit_rmsd_threshold = 10; // px
+    int nx = movie.nx, ny = movie.ny;
+
+    const int n_frames = frames.size();
 
     std::vector<RFLOAT> xshifts(n_frames), yshifts(n_frames);
 
@@ -950,49 +1092,6 @@ bool MotioncorrRunner::executeOwnMotionCorrection(Micrograph &mic) {
     logfile << "interpolate_shifts = " << interpolate_shifts << std::endl;
     logfile << std::endl;
 
-    // Read gain reference
-    {
-    ifdefTIMING(TicToc tt (MCtimer, TIMING_READ_GAIN);)
-    if (!fn_gain_reference.empty()) {
-        if (isEER) {
-            EERRenderer::loadEERGain(fn_gain_reference, Igain(), eer_upsampling);
-        } else {
-            Igain.read(fn_gain_reference);
-        }
-
-        if (Xsize(Igain()) != nx || Ysize(Igain()) != ny) {
-            std::cerr << "fn_mic: " << fn_mic << " nx = " << nx << " ny = " << ny << " gain nx = " << Xsize(Igain()) << " gain ny = " << Ysize(Igain()) <<  std::endl;
-            REPORT_ERROR("The size of the image and the size of the gain reference do not match. Make sure the gain reference has been rotated if necessary.");
-        }
-    }
-    }
-
-    // Read images
-    {
-    ifdefTIMING(TicToc tt (MCtimer, TIMING_READ_MOVIE);)
-    #pragma omp parallel for num_threads(n_io_threads)
-    for (int iframe = 0; iframe < n_frames; iframe++) {
-        if (!isEER) {
-            Iframes[iframe].read(fn_mic, true, frames[iframe], nullptr, true); // mmap false, is_2D true
-        } else {
-            renderer.renderFrames(frames[iframe] * eer_grouping + 1, (frames[iframe] + 1) * eer_grouping, Iframes[iframe]());
-        }
-    }
-    }
-
-    // Apply gain
-    {
-    ifdefTIMING(TicToc tt (MCtimer, TIMING_APPLY_GAIN);)
-    if (!fn_gain_reference.empty()) {
-        #pragma omp parallel for num_threads(n_threads)
-        for (int iframe = 0; iframe < n_frames; iframe++) {
-            for (long int n = 0; n < Igain().size(); n++) {
-                Iframes[iframe]()[n] *= Igain()[n];
-            }
-        }
-    }
-    }
-
     MultidimArray<float> Isum = MultidimArray<float>::zeros(ny, nx);
     // First sum unaligned frames
     {
@@ -1235,7 +1334,7 @@ bool MotioncorrRunner::executeOwnMotionCorrection(Micrograph &mic) {
 
         // 4. Write
         PS_sum.setSamplingRateInHeader(ps_angpix, ps_angpix);
-        PS_sum.write(fn_ps);
+        writeImage(PS_sum, fn_ps);
         logfile << "Written the power spectrum for CTF estimation: " << fn_ps << std::endl;
         logfile << "The pixel size for CTF estimation: " << ps_angpix << std::endl;
     }
@@ -1486,26 +1585,48 @@ bool MotioncorrRunner::executeOwnMotionCorrection(Micrograph &mic) {
     }
 
     skip_fitting:
+    // Set the start frame for the local motion model.
+    mic.first_frame = frames[0] + 1; // NOTE that this is 1-indexed.
+
+    return true;
+}
+
+void MotioncorrRunner::sumMovie(
+    MovieFrames &movie, MotionModel *model, RFLOAT angpix, RFLOAT voltage, std::ostream &logfile
+) {
+    FileName fn_avg = getOutputFileNames(movie.fn_mic);
+    FileName fn_avg_noDW = fn_avg.withoutExtension() + "_noDW.mrc";
+
+    std::vector<Image<float> > &Iframes = movie.Iframes;
+    std::vector<MultidimArray<fComplex> > &Fframes = movie.Fframes;
+    const std::vector<int> &frames = movie.frames; // 0-indexed
+    Image<float> Iref;
+
+    RFLOAT output_angpix = angpix * bin_factor;
+    RFLOAT prescaling = early_binning ? bin_factor : 1;
+
+    const int n_frames = frames.size();
+
     if (!do_dose_weighting || save_noDW) {
         Iref().reshape(Iframes[0]());
         Iref().initZeros();
 
         {
-        ifdefTIMING(TicToc tt (MCtimer, TIMING_REAL_SPACE_INTERPOLATION);)
+        ifdefTIMING(TicToc tt (MCsumTimer, TIMING_REAL_SPACE_INTERPOLATION);)
         logfile << "Summing frames before dose weighting: ";
-        realSpaceInterpolation(Iref, Iframes, mic.model, logfile);
+        realSpaceInterpolation(Iref, Iframes, model, logfile);
         logfile << " done" << std::endl;
         }
 
         // Apply binning
         {
-        ifdefTIMING(TicToc tt (MCtimer, TIMING_BINNING);)
+        ifdefTIMING(TicToc tt (MCsumTimer, TIMING_BINNING);)
         if (!early_binning && bin_factor != 1) {
             binNonSquareImage(Iref, bin_factor);
         }
         }
 
-        // Final output
+        // Final output (written here, as this may already run on the writer thread of the pipeline)
         Iref.setSamplingRateInHeader(output_angpix, output_angpix);
         Iref.write(!do_dose_weighting ? fn_avg : fn_avg_noDW);
         logfile << "Written aligned but non-dose weighted sum to " << (!do_dose_weighting ? fn_avg : fn_avg_noDW) << std::endl;
@@ -1514,11 +1635,8 @@ bool MotioncorrRunner::executeOwnMotionCorrection(Micrograph &mic) {
     // Dose weighting
     if (do_dose_weighting) {
         {
-        ifdefTIMING(TicToc tt (MCtimer, TIMING_DOSE_WEIGHTING);)
-        if (std::abs(voltage - 300) > 2 && std::abs(voltage - 200) > 2 && std::abs(voltage - 100) > 2) {
-            REPORT_ERROR("Sorry, dose weighting is supported only for 300, 200 or 100 kV");
-        }
-
+        ifdefTIMING(TicToc tt (MCsumTimer, TIMING_DOSE_WEIGHTING);)
+        // The voltage was checked by executeOwnMotionCorrection
         std::vector <RFLOAT> doses(n_frames);
         for (int iframe = 0; iframe < n_frames; iframe++) {
             // dose AFTER each frame.
@@ -1531,13 +1649,13 @@ bool MotioncorrRunner::executeOwnMotionCorrection(Micrograph &mic) {
         }
 
         {
-        ifdefTIMING(TicToc tt (MCtimer, TIMING_DW_WEIGHT);)
+        ifdefTIMING(TicToc tt (MCsumTimer, TIMING_DW_WEIGHT);)
         doseWeighting(Fframes, doses, angpix * prescaling);
         }
 
         // Update real space images
         {
-        ifdefTIMING(TicToc tt (MCtimer, TIMING_DW_IFFT);)
+        ifdefTIMING(TicToc tt (MCsumTimer, TIMING_DW_IFFT);)
         #pragma omp parallel for num_threads(n_threads)
         for (int iframe = 0; iframe < n_frames; iframe++) {
             NewFFT::inverseFourierTransform(Fframes[iframe], Iframes[iframe]());
@@ -1549,30 +1667,25 @@ bool MotioncorrRunner::executeOwnMotionCorrection(Micrograph &mic) {
         Iref().reshape(Iframes[0]());
         Iref().initZeros();
         {
-        ifdefTIMING(TicToc tt (MCtimer, TIMING_REAL_SPACE_INTERPOLATION);)
+        ifdefTIMING(TicToc tt (MCsumTimer, TIMING_REAL_SPACE_INTERPOLATION);)
         logfile << "Summing frames after dose weighting: ";
-        realSpaceInterpolation(Iref, Iframes, mic.model, logfile);
+        realSpaceInterpolation(Iref, Iframes, model, logfile);
         logfile << " done" << std::endl;
         }
 
         // Apply binning
         {
-        ifdefTIMING(TicToc tt (MCtimer, TIMING_BINNING);)
+        ifdefTIMING(TicToc tt (MCsumTimer, TIMING_BINNING);)
         if (!early_binning && bin_factor != 1) {
             binNonSquareImage(Iref, bin_factor);
         }
         }
 
-        // Final output
+        // Final output (written here, as this may already run on the writer thread of the pipeline)
         Iref.setSamplingRateInHeader(output_angpix, output_angpix);
         Iref.write(fn_avg);
         logfile << "Written aligned and dose-weighted sum to " << fn_avg << std::endl;
     }
-
-    // Set the start frame for the local motion model.
-    mic.first_frame = frames[0] + 1; // NOTE that this is 1-indexed.
-
-    return true;
 }
 
 void MotioncorrRunner::interpolateShifts(
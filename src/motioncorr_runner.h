@@ -27,10 +27,12 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <algorithm>
+#include <memory>
 #include <src/time.h>
 #include "src/metadata_table.h"
 #include "src/image.h"
 #include "src/micrograph_model.h"
+#include "src/movie_pipeline.h"
 #include "src/jaz/new_ft.h"
 #include "src/jaz/obs_model.h"
 
@@ -48,6 +50,10 @@ public:
 	int n_threads;
 	int max_io_threads;
 
+	// Number of movies read ahead of (and written behind) the one being aligned by our own implementation
+	int pipeline_depth;
+	MoviePipeline pipeline;
+
 	// Output rootname
 	FileName fn_in, fn_out, fn_movie;
 
@@ -173,6 +179,12 @@ public:
 	// Execute our own implementation for a single micrograph
 	bool executeOwnMotionCorrection(Micrograph &mic);
 
+	// Start reading the movies of micrographs first ... last ahead of executeOwnMotionCorrection (if pipeline_depth > 0)
+	void startPipeline(long int first, long int last);
+
+	// Read the frames of movie.fn_mic that are to be used, and apply the gain reference
+	void readMovieFrames(MovieFrames &movie);
+
 	// Plot the shifts
 	void plotShifts(FileName fn_mic, Micrograph &mic);
 
@@ -192,6 +204,16 @@ public:
 	static bool detectSerialEMDefectText(FileName fn_defect);
 
 private:
+	// Align the frames of a movie, read by readMovieFrames
+	bool alignMovie(Micrograph &mic, MovieFrames &movie, std::ostream &logfile);
+
+	// Dose weight and sum the frames of an aligned movie, and write the sums.
+	// Runs on the writer thread of the pipeline (if it runs), so it is given the model, angpix and voltage of the movie.
+	void sumMovie(MovieFrames &movie, MotionModel *model, RFLOAT angpix, RFLOAT voltage, std::ostream &logfile);
+
+	// Write an output image, on the writer thread of the pipeline if it runs
+	void writeImage(Image<float> &img, const FileName &fn);
+
 	// shiftx, shifty is relative to the (real space) image size
 	void shiftNonSquareImageInFourierTransform(MultidimArray<fComplex> &frame, RFLOAT shiftx, RFLOAT shifty);
 
@@ -56,6 +56,8 @@ void MotioncorrRunnerMpi::run() {
         barstep = std::max(1, (int) my_nr_micrographs / 60);
     }
 
+    startPipeline(my_first_micrograph, my_last_micrograph);
+
     for (long int imic = my_first_micrograph; imic <= my_last_micrograph; imic++) {
         if (verb > 0 && imic % barstep == 0)
             progress_bar(imic);
@@ -84,6 +86,9 @@ void MotioncorrRunnerMpi::run() {
             plotShifts(fn_micrographs[imic], mic);
         }
     }
+    // Wait for the last sums to be written
+    pipeline.finish();
+
     if (verb > 0)
         progress_bar(my_nr_micrographs);
 
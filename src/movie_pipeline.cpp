@@ -0,0 +1,157 @@
+/***************************************************************************
+ *
+ * Author: "agent"
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This complete copyright notice must be included in any revised version of the
+ * source code. Additional authorship citations may be added, but existing
+ * author citations must be preserved.
+ ***************************************************************************/
+
+#include "src/movie_pipeline.h"
+#include <memory>
+
+void MoviePipeline::start(int depth, const std::vector<FileName> &fn_movies, Reader read) {
+    shutdown();
+    this->depth = depth;
+    this->read = read;
+    stop = false;
+    writing = false;
+    write_error = "";
+    to_read.assign(fn_movies.begin(), fn_movies.end());
+    pool.resize(depth + 2);
+    reader = std::thread(&MoviePipeline::runReader, this);
+    writer = std::thread(&MoviePipeline::runWriter, this);
+}
+
+void MoviePipeline::finish() {
+    shutdown();
+    if (!write_error.empty()) {
+        const std::string error = write_error;
+        write_error = "";
+        REPORT_ERROR("MoviePipeline: " + error);
+    }
+}
+
+void MoviePipeline::shutdown() {
+    if (!reader.joinable()) return;
+    {
+        // Let the writer empty its queue first
+        std::unique_lock<std::mutex> lock (mutex);
+        changed.wait(lock, [this] { return tasks.empty() && !writing; });
+        stop = true;
+    }
+    changed.notify_all();
+    reader.join();
+    writer.join();
+    to_read.clear();
+    ready.clear();
+    pool.clear();
+}
+
+MovieFrames MoviePipeline::take(const FileName &fn_mic) {
+    std::unique_lock<std::mutex> lock (mutex);
+    changed.wait(lock, [this] { return !ready.empty() || to_read.empty(); });
+    if (ready.empty() || ready.front().fn_mic != fn_mic)
+        REPORT_ERROR("MoviePipeline::take BUG: movies are not taken in the order they were scheduled");
+
+    MovieFrames movie = std::move(ready.front());
+    ready.pop_front();
+    lock.unlock();
+
+    if (!movie.error.empty())
+        REPORT_ERROR("MoviePipeline: " + movie.error);
+    return movie;
+}
+
+void MoviePipeline::recycle(MovieFrames &&movie) {
+    {
+        std::lock_guard<std::mutex> guard (mutex);
+        pool.push_back(std::move(movie));
+    }
+    changed.notify_all();
+}
+
+void MoviePipeline::post(Task task) {
+    std::unique_lock<std::mutex> lock (mutex);
+    if (!write_error.empty())
+        REPORT_ERROR("MoviePipeline: " + write_error);
+
+    // At most two tasks (power spectrum, and sums) per movie in the queue
+    changed.wait(lock, [this] { return tasks.size() < 2 * depth; });
+    tasks.push_back(std::move(task));
+    lock.unlock();
+    changed.notify_all();
+}
+
+void MoviePipeline::write(const Image<float> &img, const FileName &fn) {
+    const auto copy = std::make_shared<Image<float>>(img);
+    post([copy, fn] { copy->write(fn); });
+}
+
+void MoviePipeline::runReader() {
+    std::unique_lock<std::mutex> lock (mutex);
+    while (true) {
+        // Wait until there is a movie to read and a free buffer to read it into
+        changed.wait(lock, [this] { return stop || !to_read.empty() && !pool.empty(); });
+        if (stop) return;
+
+        MovieFrames movie = std::move(pool.back());
+        pool.pop_back();
+        movie.fn_mic = to_read.front();
+        lock.unlock();
+
+        movie.log = "";
+        movie.error = "";
+        try {
+            read(movie);
+        } catch (const RelionError &err) {
+            movie.error = err.msg;
+        } catch (const std::exception &err) {
+            movie.error = err.what();
+        }
+
+        lock.lock();
+        ready.push_back(std::move(movie));
+        to_read.pop_front();
+        changed.notify_all();
+    }
+}
+
+void MoviePipeline::runWriter() {
+    std::unique_lock<std::mutex> lock (mutex);
+    while (true) {
+        changed.wait(lock, [this] { return stop || !tasks.empty(); });
+        if (tasks.empty()) return;  // Only when stopping
+
+        const Task task = std::move(tasks.front());
+        tasks.pop_front();
+        writing = true;
+        lock.unlock();
+        changed.notify_all();  // Room in the queue
+
+        std::string error;
+        try {
+            task();
+        } catch (const RelionError &err) {
+            error = err.msg;
+        } catch (const std::exception &err) {
+            error = err.what();
+        }
+
+        lock.lock();
+        writing = false;
+        if (!error.empty() && write_error.empty())
+            write_error = error;
+        changed.notify_all();
+    }
+}
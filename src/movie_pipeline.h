@@ -0,0 +1,120 @@
+/***************************************************************************
+ *
+ * Author: "agent"
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This complete copyright notice must be included in any revised version of the
+ * source code. Additional authorship citations may be added, but existing
+ * author citations must be preserved.
+ ***************************************************************************/
+
+#ifndef MOVIE_PIPELINE_H_
+#define MOVIE_PIPELINE_H_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "src/filename.h"
+#include "src/image.h"
+#include "src/complex.h"
+
+// The frames of a movie, read (and gain-corrected) ahead of its alignment
+struct MovieFrames {
+    FileName fn_mic;
+    bool isEER;
+    int nx, ny, nn;                               // Size of the movie
+    std::vector<int> frames;                      // The frames to use (0-indexed)
+    std::vector<Image<float>> Iframes;            // Those frames
+    std::vector<MultidimArray<fComplex>> Fframes; // Room for their Fourier transforms
+    Image<float> Igain;                           // Gain reference (kept between movies)
+    std::string log;                              // Lines for the logfile of the movie
+    std::string error;
+};
+
+/* Overlaps reading, and summing and writing, of movies with their alignment.
+ *
+ * All movies to be processed are scheduled in start(), in the order they will be taken.
+ * A reader thread reads at most `depth` movies ahead of the one being aligned, and a writer
+ * thread runs the tasks posted for the previous ones (dose weighting, summing and writing
+ * their output images), so that for every movie one only waits for the alignment itself.
+ *
+ * The frame buffers are pooled: there are depth + 2 of them (those read ahead, the one being
+ * aligned and the one being summed), and recycle() hands a movie's buffers back for reading
+ * the next one, so that their memory does not have to be allocated (and faulted in) again
+ * for every movie.
+ */
+class MoviePipeline {
+
+    public:
+
+    typedef std::function<void(MovieFrames &movie)> Reader;
+
+    typedef std::function<void()> Task;
+
+    MoviePipeline(): depth(0), stop(false) {}
+
+    ~MoviePipeline() { shutdown(); }
+
+    // Start reading fn_movies (depth > 0) with read, which fills in a movie after its fn_mic
+    void start(int depth, const std::vector<FileName> &fn_movies, Reader read);
+
+    // Wait for all tasks, then stop both threads (dropping all movies that were not taken).
+    // Reports the first error of the writer, if any.
+    void finish();
+
+    bool isRunning() const { return reader.joinable(); }
+
+    // The frames of the next movie, which has to be fn_mic (waiting for them if need be)
+    MovieFrames take(const FileName &fn_mic);
+
+    // Hand the buffers of a taken movie back (from any thread)
+    void recycle(MovieFrames &&movie);
+
+    // Run task on the writer thread, after all tasks posted before it.
+    // Tasks must not post tasks themselves.
+    void post(Task task);
+
+    // Write a copy of img to fn on the writer thread
+    void write(const Image<float> &img, const FileName &fn);
+
+    private:
+
+    int depth;
+    bool stop;
+    Reader read;
+
+    std::deque<FileName> to_read;   // Movies still to be read
+    std::deque<MovieFrames> ready;  // Movies read, in the order they will be taken
+    std::vector<MovieFrames> pool;  // Free buffers
+
+    std::deque<Task> tasks;
+    bool writing;
+    std::string write_error;
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::thread reader, writer;
+
+    // finish(), without reporting errors
+    void shutdown();
+
+    void runReader();
+
+    void runWriter();
+
+};
+
+#endif
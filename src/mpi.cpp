@@ -44,6 +44,10 @@
  ***************************************************************************/
 
 #include "src/mpi.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <vector>
 //#define MPI_DEBUG
 
 //------------ MPI ---------------------------
@@ -65,6 +69,24 @@ MpiNode::MpiNode(int &argc, char ** argv) {
     } else {
         MPI_Group_rank(followerG, &followerRank);
     }
+
+    // Set up one communicator per random subset of followers (1, 3, 5, ... and 2, 4, 6, ...)
+    MPI_Comm_split(MPI_COMM_WORLD, rank == 0 ? MPI_UNDEFINED : myRandomSubset(), rank, &halfsetC);
+
+    // Set up one communicator per host (ranks that can share memory)
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &nodeC);
+    MPI_Comm_rank(nodeC, &nodeRank);
+
+    // And the same for the followers only, with one communicator linking the hosts
+    followerNodeC = followerHostsC = MPI_COMM_NULL;
+    followerNodeRank = followerHost = -1;
+    if (rank != 0) {
+        MPI_Comm_split_type(followerC, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &followerNodeC);
+        MPI_Comm_rank(followerNodeC, &followerNodeRank);
+    }
+    MPI_Comm_split(MPI_COMM_WORLD, followerNodeRank == 0 ? 0 : MPI_UNDEFINED, rank, &followerHostsC);
+    if (followerNodeRank == 0) MPI_Comm_rank(followerHostsC, &followerHost);
+    if (rank != 0) MPI_Bcast(&followerHost, 1, MPI_INT, 0, followerNodeC);
 }
 
 MpiNode::~MpiNode() {
@@ -91,6 +113,54 @@ void MpiNode::barrierWait() {
     MPI_Barrier(MPI_COMM_WORLD);
 }
 
+std::shared_ptr<SharedMemorySegment> MpiNode::shareOnNode(const void *data, size_t size) {
+    return mapOnNode(data, size, nodeC, false);
+}
+
+std::shared_ptr<SharedMemorySegment> MpiNode::allocateOnNode(size_t size, MPI_Comm comm) {
+    return mapOnNode(nullptr, size, comm, true);
+}
+
+std::shared_ptr<SharedMemorySegment> MpiNode::mapOnNode(const void *data, size_t size, MPI_Comm comm, bool is_writable) {
+    int comm_rank;
+    MPI_Comm_rank(comm, &comm_rank);
+
+    // Rank 0 decides on the size and the name
+    unsigned long long bytes = size;
+    MPI_Bcast(&bytes, 1, MPI_UNSIGNED_LONG_LONG, 0, comm);
+    if (bytes == 0) return nullptr;
+
+    static int counter = 0;
+    char name[64];
+    snprintf(name, sizeof(name), "/relion_%d_%d_%d", (int) getpid(), rank, counter++);
+    MPI_Bcast(name, sizeof(name), MPI_CHAR, 0, comm);
+
+    // Create (and fill) the segment, then let the others map it
+    std::shared_ptr<SharedMemorySegment> segment;
+    int ok = 1;
+    if (comm_rank == 0) {
+        try {
+            segment = std::make_shared<SharedMemorySegment>(name, bytes, true);
+            if (data) memcpy(segment->data(), data, bytes);
+        } catch (RelionError &e) {
+            std::cerr << e;
+            ok = 0;
+        }
+    }
+    MPI_Bcast(&ok, 1, MPI_INT, 0, comm);
+    if (!ok)
+        REPORT_ERROR("MpiNode: cannot create a shared memory segment of " + std::to_string(bytes) + " bytes on " + getHostName());
+
+    if (comm_rank != 0)
+        segment = std::make_shared<SharedMemorySegment>(name, bytes, false, is_writable);
+
+    // Once everyone has it mapped, the name is no longer needed
+    MPI_Barrier(comm);
+    if (comm_rank == 0) segment->unlink();
+
+    return segment;
+}
+
 // MPI_TEST will be executed every this many seconds: so this determines the minimum time taken for every send operation!!
 //#define VERBOSE_MPISENDRECV
 int MpiNode::relion_MPI_Send(void *buf, std::ptrdiff_t count, MPI_Datatype datatype, int dest, int tag, MPI_Comm comm) {
@@ -246,6 +316,177 @@ int MpiNode::relion_MPI_Bcast(
     }
 }
 
+int MpiNode::relion_MPI_Allreduce_sum(RFLOAT *buf, std::ptrdiff_t count, MPI_Comm comm) {
+    int nranks, me;
+    MPI_Comm_size(comm, &nranks);
+    MPI_Comm_rank(comm, &me);
+    if (nranks < 2 || count <= 0) return MPI_SUCCESS;
+
+    const int right = (me + 1) % nranks;
+    const int left  = (me - 1 + nranks) % nranks;
+
+    // Block b of the buffer is [offset(b), offset(b + 1))
+    const auto offset = [count, nranks] (int b) -> std::ptrdiff_t {
+        return count / nranks * b + std::min<std::ptrdiff_t>(b, count % nranks);
+    };
+    const auto block = [nranks] (int b) { return ((b % nranks) + nranks) % nranks; };
+
+    // 4M elements (32 MB in double precision) per message
+    const std::ptrdiff_t chunksize = 4 * 1024 * 1024;
+    std::vector<RFLOAT> recvbuf (offset(1));
+    std::vector<MPI_Request> sends, recvs;
+
+    // Send block sendb to the right and receive block recvb from the left.
+    // Chunks are added into (or copied over) recvb as they arrive.
+    const auto step = [&] (int sendb, int recvb, bool do_sum) {
+        const std::ptrdiff_t sendstart = offset(sendb), sendsize = offset(sendb + 1) - sendstart;
+        const std::ptrdiff_t recvstart = offset(recvb), recvsize = offset(recvb + 1) - recvstart;
+        sends.clear();
+        recvs.clear();
+        for (std::ptrdiff_t i = 0; i < recvsize; i += chunksize) {
+            recvs.emplace_back();
+            int result = MPI_Irecv(
+                recvbuf.data() + i, std::min(chunksize, recvsize - i), relion_MPI::DOUBLE,
+                left, MPITag::PACK, comm, &recvs.back());
+            possibly_report_MPI_ERROR(result);
+        }
+        for (std::ptrdiff_t i = 0; i < sendsize; i += chunksize) {
+            sends.emplace_back();
+            int result = MPI_Isend(
+                buf + sendstart + i, std::min(chunksize, sendsize - i), relion_MPI::DOUBLE,
+                right, MPITag::PACK, comm, &sends.back());
+            possibly_report_MPI_ERROR(result);
+        }
+        for (int n = 0; n < recvs.size(); n++) {
+            int ichunk;
+            MPI_Status status;
+            int result = MPI_Waitany(recvs.size(), recvs.data(), &ichunk, &status);
+            possibly_report_MPI_ERROR(result);
+            const std::ptrdiff_t i = ichunk * chunksize;
+            RFLOAT *const dest = buf + recvstart + i;
+            const RFLOAT *const src = recvbuf.data() + i;
+            const std::ptrdiff_t n_elem = std::min(chunksize, recvsize - i);
+            if (do_sum) {
+                for (std::ptrdiff_t j = 0; j < n_elem; j++) dest[j] += src[j];
+            } else {
+                std::copy(src, src + n_elem, dest);
+            }
+        }
+        if (!sends.empty()) {
+            int result = MPI_Waitall(sends.size(), sends.data(), MPI_STATUSES_IGNORE);
+            possibly_report_MPI_ERROR(result);
+        }
+    };
+
+    // Reduce-scatter: afterwards, this rank holds the complete sum of block (me + 1)
+    for (int s = 0; s < nranks - 1; s++)
+        step(block(me - s), block(me - s - 1), true);
+
+    // Allgather: pass the completed blocks around the ring
+    for (int s = 0; s < nranks - 1; s++)
+        step(block(me + 1 - s), block(me - s), false);
+
+    return MPI_SUCCESS;
+}
+
+int MpiNode::relion_MPI_Allreduce_sum_float(RFLOAT *buf, std::ptrdiff_t count, MPI_Comm comm) {
+    int nranks, me;
+    MPI_Comm_size(comm, &nranks);
+    MPI_Comm_rank(comm, &me);
+    if (count <= 0) return MPI_SUCCESS;
+
+    // Block b of the buffer is [offset(b), offset(b + 1))
+    const auto offset = [count, nranks] (int b) -> std::ptrdiff_t {
+        return count / nranks * b + std::min<std::ptrdiff_t>(b, count % nranks);
+    };
+    const std::ptrdiff_t mystart = offset(me), mysize = offset(me + 1) - mystart;
+
+    // 8M elements (32 MB in single precision) per message
+    const std::ptrdiff_t chunksize = 8 * 1024 * 1024;
+    std::vector<float> sendbuf (buf, buf + count);
+    std::vector<MPI_Request> sends, recvs;
+
+    const auto send = [&] (const float *from, std::ptrdiff_t size, int dest) {
+        for (std::ptrdiff_t i = 0; i < size; i += chunksize) {
+            sends.emplace_back();
+            int result = MPI_Isend(
+                from + i, std::min(chunksize, size - i), MPI_FLOAT,
+                dest, MPITag::PACK, comm, &sends.back());
+            possibly_report_MPI_ERROR(result);
+        }
+    };
+    const auto receive = [&] (float *into, std::ptrdiff_t size, int source) {
+        for (std::ptrdiff_t i = 0; i < size; i += chunksize) {
+            recvs.emplace_back();
+            int result = MPI_Irecv(
+                into + i, std::min(chunksize, size - i), MPI_FLOAT,
+                source, MPITag::PACK, comm, &recvs.back());
+            possibly_report_MPI_ERROR(result);
+        }
+    };
+
+    // Reduce-scatter: every other rank sends its contribution to my block,
+    // which I add to mine in the order in which the chunks arrive
+    std::vector<float> recvbuf ((nranks - 1) * mysize);
+    std::vector<std::ptrdiff_t> chunk_start;  // Into recvbuf, for each receive request
+    for (int s = 0, slot = 0; s < nranks; s++) {
+        if (s == me) continue;
+        receive(recvbuf.data() + slot * mysize, mysize, s);
+        for (std::ptrdiff_t i = 0; i < mysize; i += chunksize)
+            chunk_start.push_back(slot * mysize + i);
+        slot++;
+    }
+    for (int s = 0; s < nranks; s++) {
+        if (s != me) send(sendbuf.data() + offset(s), offset(s + 1) - offset(s), s);
+    }
+
+    std::vector<RFLOAT> compensation (mysize, 0.0);
+    for (int n = 0; n < recvs.size(); n++) {
+        int ichunk;
+        MPI_Status status;
+        int result = MPI_Waitany(recvs.size(), recvs.data(), &ichunk, &status);
+        possibly_report_MPI_ERROR(result);
+        const std::ptrdiff_t start = chunk_start[ichunk], i = start % mysize;
+        const std::ptrdiff_t n_elem = std::min(chunksize, mysize - i);
+        RFLOAT *const sum = buf + mystart + i;
+        RFLOAT *const c = compensation.data() + i;
+        const float *const src = recvbuf.data() + start;
+        for (std::ptrdiff_t j = 0; j < n_elem; j++) {
+            const RFLOAT y = (RFLOAT) src[j] - c[j];
+            const RFLOAT t = sum[j] + y;
+            c[j] = (t - sum[j]) - y;
+            sum[j] = t;
+        }
+    }
+    if (!sends.empty()) {
+        int result = MPI_Waitall(sends.size(), sends.data(), MPI_STATUSES_IGNORE);
+        possibly_report_MPI_ERROR(result);
+    }
+    sends.clear();
+    recvs.clear();
+    recvbuf.clear();
+
+    // Allgather: my block, rounded, goes to everyone (and into sendbuf, like the other blocks)
+    for (std::ptrdiff_t j = 0; j < mysize; j++)
+        sendbuf[mystart + j] = buf[mystart + j];
+    for (int s = 0; s < nranks; s++) {
+        if (s == me) continue;
+        receive(sendbuf.data() + offset(s), offset(s + 1) - offset(s), s);
+        send(sendbuf.data() + mystart, mysize, s);
+    }
+    if (!recvs.empty()) {
+        int result = MPI_Waitall(recvs.size(), recvs.data(), MPI_STATUSES_IGNORE);
+        possibly_report_MPI_ERROR(result);
+    }
+    if (!sends.empty()) {
+        int result = MPI_Waitall(sends.size(), sends.data(), MPI_STATUSES_IGNORE);
+        possibly_report_MPI_ERROR(result);
+    }
+    std::copy(sendbuf.begin(), sendbuf.end(), buf);
+
+    return MPI_SUCCESS;
+}
+
 void MpiNode::possibly_report_MPI_ERROR(int error_code) {
     if (error_code == MPI_SUCCESS) return;
     char error_string[200];
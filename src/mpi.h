@@ -49,8 +49,10 @@
 #include <cstdlib>
 #include <cstdio>
 #include <unistd.h>
+#include <memory>
 #include "src/error.h"
 #include "src/macros.h"
+#include "src/shared_memory.h"
 
 namespace relion_MPI {
 
@@ -92,6 +94,22 @@ class MpiNode {
     MPI_Comm worldC, followerC; // communicators
     int followerRank; // index of follower within the follower-group (and communicator)
 
+    // Followers of the same random subset (MPI_COMM_NULL on the leader)
+    MPI_Comm halfsetC;
+
+    // All ranks on the same host, and the index of this rank among them
+    MPI_Comm nodeC;
+    int nodeRank;
+
+    // Followers on the same host, and the index of this follower among them (MPI_COMM_NULL and -1 on the leader)
+    MPI_Comm followerNodeC;
+    int followerNodeRank;
+
+    // The first follower on every host (MPI_COMM_NULL on the others),
+    // and the index of the host of this follower among those (-1 on the leader)
+    MPI_Comm followerHostsC;
+    int followerHost;
+
     MpiNode(int &argc, char **argv);
 
     ~MpiNode();
@@ -115,9 +133,43 @@ class MpiNode {
 
     int relion_MPI_Bcast(void *buffer, long int count, MPI_Datatype datatype, int root, MPI_Comm comm);
 
+    /** In-place sum of buf over all ranks in comm.
+     *
+     * Ring reduce-scatter followed by a ring allgather,
+     * so each rank sends and receives 2 (P - 1) / P times the buffer regardless of P.
+     * Every ring step is split into chunks with non-blocking transfers,
+     * so that summing one chunk overlaps with receiving the next.
+     */
+    int relion_MPI_Allreduce_sum(RFLOAT *buf, std::ptrdiff_t count, MPI_Comm comm);
+
+    /** As relion_MPI_Allreduce_sum, but sending everything in single precision (half the volume in double-precision builds).
+     *
+     * Every rank sums block r of the buffer for rank r itself: it receives the other ranks' (single-precision) contributions
+     * and adds them to its own with Kahan-compensated summation, so that the sum is only rounded once,
+     * when it is passed on to the others. All ranks end up with the same (rounded) values.
+     */
+    int relion_MPI_Allreduce_sum_float(RFLOAT *buf, std::ptrdiff_t count, MPI_Comm comm);
+
+    /** Copy size bytes from data on node rank 0 (data is ignored on the others)
+     * into a segment of shared memory that all ranks on this host can read.
+     * Collective over nodeC. Returns nullptr if size is 0 on node rank 0.
+     */
+    std::shared_ptr<SharedMemorySegment> shareOnNode(const void *data, size_t size);
+
+    /** Allocate size bytes (the value on rank 0 of comm counts) of shared memory that all ranks in comm can read and write.
+     * comm must only contain ranks on this host (e.g. nodeC or followerNodeC). Collective over comm.
+     * Returns nullptr if size is 0.
+     */
+    std::shared_ptr<SharedMemorySegment> allocateOnNode(size_t size, MPI_Comm comm);
+
     /* Better error handling of MPI error messages */
     void possibly_report_MPI_ERROR(int error_code);
 
+    private:
+
+    // Create a shared memory segment on rank 0 of comm (copying data into it, if given) and map it on the others
+    std::shared_ptr<SharedMemorySegment> mapOnNode(const void *data, size_t size, MPI_Comm comm, bool is_writable);
+
 };
 
 // General function to print machine names on all MPI nodes
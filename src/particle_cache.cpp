@@ -0,0 +1,214 @@
+/***************************************************************************
+ *
+ * Author: "agent"
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This complete copyright notice must be included in any revised version of the
+ * source code. Additional authorship citations may be added, but existing
+ * author citations must be preserved.
+ ***************************************************************************/
+
+#include "src/particle_cache.h"
+#include <cmath>
+#include <cstring>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace {
+
+    // IEEE half precision, rounding to the nearest (even) value
+    std::uint16_t floatToHalf(float f) {
+        std::uint32_t x;
+        std::memcpy(&x, &f, 4);
+        const std::uint32_t sign = (x >> 16) & 0x8000, abs = x & 0x7fffffff;
+        if (abs > 0x7f800000) return sign | 0x7e00;  // NaN
+        if (abs >= 0x47800000) return sign | 0x7c00;  // Too large: infinity
+        const std::uint32_t e = abs >> 23, mant = abs & 0x7fffff;
+        if (e >= 113) {
+            // Normal (a carry out of the mantissa correctly increments the exponent)
+            std::uint32_t h = (e - 112) << 10 | mant >> 13;
+            const std::uint32_t rem = mant & 0x1fff;
+            if (rem > 0x1000 || rem == 0x1000 && (h & 1)) h++;
+            return sign | h;
+        }
+        if (e < 102) return sign;  // Below half of the smallest subnormal
+        // Subnormal
+        const std::uint32_t m = mant | 0x800000, shift = 126 - e;
+        std::uint32_t h = m >> shift;
+        const std::uint32_t rem = m & ((1u << shift) - 1), halfway = 1u << shift - 1;
+        if (rem > halfway || rem == halfway && (h & 1)) h++;
+        return sign | h;
+    }
+
+    float halfToFloat(std::uint16_t h) {
+        const std::uint32_t sign = (std::uint32_t) (h & 0x8000) << 16, e = h >> 10 & 0x1f, m = h & 0x3ff;
+        std::uint32_t x;
+        if (e == 0) {
+            const float f = std::ldexp((float) m, -24);
+            return sign ? -f : f;
+        } else if (e == 31) {
+            x = sign | 0x7f800000 | m << 13;
+        } else {
+            x = sign | (e + 112) << 23 | m << 13;
+        }
+        float f;
+        std::memcpy(&f, &x, 4);
+        return f;
+    }
+
+    // All 65536 half precision values, so that decoding is a lookup
+    const std::vector<float>& halfTable() {
+        static const std::vector<float> table = [] {
+            std::vector<float> t (65536);
+            for (std::uint32_t h = 0; h < 65536; h++) t[h] = halfToFloat(h);
+            return t;
+        }();
+        return table;
+    }
+
+}
+
+ParticleImageCache::Format ParticleImageCache::formatFromString(const std::string &name) {
+    if (name.empty() || name == "none") return NONE;
+    if (name == "float16") return FLOAT16;
+    if (name == "lossless") {
+        #ifndef HAVE_ZLIB
+        REPORT_ERROR("ParticleImageCache: lossless compression of pre-read images requires RELION to be compiled with zlib; use float16 instead.");
+        #endif
+        return LOSSLESS;
+    }
+    REPORT_ERROR("ParticleImageCache: unknown compression " + name + " (use float16 or lossless)");
+}
+
+void ParticleImageCache::clear() {
+    index.clear();
+    std::vector<char>().swap(buffer);
+    data_ = nullptr;
+    size_ = 0;
+    owner.reset();
+    raw_bytes = 0;
+    expected_nr_images = 0;
+}
+
+void ParticleImageCache::add(long int id, const MultidimArray<float> &img) {
+    if (data_)
+        REPORT_ERROR("ParticleImageCache::add BUG: cannot add images to adopted blocks");
+    if (id >= index.size()) index.resize(id + 1, Entry {0, 0, 0, 0, 0, 0});
+
+    const size_t n = img.size();
+    const size_t offset = buffer.size();
+
+    switch (format) {
+
+        case FLOAT16: {
+        buffer.resize(offset + n * 2);
+        std::uint16_t *dest = reinterpret_cast<std::uint16_t*>(buffer.data() + offset);
+        for (size_t i = 0; i < n; i++) {
+            dest[i] = floatToHalf(img.data[i]);
+            if ((dest[i] & 0x7fff) == 0x7c00 && std::isfinite(img.data[i]))
+                REPORT_ERROR("ParticleImageCache: image " + integerToString(id) + " has values beyond the float16 range (65504); normalise the particles or use lossless compression.");
+        }
+        break;
+        }
+
+        case LOSSLESS: {
+        #ifdef HAVE_ZLIB
+        // Byte planes compress much better than interleaved floats (the exponents are all similar)
+        std::vector<unsigned char> planes (n * 4);
+        const unsigned char *src = reinterpret_cast<const unsigned char*>(img.data);
+        for (size_t i = 0; i < n; i++)
+        for (int b = 0; b < 4; b++)
+            planes[b * n + i] = src[i * 4 + b];
+
+        uLongf len = compressBound(planes.size());
+        std::vector<unsigned char> packed (len);
+        if (compress2(packed.data(), &len, planes.data(), planes.size(), 1) != Z_OK)
+            REPORT_ERROR("ParticleImageCache::add: zlib failed to compress an image");
+        if (len < planes.size()) {
+            buffer.insert(buffer.end(), packed.begin(), packed.begin() + len);
+        } else {
+            // Incompressible: keep the planes as they are
+            buffer.insert(buffer.end(), planes.begin(), planes.end());
+        }
+        #endif
+        break;
+        }
+
+        default:
+        REPORT_ERROR("ParticleImageCache::add BUG: the cache is not enabled");
+    }
+
+    if (offset == 0 && expected_nr_images > 1) {
+        // Lossless blocks vary in size: leave some room
+        const double factor = format == LOSSLESS ? 1.1 : 1.0;
+        buffer.reserve(factor * buffer.size() * expected_nr_images);
+    }
+
+    index[id] = Entry {offset, buffer.size() - offset, (std::int32_t) img.xdim, (std::int32_t) img.ydim, (std::int32_t) img.zdim, 1};
+    raw_bytes += n * sizeof(float);
+}
+
+void ParticleImageCache::get(long int id, MultidimArray<RFLOAT> &img) const {
+    if (!contains(id))
+        REPORT_ERROR("ParticleImageCache::get BUG: image " + integerToString(id) + " was not pre-read");
+
+    const Entry &entry = index[id];
+    img.reshape(entry.xdim, entry.ydim, entry.zdim);
+    img.setXmippOrigin();
+    const size_t n = img.size();
+    const char *block = data() + entry.offset;
+
+    switch (format) {
+
+        case FLOAT16: {
+        const std::vector<float> &table = halfTable();
+        const std::uint16_t *src = reinterpret_cast<const std::uint16_t*>(block);
+        for (size_t i = 0; i < n; i++) img.data[i] = table[src[i]];
+        break;
+        }
+
+        case LOSSLESS: {
+        #ifdef HAVE_ZLIB
+        std::vector<unsigned char> planes (n * 4);
+        if (entry.size == planes.size()) {
+            std::memcpy(planes.data(), block, planes.size());
+        } else {
+            uLongf len = planes.size();
+            if (uncompress(planes.data(), &len, reinterpret_cast<const Bytef*>(block), entry.size) != Z_OK || len != planes.size())
+                REPORT_ERROR("ParticleImageCache::get: zlib failed to decompress image " + integerToString(id));
+        }
+        for (size_t i = 0; i < n; i++) {
+            unsigned char bytes[4];
+            for (int b = 0; b < 4; b++) bytes[b] = planes[b * n + i];
+            float f;
+            std::memcpy(&f, bytes, 4);
+            img.data[i] = f;
+        }
+        #endif
+        break;
+        }
+
+        default:
+        REPORT_ERROR("ParticleImageCache::get BUG: the cache is not enabled");
+    }
+}
+
+void ParticleImageCache::adopt(const char *data, std::uint64_t size, std::shared_ptr<void> owner) {
+    std::vector<char>().swap(buffer);
+    data_ = data;
+    size_ = size;
+    this->owner = owner;
+    raw_bytes = 0;
+    for (const Entry &entry : index)
+        raw_bytes += (std::uint64_t) entry.xdim * entry.ydim * entry.zdim * sizeof(float);
+}
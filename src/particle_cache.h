@@ -0,0 +1,104 @@
+/***************************************************************************
+ *
+ * Author: "agent"
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This complete copyright notice must be included in any revised version of the
+ * source code. Additional authorship citations may be added, but existing
+ * author citations must be preserved.
+ ***************************************************************************/
+
+#ifndef PARTICLE_CACHE_H_
+#define PARTICLE_CACHE_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "src/multidim_array.h"
+
+/* Compressed copy of the particle images in RAM (--preread_images with --preread_compress).
+ *
+ * Every image is stored as one block, either in half precision (FLOAT16, 2 bytes per pixel)
+ * or bit-exact (LOSSLESS: the four byte planes of the floats are deflated separately).
+ * Images are added while reading the data set and decoded one at a time when they are needed.
+ *
+ * All blocks live in one read-only buffer, which can be handed over to memory shared by
+ * all MPI ranks on a host (see MlOptimiserMpi), so that each host keeps a single copy.
+ */
+class ParticleImageCache {
+
+    public:
+
+    enum Format { NONE, FLOAT16, LOSSLESS };
+
+    // Location of the block of one image
+    struct Entry {
+        std::uint64_t offset, size;
+        std::int32_t xdim, ydim, zdim, is_set;
+    };
+
+    Format format;
+
+    ParticleImageCache(): format(NONE), data_(nullptr), size_(0), raw_bytes(0), expected_nr_images(0) {}
+
+    // "float16", "lossless" or "" (no compression)
+    static Format formatFromString(const std::string &name);
+
+    bool isEnabled() const { return format != NONE; }
+
+    // Remove all images (keeps the format)
+    void clear();
+
+    // Expect about nr_images images (the buffer is sized from the first one)
+    void reserve(long int nr_images) { expected_nr_images = nr_images; }
+
+    // Compress image id (the row of the image in Experiment::MDimg)
+    void add(long int id, const MultidimArray<float> &img);
+
+    bool contains(long int id) const { return id >= 0 && id < index.size() && index[id].is_set; }
+
+    // Decompress image id into img (with the origin in the centre). Safe to call from several threads.
+    void get(long int id, MultidimArray<RFLOAT> &img) const;
+
+    // Size of the compressed blocks and of the images they hold (bytes)
+    std::uint64_t bytes() const { return data_ ? size_ : buffer.size(); }
+    std::uint64_t uncompressedBytes() const { return raw_bytes; }
+
+    // The compressed blocks (one contiguous buffer)
+    const char* data() const { return data_ ? data_ : buffer.data(); }
+
+    // The location of every block
+    std::vector<Entry>& entries() { return index; }
+
+    // Use blocks that now live elsewhere (e.g. in shared memory kept alive by owner) instead of the own buffer
+    void adopt(const char *data, std::uint64_t size, std::shared_ptr<void> owner);
+
+    private:
+
+    std::vector<Entry> index;
+
+    // Blocks added on this rank
+    std::vector<char> buffer;
+
+    // Adopted blocks
+    const char *data_;
+    std::uint64_t size_;
+    std::shared_ptr<void> owner;
+
+    std::uint64_t raw_bytes;
+
+    long int expected_nr_images;
+
+};
+
+#endif
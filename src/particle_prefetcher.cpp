@@ -0,0 +1,153 @@
+/***************************************************************************
+ *
+ * Author: "agent"
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This complete copyright notice must be included in any revised version of the
+ * source code. Additional authorship citations may be added, but existing
+ * author citations must be preserved.
+ ***************************************************************************/
+
+#include "src/particle_prefetcher.h"
+#include "src/image.h"
+#include <chrono>
+
+static double now() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+std::vector<MultidimArray<RFLOAT>> readParticleImages(const std::vector<FileName> &fn_imgs) {
+    std::vector<MultidimArray<RFLOAT>> imgs;
+    imgs.reserve(fn_imgs.size());
+
+    // Images in MRC stacks come from the mapping of the stack shared with the other threads;
+    // others from an open file, which is only opened/closed once for common stacks
+    fImageHandler hFile;
+    FileName fn_open_stack = "";
+    for (const FileName &fn_img : fn_imgs) {
+        Image<RFLOAT> img;
+        if (fn_img.getFileFormat().contains("mrcs") && fn_img.contains("@")) {
+            img.readMapped(fn_img);
+            img().setXmippOrigin();
+            imgs.push_back(std::move(img()));
+            continue;
+        }
+        FileName fn_stack;
+        long int dump;
+        fn_img.decompose(dump, fn_stack);
+        if (fn_stack != fn_open_stack) {
+            hFile.openFile(fn_stack, WRITE_READONLY);
+            fn_open_stack = fn_stack;
+        }
+        img.readFromOpenFile(fn_img, hFile, -1, false);
+        img().setXmippOrigin();
+        imgs.push_back(std::move(img()));
+    }
+    return imgs;
+}
+
+void ParticlePrefetcher::start(int depth) {
+    finish();
+    this->depth = depth;
+    stop = false;
+    nr_read = 0;
+    last_take = now();
+    thread = std::thread(&ParticlePrefetcher::run, this);
+}
+
+void ParticlePrefetcher::finish() {
+    if (!thread.joinable()) return;
+    {
+        std::lock_guard<std::mutex> guard (mutex);
+        stop = true;
+    }
+    changed.notify_all();
+    thread.join();
+    batches.clear();
+    nr_read = 0;
+}
+
+size_t ParticlePrefetcher::size() {
+    std::lock_guard<std::mutex> guard (mutex);
+    return batches.size();
+}
+
+void ParticlePrefetcher::schedule(long int first_part_id, const std::vector<FileName> &fn_imgs) {
+    {
+        std::lock_guard<std::mutex> guard (mutex);
+        batches.push_back({first_part_id, fn_imgs, {}, false, ""});
+    }
+    changed.notify_all();
+}
+
+bool ParticlePrefetcher::isNext(long int first_part_id) {
+    std::lock_guard<std::mutex> guard (mutex);
+    return !batches.empty() && batches.front().first_part_id == first_part_id;
+}
+
+std::vector<MultidimArray<RFLOAT>> ParticlePrefetcher::take(long int first_part_id) {
+    const double t0 = now();
+    std::unique_lock<std::mutex> lock (mutex);
+    if (batches.empty() || batches.front().first_part_id != first_part_id)
+        REPORT_ERROR("ParticlePrefetcher::take BUG: batches are not taken in the order they were scheduled");
+
+    const bool stalled = !batches.front().is_read;
+    changed.wait(lock, [this] { return batches.front().is_read; });
+
+    Batch batch = std::move(batches.front());
+    batches.pop_front();
+    nr_read--;
+    lock.unlock();
+    changed.notify_all();  // Room for the next batch
+
+    if (!batch.error.empty())
+        REPORT_ERROR("ParticlePrefetcher: " + batch.error);
+
+    const double t1 = now();
+    compute_time += t0 - last_take;
+    stall_time += t1 - t0;
+    last_take = t1;
+    nr_batches++;
+    nr_stalls += stalled;
+
+    return std::move(batch.imgs);
+}
+
+void ParticlePrefetcher::run() {
+    std::unique_lock<std::mutex> lock (mutex);
+    while (true) {
+        // Wait until there is a batch to read and fewer than depth batches are waiting to be taken
+        changed.wait(lock, [this] { return stop || nr_read < batches.size() && nr_read < depth; });
+        if (stop) return;
+
+        // The deque may grow while we read, so copy the names out
+        const std::vector<FileName> fn_imgs = batches[nr_read].fn_imgs;
+        lock.unlock();
+
+        std::vector<MultidimArray<RFLOAT>> imgs;
+        std::string error;
+        try {
+            imgs = readParticleImages(fn_imgs);
+        } catch (const RelionError &err) {
+            error = err.msg;
+        }
+
+        lock.lock();
+        if (stop) return;
+        Batch &batch = batches[nr_read];
+        batch.imgs = std::move(imgs);
+        batch.error = error;
+        batch.is_read = true;
+        nr_read++;
+        changed.notify_all();
+    }
+}
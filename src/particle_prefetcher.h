@@ -0,0 +1,104 @@
+/***************************************************************************
+ *
+ * Author: "agent"
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This complete copyright notice must be included in any revised version of the
+ * source code. Additional authorship citations may be added, but existing
+ * author citations must be preserved.
+ ***************************************************************************/
+
+#ifndef PARTICLE_PREFETCHER_H_
+#define PARTICLE_PREFETCHER_H_
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "src/filename.h"
+#include "src/multidim_array.h"
+
+// Read a list of particle images, opening each stack only once
+std::vector<MultidimArray<RFLOAT>> readParticleImages(const std::vector<FileName> &fn_imgs);
+
+/* Reads the particle images of upcoming batches on a background thread.
+ *
+ * Batches are scheduled (by their first particle and image names) in the order they will be used,
+ * and the I/O thread reads at most `depth` batches ahead of the one being processed.
+ * take() hands over the images of the oldest batch, waiting for them if they are not read yet.
+ *
+ * Time spent waiting in take() (stall) and between take() calls (compute) is accumulated,
+ * so that one can tell whether the reads keep up with the alignment.
+ */
+class ParticlePrefetcher {
+
+    public:
+
+    // Time waiting for images and time spent between batches (seconds)
+    double stall_time, compute_time;
+
+    // Number of batches handed over, and how many of those had to be waited for
+    long int nr_batches, nr_stalls;
+
+    ParticlePrefetcher(): stall_time(0), compute_time(0), nr_batches(0), nr_stalls(0), depth(0), stop(false) {}
+
+    ~ParticlePrefetcher() { finish(); }
+
+    // Start the I/O thread (depth > 0)
+    void start(int depth);
+
+    // Stop the I/O thread and drop all batches that were not taken
+    void finish();
+
+    bool isRunning() const { return thread.joinable(); }
+
+    // Number of batches scheduled and not yet taken
+    size_t size();
+
+    void schedule(long int first_part_id, const std::vector<FileName> &fn_imgs);
+
+    // Is the oldest batch the one starting at first_part_id?
+    bool isNext(long int first_part_id);
+
+    std::vector<MultidimArray<RFLOAT>> take(long int first_part_id);
+
+    private:
+
+    struct Batch {
+        long int first_part_id;
+        std::vector<FileName> fn_imgs;
+        std::vector<MultidimArray<RFLOAT>> imgs;
+        bool is_read;
+        std::string error;
+    };
+
+    int depth;
+    bool stop;
+
+    // Batches in the order they will be taken. Those before `nr_read` have been read.
+    std::deque<Batch> batches;
+    size_t nr_read;
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::thread thread;
+
+    // When the last batch was taken (for compute_time)
+    double last_take;
+
+    void run();
+
+};
+
+#endif
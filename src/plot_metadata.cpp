@@ -152,7 +152,7 @@ void PlotMetaData::addToCPlot2D(
     double mydbl;
     long int myint;
     double xval, yval;
-    for (long int idx = 0; idx < mdt.objects.size(); idx++) {
+    for (long int idx = 0; idx < mdt.size(); idx++) {
         const long offx = mdt.label_indices[xaxis];
         if (offx < 0)
             REPORT_ERROR("MetaDataTable::addToCPlot2D ERROR: cannot find x-axis label");
@@ -160,9 +160,9 @@ void PlotMetaData::addToCPlot2D(
         if (xaxis == EMDL::UNDEFINED) {
             xval = idx + 1;
         } else if (EMDL::is<double>(xaxis)) {
-            xval = mdt.objects[idx]->getValue<double>(offx);
+            xval = mdt.getValueAt<double>(offx, idx);
         } else if (EMDL::is<int>(xaxis)) {
-            xval = mdt.objects[idx]->getValue<int>(offx);
+            xval = mdt.getValueAt<int>(offx, idx);
         } else
             REPORT_ERROR("MetaDataTable::addToCPlot2D ERROR: can only plot x-axis double, int or long int");
 
@@ -171,9 +171,9 @@ void PlotMetaData::addToCPlot2D(
             REPORT_ERROR("MetaDataTable::addToCPlot2D ERROR: cannot find y-axis label");
 
         if (EMDL::is<double>(yaxis)) {
-            yval = mdt.objects[idx]->getValue<double>(offy);
+            yval = mdt.getValueAt<double>(offy, idx);
         } else if (EMDL::is<int>(yaxis)) {
-            yval = mdt.objects[idx]->getValue<int>(offy);
+            yval = mdt.getValueAt<int>(offy, idx);
         } else
             REPORT_ERROR("MetaDataTable::addToCPlot2D ERROR: can only plot y-axis double, int or long int");
 
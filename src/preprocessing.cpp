@@ -30,6 +30,7 @@ int TIMING_BIAS_CORRECT     = timer.setNew("biasCorrect");
 int TIMING_EXTCT_FROM_FRAME = timer.setNew("extractParticlesFromOneFrame");
 int TIMING_READ_IMG         = timer.setNew("-readImg");
 int TIMING_WINDOW           = timer.setNew("-window");
+int TIMING_PREMULTIPLY      = timer.setNew("-premultiplyCtf");
 int TIMING_BOUNDARY         = timer.setNew("-checkBoundary");
 int TIMING_PRE_IMG_OPS      = timer.setNew("-performPerImageOperations");
 int TIMING_NORMALIZE        = timer.setNew("--normalize");
@@ -662,8 +663,8 @@ void Preprocessing::extractParticlesFromOneMicrograph(MetaDataTable &MD,
     }
 
     CTF ctf;
-    ObservationModel *obsModel;
-    int optics_group;
+    ObservationModel *obsModel = nullptr;
+    int optics_group = 0;
     if (mic_star_has_ctf || keep_ctf_from_micrographs) {
         ctf = CtfHelper::makeCTF(MDmics, &obsModelMic, imic);
         obsModel = &obsModelMic;
@@ -674,6 +675,94 @@ void Preprocessing::extractParticlesFromOneMicrograph(MetaDataTable &MD,
         my_angpix = obsModelMic.opticsMdt.getValue<RFLOAT>(EMDL::MICROGRAPH_PIXEL_SIZE, optics_group);
     }
 
+    // Read per-particle CTF (for the current particle of MD)
+    const auto readParticleCtf = [&] (CTF &ctf, ObservationModel *&obsModel, int &optics_group, RFLOAT &my_angpix) {
+        if (MDin_has_ctf && !keep_ctf_from_micrographs) {
+            ctf = CtfHelper::makeCTF(MD, &obsModelPart, optics_group);
+            obsModel = &obsModelPart;
+            optics_group = obsModelPart.getOpticsGroup(MD);
+            if (obsModelPart.getBoxSize(optics_group) != my_extract_size)
+                obsModelPart.setBoxSize(optics_group, my_extract_size);
+            my_angpix = obsModelPart.opticsMdt.getValue<RFLOAT>(EMDL::MICROGRAPH_PIXEL_SIZE, optics_group);
+        }
+    };
+
+    // Premultiply the CTF of each particle, possibly in a bigger box (premultiply_ctf_extract_size)
+    // 190802 TAKANORI: The original code using CTF::operator () was do_damping=false, but for consistency with Polishing, I changed it.
+    // The boxsize in ObsModel has been updated above.
+    // In contrast to Polish, we premultiply particle BEFORE down-sampling, so PixelSize in ObsModel is OK.
+    // But we are doing this after extraction, so there is not much merit...
+    const auto getFctf = [&] (const CTF &ctf, ObservationModel *obsModel, RFLOAT my_angpix, long int xdim, long int ydim) {
+        return CtfHelper::getFftwImage(
+            ctf,
+            xdim, ydim,
+            my_extract_size, my_extract_size, my_angpix,
+            obsModel,
+            false, do_phase_flip, do_ctf_intact_first_peak, true, false
+            // do_abs, phase_flip, intact_first_peak, damping, padding
+        );
+    };
+
+    const auto cropToExtractSize = [&] (MultidimArray<RFLOAT> &img) {
+        if (extract_size != premultiply_ctf_extract_size) {
+            img = img.windowed(
+                Xmipp::init(extract_size), Xmipp::init(extract_size),
+                Xmipp::last(extract_size), Xmipp::last(extract_size)
+            );
+        }
+    };
+
+    // 2D particles are premultiplied (or phase-flipped) first, in batches that are Fourier-transformed together
+    std::vector<MultidimArray<RFLOAT> > premultiplied;
+    if ((do_phase_flip || do_premultiply_ctf) && dimensionality == 2) {
+        ifdefPREP_TIMING(TicToc tt (timer, TIMING_PREMULTIPLY);)
+
+        CTF batch_ctf = ctf;
+        ObservationModel *batch_obsModel = obsModel;
+        int batch_optics_group = optics_group;
+        RFLOAT batch_angpix = my_angpix;
+
+        const long int batch_size = std::max(1L, std::min(64L, (4L << 20) / ((long int) my_extract_size * my_extract_size)));
+        BatchFourierTransformer batch;
+        batch.resize(std::min(batch_size, (long int) MD.size()), my_extract_size, my_extract_size);
+        std::vector<MultidimArray<RFLOAT> > Fctfs;
+
+        const auto premultiplyBatch = [&] () {
+            batch.resize(Fctfs.size(), my_extract_size, my_extract_size);
+            batch.FourierTransform();
+            for (long int j = 0; j < Fctfs.size(); j++) {
+                Complex *F = batch.fourier(j);
+                for (long int n = 0; n < Fctfs[j].size(); n++)
+                    F[n] *= Fctfs[j][n];
+            }
+            batch.inverseFourierTransform();
+            for (long int j = 0; j < Fctfs.size(); j++) {
+                premultiplied.emplace_back();
+                batch.getReal(j, premultiplied.back());
+                premultiplied.back().setXmippOrigin();
+                cropToExtractSize(premultiplied.back());
+            }
+            Fctfs.clear();
+        };
+
+        premultiplied.reserve(MD.size());
+        for (long int i : MD) {
+            const long int xpos = (long int) MD.getValue<RFLOAT>(EMDL::IMAGE_COORD_X, i);
+            const long int ypos = (long int) MD.getValue<RFLOAT>(EMDL::IMAGE_COORD_Y, i);
+            readParticleCtf(batch_ctf, batch_obsModel, batch_optics_group, batch_angpix);
+
+            const long int j = Fctfs.size();
+            batch.setReal(j, Imic().windowed(
+                xpos + Xmipp::init(my_extract_size), xpos + Xmipp::last(my_extract_size),
+                ypos + Xmipp::init(my_extract_size), ypos + Xmipp::last(my_extract_size), mic_avg
+            ));
+            Fctfs.push_back(getFctf(batch_ctf, batch_obsModel, batch_angpix, my_extract_size / 2 + 1, my_extract_size));
+
+            if (Fctfs.size() == batch.size()) premultiplyBatch();
+        }
+        if (!Fctfs.empty()) premultiplyBatch();
+    }
+
     // Now window all particles from the micrograph
     // Now do the actual phase flipping or CTF-multiplication
     MultidimArray<Complex> FT;
@@ -714,51 +803,25 @@ void Preprocessing::extractParticlesFromOneMicrograph(MetaDataTable &MD,
             REPORT_ERROR("Preprocessing::extractParticlesFromOneFrame ERROR: particle" + integerToString(ipos + 1) + " lies completely outside micrograph " + fn_mic);
         }
 
-        // Read per-particle CTF
-        if (MDin_has_ctf && !keep_ctf_from_micrographs) {
-            ctf = CtfHelper::makeCTF(MD, &obsModelPart, optics_group);
-            obsModel = &obsModelPart;
-            optics_group = obsModelPart.getOpticsGroup(MD);
-            if (obsModelPart.getBoxSize(optics_group) != my_extract_size)
-                obsModelPart.setBoxSize(optics_group, my_extract_size);
-            my_angpix = obsModelPart.opticsMdt.getValue<RFLOAT>(EMDL::MICROGRAPH_PIXEL_SIZE, optics_group);
-        }
+        readParticleCtf(ctf, obsModel, optics_group, my_angpix);
 
         Image<RFLOAT> Ipart;
-        {
-        ifdefPREP_TIMING(TicToc tt (timer, TIMING_WINDOW);)
-        // extract one particle in Ipart
-        Ipart() = (dimensionality == 3 ?
-            Imic().windowed(x0, xF, y0, yF, z0, zF) :
-            Imic().windowed(x0, xF, y0, yF, mic_avg)).setXmippOrigin();
-        }
-
-        // Premultiply the CTF of each particle, possibly in a bigger box (premultiply_ctf_extract_size)
-        if (do_phase_flip || do_premultiply_ctf) {
-            FT = transformer.FourierTransform(Ipart());  // std::move?
-
-            // 190802 TAKANORI: The original code using CTF::operator () was do_damping=false, but for consistency with Polishing, I changed it.
-            // The boxsize in ObsModel has been updated above.
-            // In contrast to Polish, we premultiply particle BEFORE down-sampling, so PixelSize in ObsModel is OK.
-            // But we are doing this after extraction, so there is not much merit...
-            MultidimArray<RFLOAT> Fctf = CtfHelper::getFftwImage(
-                ctf,
-                Xsize(FT), Ysize(FT),
-                my_extract_size, my_extract_size, my_angpix,
-                obsModel,
-                false, do_phase_flip, do_ctf_intact_first_peak, true, false
-                // do_abs, phase_flip, intact_first_peak, damping, padding
-            );
-
-            FT *= Fctf;
-
-            Ipart() = transformer.inverseFourierTransform(FT);
+        if (!premultiplied.empty()) {
+            Ipart() = std::move(premultiplied[ipos]);
+        } else {
+            {
+            ifdefPREP_TIMING(TicToc tt (timer, TIMING_WINDOW);)
+            // extract one particle in Ipart
+            Ipart() = (dimensionality == 3 ?
+                Imic().windowed(x0, xF, y0, yF, z0, zF) :
+                Imic().windowed(x0, xF, y0, yF, mic_avg)).setXmippOrigin();
+            }
 
-            if (extract_size != premultiply_ctf_extract_size) {
-                Ipart() = Ipart().windowed(
-                    Xmipp::init(extract_size), Xmipp::init(extract_size),
-                    Xmipp::last(extract_size), Xmipp::last(extract_size)
-                );
+            if (do_phase_flip || do_premultiply_ctf) {
+                FT = transformer.FourierTransform(Ipart());
+                FT *= getFctf(ctf, obsModel, my_angpix, Xsize(FT), Ysize(FT));
+                Ipart() = transformer.inverseFourierTransform(FT);
+                cropToExtractSize(Ipart());
             }
         }
 
@@ -379,6 +379,22 @@ struct NearestNeighbour {
 };
 
 void Projector::initialiseData(int current_size) {
+    setPadSize(current_size);
+    const std::array<long int, 3> shape = dataShape();
+
+    // Keep using shared memory of the right size
+    if (shared_data && data.xdim == shape[0] && data.ydim == shape[1] && data.zdim == shape[2])
+        return;
+    releaseSharedData();
+
+    data.resize(shape[0], shape[1], shape[2]);
+
+    // Set origin in the y.z-center, but on the left side for x.
+    data.setXmippOrigin().xinit = 0;
+
+}
+
+void Projector::setPadSize(int current_size) {
     // By default r_max is half ori_size
     r_max = (current_size < 0 ? ori_size : current_size) / 2;
 
@@ -387,26 +403,53 @@ void Projector::initialiseData(int current_size) {
 
     // Set pad_size
     pad_size = 2 * round(padding_factor * r_max) + 3;
+}
 
+std::array<long int, 3> Projector::dataShape() const {
     // Short side of data array
     switch (ref_dim) {
 
         case 2:
-        data.resize(pad_size, pad_size / 2 + 1);
-        break;
+        return {pad_size, pad_size / 2 + 1, 1};
 
         case 3:
-        data.resize(pad_size, pad_size, pad_size / 2 + 1);
-        break;
+        return {pad_size, pad_size, pad_size / 2 + 1};
 
         default:
         REPORT_ERROR("Projector::resizeData%%ERROR: Dimension of the data array should be 2 or 3");
 
     }
+}
 
-    // Set origin in the y.z-center, but on the left side for x.
+int Projector::setPaddedOriSize() {
+    // Size of padded real-space volume
+    int padoridim = round(padding_factor * ori_size);
+    // make sure padoridim is even
+    padoridim += padoridim % 2;
+    // Re-calculate padding factor
+    padding_factor = (float) padoridim / (float) ori_size;
+    return padoridim;
+}
+
+void Projector::shareData(int current_size, Complex *ptr, std::shared_ptr<void> owner) {
+    releaseSharedData();
+    data.clear();
+    // The padding factor as computeFourierTransformMap() will use it
+    setPaddedOriSize();
+    setPadSize(current_size);
+    const std::array<long int, 3> shape = dataShape();
+    data.setDimensions(shape[0], shape[1], shape[2]);
     data.setXmippOrigin().xinit = 0;
+    data.data = ptr;
+    shared_data = owner;
+}
 
+void Projector::releaseSharedData() {
+    if (!shared_data) return;
+    // Not ours to free
+    data.data = nullptr;
+    data.clear();
+    shared_data.reset();
 }
 
 void Projector::initZeros(int current_size) {
@@ -415,19 +458,18 @@ void Projector::initZeros(int current_size) {
 }
 
 long int Projector::getSize() {
-    // Short side of data array
-    switch (ref_dim) {
-
-        case 2:
-        return pad_size * (pad_size / 2 + 1);
-
-        case 3:
-        return pad_size * pad_size * (pad_size / 2 + 1);
-
-        default:
-        REPORT_ERROR("Projector::resizeData%%ERROR: Dimension of the data array should be 2 or 3");
+    const std::array<long int, 3> shape = dataShape();
+    return shape[0] * shape[1] * shape[2];
+}
 
-    }
+long int Projector::getSize(int current_size) const {
+    Projector sized;
+    sized.ori_size = ori_size;
+    sized.padding_factor = padding_factor;
+    sized.ref_dim = ref_dim;
+    sized.setPaddedOriSize();
+    sized.setPadSize(current_size);
+    return sized.getSize();
 }
 
 
@@ -469,12 +511,7 @@ void Projector::computeFourierTransformMap(
     {
     ifdefTIMING(TicToc tt (proj_timer, TIMING_INIT1);)
 
-    // Size of padded real-space volume
-    padoridim = round(padding_factor * ori_size);
-    // make sure padoridim is even
-    padoridim += padoridim % 2;
-    // Re-calculate padding factor
-    padding_factor = (float) padoridim / (float) ori_size;
+    padoridim = setPaddedOriSize();
 
     // Initialize data array of the oversampled transform
     ref_dim = vol_in.getDim();
@@ -656,7 +693,12 @@ void Projector::computeFourierTransformMap(
     Mpad.clear();
 
     // Resize data array to the right size and initialise to zero
-    initZeros(current_size);
+    // (unless another rank fills the shared data array)
+    if (do_heavy || !shared_data) {
+        initZeros(current_size);
+    } else {
+        initialiseData(current_size);
+    }
 
     // Fill data only for those points with distance to origin less than max_r
     // (other points will be zero because of initZeros() call above
@@ -799,7 +841,7 @@ void Projector::computeFourierTransformMap(
 
 }
 
-void Projector::griddingCorrect(MultidimArray<RFLOAT> &vol_in) {
+void Projector::griddingCorrect(MultidimArray<RFLOAT> &vol_in, int nr_threads) {
     // Correct real-space map by dividing it by the Fourier transform of the interpolator(s)
     vol_in.setXmippOrigin();
 
@@ -815,7 +857,10 @@ void Projector::griddingCorrect(MultidimArray<RFLOAT> &vol_in) {
     if (!maybe_square)
         REPORT_ERROR((std::string) "BUG Projector::" + __func__ + ": unrecognised interpolator scheme.");
 
-    FOR_ALL_ELEMENTS_IN_ARRAY3D(vol_in, i, j, k) {
+    #pragma omp parallel for num_threads(nr_threads)
+    for (long int k = Zinit(vol_in); k <= Zlast(vol_in); k++)
+    for (long int j = Yinit(vol_in); j <= Ylast(vol_in); j++)
+    for (long int i = Xinit(vol_in); i <= Xlast(vol_in); i++) {
         const RFLOAT r = hypot((double) i, j, k);
         if (r > 0.0) {
             const RFLOAT rval = r / (ori_size * padding_factor);
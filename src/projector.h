@@ -20,6 +20,7 @@
 #ifndef __PROJECTOR_H
 #define __PROJECTOR_H
 
+#include <memory>
 #include "src/fftw.h"
 #include "src/multidim_array.h"
 #include "src/image.h"
@@ -92,6 +93,20 @@ class Projector {
     // Dimension of the projections (1 or 2 or 3)
     int data_dim;
 
+    private:
+
+    // Keeps alive the memory (shared with other processes) that data points into, see shareData()
+    std::shared_ptr<void> shared_data;
+
+    // Set r_max and pad_size for current_size
+    void setPadSize(int current_size);
+
+    // Shape of the data array for the current pad_size
+    std::array<long int, 3> dataShape() const;
+
+    // Round the padded size of the map to an even number (adjusting padding_factor) and return it
+    int setPaddedOriSize();
+
     public:
 
     /** Empty constructor
@@ -159,6 +174,7 @@ class Projector {
      */
     Projector& operator = (const Projector &op) {
         if (&op != this) {
+            releaseSharedData();
             data = op.data;
             ori_size = op.ori_size;
             pad_size = op.pad_size;
@@ -188,6 +204,7 @@ class Projector {
       * Initialize everything to back to default and empty arrays
       */
     void clear() {
+        releaseSharedData();
         data.clear();
         r_max = r_min_nn = interpolator = ref_dim = data_dim = pad_size = 0;
         padding_factor = 0.0;
@@ -208,6 +225,24 @@ class Projector {
      */
     long int getSize();
 
+    /*
+     * Size of the data array for current_size (without changing anything)
+     */
+    long int getSize(int current_size) const;
+
+    /*
+     * Let data point into memory owned by someone else (e.g. shared with other MPI ranks on the host),
+     * which has room for getSize(current_size) elements and is kept alive by owner.
+     * initialiseData() and computeFourierTransformMap() then keep using it (as long as the size does not change),
+     * so that one rank can fill it and the others only read it: they should call computeFourierTransformMap() with do_heavy = false.
+     */
+    void shareData(int current_size, Complex *ptr, std::shared_ptr<void> owner);
+
+    // Stop using shared memory (data becomes empty)
+    void releaseSharedData();
+
+    bool isShared() const { return !!shared_data; }
+
     /* ** Prepares a 3D map for taking slices in its 3D Fourier Transform
      *
      * This routine does the following:
@@ -229,7 +264,7 @@ class Projector {
      * the real-space maps by dividing them by the Fourier Transform of the interpolator
      * Note these corrections are made on the not-oversampled, i.e. originally sized real-space map
      */
-    void griddingCorrect(MultidimArray<RFLOAT> &vol_in);
+    void griddingCorrect(MultidimArray<RFLOAT> &vol_in, int nr_threads = 1);
 
     /*
     * Go from the Projector-centered fourier transform back to FFTW-uncentered one
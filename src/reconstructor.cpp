@@ -66,6 +66,7 @@ void Reconstructor::read(int argc, char **argv) {
     blob_order = textToInteger(parser.getOption("--blob_m", "Order of blob for gridding interpolation", "0"));
     blob_alpha = textToFloat(parser.getOption("--blob_a", "Alpha-value of blob for gridding interpolation", "15"));
     iter = textToInteger(parser.getOption("--iter", "Number of gridding-correction iterations", "10"));
+    nr_threads = textToInteger(parser.getOption("--j", "Number of threads for the gridding-correction and the final transforms (the transforms only with threaded FFTW)", "1"));
     ref_dim = textToInteger(parser.getOption("--refdim", "Dimension of the reconstruction (2D or 3D)", "3"));
     angular_error = textToFloat(parser.getOption("--angular_error", "Apply random deviations with this standard deviation (in degrees) to each of the 3 Euler angles", "0."));
     shift_error = textToFloat(parser.getOption("--shift_error", "Apply random deviations with this standard deviation (in Angstrom) to each of the 2 translations", "0."));
@@ -631,7 +632,7 @@ void Reconstructor::reconstruct() {
                 fn_root, tau2, tmp, tmp, tmp, false, 1.0, 1
             );
         } else {
-            vol() = backprojector.reconstruct(iter, do_map, tau2);
+            vol() = backprojector.reconstruct(iter, do_map, tau2, 1.0, 1.0, -1, verb > 1, nullptr, nr_threads);
         }
     }
 
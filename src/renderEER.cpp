@@ -1,5 +1,6 @@
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <vector>
 #include <algorithm>
@@ -35,6 +36,7 @@ const int EERRenderer::EER_IMAGE_WIDTH = 4096;
 const int EERRenderer::EER_IMAGE_HEIGHT = 4096;
 const int EERRenderer::EER_IMAGE_PIXELS = EERRenderer::EER_IMAGE_WIDTH * EERRenderer::EER_IMAGE_HEIGHT;
 const unsigned int EERRenderer::EER_LEN_FOOTER = 24;
+const unsigned int EERRenderer::EER_BUFFER_PADDING = 8;
 const uint16_t EERRenderer::TIFF_COMPRESSION_EER8bit = 65000;
 const uint16_t EERRenderer::TIFF_COMPRESSION_EER7bit = 65001;
 
@@ -222,11 +224,27 @@ void EERRenderer::lazyReadFrames() {
             // cannot return from within omp critical
             frame_starts.resize(nframes, 0);
             frame_sizes.resize(nframes, 0);
-            buf = (unsigned char*) malloc(file_size); // This is big enough
+
+            // Only the frames of interest are kept in memory.
+            long long buf_size = 0;
+            for (int frame = 0; frame < nframes; frame++) {
+                if (
+                    preread_start > 0 && frame < preread_start ||
+                    preread_end   > 0 && frame > preread_end
+                ) continue;
+
+                TIFFSetDirectory(ftiff, frame);
+                const int nstrips = TIFFNumberOfStrips(ftiff);
+                for (int strip = 0; strip < nstrips; strip++)
+                    buf_size += TIFFRawStripSize(ftiff, strip);
+            }
+
+            // The decoders read a few bytes beyond the end of a frame
+            buf = (unsigned char*) malloc(buf_size + EER_BUFFER_PADDING);
             if (!buf) REPORT_ERROR("Failed to allocate the buffer for " + fn_movie);
+            memset(buf + buf_size, 0, EER_BUFFER_PADDING);
             long long pos = 0;
 
-            // Read everything
             for (int frame = 0; frame < nframes; frame++) {
                 if (
                     preread_start > 0 && frame < preread_start ||
@@ -239,7 +257,7 @@ void EERRenderer::lazyReadFrames() {
 
                 for (int strip = 0; strip < nstrips; strip++) {
                     const int strip_size = TIFFRawStripSize(ftiff, strip);
-                    if (pos + strip_size >= file_size) {
+                    if (pos + strip_size > buf_size) {
                         REPORT_ERROR("EER: buffer overflow when reading raw strips.");
                     }
 
@@ -248,7 +266,7 @@ void EERRenderer::lazyReadFrames() {
                     frame_sizes[frame] += strip_size;
                 }
                 #ifdef DEBUG_EER
-                printf("EER in TIFF: Read frame %d from %s, nstrips = %d, current pos in buffer = %lld / %lld\n", frame, fn_movie.c_str(), nstrips, pos, file_size);
+                printf("EER in TIFF: Read frame %d from %s, nstrips = %d, current pos in buffer = %lld / %lld\n", frame, fn_movie.c_str(), nstrips, pos, buf_size);
                 #endif
             }
 
@@ -276,8 +294,124 @@ int EERRenderer::getHeight() {
     return EER_IMAGE_HEIGHT << (eer_upsampling - 1);
 }
 
+long long EERRenderer::decodeFrame(
+    int iframe, std::vector<unsigned int> &positions, std::vector<unsigned char> &symbols
+) const {
+    long long pos = frame_starts[iframe];
+    unsigned int n_pix = 0;
+    unsigned int n_electron = 0;
+    const int max_electrons = frame_sizes[iframe] * 2 + 1; // at 4 bits per electron (very permissive bound!)
+    if (positions.size() < max_electrons) {
+        positions.resize(max_electrons);
+        symbols.resize(max_electrons);
+    }
+
+    const long long pos_limit = frame_starts[iframe] + frame_sizes[iframe];
+
+    if (is_7bit) {
+        unsigned int bit_pos = 0; // 4 K * 4 K * 11 bit << 2 ** 32
+        unsigned char p, s;
+
+        while (true) {
+            // Fetch 32 bits and unpack up to 2 chunks of 7 + 4 bits.
+            // This is faster than unpack 7 and 4 bits sequentially.
+            // Since the buffer is padded (or followed by the footer),
+            // it is always safe to read ahead by up to 4 bytes from within the frame.
+
+            long long first_byte = pos + (bit_pos >> 3);
+            if (first_byte >= pos_limit) break; // truncated or corrupted frame
+            const unsigned int bit_offset_in_first_byte = bit_pos & 7; // 7 = 00000111 (same as % 8)
+            const unsigned int chunk = (*(unsigned int*)(buf + first_byte)) >> bit_offset_in_first_byte;
+
+            p = (unsigned char)(chunk & 127); // 127 = 01111111
+            bit_pos += 7; // TODO: we can remove this for further speed.
+            n_pix += p;
+            if (n_pix >= EER_IMAGE_PIXELS) break;
+            if (p == 127) continue; // this should be rare.
+
+            s = (unsigned char)((chunk >> 7) & 15) ^ 0x0A; // 15 = 00001111; See below for 0x0A
+            bit_pos += 4;
+            positions[n_electron] = n_pix;
+            symbols[n_electron] = s;
+            n_electron++;
+            n_pix++;
+
+            p = (unsigned char)((chunk >> 11) & 127); // 127 = 01111111
+            bit_pos += 7;
+            n_pix += p;
+            if (n_pix >= EER_IMAGE_PIXELS) break;
+            if (p == 127) continue;
+
+            s = (unsigned char)((chunk >> 18) & 15) ^ 0x0A; // 15 = 00001111; See below for 0x0A
+            bit_pos += 4;
+            positions[n_electron] = n_pix;
+            symbols[n_electron] = s;
+            n_electron++;
+            n_pix++;
+        }
+    } else {
+        // unpack every two symbols = 12 bit * 2 = 24 bit = 3 byte
+        // high <- |bbbbBBBB|BBBBaaaa|AAAAAAAA| -> low
+        // This is done block by block, in two passes:
+        // the first one splits the bytes into runs and symbols without any dependency between groups
+        // (so that the compiler can vectorise it), the second one accumulates the runs into positions
+        // without branches (except for the end of the frame).
+        const int block = 128; // groups of 3 bytes
+        unsigned char p[2 * block], s[2 * block];
+
+        // Because there is a footer (or padding), it is safe to go beyond the limit by two bytes.
+        bool done = false;
+        while (pos < pos_limit && !done) {
+            const int n_groups = std::min((long long) block, (pos_limit - pos + 2) / 3);
+            const unsigned char *const b = buf + pos;
+
+            #pragma omp simd
+            for (int k = 0; k < n_groups; k++) {
+                // symbol is bit tricky. 0000YyXx; Y and X must be flipped.
+                p[2 * k]     = b[3 * k];
+                s[2 * k]     = (b[3 * k + 1] & 0x0F) ^ 0x0A; // 0x0F = 00001111, 0x0A = 00001010
+                p[2 * k + 1] = (b[3 * k + 1] >> 4) | (b[3 * k + 2] << 4);
+                s[2 * k + 1] = (b[3 * k + 2] >> 4) ^ 0x0A;
+            }
+
+            for (int k = 0; k < 2 * n_groups; k++) {
+                // Note the order. Add p before checking the size and placing a new electron.
+                n_pix += p[k];
+                if (n_pix >= EER_IMAGE_PIXELS) { done = true; break; }
+                // Always written; only kept (by incrementing n_electron) if this is an electron
+                positions[n_electron] = n_pix;
+                symbols[n_electron] = s[k];
+                const unsigned int is_electron = p[k] < 255;
+                n_electron += is_electron;
+                n_pix += is_electron;
+            }
+            #ifdef DEBUG_EER_DETAIL
+            printf("%lld: %d groups, %u\n", pos, n_groups, n_pix);
+            #endif
+            pos += 3 * n_groups;
+        }
+    }
+
+    if (n_pix != EER_IMAGE_PIXELS) return -1;
+    return n_electron;
+}
+
+template <typename T>
+void EERRenderer::renderElectrons(
+    MultidimArray<T> &image,
+    std::vector<unsigned int> &positions, std::vector<unsigned char> &symbols,
+    int n_electrons
+) {
+    switch (eer_upsampling) {
+        case 3: render16K(image, positions, symbols, n_electrons); break;
+        case 2: render8K (image, positions, symbols, n_electrons); break;
+        case 1: render4K (image, positions, symbols, n_electrons); break;
+        default: REPORT_ERROR("Invalid EER upsamle");
+    }
+}
+
 template <typename T>
-long long EERRenderer::renderFrames(int frame_start, int frame_end, MultidimArray<T> &image) {
+long long EERRenderer::renderFrames(int frame_start, int frame_end, MultidimArray<T> &image, int nr_threads) {
     if (!ready) REPORT_ERROR("EERRenderer::renderNFrames called before ready.");
 
     lazyReadFrames();
@@ -294,133 +428,66 @@ long long EERRenderer::renderFrames(int frame_start, int frame_end, MultidimArra
     frame_start--;
     frame_end--;
 
-    long long total_n_electron = 0;
-
-    std::vector<unsigned int> positions;
-    std::vector<unsigned char> symbols;
-    image.initZeros(getHeight(), getWidth());
-
-    for (int iframe = frame_start; iframe <= frame_end; iframe++) {
-        unsigned int n_electron;
-        RCTICTOC(TIMING_UNPACK_RLE, ({
-        if (
-            preread_start > 0 && iframe < preread_start ||
-              preread_end   > 0 && iframe > preread_end
-        ) {
-            std::cerr << "EERRenderer::renderFrames(frame_start = " << frame_start + 1 << ", frame_end = " << frame_end + 1<< "),  NFrames = " << getNFrames() << " preread_start = " << preread_start + 1 << " prered_end = " << preread_end + 1<< std::endl;
-            REPORT_ERROR("Tried to render frames outside pre-read region");
-        }
-
-        long long pos = frame_starts[iframe];
-        unsigned int n_pix = 0;
-        n_electron = 0;
-        const int max_electrons = frame_sizes[iframe] * 2; // at 4 bits per electron (very permissive bound!)
-        if (positions.size() < max_electrons) {
-            positions.resize(max_electrons);
-            symbols.resize(max_electrons);
-        }
+    // Errors cannot be reported from within the parallel region below, so check everything here.
+    if (
+        preread_start > 0 && frame_start < preread_start ||
+        preread_end   > 0 && frame_end   > preread_end
+    ) {
+        std::cerr << "EERRenderer::renderFrames(frame_start = " << frame_start + 1 << ", frame_end = " << frame_end + 1<< "),  NFrames = " << getNFrames() << " preread_start = " << preread_start + 1 << " prered_end = " << preread_end + 1<< std::endl;
+        REPORT_ERROR("Tried to render frames outside pre-read region");
+    }
+    if (eer_upsampling < 1 || eer_upsampling > 3) REPORT_ERROR("Invalid EER upsamle");
 
-        if (is_7bit) {
-            unsigned int bit_pos = 0; // 4 K * 4 K * 11 bit << 2 ** 32
-            unsigned char p, s;
+    nr_threads = std::max(1, std::min(nr_threads, frame_end - frame_start + 1));
 
-            while (true) {
-                // Fetch 32 bits and unpack up to 2 chunks of 7 + 4 bits.
-                // This is faster than unpack 7 and 4 bits sequentially.
-                // Since the size of buf is larger than the actual size by the TIFF header size,
-                // it is always safe to read ahead.
+    long long total_n_electron = 0;
 
-                long long first_byte = pos + (bit_pos >> 3);
-                const unsigned int bit_offset_in_first_byte = bit_pos & 7; // 7 = 00000111 (same as % 8)
-                const unsigned int chunk = (*(unsigned int*)(buf + first_byte)) >> bit_offset_in_first_byte;
+    image.initZeros(getHeight(), getWidth());
 
-                p = (unsigned char)(chunk & 127); // 127 = 01111111
-                bit_pos += 7; // TODO: we can remove this for further speed.
-                n_pix += p;
-                if (n_pix >= EER_IMAGE_PIXELS) break;
-                if (p == 127) continue; // this should be rare.
+    // Thread 0 renders into image, the others into images of their own, which are added to image at the end.
+    std::vector<MultidimArray<T> > partial_sums (nr_threads - 1);
 
-                s = (unsigned char)((chunk >> 7) & 15) ^ 0x0A; // 15 = 00001111; See below for 0x0A
-                bit_pos += 4;
-                positions[n_electron] = n_pix;
-                symbols[n_electron] = s;
-                n_electron++;
-                n_pix++;
-
-                p = (unsigned char)((chunk >> 11) & 127); // 127 = 01111111
-                bit_pos += 7;
-                n_pix += p;
-                if (n_pix >= EER_IMAGE_PIXELS) break;
-                if (p == 127) continue;
-
-                s = (unsigned char)((chunk >> 18) & 15) ^ 0x0A; // 15 = 00001111; See below for 0x0A
-                bit_pos += 4;
-                positions[n_electron] = n_pix;
-                symbols[n_electron] = s;
-                n_electron++;
-                n_pix++;
+    #pragma omp parallel num_threads(nr_threads) reduction(+:total_n_electron)
+    {
+        const int ithread = omp_get_thread_num();
+        MultidimArray<T> &sum = ithread == 0 ? image : partial_sums[ithread - 1];
+        if (ithread > 0) sum.initZeros(getHeight(), getWidth());
+
+        std::vector<unsigned int> positions;
+        std::vector<unsigned char> symbols;
+
+        #pragma omp for schedule(dynamic)
+        for (int iframe = frame_start; iframe <= frame_end; iframe++) {
+            long long n_electron;
+            RCTICTOC(TIMING_UNPACK_RLE, ({
+            n_electron = decodeFrame(iframe, positions, symbols);
+            }))
+
+            if (n_electron < 0) {
+                #pragma omp critical(EERRenderer_renderFrames)
+                std::cerr << "WARNING: The number of pixels is not right in " + fn_movie + " frame " + integerToString(iframe + 1) + ". Probably this frame is corrupted. This frame is skipped." << std::endl;
+                continue;
             }
-        } else {
-            // unpack every two symbols = 12 bit * 2 = 24 bit = 3 byte
-            // high <- |bbbbBBBB|BBBBaaaa|AAAAAAAA| -> low
-            // With SIMD intrinsics at the SSSE3 level, we can unpack 10 symbols (120 bits) simultaneously.
-            unsigned char p1, p2, s1, s2;
-
-            const long long pos_limit = frame_starts[iframe] + frame_sizes[iframe];
-            // Because there is a footer, it is safe to go beyond the limit by two bytes.
-            while (pos < pos_limit) {
-                // symbol is bit tricky. 0000YyXx; Y and X must be flipped.
-                p1 = buf[pos];
-                s1 = (buf[pos + 1] & 0x0F) ^ 0x0A; // 0x0F = 00001111, 0x0A = 00001010
-
-                p2 = (buf[pos + 1] >> 4) | (buf[pos + 2] << 4);
-                s2 = (buf[pos + 2] >> 4) ^ 0x0A;
-
-                // Note the order. Add p before checking the size and placing a new electron.
-                n_pix += p1;
-                if (n_pix >= EER_IMAGE_PIXELS) break;
-                if (p1 < 255) {
-                    positions[n_electron] = n_pix;
-                    symbols[n_electron] = s1;
-                    n_electron++;
-                    n_pix++;
-                }
 
-                n_pix += p2;
-                if (n_pix >= EER_IMAGE_PIXELS) break;
-                if (p2 < 255) {
-                    positions[n_electron] = n_pix;
-                    symbols[n_electron] = s2;
-                    n_electron++;
-                    n_pix++;
-                }
-                #ifdef DEBUG_EER_DETAIL
-                printf("%d: %u %u, %u %u %d\n", pos, p1, s1, p2, s2, n_pix);
-                #endif
-                pos += 3;
-            }
-        }
+            RCTICTOC(TIMING_RENDER_ELECTRONS, ({
+            renderElectrons(sum, positions, symbols, n_electron);
+            }))
 
-        if (n_pix != EER_IMAGE_PIXELS) {
-            std::cerr << "WARNING: The number of pixels is not right in " + fn_movie + " frame " + integerToString(iframe + 1) + ". Probably this frame is corrupted. This frame is skipped." << std::endl;
-            continue;
+            total_n_electron += n_electron;
+            #ifdef DEBUG_EER
+            printf("Decoded %lld electrons from frame %5d.\n", n_electron, iframe);
+            #endif
         }
 
-        }))
-
-        RCTICTOC(TIMING_RENDER_ELECTRONS, ({
-        switch (eer_upsampling) {
-            case 3: render16K(image, positions, symbols, n_electron); break;
-            case 2: render8K (image, positions, symbols, n_electron); break;
-            case 1: render4K (image, positions, symbols, n_electron); break;
-            default: REPORT_ERROR("Invalid EER upsamle");
+        // The implicit barrier of omp for makes sure all partial sums are complete
+        if (nr_threads > 1) {
+            const long int npix = image.size();
+            #pragma omp for
+            for (long int n = 0; n < npix; n++) {
+                for (int i = 0; i < nr_threads - 1; i++)
+                    image.data[n] += partial_sums[i].data[n];
+            }
         }
-        }))
-
-        total_n_electron += n_electron;
-        #ifdef DEBUG_EER
-        printf("Decoded %lld electrons / %d pixels from frame %5d.\n", n_electron, n_pix, iframe);
-        #endif
     }
     #ifdef DEBUG_EER
     printf("Decoded %lld electrons in total.\n", total_n_electron);
@@ -434,9 +501,9 @@ long long EERRenderer::renderFrames(int frame_start, int frame_end, MultidimArra
 }
 
 // Instantiate for Polishing
-template long long EERRenderer::renderFrames<float>(int frame_start, int frame_end, MultidimArray<float> &image);
-template long long EERRenderer::renderFrames<short>(int frame_start, int frame_end, MultidimArray<short> &image);
-template long long EERRenderer::renderFrames<unsigned short>(int frame_start, int frame_end, MultidimArray<unsigned short> &image);
-template long long EERRenderer::renderFrames<char>(int frame_start, int frame_end, MultidimArray<char> &image);
-template long long EERRenderer::renderFrames<signed char>(int frame_start, int frame_end, MultidimArray<signed char> &image);
-template long long EERRenderer::renderFrames<unsigned char>(int frame_start, int frame_end, MultidimArray<unsigned char> &image);
+template long long EERRenderer::renderFrames<float>(int frame_start, int frame_end, MultidimArray<float> &image, int nr_threads);
+template long long EERRenderer::renderFrames<short>(int frame_start, int frame_end, MultidimArray<short> &image, int nr_threads);
+template long long EERRenderer::renderFrames<unsigned short>(int frame_start, int frame_end, MultidimArray<unsigned short> &image, int nr_threads);
+template long long EERRenderer::renderFrames<char>(int frame_start, int frame_end, MultidimArray<char> &image, int nr_threads);
+template long long EERRenderer::renderFrames<signed char>(int frame_start, int frame_end, MultidimArray<signed char> &image, int nr_threads);
+template long long EERRenderer::renderFrames<unsigned char>(int frame_start, int frame_end, MultidimArray<unsigned char> &image, int nr_threads);
@@ -28,6 +28,7 @@ class EERRenderer {
     static const char EER_FOOTER_ERR[];
     static const int EER_IMAGE_WIDTH, EER_IMAGE_HEIGHT, EER_IMAGE_PIXELS;
     static const unsigned int EER_LEN_FOOTER;
+    static const unsigned int EER_BUFFER_PADDING;
     static const uint16_t TIFF_COMPRESSION_EER8bit, TIFF_COMPRESSION_EER7bit;
 
     int eer_upsampling;
@@ -46,6 +47,12 @@ class EERRenderer {
     template <typename T>
     void render4K(MultidimArray<T> &image, std::vector<unsigned int> &positions, std::vector<unsigned char> &symbols, int n_electrons);
 
+    // Decode the electrons of a (0-indexed) frame. Returns their number, or -1 if the frame is corrupted.
+    long long decodeFrame(int iframe, std::vector<unsigned int> &positions, std::vector<unsigned char> &symbols) const;
+
+    template <typename T>
+    void renderElectrons(MultidimArray<T> &image, std::vector<unsigned int> &positions, std::vector<unsigned char> &symbols, int n_electrons);
+
     static TIFFErrorHandler prevTIFFWarningHandler;
 
     public:
@@ -87,8 +94,10 @@ class EERRenderer {
     // image is cleared.
     // This function is thread-safe (except for timing).
     // It is caller's responsibility to make sure type T does not overflow.
+    // With nr_threads > 1, the frames are decoded in parallel, every thread summing its frames
+    // in an image of its own (so this needs nr_threads - 1 more images of memory).
     template <typename T>
-    long long renderFrames(int frame_start, int frame_end, MultidimArray<T> &image);
+    long long renderFrames(int frame_start, int frame_end, MultidimArray<T> &image, int nr_threads = 1);
 
     // The gain reference for EER is not multiplicative! So the inverse is taken here.
     // 0 means defect.
@@ -0,0 +1,326 @@
+/***************************************************************************
+ *
+ * Author: "agent"
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This complete copyright notice must be included in any revised version of the
+ * source code. Additional authorship citations may be added, but existing
+ * author citations must be preserved.
+ ***************************************************************************/
+
+#include "src/scratch_stager.h"
+#include "src/image.h"
+#include "src/time.h"
+#include <cerrno>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <sstream>
+#include <sys/stat.h>
+
+namespace {
+
+    // Images of a stack are copied in blocks of (at least one image and) about this many bytes,
+    // and other images in blocks of this many files
+    const size_t chunk_bytes = 64 * 1024 * 1024;
+    const long int chunk_files = 16;
+
+    std::string signature(const ScratchStager::Group &group) {
+        std::hash<std::string> hash;
+        size_t h = hash(group.fn_stack);
+        const auto mix = [&] (const std::string &s) { h = h * 1099511628211ULL ^ hash(s); };
+        for (const auto &fn : group.fn_imgs)   mix(fn);
+        for (const auto &fn : group.fn_copies) mix(fn);
+        mix(std::to_string(group.xdim) + "x" + std::to_string(group.ydim));
+        std::stringstream sts;
+        sts << std::hex << h;
+        return sts.str();
+    }
+
+    // Returns false if there is no (readable) manifest
+    bool readManifest(const FileName &fn_manifest, std::string &signature, long int &nr_images, long int &nr_copied) {
+        std::ifstream in (fn_manifest.c_str());
+        std::string key;
+        return in
+            && in >> key >> signature && key == "signature"
+            && in >> key >> nr_images && key == "images"
+            && in >> key >> nr_copied && key == "copied";
+    }
+
+    void writeAll(int fd, const char *data, size_t size, off_t offset, const FileName &fn) {
+        while (size > 0) {
+            const ssize_t n = pwrite(fd, data, size, offset);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                REPORT_ERROR("ScratchStager: cannot write to " + fn + ": " + strerror(errno));
+            }
+            data += n;
+            size -= n;
+            offset += n;
+        }
+    }
+
+    off_t fileSize(const FileName &fn) {
+        struct stat st;
+        return stat(fn.c_str(), &st) == 0 ? st.st_size : -1;
+    }
+
+    // Make sure what was written to fn is on the disk
+    void syncFile(const FileName &fn) {
+        const int fd = open(fn.c_str(), O_RDONLY);
+        if (fd == -1)
+            REPORT_ERROR("ScratchStager: cannot open " + fn + ": " + strerror(errno));
+        const int err = fdatasync(fd);
+        close(fd);
+        if (err)
+            REPORT_ERROR("ScratchStager: cannot sync " + fn + ": " + strerror(errno));
+    }
+
+}
+
+ScratchStager::ScratchStager(const std::vector<Group> &groups, int nr_threads, bool do_resume):
+    groups(groups), nr_threads(std::max(nr_threads, 1)), do_resume(do_resume),
+    staged(new std::atomic<bool>[groups.size()]), next_chunk(0), abort(false), nr_chunks_done(0)
+{
+    for (int igroup = 0; igroup < groups.size(); igroup++)
+        staged[igroup] = false;
+}
+
+ScratchStager::~ScratchStager() {
+    stop();
+}
+
+long int ScratchStager::copiedImages(const FileName &fn_manifest, long int *nr_images) {
+    std::string signature;
+    long int nr_total, nr_copied;
+    if (!readManifest(fn_manifest, signature, nr_total, nr_copied)) return -1;
+    if (nr_images) *nr_images = nr_total;
+    return nr_copied;
+}
+
+void ScratchStager::prepare() {
+    chunks.clear();
+    signatures.resize(groups.size());
+    nr_copied.assign(groups.size(), 0);
+    done.assign(groups.size(), std::map<long int, long int>());
+
+    for (int igroup = 0; igroup < groups.size(); igroup++) {
+        const Group &group = groups[igroup];
+        const long int nr_images = group.fn_imgs.size();
+        if (nr_images == 0) {
+            // Nothing to copy (nor a manifest)
+            staged[igroup] = true;
+            continue;
+        }
+        const bool is_stack = !group.fn_stack.empty();
+        if (!is_stack && group.fn_copies.size() != nr_images)
+            REPORT_ERROR("ScratchStager BUG: the number of copies is not the number of images");
+        signatures[igroup] = signature(group);
+
+        const std::vector<char> header = is_stack ? mrcStackHeader(group.xdim, group.ydim, nr_images, group.angpix) : std::vector<char>();
+        const off_t stack_size = header.size() + (off_t) nr_images * group.xdim * group.ydim * sizeof(float);
+
+        // Resume where a copy of the same images stopped
+        long int first = 0;
+        std::string old_signature;
+        long int old_nr_images, old_nr_copied;
+        if (
+            do_resume && readManifest(group.fn_manifest, old_signature, old_nr_images, old_nr_copied) &&
+            old_signature == signatures[igroup] && old_nr_images == nr_images &&
+            (!is_stack || fileSize(group.fn_stack) == stack_size)
+        ) {
+            first = std::min(std::max(old_nr_copied, 0L), nr_images);
+        }
+
+        if (first == 0 && is_stack) {
+            // The whole stack (with the data still missing)
+            const int fd = open(group.fn_stack.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+            if (fd == -1)
+                REPORT_ERROR("ScratchStager: cannot create " + group.fn_stack + ": " + strerror(errno));
+            writeAll(fd, header.data(), header.size(), 0, group.fn_stack);
+            const int err = ftruncate(fd, stack_size);
+            close(fd);
+            if (err)
+                REPORT_ERROR("ScratchStager: cannot make room for " + group.fn_stack + ": " + strerror(errno));
+            chmod(group.fn_stack.c_str(), 0777);
+        }
+
+        nr_copied[igroup] = first;
+        writeManifest(igroup);
+        staged[igroup] = first == nr_images;
+
+        const long int per_chunk = is_stack ?
+            std::max(1L, (long int) (chunk_bytes / (group.xdim * group.ydim * sizeof(float)))) : chunk_files;
+        for (long int n = first; n < nr_images; n += per_chunk)
+            chunks.push_back({igroup, n, std::min(n + per_chunk, nr_images)});
+    }
+}
+
+bool ScratchStager::copy(const Chunk &chunk) {
+    const Group &group = groups[chunk.igroup];
+
+    if (group.fn_stack.empty()) {
+        for (long int n = chunk.first; n < chunk.last; n++) {
+            if (abort) return false;
+            Image<RFLOAT>::from_filename(group.fn_imgs[n]).write(group.fn_copies[n]);
+            chmod(group.fn_copies[n].c_str(), 0777);
+            // The manifest will say this image is there
+            syncFile(group.fn_copies[n]);
+        }
+        return true;
+    }
+
+    // Gather the images in their order in the stack, and write them out in one go
+    const size_t npix = group.xdim * group.ydim;
+    std::vector<float> buffer (npix * (chunk.last - chunk.first));
+    std::shared_ptr<const MappedMRCStack> stack;
+    for (long int n = chunk.first; n < chunk.last; n++) {
+        if (abort) return false;
+        const FileName &fn_img = group.fn_imgs[n];
+        float *const dest = buffer.data() + (n - chunk.first) * npix;
+        long int index;
+        FileName fn_src;
+        fn_img.decompose(index, fn_src);
+        if (index > 0 && fn_img.getFileFormat().contains("mrcs")) {
+            // Consecutive images usually come from the same stack
+            fn_src = fn_src.removeFileFormat();
+            if (!stack || stack->filename != fn_src)
+                stack = MappedMRCStack::get(fn_src);
+            if (stack->xdim != group.xdim || stack->ydim != group.ydim)
+                REPORT_ERROR("ScratchStager: the images in " + fn_src + " do not have the size of the others in their optics group");
+            stack->copy(index - 1, dest);
+        } else {
+            const auto img = Image<float>::from_filename(fn_img);
+            if (Xsize(img()) != group.xdim || Ysize(img()) != group.ydim || Zsize(img()) != 1)
+                REPORT_ERROR("ScratchStager: " + fn_img + " does not have the size of the other images in its optics group");
+            std::copy(img().begin(), img().end(), dest);
+        }
+    }
+
+    const int fd = open(group.fn_stack.c_str(), O_WRONLY);
+    if (fd == -1)
+        REPORT_ERROR("ScratchStager: cannot open " + group.fn_stack + ": " + strerror(errno));
+    const off_t offset = mrcStackHeader(0, 0, 0).size() + (off_t) chunk.first * npix * sizeof(float);
+    try {
+        writeAll(fd, (const char*) buffer.data(), buffer.size() * sizeof(float), offset, group.fn_stack);
+    } catch (...) {
+        close(fd);
+        throw;
+    }
+    // The manifest will say these images are there
+    fdatasync(fd);
+    close(fd);
+    return true;
+}
+
+void ScratchStager::finish(const Chunk &chunk) {
+    std::lock_guard<std::mutex> lock (mutex);
+    nr_chunks_done++;
+
+    const int igroup = chunk.igroup;
+    std::map<long int, long int> &ahead = done[igroup];
+    ahead[chunk.first] = chunk.last;
+    if (chunk.first != nr_copied[igroup]) return;
+
+    // All images before nr_copied are there
+    for (auto it = ahead.find(nr_copied[igroup]); it != ahead.end(); it = ahead.find(nr_copied[igroup])) {
+        nr_copied[igroup] = it->second;
+        ahead.erase(it);
+    }
+    writeManifest(igroup);
+    if (nr_copied[igroup] == groups[igroup].fn_imgs.size())
+        staged[igroup] = true;
+}
+
+void ScratchStager::writeManifest(int igroup) {
+    const FileName &fn_manifest = groups[igroup].fn_manifest;
+    const FileName fn_tmp = fn_manifest + ".tmp";
+    {
+        std::ofstream out (fn_tmp.c_str());
+        out << "signature " << signatures[igroup] << "\n"
+            << "images " << groups[igroup].fn_imgs.size() << "\n"
+            << "copied " << nr_copied[igroup] << "\n";
+        if (!out)
+            REPORT_ERROR("ScratchStager: cannot write " + fn_tmp);
+    }
+    // Never leave a half-written manifest
+    if (rename(fn_tmp.c_str(), fn_manifest.c_str()))
+        REPORT_ERROR("ScratchStager: cannot write " + fn_manifest + ": " + strerror(errno));
+    chmod(fn_manifest.c_str(), 0777);
+}
+
+void ScratchStager::fail(const std::string &message) {
+    std::lock_guard<std::mutex> lock (mutex);
+    if (error.empty()) error = message;
+    abort = true;
+}
+
+void ScratchStager::work(int verb) {
+    while (!abort) {
+        const size_t ichunk = next_chunk++;
+        if (ichunk >= chunks.size()) return;
+        try {
+            if (copy(chunks[ichunk])) finish(chunks[ichunk]);
+        } catch (const RelionError &err) {
+            fail(err.msg);
+        } catch (const std::exception &err) {
+            fail(err.what());
+        } catch (...) {
+            fail("unknown error while copying to scratch");
+        }
+        if (verb > 0) {
+            std::lock_guard<std::mutex> lock (mutex);
+            progress_bar(nr_chunks_done);
+        }
+    }
+}
+
+std::string ScratchStager::copyAll(int verb) {
+    if (verb > 0) init_progress_bar(chunks.size());
+
+    // The calling thread is one of the nr_threads, and the only one to report progress
+    std::vector<std::thread> threads;
+    for (int i = 1; i < nr_threads; i++)
+        threads.emplace_back(&ScratchStager::work, this, 0);
+    work(verb);
+    for (auto &t : threads) t.join();
+
+    if (verb > 0) progress_bar(chunks.size());
+    MappedMRCStack::releaseUnused();
+
+    std::lock_guard<std::mutex> lock (mutex);
+    return error;
+}
+
+void ScratchStager::run(int verb) {
+    prepare();
+    const std::string err = copyAll(verb);
+    if (!err.empty())
+        REPORT_ERROR("ScratchStager: " + err);
+}
+
+void ScratchStager::start() {
+    if (isRunning())
+        REPORT_ERROR("ScratchStager BUG: already copying");
+    prepare();
+    thread = std::thread([this] () {
+        const std::string err = copyAll(0);
+        if (!err.empty())
+            std::cerr << " Warning: stopped copying particles to the scratch disk: " << err << std::endl
+                      << " The particles that were not copied will be read from where they were." << std::endl;
+    });
+}
+
+void ScratchStager::stop() {
+    abort = true;
+    if (thread.joinable()) thread.join();
+}
@@ -0,0 +1,127 @@
+/***************************************************************************
+ *
+ * Author: "agent"
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This complete copyright notice must be included in any revised version of the
+ * source code. Additional authorship citations may be added, but existing
+ * author citations must be preserved.
+ ***************************************************************************/
+
+#ifndef SCRATCH_STAGER_H_
+#define SCRATCH_STAGER_H_
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "src/filename.h"
+
+/* Copies particle images to a scratch disk, on several threads.
+ *
+ * The images of a group (an optics group) either all go into one float MRC stack,
+ * which is then written in large blocks at their final positions, or each into its own file (sub-tomograms).
+ * Groups are copied one after the other, so that the first ones are complete (isStaged()) while the others are still being copied.
+ *
+ * Next to its copies, every group has a manifest with the number of images that have been copied (all images before it are),
+ * so that an interrupted copy can be resumed where it stopped, and a signature of the image names,
+ * so that it is only resumed for the same images.
+ */
+class ScratchStager {
+
+    public:
+
+    struct Group {
+        FileName fn_manifest;
+        FileName fn_stack;                // The stack to copy all images into, or empty:
+        std::vector<FileName> fn_copies;  // the file to copy each image into
+        std::vector<FileName> fn_imgs;    // The images to copy, in their order in the stack
+        long int xdim, ydim;              // The size of the images in the stack
+        RFLOAT angpix;                    // For the header of the stack (0 if unknown)
+    };
+
+    ScratchStager(const std::vector<Group> &groups, int nr_threads = 1, bool do_resume = false);
+
+    // Waits for (or stops) the copying
+    ~ScratchStager();
+
+    // Copy everything, reporting progress if verb > 0
+    void run(int verb = 0);
+
+    // Copy everything in the background. If this fails, the groups that were not finished are never staged.
+    void start();
+
+    // Stop copying (in the background) as soon as possible
+    void stop();
+
+    bool isRunning() const { return thread.joinable(); }
+
+    // Have all images of group igroup been copied?
+    bool isStaged(int igroup) const { return staged[igroup]; }
+
+    // The number of images that have been copied according to a manifest, or -1 if there is none
+    // (if nr_images is given, it is set to the number of images to copy)
+    static long int copiedImages(const FileName &fn_manifest, long int *nr_images = nullptr);
+
+    private:
+
+    struct Chunk {
+        int igroup;
+        long int first, last;  // Images first ... last - 1 of the group
+    };
+
+    std::vector<Group> groups;
+    int nr_threads;
+    bool do_resume;
+
+    std::vector<Chunk> chunks;
+    std::vector<std::string> signatures;  // Per group, of its image names and copies
+    std::unique_ptr<std::atomic<bool>[]> staged;
+
+    std::mutex mutex;
+    std::atomic<size_t> next_chunk;
+    std::atomic<bool> abort;
+    std::vector<long int> nr_copied;                 // Per group
+    std::vector<std::map<long int, long int>> done;  // Per group, the chunks (first -> last) copied beyond nr_copied
+    size_t nr_chunks_done;
+    std::string error;
+    std::thread thread;
+
+    // Divide the groups into chunks, and make their stacks (or find where they stopped)
+    void prepare();
+
+    // Returns false if it was stopped before the whole chunk was copied
+    bool copy(const Chunk &chunk);
+
+    // Record that a chunk was copied, and update the manifest of its group
+    void finish(const Chunk &chunk);
+
+    void writeManifest(int igroup);
+
+    // Keep the first error, and stop all copying threads
+    void fail(const std::string &message);
+
+    // Copy chunks until there are none left (progress reported if verb > 0)
+    void work(int verb);
+
+    // Run the copying threads (progress reported if verb > 0), and return the first error (if any)
+    std::string copyAll(int verb);
+
+    ScratchStager(const ScratchStager&);
+    ScratchStager& operator=(const ScratchStager&);
+
+};
+
+#endif
@@ -0,0 +1,80 @@
+/***************************************************************************
+ *
+ * Author: "agent"
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * This complete copyright notice must be included in any revised version of the
+ * source code. Additional authorship citations may be added, but existing
+ * author citations must be preserved.
+ ***************************************************************************/
+
+#ifndef SHARED_MEMORY_H_
+#define SHARED_MEMORY_H_
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <string>
+#include "src/error.h"
+
+/** POSIX shared memory segment, mapped into this process.
+ *
+ * One process creates the segment (read-write), the others on the same host open it by name (read-only, unless is_writable).
+ * Once everyone has opened it, the creator can unlink the name:
+ * the memory is then released when the last process unmaps it (on destruction or exit).
+ */
+class SharedMemorySegment {
+
+    std::string name;
+    size_t len;
+    void *ptr;
+
+    public:
+
+    SharedMemorySegment(const std::string &name, size_t size, bool do_create, bool is_writable = false): name(name), len(size), ptr(nullptr) {
+        is_writable |= do_create;
+        const int fd = shm_open(name.c_str(), do_create ? O_CREAT | O_EXCL | O_RDWR : is_writable ? O_RDWR : O_RDONLY, 0600);
+        if (fd < 0)
+            REPORT_ERROR("SharedMemorySegment: cannot " + std::string(do_create ? "create " : "open ") + name);
+        // Reserve the pages now, so that a full /dev/shm is an error here rather than a SIGBUS later
+        if (do_create && (ftruncate(fd, len) != 0 || posix_fallocate(fd, 0, len) != 0)) {
+            close(fd);
+            shm_unlink(name.c_str());
+            REPORT_ERROR("SharedMemorySegment: cannot allocate " + std::to_string(len) + " bytes for " + name + " (is /dev/shm large enough?)");
+        }
+        void *p = mmap(nullptr, len, is_writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (p == MAP_FAILED) {
+            if (do_create) shm_unlink(name.c_str());
+            REPORT_ERROR("SharedMemorySegment: cannot map " + name);
+        }
+        ptr = p;
+    }
+
+    SharedMemorySegment(const SharedMemorySegment&) = delete;
+    SharedMemorySegment& operator = (const SharedMemorySegment&) = delete;
+
+    ~SharedMemorySegment() { munmap(ptr, len); }
+
+    // Remove the name (the mappings stay valid)
+    void unlink() { shm_unlink(name.c_str()); }
+
+    // No more writes through this mapping
+    void makeReadOnly() { mprotect(ptr, len, PROT_READ); }
+
+    char* data() const { return static_cast<char*>(ptr); }
+
+    size_t size() const { return len; }
+
+};
+
+#endif
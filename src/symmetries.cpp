@@ -101,8 +101,8 @@ int SymList::read_sym_file(FileName fn_sym) {
         }
     }
     // Ask for memory
-    __L.resize(4 * true_symNo, 4);
-    __R.resize(4 * true_symNo, 4);
+    __L.resize(4, 4 * true_symNo);
+    __R.resize(4, 4 * true_symNo);
     __chain_length.resize(true_symNo);
     std::fill(__chain_length.begin(), __chain_length.end(), 1);
 
@@ -122,9 +122,9 @@ int SymList::read_sym_file(FileName fn_sym) {
                 axis[i] = textToDouble(token);
             }
             RFLOAT ang_incr = 360.0 / fold;
-            RFLOAT rot_ang;
+            RFLOAT rot_ang = ang_incr;
             L.setIdentity();
-            for (int j = 1, rot_ang = ang_incr; j < fold; j++, rot_ang += ang_incr) {
+            for (int j = 1; j < fold; j++, rot_ang += ang_incr) {
                 R = rotation3DMatrix(rot_ang, axis);
                 setSmallValuesToZero(R.begin(), R.end());
                 set_matrices(i++, L, R.transpose());
@@ -198,8 +198,8 @@ void SymList::add_matrices(
     ) REPORT_ERROR( "SymList::add_matrix: Transformation matrix is not 4×4");
 
     if (TrueSymsNo() == SymsNo()) {
-        __L.resize(__L.nrows() + 4, 4);
-        __R.resize(__R.nrows() + 4, 4);
+        __L.resize(4, __L.nrows() + 4);
+        __R.resize(4, __R.nrows() + 4);
         __chain_length.resize(__chain_length.size() + 1);
     }
 
@@ -41,7 +41,7 @@ void TIFFConverter::read(int argc, char **argv) {
     fn_in = parser.getOption("--i", "Input movie to be compressed (an MRC/MRCS file or a list of movies as .star or .lst)");
     fn_out = parser.getOption("--o", "Directory for output TIFF files", "./");
     only_do_unfinished = parser.checkOption("--only_do_unfinished", "Only process non-converted movies.");
-    nr_threads = textToInteger(parser.getOption("--j", "Number of threads (useful only for --estimate_gain)", "1"));
+    nr_threads = textToInteger(parser.getOption("--j", "Number of threads (useful only for --estimate_gain and EER movies)", "1"));
     fn_gain = parser.getOption("--gain", "Estimated gain map and its reliablity map (read)", "");
     thresh_reliable = textToInteger(parser.getOption("--thresh", "Number of success needed to consider a pixel reliable", "50"));
     do_estimate = parser.checkOption("--estimate_gain", "Estimate gain");
@@ -262,7 +262,7 @@ void TIFFConverter::only_compress(FileName fn_movie, FileName fn_tiff) {
 
             std::cout << " Rendering EER (hardware) frame " << frame << " to " << frame_end << std::endl;
             MultidimArray<T> buf = MultidimArray<T>::zeros(renderer.getHeight(), renderer.getWidth());
-            renderer.renderFrames(frame, frame_end, buf);
+            renderer.renderFrames(frame, frame_end, buf, nr_threads);
             write_tiff_one_page(tif, buf, -1, decide_filter(renderer.getWidth(), true), deflate_level, line_by_line);
         }
     }
@@ -0,0 +1,106 @@
+#ifdef ALTCPU
+#include <catch2/catch.hpp>
+#include <random>
+#include <vector>
+#include <tbb/parallel_for.h>
+#include "src/acc/cpu/cuda_stubs.h"
+#include "src/acc/acc_ptr.h"
+#include "src/acc/cpu/cpu_kernels/helper.h"
+#include "src/acc/cpu/cpu_kernels/BP.h"
+
+static const int bp_max_r = 7, bp_padding_factor = 2;
+static const int bp_pad_size = 2 * (bp_padding_factor * bp_max_r + 1) + 1;
+static const size_t bp_mdl_xyz = (size_t) (bp_pad_size / 2 + 1) * bp_pad_size * bp_pad_size;
+
+// Backproject random 2D images into a 3D model, one image per TBB task,
+// either with the per-thread buffers (merged at the end) or locking rows of the model
+static void backprojectImages(
+  XFLOAT *mdl_real, XFLOAT *mdl_imag, XFLOAT *mdl_weight, BackprojectionBuffers *buffers
+) {
+  const int n_images = 6, n_trans = 3;
+  const int ori_size = 16;
+  const unsigned img_x = ori_size / 2 + 1, img_y = ori_size, img_xy = img_x * img_y;
+  const unsigned mdl_x = bp_pad_size / 2 + 1, mdl_y = bp_pad_size;
+  const int mdl_init = -(bp_pad_size / 2);
+
+  std::mt19937 rng (2018);
+  std::normal_distribution<XFLOAT> normal (0.0, 1.0);
+  std::uniform_real_distribution<XFLOAT> uniform (0.0, 1.0);
+
+  std::vector<XFLOAT> img_real (n_images * img_xy), img_imag (n_images * img_xy);
+  std::vector<XFLOAT> ctfs (n_images * img_xy), minvsigma2s (n_images * img_xy);
+  for (unsigned i = 0; i < n_images * img_xy; i++) {
+    img_real[i] = normal(rng);
+    img_imag[i] = normal(rng);
+    ctfs[i] = 2.0 * uniform(rng) - 1.0;
+    minvsigma2s[i] = uniform(rng);
+  }
+
+  std::vector<XFLOAT> trans_x (n_trans), trans_y (n_trans), weights (n_images * n_trans);
+  for (int i = 0; i < n_trans; i++) {
+    trans_x[i] = 0.1 * normal(rng);
+    trans_y[i] = 0.1 * normal(rng);
+  }
+  for (int i = 0; i < n_images * n_trans; i++)
+    weights[i] = uniform(rng);
+
+  // Random rotation matrices, from normalised quaternions
+  std::vector<XFLOAT> eulers (n_images * 9);
+  for (int img = 0; img < n_images; img++) {
+    XFLOAT q[4], norm = 0.0;
+    for (XFLOAT &qi : q) { qi = normal(rng); norm += qi * qi; }
+    for (XFLOAT &qi : q) qi /= sqrt(norm);
+    const XFLOAT a = q[0], b = q[1], c = q[2], d = q[3];
+    const XFLOAT R[9] = {
+      a*a + b*b - c*c - d*d, 2 * (b*c - a*d),       2 * (b*d + a*c),
+      2 * (b*c + a*d),       a*a - b*b + c*c - d*d, 2 * (c*d - a*b),
+      2 * (b*d - a*c),       2 * (c*d + a*b),       a*a - b*b - c*c + d*d
+    };
+    std::copy(R, R + 9, &eulers[img * 9]);
+  }
+
+  std::vector<tbb::spin_mutex> mutexes (mdl_y * mdl_y);
+
+  tbb::parallel_for(0, n_images, [&](int img) {
+    CpuKernels::backprojectRef3D<false>(
+      1, &img_real[img * img_xy], &img_imag[img * img_xy],
+      trans_x.data(), trans_y.data(), &weights[img * n_trans],
+      &minvsigma2s[img * img_xy], &ctfs[img * img_xy],
+      n_trans, 0.2, 1.0, &eulers[img * 9],
+      mdl_real, mdl_imag, mdl_weight,
+      bp_max_r, bp_max_r * bp_max_r, bp_padding_factor,
+      img_x, img_y, 1, img_xy,
+      mdl_x, mdl_y, mdl_init, mdl_init,
+      mutexes.data(), buffers
+    );
+  });
+
+  if (buffers) buffers->merge();
+}
+
+// Test that backprojecting through the per-thread buffers gives the same model as backprojecting directly,
+// with buffers large enough for the whole model and with buffers that have to be flushed after every tile.
+TEST_CASE("Test BackprojectionBuffers", "[backprojection]") {
+  std::vector<XFLOAT> direct_real (bp_mdl_xyz), direct_imag (bp_mdl_xyz), direct_weight (bp_mdl_xyz);
+  backprojectImages(direct_real.data(), direct_imag.data(), direct_weight.data(), nullptr);
+
+  XFLOAT total_weight = 0.0;
+  for (XFLOAT w : direct_weight) total_weight += w;
+  REQUIRE(total_weight > 0.0);
+
+  for (size_t bytes_per_thread : {(size_t) 1 << 30, (size_t) 1}) {
+    std::vector<XFLOAT> mdl_real (bp_mdl_xyz), mdl_imag (bp_mdl_xyz), mdl_weight (bp_mdl_xyz);
+    BackprojectionBuffers buffers (
+      mdl_real.data(), mdl_imag.data(), mdl_weight.data(),
+      bp_pad_size / 2 + 1, bp_pad_size, bp_pad_size, bytes_per_thread
+    );
+    backprojectImages(mdl_real.data(), mdl_imag.data(), mdl_weight.data(), &buffers);
+
+    for (size_t i = 0; i < bp_mdl_xyz; i++) {
+      REQUIRE(mdl_real  [i] == Approx(direct_real  [i]).margin(1e-4));
+      REQUIRE(mdl_imag  [i] == Approx(direct_imag  [i]).margin(1e-4));
+      REQUIRE(mdl_weight[i] == Approx(direct_weight[i]).margin(1e-4));
+    }
+  }
+}
+#endif
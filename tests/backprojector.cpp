@@ -0,0 +1,76 @@
+#include <catch2/catch.hpp>
+#include <random>
+#include "src/backprojector.h"
+
+// Trilinear interpolation of the stored half of a Fourier-space array at logical coordinates (xp, yp, zp),
+// using the Friedel mate (conjugated, for complex values) where xp < 0
+template <typename T>
+static T interpolateHalf(const MultidimArray<T> &v, RFLOAT xp, RFLOAT yp, RFLOAT zp, bool &is_neg_x) {
+  is_neg_x = xp < 0;
+  if (is_neg_x) { xp = -xp; yp = -yp; zp = -zp; }
+  const long int x0 = floor(xp), y0 = floor(yp), z0 = floor(zp);
+  const RFLOAT fx = xp - x0, fy = yp - y0, fz = zp - z0;
+  T result (0);
+  for (int dz = 0; dz < 2; dz++)
+  for (int dy = 0; dy < 2; dy++)
+  for (int dx = 0; dx < 2; dx++) {
+    const RFLOAT w = (dx ? fx : 1 - fx) * (dy ? fy : 1 - fy) * (dz ? fz : 1 - fz);
+    result += v.elem(x0 + dx, y0 + dy, z0 + dz) * w;
+  }
+  return result;
+}
+
+// Symmetrise data and weight one operator at a time, adding at each point inside r_max
+// the interpolated values at its images under every operator (but the identity)
+static void referencePointGroupSymmetry(const BackProjector &bp, MultidimArray<Complex> &data, MultidimArray<RFLOAT> &weight) {
+  const RFLOAT rmax = round(bp.r_max * bp.padding_factor);
+  data = bp.data;
+  weight = bp.weight;
+  Matrix<RFLOAT> L (4, 4), R (4, 4);
+  for (int isym = 0; isym < bp.SL.SymsNo(); isym++) {
+    bp.SL.get_matrices(isym, L, R);
+    for (long int z = Zinit(data); z <= Zlast(data); z++)
+    for (long int y = Yinit(data); y <= Ylast(data); y++)
+    for (long int x = Xinit(data); x <= Xlast(data); x++) {
+      if (x * x + y * y + z * z > rmax * rmax) continue;
+      const RFLOAT xp = R(0, 0) * x + R(0, 1) * y + R(0, 2) * z;
+      const RFLOAT yp = R(1, 0) * x + R(1, 1) * y + R(1, 2) * z;
+      const RFLOAT zp = R(2, 0) * x + R(2, 1) * y + R(2, 2) * z;
+      bool is_neg_x;
+      const Complex d = interpolateHalf(bp.data, xp, yp, zp, is_neg_x);
+      data.elem(x, y, z) += is_neg_x ? conj(d) : d;
+      weight.elem(x, y, z) += interpolateHalf(bp.weight, xp, yp, zp, is_neg_x);
+    }
+  }
+}
+
+// Test the single-pass symmetrisation against a per-operator reference, on random arrays.
+TEST_CASE("Test BackProjector::applyPointGroupSymmetry", "[backprojector]") {
+  std::mt19937 rng (1982);
+  std::normal_distribution<RFLOAT> normal (0.0, 1.0);
+  for (const std::pair<const char *, int> &group : {std::make_pair("D2", 4), std::make_pair("I", 60)}) {
+    BackProjector bp (16, 3, group.first);
+    REQUIRE(bp.SL.SymsNo() + 1 == group.second);  // the identity is not stored
+    bp.initZeros();
+    // The stored half of the padded transform: x from 0, y and z centred
+    const long int pad = bp.pad_size;
+    bp.data  .resize(pad / 2 + 1, pad, pad).setXmippOrigin().xinit = 0;
+    bp.weight.resize(pad / 2 + 1, pad, pad).setXmippOrigin().xinit = 0;
+    for (size_t n = 0; n < bp.data.size(); n++) {
+      bp.data[n] = Complex(normal(rng), normal(rng));
+      bp.weight[n] = std::abs(normal(rng));
+    }
+
+    MultidimArray<Complex> data;
+    MultidimArray<RFLOAT> weight;
+    referencePointGroupSymmetry(bp, data, weight);
+    bp.applyPointGroupSymmetry(3);
+
+    REQUIRE(bp.data.sameShape(data));
+    for (size_t n = 0; n < data.size(); n++) {
+      REQUIRE(bp.data[n].real == Approx(data[n].real).margin(1e-9));
+      REQUIRE(bp.data[n].imag == Approx(data[n].imag).margin(1e-9));
+      REQUIRE(bp.weight[n] == Approx(weight[n]).margin(1e-9));
+    }
+  }
+}
@@ -0,0 +1,99 @@
+#include <catch2/catch.hpp>
+#include <algorithm>
+#include <random>
+#include "src/local_symmetry.h"
+
+// A smooth random map of size n: Gaussian blobs of random heights around the centre
+static MultidimArray<RFLOAT> randomBlobs(long int n, std::mt19937 &rng) {
+  std::uniform_real_distribution<RFLOAT> position (-0.2 * n, 0.2 * n), height (0.5, 1.5);
+  MultidimArray<RFLOAT> map = MultidimArray<RFLOAT>::zeros(n, n, n);
+  map.setXmippOrigin();
+  const RFLOAT sigma = n / 16.0;
+  for (int blob = 0; blob < 8; blob++) {
+    const RFLOAT x0 = position(rng), y0 = position(rng), z0 = position(rng), h = height(rng);
+    FOR_ALL_ELEMENTS_IN_ARRAY3D(map, i, j, k) {
+      const RFLOAT r2 = (i - x0) * (i - x0) + (j - y0) * (j - y0) + (k - z0) * (k - z0);
+      map.elem(i, j, k) += h * exp(-r2 / (2 * sigma * sigma));
+    }
+  }
+  return map;
+}
+
+// A sphere of radius n / 3 with a cosine edge of n / 8 pixels
+static MultidimArray<RFLOAT> softSphere(long int n) {
+  MultidimArray<RFLOAT> mask (n, n, n);
+  mask.setXmippOrigin();
+  const RFLOAT radius = n / 3.0, edge = n / 8.0;
+  FOR_ALL_ELEMENTS_IN_ARRAY3D(mask, i, j, k) {
+    const RFLOAT r = sqrt((RFLOAT) (i * i + j * j + k * k));
+    mask.elem(i, j, k) = r < radius ? 1.0 : r > radius + edge ? 0.0 : 0.5 + 0.5 * cos(PI * (r - radius) / edge);
+  }
+  return mask;
+}
+
+// Test the coarse (FFT) search of calculateOperatorCC on a pair of maps related by a known operator:
+// its CCs should be those of the exact calculation on the downsampled maps, up to interpolation errors,
+// and it should rank the true operator among the best nr_refine sampling points.
+TEST_CASE("Test coarseOperatorCCs", "[local_symmetry]") {
+  const long int n = 64, nc = 32;
+  std::mt19937 rng (2016);
+  const MultidimArray<RFLOAT> dest = randomBlobs(n, rng), mask = softSphere(n);
+
+  Vector<RFLOAT> op_true;
+  Localsym_composeOperator(op_true, 12.0, 34.0, -56.0, 2.0, -4.0, 6.0);
+  Matrix<RFLOAT> op_mat;
+  Localsym_operator2matrix(op_true, op_mat, LOCALSYM_OP_DO_INVERT);
+  MultidimArray<RFLOAT> src = applyGeometry(dest, op_mat, IS_NOT_INV, DONT_WRAP);
+  src.setXmippOrigin();
+
+  // Sampling points around the true operator, on a grid that contains it
+  std::vector<Vector<RFLOAT>> op_samplings;
+  long int true_index = -1;
+  for (RFLOAT da : {-8.0, 0.0, 8.0})
+  for (RFLOAT db : {-8.0, 0.0, 8.0})
+  for (RFLOAT dg : {-8.0, 0.0, 8.0})
+  for (RFLOAT dx : {-4.0, 0.0, 4.0})
+  for (RFLOAT dy : {-4.0, 0.0, 4.0})
+  for (RFLOAT dz : {-4.0, 0.0, 4.0}) {
+    if (da == 0.0 && db == 0.0 && dg == 0.0 && dx == 0.0 && dy == 0.0 && dz == 0.0)
+      true_index = op_samplings.size();
+    Vector<RFLOAT> op;
+    Localsym_composeOperator(op, 12.0 + da, 34.0 + db, -56.0 + dg, 2.0 + dx, -4.0 + dy, 6.0 + dz);
+    op_samplings.push_back(op);
+  }
+
+  const std::vector<RFLOAT> coarse_ccs = coarseOperatorCCs(src, dest, mask, op_samplings, 4, false);
+  REQUIRE(coarse_ccs.size() == op_samplings.size());
+
+  // The exact CCs of the same sampling points on the maps downsampled as in the coarse search
+  MultidimArray<RFLOAT> src_c = src, dest_c = dest, mask_c = mask;
+  resizeMap(src_c, nc);
+  resizeMap(dest_c, nc);
+  resizeMap(mask_c, nc);
+  truncateMultidimArray(mask_c, 0.0, 1.0);
+  src_c.setXmippOrigin();
+  dest_c.setXmippOrigin();
+  mask_c.setXmippOrigin();
+  std::vector<Vector<RFLOAT>> op_samplings_c = op_samplings;
+  for (Vector<RFLOAT> &op : op_samplings_c)
+    Localsym_scaleTranslations(op, RFLOAT(nc) / RFLOAT(n));
+  calculateOperatorCC(src_c, dest_c, mask_c, op_samplings_c, false, false, 4);
+
+  RFLOAT max_cc = 0.0;
+  for (const Vector<RFLOAT> &op : op_samplings_c)
+    max_cc = std::max(max_cc, op[CC_POS]);
+  REQUIRE(max_cc > 0.0);
+  for (size_t i = 0; i < op_samplings.size(); i++)
+    REQUIRE(coarse_ccs[i] == Approx(op_samplings_c[i][CC_POS]).margin(0.25 * max_cc));
+
+  // With the coarse search, the exact CCs of the best nr_refine sampling points should still find the true operator
+  const long int nr_refine = 10;
+  const std::vector<long int> best = bestOperatorSamplings(src, dest, mask, op_samplings, nr_refine, 4, false);
+  REQUIRE(best.size() == nr_refine);
+  REQUIRE(std::find(best.begin(), best.end(), true_index) != best.end());
+
+  calculateOperatorCC(src, dest, mask, op_samplings, true, false, 4, nr_refine);
+  for (int pos : {AA_POS, BB_POS, GG_POS, DX_POS, DY_POS, DZ_POS})
+    REQUIRE(op_samplings[0][pos] == Approx(op_true[pos]));
+  REQUIRE(op_samplings[0][CC_POS] == Approx(0.0).margin(1e-6));
+}
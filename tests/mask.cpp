@@ -0,0 +1,61 @@
+#include <catch2/catch.hpp>
+#include <random>
+#include "src/mask.h"
+
+// The squared distance transform of msk, by comparing every pixel with every feature pixel
+static MultidimArray<RFLOAT> bruteForceSquaredDistanceTransform(const MultidimArray<RFLOAT> &msk, bool to_zeros) {
+  MultidimArray<RFLOAT> result (Xsize(msk), Ysize(msk), Zsize(msk));
+  for (long int k = 0; k < Zsize(msk); k++)
+  for (long int j = 0; j < Ysize(msk); j++)
+  for (long int i = 0; i < Xsize(msk); i++) {
+    RFLOAT best = std::numeric_limits<RFLOAT>::max();
+    for (long int kk = 0; kk < Zsize(msk); kk++)
+    for (long int jj = 0; jj < Ysize(msk); jj++)
+    for (long int ii = 0; ii < Xsize(msk); ii++) {
+      const RFLOAT value = direct::elem(msk, ii, jj, kk);
+      if (to_zeros ? value < 0.001 : value > 0.999)
+        best = std::min(best, (RFLOAT) ((i - ii) * (i - ii) + (j - jj) * (j - jj) + (k - kk) * (k - kk)));
+    }
+    direct::elem(result, i, j, k) = best;
+  }
+  return result;
+}
+
+static void requireSameDistances(const MultidimArray<RFLOAT> &msk, int n_threads) {
+  for (bool to_zeros : {false, true}) {
+    const MultidimArray<RFLOAT> fast = squaredDistanceTransform(msk, to_zeros, n_threads);
+    const MultidimArray<RFLOAT> slow = bruteForceSquaredDistanceTransform(msk, to_zeros);
+    REQUIRE(fast.sameShape(slow));
+    for (long int n = 0; n < slow.size(); n++)
+      REQUIRE(fast[n] == slow[n]);
+  }
+}
+
+// Test the linear-time distance transform against a brute-force one, on random binary masks.
+TEST_CASE("Test squaredDistanceTransform", "[mask]") {
+  std::mt19937 rng (1993);
+  for (long int zdim : {1, 7}) {
+    for (double density : {0.02, 0.2, 0.7}) {
+      MultidimArray<RFLOAT> msk (13, 9, zdim);
+      std::bernoulli_distribution is_one (density);
+      for (long int n = 0; n < msk.size(); n++)
+        msk[n] = is_one(rng) ? 1.0 : 0.0;
+      requireSameDistances(msk, 1);
+      requireSameDistances(msk, 3);
+    }
+  }
+}
+
+// Test that a mask with no ones (or no zeros) is at the largest distance everywhere.
+TEST_CASE("Test squaredDistanceTransform on uniform masks", "[mask]") {
+  for (RFLOAT value : {0.0, 1.0}) {
+    MultidimArray<RFLOAT> msk (6, 5, 4);
+    for (long int n = 0; n < msk.size(); n++)
+      msk[n] = value;
+    requireSameDistances(msk, 2);
+
+    const MultidimArray<RFLOAT> dist2 = squaredDistanceTransform(msk, false);
+    for (long int n = 0; n < dist2.size(); n++)
+      REQUIRE(dist2[n] == (value == 1.0 ? 0.0 : std::numeric_limits<RFLOAT>::max()));
+  }
+}
@@ -0,0 +1,159 @@
+#include <catch2/catch.hpp>
+#include "src/metadata_table.h"
+
+// Test that the column storage keeps rows together through sorting, subsetting and appending.
+TEST_CASE("Test MetaDataTable rows", "[metadata_table]") {
+  MetaDataTable mdt;
+  for (int i = 0; i < 6; i++) {
+    const long int j = mdt.addObject();
+    mdt.setValue(EMDL::IMAGE_NAME, std::to_string(i + 1) + "@particles.mrcs", j);
+    mdt.setValue(EMDL::MICROGRAPH_NAME, std::string(i % 2 ? "mic1.mrc" : "mic0.mrc"), j);
+    mdt.setValue(EMDL::CTF_DEFOCUSU, 10000.0 - 100.0 * i, j);
+    mdt.setValue(EMDL::PARTICLE_CLASS, i % 3 + 1, j);
+  }
+
+  mdt.sort(EMDL::CTF_DEFOCUSU);
+  REQUIRE(mdt.getValue<std::string>(EMDL::IMAGE_NAME, 0) == "6@particles.mrcs");
+  REQUIRE(mdt.getValue<int>(EMDL::PARTICLE_CLASS, 0) == 3);
+
+  mdt.newSort<MD::CompareStringsAt>(EMDL::MICROGRAPH_NAME);
+  REQUIRE(mdt.getValue<std::string>(EMDL::MICROGRAPH_NAME, 2) == "mic0.mrc");
+  REQUIRE(mdt.getValue<std::string>(EMDL::IMAGE_NAME, 3) == "6@particles.mrcs");
+
+  MetaDataTable subset = subsetMetaDataTable(mdt, EMDL::PARTICLE_CLASS, 3, 3);
+  REQUIRE(subset.size() == 2);
+  REQUIRE(subset.getValue<double>(EMDL::CTF_DEFOCUSU, 0) == Approx(9800.0));
+
+  subset.append(mdt);
+  subset.addObject(mdt.getObject(0));
+  REQUIRE(subset.size() == 9);
+  REQUIRE(subset.getValue<std::string>(EMDL::IMAGE_NAME, 8) == mdt.getValue<std::string>(EMDL::IMAGE_NAME, 0));
+}
+
+// Test that a table written in binary reads back the same, whichever columns are used first.
+TEST_CASE("Test MetaDataTable binary round trip", "[metadata_table]") {
+  MetaDataTable mdt;
+  mdt.name = "particles";
+  for (int i = 0; i < 5; i++) {
+    const long int j = mdt.addObject();
+    mdt.setValue(EMDL::IMAGE_NAME, std::to_string(i + 1) + "@particles.mrcs", j);
+    mdt.setValue(EMDL::CTF_DEFOCUSU, 10000.0 + i, j);
+    mdt.setValue(EMDL::PARTICLE_CLASS, i % 2 + 1, j);
+  }
+  const FileName fn = "test_metadata_table.star.bin";
+  mdt.write(fn);
+
+  MetaDataTable in;
+  REQUIRE(in.read(fn, "particles") == 5);
+  REQUIRE(in.getValue<double>(EMDL::CTF_DEFOCUSU, 4) == Approx(10004.0));
+  MetaDataTable copy = in;
+  REQUIRE(copy.getValue<std::string>(EMDL::IMAGE_NAME, 2) == "3@particles.mrcs");
+  REQUIRE(in.getValue<int>(EMDL::PARTICLE_CLASS, 1) == 2);
+  REQUIRE(in.getValue<std::string>(EMDL::IMAGE_NAME, 0) == "1@particles.mrcs");
+  std::remove(fn.c_str());
+}
+
+// Test that numbers are read the same way in place and through a stream, and as "is >> v" would.
+TEST_CASE("Test MetaDataTable number parsing", "[metadata_table]") {
+  const FileName fn = "test_metadata_table_numbers.star";
+  {
+    std::ofstream out (fn.c_str());
+    out << "data_particles\n\nloop_\n_rlnDefocusU #1\n_rlnClassNumber #2\n_rlnEnabled #3\n"
+        << "1.5e4 2 1\n"
+        << "nan 1.000000 1.000000\n"
+        << "inf 3abc 0.5\n"
+        << "12.5um 0x1A 2\n"
+        << "1e999 -7 abc\n"
+        << "-.5e1 +4 0\n"
+        << "0x1p3 1e3 -1\n"
+        << "\n";
+  }
+
+  MetaDataTable mapped;
+  REQUIRE(mapped.read(fn, "particles") == 7);
+  MetaDataTable streamed;
+  std::ifstream in (fn.c_str());
+  REQUIRE(streamed.readStar(in, "particles") == 7);
+
+  std::vector<double> defoci;
+  std::vector<int> classes;
+  std::vector<bool> enabled;
+  for (long int i = 0; i < 7; i++) {
+    REQUIRE(mapped.getValue<double>(EMDL::CTF_DEFOCUSU, i) == streamed.getValue<double>(EMDL::CTF_DEFOCUSU, i));
+    REQUIRE(mapped.getValue<int>(EMDL::PARTICLE_CLASS, i) == streamed.getValue<int>(EMDL::PARTICLE_CLASS, i));
+    REQUIRE(mapped.getValue<bool>(EMDL::IMAGE_ENABLED, i) == streamed.getValue<bool>(EMDL::IMAGE_ENABLED, i));
+    defoci.push_back(mapped.getValue<double>(EMDL::CTF_DEFOCUSU, i));
+    classes.push_back(mapped.getValue<int>(EMDL::PARTICLE_CLASS, i));
+    enabled.push_back(mapped.getValue<bool>(EMDL::IMAGE_ENABLED, i));
+  }
+
+  REQUIRE(defoci == std::vector<double>{15000.0, 0.0, 0.0, 12.5, std::numeric_limits<double>::max(), -5.0, 0.0});
+  REQUIRE(classes == std::vector<int>{2, 1, 3, 0, -7, 4, 1});
+  REQUIRE(enabled == std::vector<bool>{true, true, false, true, false, false, true});
+
+  // Values are parsed in place, so the last one may end the file
+  {
+    std::ofstream out (fn.c_str());
+    out << "data_particles\n\nloop_\n_rlnDefocusU #1\n_rlnClassNumber #2\n1.5e4 2\n-2.5 12";
+  }
+  REQUIRE(mapped.read(fn, "particles") == 2);
+  REQUIRE(mapped.getValue<double>(EMDL::CTF_DEFOCUSU, 1) == -2.5);
+  REQUIRE(mapped.getValue<int>(EMDL::PARTICLE_CLASS, 1) == 12);
+  std::remove(fn.c_str());
+}
+
+// Test that a binary copy next to a STAR file is only used while the STAR file is unchanged.
+TEST_CASE("Test MetaDataTable binary copy of a STAR file", "[metadata_table]") {
+  const FileName fn = "test_metadata_table_copy.star";
+  const auto table = [] (double defocus) {
+    MetaDataTable mdt;
+    mdt.name = "particles";
+    mdt.setValue(EMDL::CTF_DEFOCUSU, defocus, mdt.addObject());
+    return mdt;
+  };
+
+  table(1000.0).write(fn);
+  {
+    // A copy with a different value, to tell which file has been read
+    std::ofstream out ((fn + ".bin").c_str(), std::ios::out | std::ios::binary);
+    table(2000.0).writeBinary(out, fn);
+  }
+  MetaDataTable in;
+  REQUIRE(in.read(fn, "particles") == 1);
+  REQUIRE(in.getValue<double>(EMDL::CTF_DEFOCUSU, 0) == Approx(2000.0));
+
+  // Rewriting the STAR file, even with the same contents, changes its modification time
+  table(1000.0).write(fn);
+  REQUIRE(in.read(fn, "particles") == 1);
+  REQUIRE(in.getValue<double>(EMDL::CTF_DEFOCUSU, 0) == Approx(1000.0));
+
+  std::remove(fn.c_str());
+  std::remove((fn + ".bin").c_str());
+}
+
+// Test that strings stay right when many are overwritten (and dropped from the pool) and copied row by row.
+TEST_CASE("Test MetaDataTable string pool", "[metadata_table]") {
+  MetaDataTable mdt;
+  for (int i = 0; i < 3; i++)
+    mdt.setValue(EMDL::MICROGRAPH_NAME, "mic" + std::to_string(i) + ".mrc", mdt.addObject());
+  for (int k = 0; k < 5000; k++)
+    mdt.setValue(EMDL::IMAGE_NAME, std::to_string(k) + "@particles.mrcs", k % 3);
+  REQUIRE(mdt.getValue<std::string>(EMDL::IMAGE_NAME, 0) == "4998@particles.mrcs");
+  REQUIRE(mdt.getValue<std::string>(EMDL::IMAGE_NAME, 1) == "4999@particles.mrcs");
+  REQUIRE(mdt.getValue<std::string>(EMDL::MICROGRAPH_NAME, 2) == "mic2.mrc");
+
+  MetaDataTable rows;
+  for (int k = 0; k < 3000; k++) {
+    rows.addObject(mdt.getObject(k % 3));
+    rows.setValue(EMDL::IMAGE_NAME, std::to_string(k) + "@other.mrcs", rows.size() - 1);
+  }
+  REQUIRE(rows.size() == 3000);
+  REQUIRE(rows.getValue<std::string>(EMDL::IMAGE_NAME, 1234) == "1234@other.mrcs");
+  REQUIRE(rows.getValue<std::string>(EMDL::MICROGRAPH_NAME, 1234) == "mic1.mrc");
+
+  MetaDataTable both = mdt;
+  both.append(rows);
+  REQUIRE(both.getValue<std::string>(EMDL::IMAGE_NAME, 2) == "4997@particles.mrcs");
+  REQUIRE(both.getValue<std::string>(EMDL::IMAGE_NAME, 3 + 2999) == "2999@other.mrcs");
+  REQUIRE(both.getValue<std::string>(EMDL::MICROGRAPH_NAME, 3 + 2999) == "mic2.mrc");
+}
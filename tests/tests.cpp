@@ -2,3 +2,8 @@
 
 #include <catch2/catch.hpp>
 #include "ctf.cpp"
+#include "metadata_table.cpp"
+#include "mask.cpp"
+#include "backprojection_buffers.cpp"
+#include "backprojector.cpp"
+#include "local_symmetry.cpp"